@@ -9,15 +9,281 @@ from numpy.ctypeslib import ndpointer
 # Import the shared RK library
 lib_RK = CDLL( "../RK_C_Library/RK_Library.so" )
 
+# In-memory output buffer of the library -> mirrors RK_Buffer in RK_Library.h
+class RK_Buffer( Structure ):
+    pass
+
+RK_GROW_FUNC = CFUNCTYPE( c_int , POINTER( RK_Buffer ) , c_long )
+
+RK_Buffer._fields_ = [ ( "data" , POINTER( c_double ) ) ,
+                       ( "cap" , c_long ) ,
+                       ( "n" , c_int ) ,
+                       ( "grow" , RK_GROW_FUNC ) ,
+                       ( "user" , c_void_p ) ]
+
+# Growable numpy storage for the in-memory integrator output
+# The library writes directly into the numpy array, when it is full the grow callback swaps in a larger one (copying the rows so far)
+# Inputs:
+# - ncol: number of columns of each row ( 1 + dim_state )
+# - nrow_guess: initial guess for the number of rows
+class Numpy_Output:
+
+    def __init__( self , ncol , nrow_guess = 4096 ):
+
+        self.ncol = ncol
+        self.arr = np.empty( nrow_guess*ncol )
+        self.buf = RK_Buffer( )
+        self.grow_cb = RK_GROW_FUNC( self.grow ) # keep a reference so the callback is not garbage collected
+        self.buf.data = self.arr.ctypes.data_as( POINTER( c_double ) )
+        self.buf.cap = self.arr.size
+        self.buf.n = 0
+        self.buf.grow = self.grow_cb
+
+    # Grow callback called from the library -> must return 0 on success
+    def grow( self , buf_ptr , cap_needed ):
+
+        try:
+            arr_new = np.empty( cap_needed )
+            nused = buf_ptr.contents.n*self.ncol
+            arr_new[ : nused ] = self.arr[ : nused ]
+            self.arr = arr_new
+            buf_ptr.contents.data = self.arr.ctypes.data_as( POINTER( c_double ) )
+            buf_ptr.contents.cap = self.arr.size
+        except MemoryError:
+            return 1
+        return 0
+
+    # Return the written rows as a [ N ][ ncol ] array -> a view of the storage, no copy is made
+    def result( self ):
+
+        return self.arr[ : self.buf.n*self.ncol ].reshape( self.buf.n , self.ncol )
+
+# Events of the adaptive integrators (e.g. Poincare sections) -> mirrors RK_Event in RK_Library.h
+RK_EVENT_FUNC = CFUNCTYPE( c_double , c_int , c_double , POINTER( c_double ) , c_void_p )
+
+class RK_Event( Structure ):
+    _fields_ = [ ( "fn" , RK_EVENT_FUNC ) ,
+                 ( "data" , c_void_p ) ,
+                 ( "direction" , c_int ) ,
+                 ( "action" , c_int ) ]
+
+# Convert a list of events to the array for the library
+# Each event is a tuple ( g , direction , terminal ):
+# - g: the Nstate + 1 coefficients c of the linear event sum_i( c[ i ]*state[ i ] ) - c[ Nstate ] (fast, evaluated in C)
+#      or a Python function g( t , state ) (called from C at every step, much slower)
+# - direction: +1 only g rising through 0, -1 only falling and 0 both
+# - terminal: stop the integration at the first such event
+# Outputs:
+# - the ctypes array of RK_Event and the objects which must be kept alive during the integration
+def Make_Events( events , nstate ):
+
+    ev_arr = ( RK_Event*len( events ) )( )
+    keep = [ ]
+    for i, ( g , direction , terminal ) in enumerate( events ):
+        if callable( g ):
+            cb = RK_EVENT_FUNC( lambda n , t , state , data , g = g : g( t , np.ctypeslib.as_array( state , shape = ( n , ) ) ) )
+            keep.append( cb )
+            ev_arr[ i ].fn = cb
+        else:
+            coeff = np.array( g , dtype = np.float64 )
+            if coeff.size != nstate + 1:
+                raise ValueError( "A linear event needs dim_state + 1 coefficients" )
+            keep.append( coeff )
+            ev_arr[ i ].data = coeff.ctypes.data
+        ev_arr[ i ].direction = int( direction )
+        ev_arr[ i ].action = 1 if terminal else 0
+    return ev_arr, keep
+
+# Event for the section state[ index ] = value crossed in the given direction (e.g. theta = 0 with om_theta > 0 is Poincare_Event( 0 ))
+def Poincare_Event( index , value = 0.0 , direction = 1 , nstate = 4 , terminal = False ):
+
+    coeff = np.zeros( nstate + 1 )
+    coeff[ index ] = 1.0
+    coeff[ nstate ] = value
+    return ( coeff , direction , terminal )
+
+# Statistics of the last adaptive integration -> mirrors RK_Stats in RK_Library.h
+RK_STATS_NHIST = 64
+RK_STATS_HIST_EXP_MIN = -48
+
+class RK_Stats( Structure ):
+    _fields_ = [ ( "n_acc" , c_long ) ,
+                 ( "n_rej" , c_long ) ,
+                 ( "n_rhs" , c_long ) ,
+                 ( "n_singular" , c_long ) ,
+                 ( "loop_max" , c_int ) ,
+                 ( "dt_min" , c_double ) ,
+                 ( "dt_max" , c_double ) ,
+                 ( "dt_hist" , c_long*RK_STATS_NHIST ) ,
+                 ( "t_total" , c_double ) ,
+                 ( "t_output" , c_double ) ,
+                 ( "n_trace" , c_long ) ,
+                 ( "trace_cap" , c_int ) ,
+                 ( "trace" , c_void_p ) ]
+
+# Convert the RK_Stats structure to a dictionary
+# dt_hist[ i ] counts the accepted steps with 2^( i + RK_STATS_HIST_EXP_MIN ) <= dt < 2^( i + 1 + RK_STATS_HIST_EXP_MIN ) -> dt_bins holds the lower edges
+def Stats_Dict( stats ):
+
+    return { "n_acc" : stats.n_acc , "n_rej" : stats.n_rej , "n_rhs" : stats.n_rhs , "n_singular" : stats.n_singular ,
+             "loop_max" : bool( stats.loop_max ) , "dt_min" : stats.dt_min , "dt_max" : stats.dt_max ,
+             "dt_hist" : np.array( stats.dt_hist[ : ] ) , "dt_bins" : 2.0**np.arange( RK_STATS_HIST_EXP_MIN , RK_STATS_HIST_EXP_MIN + RK_STATS_NHIST ) ,
+             "t_total" : stats.t_total , "t_output" : stats.t_output , "n_trace" : stats.n_trace }
+
+# Checkpoint of a chunked integration -> mirrors RK_Checkpoint in RK_Library.h (also its on-disk format)
+RK_CKPT_NSTATE_MAX = 8
+
+class RK_Checkpoint( Structure ):
+    _fields_ = [ ( "magic" , c_char*8 ) ,
+                 ( "version" , c_int32 ) ,
+                 ( "Nstate" , c_int32 ) ,
+                 ( "method" , c_int32 ) ,
+                 ( "rej" , c_int32 ) ,
+                 ( "n_acc" , c_int64 ) ,
+                 ( "n_rej" , c_int64 ) ,
+                 ( "t" , c_double ) ,
+                 ( "dt" , c_double ) ,
+                 ( "err_ratiOld" , c_double ) ,
+                 ( "err_tol" , c_double ) ,
+                 ( "pend_coeff" , c_double*5 ) ,
+                 ( "e_init" , c_double ) ,
+                 ( "e_drift" , c_double ) ,
+                 ( "state" , c_double*RK_CKPT_NSTATE_MAX ) ,
+                 ( "rhs" , c_double*RK_CKPT_NSTATE_MAX ) ]
+
+# Header and reader handle of the binary trajectory files -> mirror RK_Traj_Header and RK_Traj_Reader in RK_Library.h
+RK_TRAJ_NCOL_MAX = 32
+RK_TRAJ_NAME_LEN = 64
+RK_TRAJ_HEADER_SIZE = 4096
+
+class RK_Traj_Header( Structure ):
+    _fields_ = [ ( "magic" , c_char*8 ) ,
+                 ( "version" , c_int32 ) ,
+                 ( "Ncol" , c_int32 ) ,
+                 ( "chunk_rows" , c_int32 ) ,
+                 ( "codec" , c_int32 ) ,
+                 ( "n_rows" , c_int64 ) ,
+                 ( "n_chunks" , c_int64 ) ,
+                 ( "index_offset" , c_int64 ) ,
+                 ( "err_tol" , c_double ) ,
+                 ( "pend_coeff" , c_double*5 ) ,
+                 ( "range_int" , c_double*2 ) ,
+                 ( "col_names" , ( c_char*RK_TRAJ_NAME_LEN )*RK_TRAJ_NCOL_MAX ) ,
+                 ( "dec_tol" , c_double ) ,
+                 ( "n_steps" , c_int64 ) ,
+                 ( "mant_bits" , c_int32 ) ,
+                 ( "reserved" , c_int32 ) ,
+                 ( "padding" , c_char*( RK_TRAJ_HEADER_SIZE - 136 - RK_TRAJ_NCOL_MAX*RK_TRAJ_NAME_LEN ) ) ]
+
+class RK_Traj_Reader( Structure ):
+    _fields_ = [ ( "fp" , c_void_p ) ,
+                 ( "head" , RK_Traj_Header ) ,
+                 ( "index" , POINTER( c_double ) ) ,
+                 ( "chunk" , POINTER( c_double ) ) ,
+                 ( "i_chunk" , c_long ) ,
+                 ( "offsets" , POINTER( c_int64 ) ) ,
+                 ( "zbuf" , c_void_p ) ,
+                 ( "zbuf_cap" , c_int64 ) ]
+
+# Columns of the observable rows [ Time , E_kin , E_pot , x_mid , y_mid , x_end , y_end ] -> mirrors RK_OBS_NCOL in RK_Library.h
+RK_OBS_NCOL = 7
+
+# Reductions of the observables of a run -> mirrors RK_Obs_Summary in RK_Library.h
+class RK_Obs_Summary( Structure ):
+    _fields_ = [ ( "e_init" , c_double ) ,
+                 ( "e_drift" , c_double ) ,
+                 ( "th_min" , c_double ) ,
+                 ( "th_max" , c_double ) ,
+                 ( "phi_min" , c_double ) ,
+                 ( "phi_max" , c_double ) ,
+                 ( "t_final" , c_double ) ,
+                 ( "n_flip_th" , c_int64 ) ,
+                 ( "n_flip_phi" , c_int64 ) ,
+                 ( "n_acc" , c_int64 ) ]
+
+# Header of the binary flip-time maps -> mirrors RK_Flip_Header in RK_Library.h
+class RK_Flip_Header( Structure ):
+    _fields_ = [ ( "magic" , c_char*8 ) ,
+                 ( "Nth" , c_int32 ) ,
+                 ( "Nphi" , c_int32 ) ,
+                 ( "th_range" , c_double*2 ) ,
+                 ( "phi_range" , c_double*2 ) ,
+                 ( "t_max" , c_double ) ,
+                 ( "err_tol" , c_double ) ,
+                 ( "pend_coeff" , c_double*5 ) ,
+                 ( "n_integrated" , c_int64 ) ,
+                 ( "has_prec" , c_int32 ) ,
+                 ( "reserved" , c_int32 ) ]
+
+# Precision flags of the mixed precision flip maps -> mirror RK_FLIP_PREC_* in RK_Library.h
+RK_FLIP_PREC_NONE = 0
+RK_FLIP_PREC_F32 = 1
+RK_FLIP_PREC_F64 = 2
+
 # IMPORTANT: Must be done before running any integration !!!
 # Initialize all the RK coefficients for the Dormand-Prince method !!!
 lib_RK.Set_RK_Coeff( )
 
+# Embedded Runge-Kutta pairs of the library -> mirrors RK_METHOD_* in RK_Library.h
+# DP45 is the default, DOP853 takes several times fewer RHS evaluations at tight tolerances (1e-10 and below)
+# NOTE: Only DP45 has dense output
+RK_METHODS = { "DP45" : 1 , "Tsit5" : 2 , "Verner65" : 3 , "DOP853" : 4 }
+
+# Select the embedded Runge-Kutta pair for all the integrations below (DP45_Integrator, DP45_Integrator_Array, ...)
+# Inputs:
+# - method: one of the names in RK_METHODS
+def Set_RK_Method( method ):
+
+    lib_RK.Set_RK_Method.restype = c_int
+    lib_RK.Set_RK_Method.argtypes = [ c_int ]
+    if method not in RK_METHODS or lib_RK.Set_RK_Method( RK_METHODS[ method ] ) != 0:
+        raise ValueError( "Unknown Runge-Kutta method " + str( method ) + ", use one of " + str( list( RK_METHODS ) ) )
+
+# Right-Hand-Side kernels of the batch integrator -> mirrors RK_RHS_* in RK_Library.h
+# "fast" and "repro" are vectorized (several times the RHS throughput of "libm"), "repro" gives the same bits on every CPU
+RK_RHS_MODES = { "libm" : 0 , "fast" : 1 , "repro" : 2 }
+
+# Select the Right-Hand-Side kernel of DP45_Integrate_Batch
+# Inputs:
+# - rhs_mode: one of the names in RK_RHS_MODES
+def Set_RK_RHS_Mode( rhs_mode ):
+
+    lib_RK.Set_RK_RHS_Mode.restype = c_int
+    lib_RK.Set_RK_RHS_Mode.argtypes = [ c_int ]
+    if rhs_mode not in RK_RHS_MODES or lib_RK.Set_RK_RHS_Mode( RK_RHS_MODES[ rhs_mode ] ) != 0:
+        raise ValueError( "Unknown RHS mode " + str( rhs_mode ) + ", use one of " + str( list( RK_RHS_MODES ) ) )
+
 # Prinout the Runge-Kutta constants for integration to check that they are set appropriately
 def Check_RK_Coeff( ):
 
     lib_RK.Check_RK_Coeff( )
 
+# Statistics of the last run of DP45_Integrator, DP45_Integrator_Array, ... -> returns a dictionary (see Stats_Dict)
+def Get_RK_Stats( ):
+
+    stats = RK_Stats( )
+    lib_RK.Get_RK_Stats.restype = None
+    lib_RK.Get_RK_Stats.argtypes = [ POINTER( RK_Stats ) ]
+    lib_RK.Get_RK_Stats( byref( stats ) )
+    return Stats_Dict( stats )
+
+# Keep the last cap step attempts of the runs of DP45_Integrator, ... in a trace (0 disables it)
+def Set_RK_Trace( cap ):
+
+    lib_RK.Set_RK_Trace.restype = c_int
+    lib_RK.Set_RK_Trace.argtypes = [ c_int ]
+    if lib_RK.Set_RK_Trace( cap ) < 0:
+        raise MemoryError( "Could not allocate the step trace" )
+
+# Per-step trace of the last run -> returns rows[ N ][ 4 ] as [ t , dt , err_ratio , accepted ] in chronological order
+def Get_RK_Trace( max_rows = 1 << 16 ):
+
+    rows = np.zeros( ( max_rows , 4 ) )
+    lib_RK.Get_RK_Trace.restype = c_long
+    lib_RK.Get_RK_Trace.argtypes = [ ndpointer( c_double ) , c_long ]
+    nrows = lib_RK.Get_RK_Trace( rows , max_rows )
+    return rows[ : nrows ]
+
 # Test interface to the C library from Py 
 # Enter double x value to be allocated and check that it is true 
 def Test_Clib_Interface( x_val ):
@@ -71,4 +337,1128 @@ def DP45_Integrator( err_tol , state_init , range_int , file_name , header ):
 
     lib_RK.DP45_Integrator.restype = None
     lib_RK.DP45_Integrator.argtypes = [ c_int , c_double , ndpointer( c_double ) , ndpointer( c_double ) , c_char_p , c_char_p ]
-    lib_RK.DP45_Integrator( nstate , err_tol , np.array( state_init ) , np.array( range_int ) , file_name , header )
\ No newline at end of file
+    lib_RK.DP45_Integrator( nstate , err_tol , np.array( state_init ) , np.array( range_int ) , file_name , header )
+
+# 4-5th order adaptive Dormand-Prince integrator for an ensemble of initial states (batch mode)
+# Each trajectory follows the same step control as DP45_Integrator (up to the rounding of the vectorized RHS), but nothing is written to files
+# Inputs:
+# - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+# - states_init[ Ntraj ][ dim_state ]: initial states for the integrator, one trajectory per row
+# - range_int[ 2 ]: initial and final values evolution parameter (initial and final time) - common for all trajectories
+# Outputs:
+# - state_final[ Ntraj ][ dim_state ]: the state of each trajectory at the end of the integration
+# - t_final[ Ntraj ]: the time reached by each trajectory (less than range_int[ 1 ] only if the iteration cap was hit)
+# - n_steps[ Ntraj ]: the number of accepted steps for each trajectory
+def DP45_Integrate_Batch( err_tol , states_init , range_int ):
+
+    states_init = np.ascontiguousarray( states_init , dtype = np.float64 )
+    ntraj, nstate = states_init.shape
+
+    state_final = np.zeros( ( ntraj , nstate ) )
+    t_final = np.zeros( ntraj )
+    n_steps = np.zeros( ntraj , dtype = np.int32 )
+
+    lib_RK.DP45_Integrate_Batch.restype = None
+    lib_RK.DP45_Integrate_Batch.argtypes = [ c_int , c_int , c_double , ndpointer( c_double ) , ndpointer( c_double ) , ndpointer( c_double ) , ndpointer( c_double ) , ndpointer( c_int32 ) ]
+    lib_RK.DP45_Integrate_Batch( ntraj , nstate , err_tol , states_init , np.array( range_int , dtype = np.float64 ) , state_final , t_final , n_steps )
+
+    return state_final, t_final, n_steps
+
+# Multi-threaded sweep over pendulum parameters and initial states with the 4-5th order Dormand-Prince integrator
+# The runs are spread over all the cores (work-stealing) and only a compact summary of each run is returned, nothing is written to files
+# Inputs:
+# - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+# - pend_params[ Npar ][ 5 ]: the coefficients a_th to b_phi for each parameter set -> build them with get_int_params from main.py
+# - states_init[ Nic ][ dim_state ]: initial states for the integrator
+# - range_int[ 2 ]: initial and final values evolution parameter (initial and final time) - common for all the runs
+# - grid: True to run every parameter set with every initial state (run index = ipar*Nic + iic), False for matched pairs (Npar == Nic)
+# - nthreads: number of worker threads, 0 to use all the available cores
+# Outputs:
+# - state_final[ Nrun ][ dim_state ]: the final state of each run
+# - summary[ Nrun ][ 4 ]: [ t_final , accepted steps , rejected steps , max |E - E_0| ] for each run
+def DP45_Param_Sweep( err_tol , pend_params , states_init , range_int , grid = True , nthreads = 0 ):
+
+    pend_params = np.ascontiguousarray( pend_params , dtype = np.float64 ).reshape( -1 , 5 )
+    states_init = np.ascontiguousarray( states_init , dtype = np.float64 )
+    if states_init.ndim == 1:
+        states_init = states_init.reshape( 1 , -1 )
+    npar = pend_params.shape[ 0 ]
+    nic, nstate = states_init.shape
+    nrun = npar*nic if grid else npar
+
+    state_final = np.zeros( ( nrun , nstate ) )
+    summary = np.zeros( ( nrun , 4 ) )
+
+    lib_RK.DP45_Param_Sweep.restype = c_int
+    lib_RK.DP45_Param_Sweep.argtypes = [ c_int , c_int , c_int , c_int , c_double , ndpointer( c_double ) , ndpointer( c_double ) , ndpointer( c_double ) , c_int , ndpointer( c_double ) , ndpointer( c_double ) ]
+    res = lib_RK.DP45_Param_Sweep( npar , nic , nstate , int( grid ) , err_tol , pend_params , states_init , np.array( range_int , dtype = np.float64 ) , nthreads , state_final , summary )
+    if res < 0:
+        raise ValueError( "Matched parameter sweep needs as many parameter sets as initial states" )
+
+    return state_final, summary
+
+# Flip-time map of the double Pendulum -> time until either arm flips over for a grid of release angles at rest
+# The work concentrates on the fractal boundaries: a coarse lattice is refined only where its cells are not uniform
+# Inputs:
+# - err_tol: error tolerance per step
+# - th_range[ 2 ], phi_range[ 2 ]: the angles of the first and the last column (theta) and row (phi)
+# - nth, nphi: number of columns and rows of the map
+# - t_max: the integration stops here for the arms which do not flip
+# - refine_step: spacing of the coarsest lattice in pixels (a power of 2), 1 integrates every pixel
+# - refine_tol: largest spread of log( t_flip ) in a cell which is still interpolated
+# - file_name: also write the map as a binary file (see Read_Flip_Map) or as an image if it ends with .ppm
+# - tile: size of the square image tiles handed to the threads, nthreads: number of threads (0 for all the cores)
+# Outputs:
+# - flip_time[ nphi ][ nth ]: time of the first flip of each pixel (inf if it does not flip before t_max, nan if the step limit was hit)
+# - number of integrated trajectories
+def DP45_Flip_Map( err_tol , th_range , phi_range , nth , nphi , t_max , refine_step = 8 , refine_tol = 0.05 , file_name = None , tile = 64 , nthreads = 0 ):
+
+    flip_time = np.zeros( ( nphi , nth ) , dtype = np.float32 )
+
+    lib_RK.DP45_Flip_Map.restype = c_long
+    lib_RK.DP45_Flip_Map.argtypes = [ c_double , ndpointer( c_double ) , ndpointer( c_double ) , c_int , c_int , c_double , c_int , c_double , c_int , c_int , ndpointer( c_float ) , c_char_p ]
+    nint = lib_RK.DP45_Flip_Map( err_tol , np.array( th_range , dtype = np.float64 ) , np.array( phi_range , dtype = np.float64 ) , nth , nphi , t_max ,
+                                 refine_step , refine_tol , tile , nthreads , flip_time , file_name )
+    if nint < 0:
+        raise ValueError( "Could not compute the flip map" )
+
+    return flip_time, nint
+
+# Mixed precision flip-time map -> single precision screening, the ambiguous pixels are verified in double precision
+# Inputs:
+# - err_tol: error tolerance per step of the double precision verification
+# - th_range, phi_range, nth, nphi, t_max, refine_step, refine_tol, file_name, tile, nthreads: see DP45_Flip_Map
+# - screen_tol: error tolerance per step of the single precision screening
+# - screen_margin: relative margin to t_max and to pi in which a screened result is verified
+# Outputs:
+# - flip_time[ nphi ][ nth ]: see DP45_Flip_Map
+# - prec[ nphi ][ nth ]: which precision produced each pixel (RK_FLIP_PREC_F32, RK_FLIP_PREC_F64 or RK_FLIP_PREC_NONE) -> np.count_nonzero( prec == RK_FLIP_PREC_F64 ) pixels were verified in double precision
+# - nint: number of integrated trajectories
+def DP45_Flip_Map_Mixed( err_tol , th_range , phi_range , nth , nphi , t_max , refine_step = 8 , refine_tol = 0.05 , screen_tol = 1e-5 , screen_margin = 0.05 ,
+                         file_name = None , tile = 64 , nthreads = 0 ):
+
+    flip_time = np.zeros( ( nphi , nth ) , dtype = np.float32 )
+    prec = np.zeros( ( nphi , nth ) , dtype = np.uint8 )
+
+    lib_RK.DP45_Flip_Map_Mixed.restype = c_long
+    lib_RK.DP45_Flip_Map_Mixed.argtypes = [ c_double , ndpointer( c_double ) , ndpointer( c_double ) , c_int , c_int , c_double , c_int , c_double , c_int , c_int ,
+                                            c_double , c_double , ndpointer( c_float ) , ndpointer( c_uint8 ) , c_char_p ]
+    nint = lib_RK.DP45_Flip_Map_Mixed( err_tol , np.array( th_range , dtype = np.float64 ) , np.array( phi_range , dtype = np.float64 ) , nth , nphi , t_max ,
+                                       refine_step , refine_tol , tile , nthreads , screen_tol , screen_margin , flip_time , prec , file_name )
+    if nint < 0:
+        raise ValueError( "Could not compute the mixed precision flip map" )
+
+    return flip_time, prec, nint
+
+# Read a binary flip-time map written by DP45_Flip_Map or DP45_Flip_Map_Mixed
+# Outputs:
+# - head: the RK_Flip_Header of the file
+# - flip_time[ Nphi ][ Nth ]: the map
+# - prec[ Nphi ][ Nth ]: the precision flags or None if the file has none
+def Read_Flip_Map( file_name ):
+
+    prec = None
+    with open( file_name , "rb" ) as f:
+        head = RK_Flip_Header.from_buffer_copy( f.read( sizeof( RK_Flip_Header ) ) )
+        if head.magic != b"DCFLIP01":
+            raise IOError( "Not a binary flip map: " + str( file_name ) )
+        flip_time = np.fromfile( f , dtype = np.float32 , count = head.Nth*head.Nphi ).reshape( head.Nphi , head.Nth )
+        if head.has_prec:
+            prec = np.fromfile( f , dtype = np.uint8 , count = head.Nth*head.Nphi ).reshape( head.Nphi , head.Nth )
+
+    return head, flip_time, prec
+
+# 4th order Runge-Kutta integrator for testing purposes with in-memory output (no .csv file is written or parsed)
+# Inputs:
+# - npoints: number of integration points (NOT INTERVALS)
+# - state_init[ dim_state ]: initial state for the integrator
+# - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+# Outputs:
+# - time[ N ]: the times of the points
+# - states[ N ][ dim_state ]: the states at those times
+# -- Both are views into the array filled by the library, use states[ : , j ] for the separate quantities
+def RK4_Integrator_Array( npoints , state_init , range_int ):
+
+    nstate = len( state_init )
+    out = Numpy_Output( nstate + 1 , npoints )
+
+    lib_RK.RK4_Integrator_Buffer.restype = c_int
+    lib_RK.RK4_Integrator_Buffer.argtypes = [ c_int , c_int , ndpointer( c_double ) , ndpointer( c_double ) , POINTER( RK_Buffer ) ]
+    res = lib_RK.RK4_Integrator_Buffer( nstate , npoints , np.array( state_init , dtype = np.float64 ) , np.array( range_int , dtype = np.float64 ) , byref( out.buf ) )
+    if res < 0:
+        raise MemoryError( "Could not grow the output buffer for the RK4 integration" )
+
+    res_arr = out.result( )
+    return res_arr[ : , 0 ], res_arr[ : , 1 : ]
+
+# 4-5th order adaptive Dormand-Prince integrator with in-memory output (no .csv file is written or parsed)
+# Inputs:
+# - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+# - state_init[ dim_state ]: initial state for the integrator
+# - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+# Outputs:
+# - time[ N ]: the times of the accepted steps
+# - states[ N ][ dim_state ]: the states at those times
+# -- Both are views into the array filled by the library, use states[ : , j ] for the separate quantities
+def DP45_Integrator_Array( err_tol , state_init , range_int ):
+
+    nstate = len( state_init )
+    out = Numpy_Output( nstate + 1 )
+
+    lib_RK.DP45_Integrator_Buffer.restype = c_int
+    lib_RK.DP45_Integrator_Buffer.argtypes = [ c_int , c_double , ndpointer( c_double ) , ndpointer( c_double ) , POINTER( RK_Buffer ) ]
+    res = lib_RK.DP45_Integrator_Buffer( nstate , err_tol , np.array( state_init , dtype = np.float64 ) , np.array( range_int , dtype = np.float64 ) , byref( out.buf ) )
+    if res < 0:
+        raise MemoryError( "Could not grow the output buffer for the DP45 integration" )
+
+    res_arr = out.result( )
+    return res_arr[ : , 0 ], res_arr[ : , 1 : ]
+
+# 4-5th order adaptive Dormand-Prince integrator which returns only the events (e.g. Poincare section points)
+# The crossings are located in C on the interpolant of each step, so no trajectory is stored or written
+# Inputs:
+# - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+# - state_init[ dim_state ]: initial state for the integrator
+# - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+# - events: list of ( g , direction , terminal ) as in Make_Events (see also Poincare_Event)
+# Outputs:
+# - time[ N ], states[ N ][ dim_state ]: the times and states of the events in the order of the crossings
+# - index[ N ]: which event occurred
+def DP45_Integrator_Events( err_tol , state_init , range_int , events ):
+
+    nstate = len( state_init )
+    out = Numpy_Output( nstate + 2 )
+    ev_arr, keep = Make_Events( events , nstate )
+
+    lib_RK.DP45_Integrator_Events.restype = c_int
+    lib_RK.DP45_Integrator_Events.argtypes = [ c_int , c_double , ndpointer( c_double ) , ndpointer( c_double ) , c_int , POINTER( RK_Event ) , POINTER( RK_Buffer ) ]
+    res = lib_RK.DP45_Integrator_Events( nstate , err_tol , np.array( state_init , dtype = np.float64 ) , np.array( range_int , dtype = np.float64 ) , len( events ) , ev_arr , byref( out.buf ) )
+    if res < 0:
+        raise ValueError( "Event integration failed -> check the events and the output buffer" )
+
+    res_arr = out.result( )
+    return res_arr[ : , 0 ], res_arr[ : , 1 : - 1 ], res_arr[ : , - 1 ].astype( int )
+
+# 4-5th order adaptive Dormand-Prince integrator of the double pendulum which computes the observables inside the integration
+# Energies and bob positions are evaluated in C at every written state and the reductions at every accepted step, so no state history is kept
+# Inputs:
+# - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+# - state_init[ 4 ]: initial state [ theta , phi , om_theta , om_phi ]
+# - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+# - lengths[ 2 ]: the rod lengths l1 and l2 of the positions
+# - t_out[ Nout ]: output times of the rows (dense output) -> None for a row at every accepted step
+# - rows: False to compute only the reductions
+# - states: also return the states at the times of the rows (the trajectory and its observables from one integration)
+# Outputs:
+# - time[ N ]: the times of the rows
+# - states[ N ][ 4 ]: [ theta , phi , om_theta , om_phi ] at those times (only with states = True)
+# - obs[ N ][ 6 ]: [ E_kin , E_pot , x_mid , y_mid , x_end , y_end ] at those times (use obs[ : , j ] for the separate quantities)
+# - red: the RK_Obs_Summary of the run -> e_drift, th_min/th_max, phi_min/phi_max, n_flip_th/n_flip_phi, ...
+def DP45_Integrator_Observables( err_tol , state_init , range_int , lengths = ( 1.0 , 1.0 ) , t_out = None , rows = True , states = False ):
+
+    nrow_guess = 4096 if t_out is None else max( len( t_out ) , 1 )
+    out = Numpy_Output( RK_OBS_NCOL , nrow_guess )
+    out_st = Numpy_Output( 5 , nrow_guess ) if states else None
+    red = RK_Obs_Summary( )
+    t_arr = np.ascontiguousarray( t_out if t_out is not None else [ 0.0 ] , dtype = np.float64 )
+
+    lib_RK.DP45_Integrator_Observables.restype = c_int
+    lib_RK.DP45_Integrator_Observables.argtypes = [ c_double , ndpointer( c_double ) , ndpointer( c_double ) , c_int , ndpointer( c_double ) , ndpointer( c_double ) ,
+                                                    POINTER( RK_Buffer ) , POINTER( RK_Buffer ) , POINTER( RK_Obs_Summary ) ]
+    res = lib_RK.DP45_Integrator_Observables( err_tol , np.array( state_init , dtype = np.float64 ) , np.array( range_int , dtype = np.float64 ) ,
+                                              0 if t_out is None else len( t_arr ) , t_arr , np.array( lengths , dtype = np.float64 ) ,
+                                              byref( out.buf ) if rows else None , byref( out_st.buf ) if states else None , byref( red ) )
+    if res < 0:
+        raise RuntimeError( "Observable integration failed -> out of memory or the selected method has no dense output (use DP45)" )
+
+    res_arr = out.result( )
+    if not states:
+        return res_arr[ : , 0 ], res_arr[ : , 1 : ], red
+
+    return res_arr[ : , 0 ], out_st.result( )[ : , 1 : ], res_arr[ : , 1 : ], red
+
+# Parareal parallel-in-time DP45 integration of a single long trajectory -> the interval is cut into nslice slices integrated at once
+# by the fine propagator (the global method at err_tol) and corrected by a cheap sequential coarse propagator until the slice starts converge
+# K iterations take about K fine slices of wall time instead of nslice -> for the chaotic pendulum K grows with the horizon
+# Inputs:
+# - err_tol: error tolerance per step of the fine propagator
+# - state_init[ dim_state ]: initial state for the integrator
+# - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+# - nslice: number of time slices (at least the number of threads)
+# - coarse_steps: fixed RK4 steps per slice of the coarse propagator (0 to use the adaptive method at coarse_tol)
+# - coarse_tol: error tolerance per step of the adaptive coarse propagator
+# - kmax: maximum number of iterations
+# - conv_tol: stop once no slice start moves by more than this
+# - t_out: output times for the dense output (None for a row at every accepted fine step)
+# - nthreads: number of worker threads, 0 to use all the available cores
+# - integrator: RK_Integrator whose method, tolerance and coefficients are used for the fine propagator (None for the global ones)
+# Outputs:
+# - time[ N ], states[ N ][ dim_state ]: the trajectory
+# - diag[ K ][ 4 ]: per iteration [ largest update of a slice start , slices integrated by the fine propagator , fine wall time [s] , coarse wall time [s] ]
+def DP45_Parareal( err_tol , state_init , range_int , nslice = 16 , coarse_steps = 0 , coarse_tol = 1e-4 , kmax = 8 , conv_tol = 1e-8 ,
+                   t_out = None , nthreads = 0 , integrator = None ):
+
+    state_init = np.array( state_init , dtype = np.float64 )
+    t_out = None if t_out is None else np.ascontiguousarray( t_out , dtype = np.float64 ).ravel( )
+    out = Numpy_Output( len( state_init ) + 1 , 4096 if t_out is None else max( len( t_out ) , 1 ) )
+    diag = np.zeros( ( max( kmax , 1 ) , 4 ) )
+    args = [ state_init , np.array( range_int , dtype = np.float64 ) , nslice , coarse_steps , coarse_tol , kmax , conv_tol , nthreads ,
+             0 if t_out is None else len( t_out ) , None if t_out is None else t_out.ctypes.data , byref( out.buf ) , None , diag ]
+    types = [ ndpointer( c_double ) , ndpointer( c_double ) , c_int , c_int , c_double , c_int , c_double , c_int , c_int , c_void_p , POINTER( RK_Buffer ) ,
+              c_void_p , ndpointer( c_double ) ]
+    if integrator is None:
+        lib_RK.DP45_Parareal.restype = c_int
+        lib_RK.DP45_Parareal.argtypes = [ c_int , c_double ] + types
+        niter = lib_RK.DP45_Parareal( len( state_init ) , err_tol , *args )
+    else:
+        lib_RK.RK_Context_Parareal.restype = c_int
+        lib_RK.RK_Context_Parareal.argtypes = [ c_void_p ] + types
+        niter = lib_RK.RK_Context_Parareal( integrator.ctx , *args )
+    if niter < 0:
+        raise ValueError( "Parareal failed -> check the state (4 quantities), nslice, kmax, the coarse propagator and the method (dense output needs DP45)" )
+
+    res_arr = out.result( )
+    return res_arr[ : , 0 ], res_arr[ : , 1 : ], diag[ : niter ]
+
+# Symplectic Gauss-Legendre integrator of the double pendulum with a fixed step (structure preserving, for long horizons)
+# The energy error stays bounded instead of drifting, so large steps can be taken when only the statistics / phase space matter
+# Inputs:
+# - dt: fixed time step (shortened slightly so that an integer number of steps covers range_int)
+# - state_init[ 4 ]: initial state [ theta , phi , om_theta , om_phi ]
+# - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+# - nstage: number of Gauss-Legendre stages (1, 2 or 3 -> order 2, 4 and 6)
+# - nskip: keep every nskip-th step (the first and the last state are always kept)
+# Outputs:
+# - time[ N ]: the times of the kept steps
+# - states[ N ][ 4 ]: the states at those times
+# - summary[ 4 ]: [ t_final , steps , fixed-point iterations , max |E - E_0| at the kept steps ]
+def GL_Integrator_Array( dt , state_init , range_int , nstage = 2 , nskip = 1 ):
+
+    out = Numpy_Output( 5 , int( ( range_int[ 1 ] - range_int[ 0 ] )/( dt*nskip ) ) + 2 )
+    summary = np.zeros( 4 )
+
+    lib_RK.GL_Integrator_Buffer.restype = c_int
+    lib_RK.GL_Integrator_Buffer.argtypes = [ c_int , c_double , c_int , ndpointer( c_double ) , ndpointer( c_double ) , POINTER( RK_Buffer ) , ndpointer( c_double ) ]
+    res = lib_RK.GL_Integrator_Buffer( nstage , dt , nskip , np.array( state_init , dtype = np.float64 ) , np.array( range_int , dtype = np.float64 ) , byref( out.buf ) , summary )
+    if res < 0:
+        raise ValueError( "Gauss-Legendre integration failed -> check nstage, dt and range_int" )
+
+    res_arr = out.result( )
+    return res_arr[ : , 0 ], res_arr[ : , 1 : ], summary
+
+# Lyapunov spectrum of the double pendulum from the variational equations (global coefficients and method)
+# The tangent vectors are integrated in C with the state and re-orthonormalized every t_orth -> only the exponents come back
+# Inputs:
+# - err_tol: error tolerance per step (over the state and the tangent vectors)
+# - state_init[ 4 ]: initial state for the integrator
+# - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+# - t_orth: time between the re-orthonormalizations
+# - history: also return the running estimates after every re-orthonormalization
+# Outputs:
+# - lyap[ 4 ]: the Lyapunov exponents
+# - time[ N ], lyap_hist[ N ][ 4 ]: the convergence history (only with history = True)
+def Lyapunov_Spectrum( err_tol , state_init , range_int , t_orth = 1.0 , history = False ):
+
+    lyap = np.zeros( 4 )
+    out = Numpy_Output( 5 , int( ( range_int[ 1 ] - range_int[ 0 ] )/t_orth ) + 2 ) if history else None
+
+    lib_RK.Lyapunov_Spectrum.restype = c_int
+    lib_RK.Lyapunov_Spectrum.argtypes = [ c_double , ndpointer( c_double ) , ndpointer( c_double ) , c_double , ndpointer( c_double ) , POINTER( RK_Buffer ) ]
+    res = lib_RK.Lyapunov_Spectrum( err_tol , np.array( state_init , dtype = np.float64 ) , np.array( range_int , dtype = np.float64 ) , t_orth , lyap , byref( out.buf ) if history else None )
+    if res < 0:
+        raise ValueError( "Lyapunov spectrum failed -> check t_orth and range_int" )
+
+    if not history:
+        return lyap
+    res_arr = out.result( )
+    return lyap, res_arr[ : , 0 ], res_arr[ : , 1 : ]
+
+# 4-5th order adaptive Dormand-Prince integrator with dense output at the requested times
+# The integrator steps as the tolerance allows and the states at t_out come from its own 4th order interpolant (no splines needed)
+# Inputs:
+# - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+# - state_init[ dim_state ]: initial state for the integrator
+# - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+# - t_out[ Nout ]: output times in increasing order (uniform like np.linspace or arbitrary), the ones outside range_int are skipped
+# Outputs:
+# - states[ N ][ dim_state ]: the states at the first N output times inside range_int
+def DP45_Integrator_Dense( err_tol , state_init , range_int , t_out ):
+
+    nstate = len( state_init )
+    t_out = np.ascontiguousarray( t_out , dtype = np.float64 )
+    state_out = np.zeros( ( len( t_out ) , nstate ) )
+
+    lib_RK.DP45_Integrator_Dense.restype = c_int
+    lib_RK.DP45_Integrator_Dense.argtypes = [ c_int , c_double , ndpointer( c_double ) , ndpointer( c_double ) , c_int , ndpointer( c_double ) , ndpointer( c_double ) ]
+    nout = lib_RK.DP45_Integrator_Dense( nstate , err_tol , np.array( state_init , dtype = np.float64 ) , np.array( range_int , dtype = np.float64 ) , len( t_out ) , t_out , state_out )
+    if nout < 0:
+        raise RuntimeError( "Dense output failed -> out of memory or the selected method has no dense output (use DP45)" )
+
+    return state_out[ : nout ]
+
+# 4-5th order adaptive Dormand-Prince integrator with output to a binary trajectory file
+# Read the file back with Traj_File or parse_results_bin from Visualizations.py
+# Inputs:
+# - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+# - state_init[ dim_state ]: initial state for the integrator
+# - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+# - file_name: a char of the output filename where the results will be written, like b"file.traj"
+# - col_names: comma separated names of the columns (same text as the .csv header)
+# Outputs:
+# - number of rows written to the file
+def DP45_Integrator_Bin( err_tol , state_init , range_int , file_name , col_names ):
+
+    nstate = len( state_init )
+
+    lib_RK.DP45_Integrator_Bin.restype = c_long
+    lib_RK.DP45_Integrator_Bin.argtypes = [ c_int , c_double , ndpointer( c_double ) , ndpointer( c_double ) , c_char_p , c_char_p ]
+    nrows = lib_RK.DP45_Integrator_Bin( nstate , err_tol , np.array( state_init , dtype = np.float64 ) , np.array( range_int , dtype = np.float64 ) , file_name , col_names )
+    if nrows < 0:
+        raise IOError( "Could not write the binary trajectory file " + str( file_name ) )
+
+    return nrows
+
+# 4-5th order adaptive Dormand-Prince integrator with output to a compressed binary trajectory file
+# Read the file back with Traj_Stream / Read_Traj below or with Traj_File from Visualizations.py (like the raw binary files)
+# Inputs:
+# - err_tol, state_init[ dim_state ], range_int[ 2 ], file_name, col_names: as in DP45_Integrator_Bin
+# - dec_tol: drop the accepted steps which the cubic Hermite interpolant of the kept rows reproduces within dec_tol (0 keeps them all)
+#   -> Traj_Interp gives the states in between from that interpolant
+# - mant_bits: bits of mantissa kept in the state values (52 is lossless, 36 is about the precision of the .csv)
+# Outputs:
+# - number of rows written to the file
+def DP45_Integrator_Packed( err_tol , state_init , range_int , file_name , col_names , dec_tol = 0.0 , mant_bits = 52 ):
+
+    nstate = len( state_init )
+
+    lib_RK.DP45_Integrator_Packed.restype = c_long
+    lib_RK.DP45_Integrator_Packed.argtypes = [ c_int , c_double , ndpointer( c_double ) , ndpointer( c_double ) , c_char_p , c_char_p , c_double , c_int ]
+    nrows = lib_RK.DP45_Integrator_Packed( nstate , err_tol , np.array( state_init , dtype = np.float64 ) , np.array( range_int , dtype = np.float64 ) , file_name , col_names ,
+                                           dec_tol , mant_bits )
+    if nrows < 0:
+        raise IOError( "Could not write the compressed trajectory file " + str( file_name ) )
+
+    return nrows
+
+# Open a (raw or compressed) binary trajectory file in the library -> the reader must be freed with lib_RK.RK_Traj_Close
+def Traj_Open( file_name ):
+
+    lib_RK.RK_Traj_Open.restype = POINTER( RK_Traj_Reader )
+    lib_RK.RK_Traj_Open.argtypes = [ c_char_p ]
+    lib_RK.RK_Traj_Close.restype = None
+    lib_RK.RK_Traj_Close.argtypes = [ POINTER( RK_Traj_Reader ) ]
+    tr = lib_RK.RK_Traj_Open( file_name if isinstance( file_name , bytes ) else file_name.encode( ) )
+    if not tr:
+        raise IOError( "Not a binary trajectory file: " + str( file_name ) )
+
+    return tr
+
+# Streaming decoder of a (raw or compressed) binary trajectory file -> yields the rows of one chunk at a time
+# Only one chunk is kept in memory, so files larger than the memory can be reduced on the fly
+# Inputs:
+# - file_name: name of the binary trajectory file (str or bytes)
+# Outputs:
+# - yields arrays of rows [ n ][ Ncol ] = [ time , state ... ] in the order of the file
+def Traj_Stream( file_name ):
+
+    tr = Traj_Open( file_name )
+    head = tr.contents.head
+
+    lib_RK.RK_Traj_Read_Chunk.restype = c_long
+    lib_RK.RK_Traj_Read_Chunk.argtypes = [ POINTER( RK_Traj_Reader ) , c_long , ndpointer( c_double ) ]
+    rows = np.zeros( ( head.chunk_rows , head.Ncol ) )
+    try:
+        for i_chunk in range( head.n_chunks ):
+            n = lib_RK.RK_Traj_Read_Chunk( tr , i_chunk , rows )
+            if n < 0:
+                raise IOError( "Could not decode chunk " + str( i_chunk ) + " of " + str( file_name ) )
+            yield rows[ : n ].copy( )
+    finally:
+        lib_RK.RK_Traj_Close( tr )
+
+# Read a whole (raw or compressed) binary trajectory file
+# Outputs:
+# - time[ N ], states[ N ][ dim_state ] as DP45_Integrator_Array
+def Read_Traj( file_name ):
+
+    res_arr = np.concatenate( list( Traj_Stream( file_name ) ) )
+    return res_arr[ : , 0 ], res_arr[ : , 1 : ]
+
+# States at arbitrary times from the cubic Hermite interpolant between the stored rows of a double Pendulum trajectory file
+# For a decimated file (DP45_Integrator_Packed with dec_tol > 0) the dropped steps are within dec_tol of it
+# Inputs:
+# - file_name: name of the binary trajectory file
+# - t_out[ N ]: times inside the stored rows
+# Outputs:
+# - states[ N ][ dim_state ] at t_out
+def Traj_Interp( file_name , t_out ):
+
+    tr = Traj_Open( file_name )
+    ncol = tr.contents.head.Ncol
+    row = np.zeros( ncol )
+    states = np.zeros( ( len( t_out ) , ncol - 1 ) )
+
+    lib_RK.RK_Traj_Interp.restype = c_int
+    lib_RK.RK_Traj_Interp.argtypes = [ POINTER( RK_Traj_Reader ) , c_double , ndpointer( c_double ) ]
+    try:
+        for i , t in enumerate( t_out ):
+            if lib_RK.RK_Traj_Interp( tr , t , row ) != 0:
+                raise ValueError( "No interpolant at t = " + str( t ) + " -> outside the file or not a double Pendulum trajectory" )
+            states[ i ] = row[ 1 : ]
+    finally:
+        lib_RK.RK_Traj_Close( tr )
+
+    return states
+
+# Start a chunked (resumable) integration -> returns the checkpoint to pass to DP45_Integrator_Advance
+def Make_Checkpoint( state_init , t_init = 0.0 ):
+
+    cp = RK_Checkpoint( )
+    lib_RK.RK_Checkpoint_Init.restype = c_int
+    lib_RK.RK_Checkpoint_Init.argtypes = [ POINTER( RK_Checkpoint ) , c_int , c_double , ndpointer( c_double ) ]
+    if lib_RK.RK_Checkpoint_Init( byref( cp ) , len( state_init ) , t_init , np.array( state_init , dtype = np.float64 ) ) != 0:
+        raise ValueError( "Checkpoints support up to " + str( RK_CKPT_NSTATE_MAX ) + " quantities in the state" )
+    return cp
+
+# Write a checkpoint to a file and read it back (e.g. to continue a long run in another session)
+def Save_Checkpoint( cp , file_name ):
+
+    lib_RK.RK_Checkpoint_Save.restype = c_int
+    lib_RK.RK_Checkpoint_Save.argtypes = [ POINTER( RK_Checkpoint ) , c_char_p ]
+    if lib_RK.RK_Checkpoint_Save( byref( cp ) , file_name ) != 0:
+        raise IOError( "Could not write the checkpoint file " + str( file_name ) )
+
+def Load_Checkpoint( file_name ):
+
+    cp = RK_Checkpoint( )
+    lib_RK.RK_Checkpoint_Load.restype = c_int
+    lib_RK.RK_Checkpoint_Load.argtypes = [ POINTER( RK_Checkpoint ) , c_char_p ]
+    if lib_RK.RK_Checkpoint_Load( byref( cp ) , file_name ) != 0:
+        raise IOError( "Could not read the checkpoint file " + str( file_name ) )
+    return cp
+
+# Advance a checkpointed integration to t_target -> a long run in bounded-memory chunks, cp is updated in place
+# Returns time[ N ], states[ N ][ dim_state ] of the accepted steps of this chunk and done (False if it stopped at the iteration cap -> call again)
+def DP45_Integrator_Advance( err_tol , cp , t_target ):
+
+    out = Numpy_Output( cp.Nstate + 1 )
+
+    lib_RK.DP45_Integrator_Advance.restype = c_int
+    lib_RK.DP45_Integrator_Advance.argtypes = [ c_double , POINTER( RK_Checkpoint ) , c_double , POINTER( RK_Buffer ) ]
+    res = lib_RK.DP45_Integrator_Advance( err_tol , byref( cp ) , t_target , byref( out.buf ) )
+    if res < 0:
+        raise ValueError( "Could not advance the checkpoint from t = " + str( cp.t ) + " to " + str( t_target ) )
+
+    res_arr = out.result( )
+    return res_arr[ : , 0 ], res_arr[ : , 1 : ], res == 0
+
+# Modes of the real-time streams -> mirror RK_STREAM_* in RK_Library.h
+RK_STREAM_BLOCK = 0
+RK_STREAM_DROP = 1
+
+# Real-time stream of the DP45 integrator for live visualization -> the integration runs on its own thread in the library and publishes
+# frames every dt_frame of simulation time into a bounded ring, poll( ) takes the ones published so far without waiting (e.g. from FuncAnimation)
+# A frame is [ t , state[ 0 ] , ... , state[ dim_state - 1 ] ] followed for the double pendulum by [ E_kin , E_pot , x_mid , y_mid , x_end , y_end ]
+# Inputs:
+# - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+# - state_init[ dim_state ]: initial state for the integrator
+# - range_int[ 2 ]: time of the first frame and end of the integration (np.inf for a run which only ends at close( ))
+# - dt_frame: time between two frames
+# - nframe: frames in the ring -> the memory stays bounded however long the run is
+# - drop: False to make the integration wait for the consumer when the ring is full, True to drop the frames which do not fit
+# - speed: simulation time per second of wall time (1.0 for real time, 0 for as fast as possible)
+# - lengths[ 2 ]: the rod lengths l1 and l2 of the positions
+# - integrator: RK_Integrator whose tolerance, method and coefficients are used (None for the global ones, err_tol is then used)
+class DP45_Stream:
+
+    def __init__( self , err_tol , state_init , range_int , dt_frame , nframe = 4096 , drop = False , speed = 0.0 , lengths = ( 1.0 , 1.0 ) , integrator = None ):
+
+        lib_RK.RK_Stream_Poll.restype = c_int
+        lib_RK.RK_Stream_Poll.argtypes = [ c_void_p , c_int , ndpointer( c_double ) ]
+        lib_RK.RK_Stream_Info.restype = None
+        lib_RK.RK_Stream_Info.argtypes = [ c_void_p , ndpointer( c_double ) ]
+        lib_RK.RK_Stream_Close.restype = None
+        lib_RK.RK_Stream_Close.argtypes = [ c_void_p ]
+
+        mode = RK_STREAM_DROP if drop else RK_STREAM_BLOCK
+        state_init = np.array( state_init , dtype = np.float64 )
+        range_int = np.array( range_int , dtype = np.float64 )
+        lengths = np.array( lengths , dtype = np.float64 )
+        if integrator is None:
+            lib_RK.DP45_Stream_Open.restype = c_void_p
+            lib_RK.DP45_Stream_Open.argtypes = [ c_int , c_double , ndpointer( c_double ) , ndpointer( c_double ) , c_double , c_int , c_int , c_double , ndpointer( c_double ) ]
+            self.st = lib_RK.DP45_Stream_Open( len( state_init ) , err_tol , state_init , range_int , dt_frame , nframe , mode , speed , lengths )
+        else:
+            lib_RK.RK_Context_Stream_Open.restype = c_void_p
+            lib_RK.RK_Context_Stream_Open.argtypes = [ c_void_p , ndpointer( c_double ) , ndpointer( c_double ) , c_double , c_int , c_int , c_double , ndpointer( c_double ) ]
+            self.st = lib_RK.RK_Context_Stream_Open( integrator.ctx , state_init , range_int , dt_frame , nframe , mode , speed , lengths )
+        if not self.st:
+            raise ValueError( "Could not start the stream -> check dt_frame, nframe, range_int and the method (needs dense output)" )
+
+        self.nframe = nframe
+        self.ncol = int( self.info( )[ 5 ] )
+        self.frames = np.zeros( ( nframe , self.ncol ) )
+
+    # Take the frames published so far (at most max_frames) -> frames[ N ][ ncol ] (a copy, N may be 0) or None once the stream has ended
+    def poll( self , max_frames = None ):
+
+        n = lib_RK.RK_Stream_Poll( self.st , self.nframe if max_frames is None else min( max_frames , self.nframe ) , self.frames )
+        if n < 0:
+            return None
+        return self.frames[ : n ].copy( )
+
+    # Progress -> [ time reached , frames published , frames dropped , frames waiting , 1 ended / -1 failed / 0 running , ncol ]
+    def info( self ):
+
+        info = np.zeros( 6 )
+        lib_RK.RK_Stream_Info( self.st , info )
+        return info
+
+    # Stop the integration (if it still runs) and free the stream
+    def close( self ):
+
+        if getattr( self , "st" , None ):
+            lib_RK.RK_Stream_Close( self.st )
+            self.st = None
+
+    def __del__( self ):
+
+        self.close( )
+
+    def __enter__( self ):
+
+        return self
+
+    def __exit__( self , *args ):
+
+        self.close( )
+
+# N-link planar pendulum -> a chain of rigid links with the centre of mass in the middle, each hanging from the end of the previous one
+# The state is [ theta_0 , ... , theta_{N-1} , om_0 , ... , om_{N-1} ] with the absolute angles from the downward vertical (the double pendulum for N = 2)
+# The RHS is O( N ) (articulated-body algorithm), so long chains stay cheap. Do not share one object between threads (it owns the RHS workspace).
+# Inputs:
+# - length[ N ], mass[ N ]: the link lengths and masses
+# - inertia[ N ]: the moments of inertia about the centres of mass (None for uniform rods)
+# - g_acc: gravitational acceleration
+class Chain_Pendulum:
+
+    def __init__( self , length , mass , inertia = None , g_acc = 9.81 ):
+
+        lib_RK.RK_Chain_Create.restype = c_void_p
+        lib_RK.RK_Chain_Create.argtypes = [ c_int , ndpointer( c_double ) , ndpointer( c_double ) , c_void_p , c_double ]
+        lib_RK.RK_Chain_Free.restype = None
+        lib_RK.RK_Chain_Free.argtypes = [ c_void_p ]
+
+        length = np.ascontiguousarray( length , dtype = np.float64 ).ravel( )
+        mass = np.ascontiguousarray( mass , dtype = np.float64 ).ravel( )
+        inertia = None if inertia is None else np.ascontiguousarray( inertia , dtype = np.float64 ).ravel( )
+        if len( mass ) != len( length ) or ( inertia is not None and len( inertia ) != len( length ) ):
+            raise ValueError( "length, mass and inertia need one value per link" )
+        self.nlink = len( length )
+        self.length = length
+        self.chain = lib_RK.RK_Chain_Create( self.nlink , length , mass , None if inertia is None else inertia.ctypes.data , g_acc )
+        if not self.chain:
+            raise ValueError( "Could not create the chain -> check the number of links and that the lengths and masses are positive" )
+
+    def __del__( self ):
+
+        if getattr( self , "chain" , None ):
+            lib_RK.RK_Chain_Free( self.chain )
+            self.chain = None
+
+    # Derivative of the state
+    def rhs( self , state ):
+
+        deriv = np.zeros( 2*self.nlink )
+        lib_RK.RK_Chain_RHS.restype = None
+        lib_RK.RK_Chain_RHS.argtypes = [ c_void_p , ndpointer( c_double ) , ndpointer( c_double ) ]
+        lib_RK.RK_Chain_RHS( self.chain , np.array( state , dtype = np.float64 ) , deriv )
+        return deriv
+
+    # Total energy (zero potential at the height of the pivot) -> for states[ Nt ][ 2*N ] returns energy[ Nt ]
+    def energy( self , states ):
+
+        lib_RK.RK_Chain_Energy.restype = c_double
+        lib_RK.RK_Chain_Energy.argtypes = [ c_void_p , ndpointer( c_double ) ]
+        states = np.ascontiguousarray( states , dtype = np.float64 )
+        if states.ndim == 1:
+            return lib_RK.RK_Chain_Energy( self.chain , states )
+        return np.array( [ lib_RK.RK_Chain_Energy( self.chain , np.ascontiguousarray( row ) ) for row in states ] )
+
+    # End points of the links -> for states[ Nt ][ 2*N ] returns x[ Nt ][ N ], y[ Nt ][ N ]
+    def positions( self , states ):
+
+        states = np.atleast_2d( np.asarray( states , dtype = np.float64 ) )
+        x = np.cumsum( self.length*np.sin( states[ : , : self.nlink ] ) , axis = 1 )
+        y = - np.cumsum( self.length*np.cos( states[ : , : self.nlink ] ) , axis = 1 )
+        return x, y
+
+    # Adaptive integration with the method of Set_RK_Method (or of integrator)
+    # - err_tol: error tolerance per step (ignored with an integrator)
+    # - t_out: output times for the dense output (None for a row at every accepted step)
+    # - integrator: RK_Integrator whose method, tolerance and statistics are used (None for the global ones)
+    # Outputs: time[ Nt ], states[ Nt ][ 2*N ], summary[ 4 ] = [ t_final , accepted steps , rejected steps , max |E - E_0| ]
+    def integrate( self , err_tol , state_init , range_int , t_out = None , integrator = None ):
+
+        ncol = 2*self.nlink + 1
+        t_out = None if t_out is None else np.ascontiguousarray( t_out , dtype = np.float64 ).ravel( )
+        out = Numpy_Output( ncol , 4096 if t_out is None else len( t_out ) )
+        summary = np.zeros( 4 )
+        args = [ np.array( state_init , dtype = np.float64 ) , np.array( range_int , dtype = np.float64 ) , 0 if t_out is None else len( t_out ) ,
+                 None if t_out is None else t_out.ctypes.data , byref( out.buf ) , None , summary ]
+        types = [ ndpointer( c_double ) , ndpointer( c_double ) , c_int , c_void_p , POINTER( RK_Buffer ) , c_void_p , ndpointer( c_double ) ]
+        if integrator is None:
+            lib_RK.DP45_Chain_Integrator.restype = c_int
+            lib_RK.DP45_Chain_Integrator.argtypes = [ c_void_p , c_double ] + types
+            res = lib_RK.DP45_Chain_Integrator( self.chain , err_tol , *args )
+        else:
+            lib_RK.RK_Context_Chain_Integrate.restype = c_int
+            lib_RK.RK_Context_Chain_Integrate.argtypes = [ c_void_p , c_void_p ] + types
+            res = lib_RK.RK_Context_Chain_Integrate( integrator.ctx , self.chain , *args )
+        if res < 0:
+            raise ValueError( "Chain integration failed -> check the state size, t_out and the method (dense output needs DP45)" )
+
+        res_arr = out.result( )
+        return res_arr[ : , 0 ], res_arr[ : , 1 : ], summary
+
+# Monte Carlo uncertainty propagation with online statistics -> mean, covariance, quantiles and angle histograms of the state at the output times
+# The samples perturb the initial state and the physical dimensions [ l1 , l2 , m1 , m2 , g ] with normal deviates, sample i always gets the same
+# deviates for a seed, so a large ensemble can be run in pieces (calls, processes or machines with different i_first) and the pieces merged or saved
+# The memory only grows with the number of output times (about 33 kB each), not with the number of samples
+# Inputs:
+# - t_out[ Nout ]: increasing output times of the statistics
+# - nbins: bins of the theta and phi histograms over [ -pi , pi )
+# - file_name: load statistics saved with save( ) instead (t_out and nbins are then taken from the file)
+class MC_Stats:
+
+    def __init__( self , t_out = None , nbins = 64 , file_name = None ):
+
+        lib_RK.RK_MC_Stats_Free.restype = None
+        lib_RK.RK_MC_Stats_Free.argtypes = [ c_void_p ]
+        lib_RK.RK_MC_Stats_Info.restype = None
+        lib_RK.RK_MC_Stats_Info.argtypes = [ c_void_p , ndpointer( c_int32 ) , c_void_p , c_void_p ]
+
+        if file_name is None:
+            t_out = np.ascontiguousarray( t_out , dtype = np.float64 ).ravel( )
+            lib_RK.RK_MC_Stats_Create.restype = c_void_p
+            lib_RK.RK_MC_Stats_Create.argtypes = [ c_int , ndpointer( c_double ) , c_int ]
+            self.st = lib_RK.RK_MC_Stats_Create( len( t_out ) , t_out , nbins )
+        else:
+            lib_RK.RK_MC_Stats_Load.restype = c_void_p
+            lib_RK.RK_MC_Stats_Load.argtypes = [ c_char_p ]
+            self.st = lib_RK.RK_MC_Stats_Load( file_name if isinstance( file_name , bytes ) else file_name.encode( ) )
+        if not self.st:
+            raise ValueError( "Could not create the Monte Carlo statistics -> check t_out, nbins or the file" )
+
+        sizes = np.zeros( 2 , dtype = np.int32 )
+        lib_RK.RK_MC_Stats_Info( self.st , sizes , None , None )
+        self.nout, self.nbins = int( sizes[ 0 ] ), int( sizes[ 1 ] )
+
+    # Run the samples i_first to i_first + nsample - 1 and fold them in -> returns nsample
+    # - t_init: start of the integrations ( <= t_out[ 0 ] )
+    # - state_init[ 4 ], state_sigma[ 4 ]: mean and standard deviation of the initial state (state_sigma None for no perturbation)
+    # - dims[ 5 ], dims_sigma[ 5 ]: mean and standard deviation of [ l1 , l2 , m1 , m2 , g ] (dims None for the coefficients of Set_Pend_coeff or of the integrator)
+    # - seed: seed of the ensemble
+    # - nthreads: number of worker threads, 0 to use all the available cores
+    # - integrator: RK_Integrator whose tolerance, method and coefficients are used (None for the global coefficients, err_tol is then used)
+    def run( self , err_tol , t_init , state_init , state_sigma = None , dims = None , dims_sigma = None , nsample = 1000 , i_first = 0 , seed = 0 , nthreads = 0 , integrator = None ):
+
+        # Optional vectors -> NULL pointers when they are not given (the arrays are kept alive in vals during the call)
+        vals = [ None if v is None else np.ascontiguousarray( v , dtype = np.float64 ) for v in ( state_sigma , dims , dims_sigma ) ]
+        vecs = [ None if v is None else v.ctypes.data_as( POINTER( c_double ) ) for v in vals ]
+        args = [ self.st , t_init , np.array( state_init , dtype = np.float64 ) ] + vecs + [ i_first , nsample , seed , nthreads ]
+        types = [ c_void_p , c_double , ndpointer( c_double ) , POINTER( c_double ) , POINTER( c_double ) , POINTER( c_double ) , c_int64 , c_int64 , c_uint64 , c_int ]
+        if integrator is None:
+            lib_RK.DP45_MC_Run.restype = c_long
+            lib_RK.DP45_MC_Run.argtypes = [ c_double ] + types
+            res = lib_RK.DP45_MC_Run( err_tol , *args )
+        else:
+            lib_RK.RK_Context_MC_Run.restype = c_long
+            lib_RK.RK_Context_MC_Run.argtypes = [ c_void_p ] + types
+            res = lib_RK.RK_Context_MC_Run( integrator.ctx , *args )
+        if res < 0:
+            raise ValueError( "Monte Carlo run failed -> needs dim_state 4, a method with dense output and t_init <= t_out[ 0 ]" )
+
+        return res
+
+    # Fold the statistics of another MC_Stats (same t_out and nbins) into these ones
+    def merge( self , other ):
+
+        lib_RK.RK_MC_Stats_Merge.restype = c_int
+        lib_RK.RK_MC_Stats_Merge.argtypes = [ c_void_p , c_void_p ]
+        if lib_RK.RK_MC_Stats_Merge( self.st , other.st ) < 0:
+            raise ValueError( "Only Monte Carlo statistics with the same output times and bins can be merged" )
+
+    # Output times and counters -> t_out[ Nout ], samples run, samples which did not reach the last output time
+    def info( self ):
+
+        sizes = np.zeros( 2 , dtype = np.int32 )
+        t_out = np.zeros( self.nout )
+        n_run = np.zeros( 2 , dtype = np.int64 )
+        lib_RK.RK_MC_Stats_Info( self.st , sizes , t_out.ctypes.data , n_run.ctypes.data )
+        return t_out, int( n_run[ 0 ] ), int( n_run[ 1 ] )
+
+    # Moments at the output times -> count[ Nout ], mean[ Nout ][ 4 ], cov[ Nout ][ 4 ][ 4 ]
+    def moments( self ):
+
+        count = np.zeros( self.nout )
+        mean = np.zeros( ( self.nout , 4 ) )
+        cov = np.zeros( ( self.nout , 4 , 4 ) )
+        lib_RK.RK_MC_Stats_Moments.restype = None
+        lib_RK.RK_MC_Stats_Moments.argtypes = [ c_void_p , ndpointer( c_double ) , ndpointer( c_double ) , ndpointer( c_double ) ]
+        lib_RK.RK_MC_Stats_Moments( self.st , count , mean , cov )
+        return count, mean, cov
+
+    # Quantiles of the state components at the output times (relative accuracy RK_MC_SKETCH_ALPHA of RK_Library.h) -> quant[ Nout ][ Nq ][ 4 ]
+    def quantiles( self , q = ( 0.05 , 0.5 , 0.95 ) ):
+
+        q = np.ascontiguousarray( q , dtype = np.float64 ).ravel( )
+        quant = np.zeros( ( self.nout , len( q ) , 4 ) )
+        lib_RK.RK_MC_Stats_Quantiles.restype = None
+        lib_RK.RK_MC_Stats_Quantiles.argtypes = [ c_void_p , c_int , ndpointer( c_double ) , ndpointer( c_double ) ]
+        lib_RK.RK_MC_Stats_Quantiles( self.st , len( q ) , q , quant )
+        return quant
+
+    # Histograms of the wrapped angles -> hist[ Nout ][ 2 ][ nbins ] (theta then phi), bin_edges[ nbins + 1 ]
+    def histograms( self ):
+
+        hist = np.zeros( ( self.nout , 2 , self.nbins ) )
+        lib_RK.RK_MC_Stats_Histograms.restype = None
+        lib_RK.RK_MC_Stats_Histograms.argtypes = [ c_void_p , ndpointer( c_double ) ]
+        lib_RK.RK_MC_Stats_Histograms( self.st , hist )
+        return hist, np.linspace( -np.pi , np.pi , self.nbins + 1 )
+
+    # Write the statistics to a file -> MC_Stats( file_name = ... ) reads them back
+    def save( self , file_name ):
+
+        lib_RK.RK_MC_Stats_Save.restype = c_int
+        lib_RK.RK_MC_Stats_Save.argtypes = [ c_void_p , c_char_p ]
+        if lib_RK.RK_MC_Stats_Save( self.st , file_name if isinstance( file_name , bytes ) else file_name.encode( ) ) < 0:
+            raise IOError( "Could not write the Monte Carlo statistics to " + str( file_name ) )
+
+    def free( self ):
+
+        if getattr( self , "st" , None ):
+            lib_RK.RK_MC_Stats_Free( self.st )
+            self.st = None
+
+    def __del__( self ):
+
+        self.free( )
+
+# Reentrant integrator -> wraps an RK_Context of the library with its own coefficients, tolerance and scratch storage
+# Different RK_Integrator objects are independent: ctypes releases the GIL during the library calls, so they can integrate
+# concurrently from different Python threads (e.g. with concurrent.futures.ThreadPoolExecutor). Do not share one between threads.
+# Inputs:
+# - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+# - pend_coeff[ 5 ]: the coefficients a_th to b_phi in sequence (same order as in Set_Pend_coeff)
+# - dim_state: number of quantities in the state (phase space dimension)
+# - method: one of the names in RK_METHODS
+class RK_Integrator:
+
+    def __init__( self , err_tol , pend_coeff , dim_state = 4 , method = "DP45" ):
+
+        lib_RK.RK_Context_Create.restype = c_void_p
+        lib_RK.RK_Context_Create.argtypes = [ c_int , c_double , ndpointer( c_double ) ]
+        lib_RK.RK_Context_Free.restype = None
+        lib_RK.RK_Context_Free.argtypes = [ c_void_p ]
+
+        self.nstate = dim_state
+        self.ctx = lib_RK.RK_Context_Create( dim_state , err_tol , np.array( pend_coeff , dtype = np.float64 ) )
+        if not self.ctx:
+            raise MemoryError( "Could not allocate the integrator context" )
+        self.set_method( method )
+
+    def __del__( self ):
+
+        if getattr( self , "ctx" , None ):
+            lib_RK.RK_Context_Free( self.ctx )
+            self.ctx = None
+
+    # Change the pendulum coefficients a_th to b_phi
+    def set_pend_coeff( self , pend_coeff ):
+
+        lib_RK.RK_Context_Set_Pend_coeff.restype = None
+        lib_RK.RK_Context_Set_Pend_coeff.argtypes = [ c_void_p , ndpointer( c_double ) ]
+        lib_RK.RK_Context_Set_Pend_coeff( self.ctx , np.array( pend_coeff , dtype = np.float64 ) )
+
+    # Change the embedded Runge-Kutta pair -> one of the names in RK_METHODS
+    def set_method( self , method ):
+
+        lib_RK.RK_Context_Set_Method.restype = c_int
+        lib_RK.RK_Context_Set_Method.argtypes = [ c_void_p , c_int ]
+        if method not in RK_METHODS or lib_RK.RK_Context_Set_Method( self.ctx , RK_METHODS[ method ] ) != 0:
+            raise ValueError( "Unknown Runge-Kutta method " + str( method ) + ", use one of " + str( list( RK_METHODS ) ) )
+
+    # Change the Right-Hand-Side kernel of integrate_batch -> one of the names in RK_RHS_MODES
+    def set_rhs_mode( self , rhs_mode ):
+
+        lib_RK.RK_Context_Set_RHS_Mode.restype = c_int
+        lib_RK.RK_Context_Set_RHS_Mode.argtypes = [ c_void_p , c_int ]
+        if rhs_mode not in RK_RHS_MODES or lib_RK.RK_Context_Set_RHS_Mode( self.ctx , RK_RHS_MODES[ rhs_mode ] ) != 0:
+            raise ValueError( "Unknown RHS mode " + str( rhs_mode ) + ", use one of " + str( list( RK_RHS_MODES ) ) )
+
+    # Change the error tolerance per step
+    def set_tolerance( self , err_tol ):
+
+        lib_RK.RK_Context_Set_Tolerance.restype = None
+        lib_RK.RK_Context_Set_Tolerance.argtypes = [ c_void_p , c_double ]
+        lib_RK.RK_Context_Set_Tolerance( self.ctx , err_tol )
+
+    # Same as DP45_Integrator_Array -> returns time[ N ], states[ N ][ dim_state ]
+    def integrate_array( self , state_init , range_int ):
+
+        out = Numpy_Output( self.nstate + 1 )
+
+        lib_RK.RK_Context_DP45_Buffer.restype = c_int
+        lib_RK.RK_Context_DP45_Buffer.argtypes = [ c_void_p , ndpointer( c_double ) , ndpointer( c_double ) , POINTER( RK_Buffer ) ]
+        res = lib_RK.RK_Context_DP45_Buffer( self.ctx , np.array( state_init , dtype = np.float64 ) , np.array( range_int , dtype = np.float64 ) , byref( out.buf ) )
+        if res < 0:
+            raise MemoryError( "Could not grow the output buffer for the DP45 integration" )
+
+        res_arr = out.result( )
+        return res_arr[ : , 0 ], res_arr[ : , 1 : ]
+
+    # Same as DP45_Integrator_Events with the method of this integrator -> also returns state_final[ dim_state ] and summary[ 4 ]
+    def integrate_events( self , state_init , range_int , events ):
+
+        out = Numpy_Output( self.nstate + 2 )
+        ev_arr, keep = Make_Events( events , self.nstate )
+        state_final = np.zeros( self.nstate )
+        summary = np.zeros( 4 )
+
+        lib_RK.RK_Context_DP45_Events.restype = c_int
+        lib_RK.RK_Context_DP45_Events.argtypes = [ c_void_p , ndpointer( c_double ) , ndpointer( c_double ) , c_int , POINTER( RK_Event ) , POINTER( RK_Buffer ) , ndpointer( c_double ) , ndpointer( c_double ) ]
+        res = lib_RK.RK_Context_DP45_Events( self.ctx , np.array( state_init , dtype = np.float64 ) , np.array( range_int , dtype = np.float64 ) , len( events ) , ev_arr , byref( out.buf ) , state_final , summary )
+        if res < 0:
+            raise ValueError( "Event integration failed -> check the events and the output buffer" )
+
+        res_arr = out.result( )
+        return res_arr[ : , 0 ], res_arr[ : , 1 : - 1 ], res_arr[ : , - 1 ].astype( int ), state_final, summary
+
+    # Same as DP45_Integrator_Dense -> returns states[ N ][ dim_state ] at the output times inside range_int
+    def integrate_dense( self , state_init , range_int , t_out ):
+
+        t_out = np.ascontiguousarray( t_out , dtype = np.float64 )
+        state_out = np.zeros( ( len( t_out ) , self.nstate ) )
+
+        lib_RK.RK_Context_DP45_Dense.restype = c_int
+        lib_RK.RK_Context_DP45_Dense.argtypes = [ c_void_p , ndpointer( c_double ) , ndpointer( c_double ) , c_int , ndpointer( c_double ) , ndpointer( c_double ) ]
+        nout = lib_RK.RK_Context_DP45_Dense( self.ctx , np.array( state_init , dtype = np.float64 ) , np.array( range_int , dtype = np.float64 ) , len( t_out ) , t_out , state_out )
+        if nout < 0:
+            raise RuntimeError( "Dense output failed -> out of memory or the selected method has no dense output (use DP45)" )
+
+        return state_out[ : nout ]
+
+    # Same as DP45_Integrator_Observables with the tolerance, method and coefficients of this integrator (dim_state must be 4)
+    def integrate_observables( self , state_init , range_int , lengths = ( 1.0 , 1.0 ) , t_out = None , rows = True , states = False ):
+
+        nrow_guess = 4096 if t_out is None else max( len( t_out ) , 1 )
+        out = Numpy_Output( RK_OBS_NCOL , nrow_guess )
+        out_st = Numpy_Output( 5 , nrow_guess ) if states else None
+        red = RK_Obs_Summary( )
+        t_arr = np.ascontiguousarray( t_out if t_out is not None else [ 0.0 ] , dtype = np.float64 )
+
+        lib_RK.RK_Context_DP45_Observables.restype = c_int
+        lib_RK.RK_Context_DP45_Observables.argtypes = [ c_void_p , ndpointer( c_double ) , ndpointer( c_double ) , c_int , ndpointer( c_double ) , ndpointer( c_double ) ,
+                                                        POINTER( RK_Buffer ) , POINTER( RK_Buffer ) , POINTER( RK_Obs_Summary ) ]
+        res = lib_RK.RK_Context_DP45_Observables( self.ctx , np.array( state_init , dtype = np.float64 ) , np.array( range_int , dtype = np.float64 ) ,
+                                                  0 if t_out is None else len( t_arr ) , t_arr , np.array( lengths , dtype = np.float64 ) ,
+                                                  byref( out.buf ) if rows else None , byref( out_st.buf ) if states else None , byref( red ) )
+        if res < 0:
+            raise RuntimeError( "Observable integration failed -> dim_state must be 4 and the method must have dense output for t_out" )
+
+        res_arr = out.result( )
+        if not states:
+            return res_arr[ : , 0 ], res_arr[ : , 1 : ], red
+
+        return res_arr[ : , 0 ], out_st.result( )[ : , 1 : ], res_arr[ : , 1 : ], red
+
+    # Same as DP45_Integrator -> writes a .csv file
+    def integrate_file( self , state_init , range_int , file_name , header ):
+
+        lib_RK.RK_Context_DP45_File.restype = None
+        lib_RK.RK_Context_DP45_File.argtypes = [ c_void_p , ndpointer( c_double ) , ndpointer( c_double ) , c_char_p , c_char_p ]
+        lib_RK.RK_Context_DP45_File( self.ctx , np.array( state_init , dtype = np.float64 ) , np.array( range_int , dtype = np.float64 ) , file_name , header )
+
+    # Same as DP45_Integrator_Bin -> writes a binary trajectory file and returns the number of rows
+    def integrate_bin( self , state_init , range_int , file_name , col_names ):
+
+        lib_RK.RK_Context_DP45_Bin.restype = c_long
+        lib_RK.RK_Context_DP45_Bin.argtypes = [ c_void_p , ndpointer( c_double ) , ndpointer( c_double ) , c_char_p , c_char_p ]
+        nrows = lib_RK.RK_Context_DP45_Bin( self.ctx , np.array( state_init , dtype = np.float64 ) , np.array( range_int , dtype = np.float64 ) , file_name , col_names )
+        if nrows < 0:
+            raise IOError( "Could not write the binary trajectory file " + str( file_name ) )
+
+        return nrows
+
+    # Same as DP45_Integrator_Packed -> writes a compressed binary trajectory file and returns the number of rows
+    def integrate_packed( self , state_init , range_int , file_name , col_names , dec_tol = 0.0 , mant_bits = 52 ):
+
+        lib_RK.RK_Context_DP45_Packed.restype = c_long
+        lib_RK.RK_Context_DP45_Packed.argtypes = [ c_void_p , ndpointer( c_double ) , ndpointer( c_double ) , c_char_p , c_char_p , c_double , c_int ]
+        nrows = lib_RK.RK_Context_DP45_Packed( self.ctx , np.array( state_init , dtype = np.float64 ) , np.array( range_int , dtype = np.float64 ) , file_name , col_names ,
+                                               dec_tol , mant_bits )
+        if nrows < 0:
+            raise IOError( "Could not write the compressed trajectory file " + str( file_name ) )
+
+        return nrows
+
+    # Same as DP45_Integrator_Advance with the method, tolerance and coefficients of this integrator
+    def advance( self , cp , t_target ):
+
+        out = Numpy_Output( self.nstate + 1 )
+
+        lib_RK.RK_Context_DP45_Advance.restype = c_int
+        lib_RK.RK_Context_DP45_Advance.argtypes = [ c_void_p , POINTER( RK_Checkpoint ) , c_double , POINTER( RK_Buffer ) ]
+        res = lib_RK.RK_Context_DP45_Advance( self.ctx , byref( cp ) , t_target , byref( out.buf ) )
+        if res < 0:
+            raise ValueError( "Could not advance the checkpoint from t = " + str( cp.t ) + " to " + str( t_target ) )
+
+        res_arr = out.result( )
+        return res_arr[ : , 0 ], res_arr[ : , 1 : ], res == 0
+
+    # Same as DP45_Stream with the tolerance, method and coefficients of this integrator (copied -> the integrator stays free)
+    def stream( self , state_init , range_int , dt_frame , nframe = 4096 , drop = False , speed = 0.0 , lengths = ( 1.0 , 1.0 ) ):
+
+        return DP45_Stream( 0.0 , state_init , range_int , dt_frame , nframe , drop , speed , lengths , integrator = self )
+
+    # Same as MC_Stats.run with the tolerance, method and coefficients (if dims is None) of this integrator
+    def mc_run( self , stats , t_init , state_init , state_sigma = None , dims = None , dims_sigma = None , nsample = 1000 , i_first = 0 , seed = 0 , nthreads = 0 ):
+
+        return stats.run( 0.0 , t_init , state_init , state_sigma , dims , dims_sigma , nsample , i_first , seed , nthreads , integrator = self )
+
+    # Same as DP45_Parareal with the method, tolerance and coefficients of this integrator for the fine propagator
+    def parareal( self , state_init , range_int , nslice = 16 , coarse_steps = 0 , coarse_tol = 1e-4 , kmax = 8 , conv_tol = 1e-8 , t_out = None , nthreads = 0 ):
+
+        return DP45_Parareal( 0.0 , state_init , range_int , nslice , coarse_steps , coarse_tol , kmax , conv_tol , t_out , nthreads , integrator = self )
+
+    # Same as DP45_Integrate_Batch -> returns state_final[ Ntraj ][ dim_state ], t_final[ Ntraj ], n_steps[ Ntraj ]
+    def integrate_batch( self , states_init , range_int ):
+
+        states_init = np.ascontiguousarray( states_init , dtype = np.float64 ).reshape( -1 , self.nstate )
+        ntraj = states_init.shape[ 0 ]
+
+        state_final = np.zeros( ( ntraj , self.nstate ) )
+        t_final = np.zeros( ntraj )
+        n_steps = np.zeros( ntraj , dtype = np.int32 )
+
+        lib_RK.RK_Context_DP45_Batch.restype = c_int
+        lib_RK.RK_Context_DP45_Batch.argtypes = [ c_void_p , c_int , ndpointer( c_double ) , ndpointer( c_double ) , ndpointer( c_double ) , ndpointer( c_double ) , ndpointer( c_int32 ) ]
+        res = lib_RK.RK_Context_DP45_Batch( self.ctx , ntraj , states_init , np.array( range_int , dtype = np.float64 ) , state_final , t_final , n_steps )
+        if res < 0:
+            raise MemoryError( "Could not allocate the batch integrator storage" )
+
+        return state_final, t_final, n_steps
+
+    # Same as GL_Integrator_Array with the coefficients of this integrator -> returns time[ N ], states[ N ][ 4 ], summary[ 4 ]
+    # nskip = 0 keeps only the final state (for long runs where only the summary matters)
+    def integrate_gl( self , dt , state_init , range_int , nstage = 2 , nskip = 1 ):
+
+        nkeep = int( ( range_int[ 1 ] - range_int[ 0 ] )/( dt*nskip ) ) + 2 if nskip > 0 else 2
+        out = Numpy_Output( 5 , nkeep )
+        state_final = np.zeros( 4 )
+        summary = np.zeros( 4 )
+
+        lib_RK.RK_Context_GL.restype = c_int
+        lib_RK.RK_Context_GL.argtypes = [ c_void_p , c_int , c_double , c_int , ndpointer( c_double ) , ndpointer( c_double ) , POINTER( RK_Buffer ) , ndpointer( c_double ) , ndpointer( c_double ) ]
+        res = lib_RK.RK_Context_GL( self.ctx , nstage , dt , nskip if nskip > 0 else 2**31 - 1 , np.array( state_init , dtype = np.float64 ) , np.array( range_int , dtype = np.float64 ) , byref( out.buf ) , state_final , summary )
+        if res < 0:
+            raise ValueError( "Gauss-Legendre integration failed -> check nstage, dt and range_int" )
+
+        res_arr = out.result( )
+        return res_arr[ : , 0 ], res_arr[ : , 1 : ], summary
+
+    # Same as Lyapunov_Spectrum with the method, tolerance and coefficients of this integrator
+    def lyapunov( self , state_init , range_int , t_orth = 1.0 , history = False ):
+
+        lyap = np.zeros( 4 )
+        out = Numpy_Output( 5 , int( ( range_int[ 1 ] - range_int[ 0 ] )/t_orth ) + 2 ) if history else None
+
+        lib_RK.RK_Context_Lyapunov.restype = c_int
+        lib_RK.RK_Context_Lyapunov.argtypes = [ c_void_p , ndpointer( c_double ) , ndpointer( c_double ) , c_double , ndpointer( c_double ) , POINTER( RK_Buffer ) ]
+        res = lib_RK.RK_Context_Lyapunov( self.ctx , np.array( state_init , dtype = np.float64 ) , np.array( range_int , dtype = np.float64 ) , t_orth , lyap , byref( out.buf ) if history else None )
+        if res < 0:
+            raise ValueError( "Lyapunov spectrum failed -> check t_orth, range_int and dim_state" )
+
+        if not history:
+            return lyap
+        res_arr = out.result( )
+        return lyap, res_arr[ : , 0 ], res_arr[ : , 1 : ]
+
+    # Statistics of the last integrate_* run of this integrator (except integrate_gl, integrate_batch and param_sweep) -> returns a dictionary
+    def stats( self ):
+
+        stats = RK_Stats( )
+        lib_RK.RK_Context_Get_Stats.restype = None
+        lib_RK.RK_Context_Get_Stats.argtypes = [ c_void_p , POINTER( RK_Stats ) ]
+        lib_RK.RK_Context_Get_Stats( self.ctx , byref( stats ) )
+        return Stats_Dict( stats )
+
+    # Keep the last cap step attempts of the runs of this integrator in a trace (0 disables it)
+    def set_trace( self , cap ):
+
+        lib_RK.RK_Context_Set_Trace.restype = c_int
+        lib_RK.RK_Context_Set_Trace.argtypes = [ c_void_p , c_int ]
+        if lib_RK.RK_Context_Set_Trace( self.ctx , cap ) < 0:
+            raise MemoryError( "Could not allocate the step trace" )
+
+    # Same as Get_RK_Trace for this integrator
+    def trace( self , max_rows = 1 << 16 ):
+
+        rows = np.zeros( ( max_rows , 4 ) )
+        lib_RK.RK_Context_Get_Trace.restype = c_long
+        lib_RK.RK_Context_Get_Trace.argtypes = [ c_void_p , ndpointer( c_double ) , c_long ]
+        nrows = lib_RK.RK_Context_Get_Trace( self.ctx , rows , max_rows )
+        return rows[ : nrows ]
+
+    # Same as DP45_Param_Sweep with the tolerance of this integrator -> returns state_final[ Nrun ][ dim_state ], summary[ Nrun ][ 4 ]
+    def param_sweep( self , pend_params , states_init , range_int , grid = True , nthreads = 0 ):
+
+        pend_params = np.ascontiguousarray( pend_params , dtype = np.float64 ).reshape( -1 , 5 )
+        states_init = np.ascontiguousarray( states_init , dtype = np.float64 ).reshape( -1 , self.nstate )
+        npar = pend_params.shape[ 0 ]
+        nic = states_init.shape[ 0 ]
+        nrun = npar*nic if grid else npar
+
+        state_final = np.zeros( ( nrun , self.nstate ) )
+        summary = np.zeros( ( nrun , 4 ) )
+
+        lib_RK.RK_Context_Param_Sweep.restype = c_int
+        lib_RK.RK_Context_Param_Sweep.argtypes = [ c_void_p , c_int , c_int , c_int , ndpointer( c_double ) , ndpointer( c_double ) , ndpointer( c_double ) , c_int , ndpointer( c_double ) , ndpointer( c_double ) ]
+        res = lib_RK.RK_Context_Param_Sweep( self.ctx , npar , nic , int( grid ) , pend_params , states_init , np.array( range_int , dtype = np.float64 ) , nthreads , state_final , summary )
+        if res < 0:
+            raise ValueError( "Matched parameter sweep needs as many parameter sets as initial states" )
+
+        return state_final, summary
+
+    # Same as DP45_Flip_Map with the tolerance, method, coefficients and RHS mode of this integrator (dim_state must be 4)
+    def flip_map( self , th_range , phi_range , nth , nphi , t_max , refine_step = 8 , refine_tol = 0.05 , file_name = None , tile = 64 , nthreads = 0 ):
+
+        flip_time = np.zeros( ( nphi , nth ) , dtype = np.float32 )
+
+        lib_RK.RK_Context_Flip_Map.restype = c_long
+        lib_RK.RK_Context_Flip_Map.argtypes = [ c_void_p , ndpointer( c_double ) , ndpointer( c_double ) , c_int , c_int , c_double , c_int , c_double , c_int , c_int , ndpointer( c_float ) , c_char_p ]
+        nint = lib_RK.RK_Context_Flip_Map( self.ctx , np.array( th_range , dtype = np.float64 ) , np.array( phi_range , dtype = np.float64 ) , nth , nphi , t_max ,
+                                           refine_step , refine_tol , tile , nthreads , flip_time , file_name )
+        if nint < 0:
+            raise ValueError( "Could not compute the flip map" )
+
+        return flip_time, nint
+
+    # Same as DP45_Flip_Map_Mixed with the tolerance, method (double precision pass), coefficients and RHS mode of this integrator
+    def flip_map_mixed( self , th_range , phi_range , nth , nphi , t_max , refine_step = 8 , refine_tol = 0.05 , screen_tol = 1e-5 , screen_margin = 0.05 ,
+                        file_name = None , tile = 64 , nthreads = 0 ):
+
+        flip_time = np.zeros( ( nphi , nth ) , dtype = np.float32 )
+        prec = np.zeros( ( nphi , nth ) , dtype = np.uint8 )
+
+        lib_RK.RK_Context_Flip_Map_Mixed.restype = c_long
+        lib_RK.RK_Context_Flip_Map_Mixed.argtypes = [ c_void_p , ndpointer( c_double ) , ndpointer( c_double ) , c_int , c_int , c_double , c_int , c_double , c_int , c_int ,
+                                                      c_double , c_double , ndpointer( c_float ) , ndpointer( c_uint8 ) , c_char_p ]
+        nint = lib_RK.RK_Context_Flip_Map_Mixed( self.ctx , np.array( th_range , dtype = np.float64 ) , np.array( phi_range , dtype = np.float64 ) , nth , nphi , t_max ,
+                                                 refine_step , refine_tol , tile , nthreads , screen_tol , screen_margin , flip_time , prec , file_name )
+        if nint < 0:
+            raise ValueError( "Could not compute the mixed precision flip map" )
+
+        return flip_time, prec, nint
@@ -0,0 +1,465 @@
+# Sharded runner for large sweeps over pendulum coefficients and initial states (DP45_Param_Sweep split over processes and machines)
+# A study is planned once into deterministic shards (fixed task ranges) described by manifest files in a study directory.
+# Any number of worker processes, on one box or on several machines sharing the directory, claim the shards through lock files
+# and write per-shard binary results. A killed worker leaves a .part file which the next worker continues from the last block.
+# Every task is integrated on its own, so the merged result does not depend on the shards, blocks, processes or threads.
+# Layout of the study directory:
+# - study.json: the settings, the study id and the number of shards
+# - pend_params.npy, states_init.npy: the inputs
+# - shard_NNNNN.json: manifest of a shard -> study id, task range and file names
+# - shard_NNNNN.lock: claim of a running worker -> record lock held by the worker, host and pid inside
+# - shard_NNNNN.part: records of the finished tasks of an incomplete shard
+# - shard_NNNNN.bin: records of a complete shard -> one record [ task , state_final , summary ] per task in task order
+# - results.npz: the merged result set (see Merge_Study)
+# Usage from the command line (run from Main_Code, the library is loaded relative to it):
+# - python Sweep_Runner.py plan <study_dir> <pend_params.npy> <states_init.npy> --t-max 10 [--err-tol 1e-10] [--matched] [--shard-size 4096]
+# - python Sweep_Runner.py run <study_dir> --procs 4 [--threads 1]
+# - python Sweep_Runner.py worker <study_dir> [--threads 0] [--steal]
+# - python Sweep_Runner.py status <study_dir>
+# - python Sweep_Runner.py merge <study_dir>
+
+import os
+import sys
+import json
+import time
+import fcntl
+import struct
+import socket
+import hashlib
+import argparse
+import subprocess
+import numpy as np
+
+STUDY_FILE = "study.json"
+STUDY_VERSION = 1
+
+# Record of one task in the shard files
+def Record_Dtype( nstate ):
+
+    return np.dtype( [ ( "task" , np.int64 ) , ( "state_final" , np.float64 , ( nstate , ) ) , ( "summary" , np.float64 , ( 4 , ) ) ] )
+
+# Name of a file of shard i_shard in the study directory
+def Shard_File( study_dir , i_shard , ext ):
+
+    return os.path.join( study_dir , "shard_%05d.%s" % ( i_shard , ext ) )
+
+# Write a JSON file atomically (the readers see either the old or the new file)
+def Write_Json( file_name , obj ):
+
+    tmp_name = file_name + ".tmp%d" % os.getpid( )
+    with open( tmp_name , "w" ) as f:
+        json.dump( obj , f , indent = 1 )
+    os.replace( tmp_name , file_name )
+
+# Split a study into shards and write the manifests
+# Planning the same study again is a no-op (so it can be part of a restartable script), a different study in the same directory is an error
+# Inputs:
+# - study_dir: directory of the study (created if needed)
+# - err_tol: error tolerance per step
+# - pend_params[ Npar ][ 5 ]: the coefficients a_th to b_phi for each parameter set
+# - states_init[ Nic ][ dim_state ]: initial states
+# - range_int[ 2 ]: integration interval of every run
+# - grid: True for every parameter set with every initial state ( task = ipar*Nic + iic ), False for matched pairs
+# - shard_size: tasks per shard -> a shard is the unit of work of a worker process
+# - method: embedded Runge-Kutta pair (see RK_METHODS in RK_Driver.py)
+# Outputs:
+# - the study settings as stored in study.json
+def Plan_Study( study_dir , err_tol , pend_params , states_init , range_int , grid = True , shard_size = 4096 , method = "DP45" ):
+
+    pend_params = np.ascontiguousarray( pend_params , dtype = np.float64 ).reshape( -1 , 5 )
+    states_init = np.ascontiguousarray( states_init , dtype = np.float64 )
+    if states_init.ndim == 1:
+        states_init = states_init.reshape( 1 , -1 )
+    npar = pend_params.shape[ 0 ]
+    nic, nstate = states_init.shape
+    if not grid and npar != nic:
+        raise ValueError( "Matched parameter sweep needs as many parameter sets as initial states" )
+    ntask = npar*nic if grid else npar
+
+    # The id depends on everything which changes the results -> the shards of different studies can not be mixed up
+    study = { "version" : STUDY_VERSION ,
+              "err_tol" : float( err_tol ) ,
+              "range_int" : [ float( range_int[ 0 ] ) , float( range_int[ 1 ] ) ] ,
+              "grid" : bool( grid ) ,
+              "method" : method ,
+              "npar" : npar ,
+              "nic" : nic ,
+              "nstate" : nstate ,
+              "ntask" : ntask ,
+              "shard_size" : int( shard_size ) }
+    digest = hashlib.sha256( json.dumps( study , sort_keys = True ).encode( ) )
+    digest.update( pend_params.tobytes( ) )
+    digest.update( states_init.tobytes( ) )
+    study[ "study_id" ] = digest.hexdigest( )[ : 16 ]
+    study[ "nshard" ] = ( ntask + shard_size - 1 ) // shard_size
+
+    os.makedirs( study_dir , exist_ok = True )
+    study_file = os.path.join( study_dir , STUDY_FILE )
+    if os.path.exists( study_file ):
+        old = Load_Study( study_dir )
+        if old[ "study_id" ] != study[ "study_id" ]:
+            raise ValueError( "A different study ( " + old[ "study_id" ] + " ) is already planned in " + str( study_dir ) )
+        return old
+
+    np.save( os.path.join( study_dir , "pend_params.npy" ) , pend_params )
+    np.save( os.path.join( study_dir , "states_init.npy" ) , states_init )
+    for i_shard in range( study[ "nshard" ] ):
+        Write_Json( Shard_File( study_dir , i_shard , "json" ) , { "study_id" : study[ "study_id" ] ,
+                                                                  "shard" : i_shard ,
+                                                                  "task_lo" : i_shard*shard_size ,
+                                                                  "task_hi" : min( ( i_shard + 1 )*shard_size , ntask ) ,
+                                                                  "part" : os.path.basename( Shard_File( study_dir , i_shard , "part" ) ) ,
+                                                                  "result" : os.path.basename( Shard_File( study_dir , i_shard , "bin" ) ) } )
+    # Written last -> a study directory with study.json is completely planned
+    Write_Json( study_file , study )
+
+    return study
+
+# Read the settings of a planned study
+def Load_Study( study_dir ):
+
+    with open( os.path.join( study_dir , STUDY_FILE ) ) as f:
+        study = json.load( f )
+    if study.get( "version" ) != STUDY_VERSION:
+        raise IOError( "Unknown study version in " + str( study_dir ) )
+
+    return study
+
+# Read the manifest of shard i_shard and check that it belongs to the study
+def Load_Shard( study_dir , study , i_shard ):
+
+    with open( Shard_File( study_dir , i_shard , "json" ) ) as f:
+        shard = json.load( f )
+    if shard[ "study_id" ] != study[ "study_id" ] or shard[ "shard" ] != i_shard:
+        raise IOError( "Shard manifest " + str( i_shard ) + " does not belong to study " + study[ "study_id" ] )
+
+    return shard
+
+# Number of complete records in a shard result file (0 if it does not exist)
+# Inputs:
+# - file_name: .part or .bin file of the shard
+# - rec: record dtype of the study
+# - task_lo: first task of the shard -> the records must be the tasks task_lo, task_lo + 1, ... in order
+# Outputs:
+# - the number of leading records which are complete and in order
+def Count_Records( file_name , rec , task_lo ):
+
+    if not os.path.exists( file_name ):
+        return 0
+    n = os.path.getsize( file_name ) // rec.itemsize
+    tasks = np.fromfile( file_name , dtype = rec , count = n )[ "task" ]
+    bad = np.flatnonzero( tasks != task_lo + np.arange( n ) )
+
+    return int( bad[ 0 ] ) if len( bad ) else n
+
+# Check if a shard is complete (its .bin file holds all its tasks)
+def Shard_Done( study_dir , study , shard ):
+
+    rec = Record_Dtype( study[ "nstate" ] )
+    file_name = os.path.join( study_dir , shard[ "result" ] )
+    ntask = shard[ "task_hi" ] - shard[ "task_lo" ]
+
+    return os.path.exists( file_name ) and os.path.getsize( file_name ) == ntask*rec.itemsize and Count_Records( file_name , rec , shard[ "task_lo" ] ) == ntask
+
+# Open lock files of the shards claimed by this process -> lock file name : fd holding the kernel lock
+claim_fds = { }
+
+# Try to claim a shard for this process with a lock file
+# The claim is an exclusive POSIX record lock (lockf) held on the lock file until Release_Shard (or the death of the process),
+# so the kernel decides the race between workers and a lock left by a dead process is free again without removing it.
+# NOTE: Closing any descriptor of a lock file drops the record locks of the process on it -> the claimed files are never reopened
+# The host and pid written into the file only serve file systems which do not share the locks between machines:
+# there a lock written by another host is taken over only with steal = True.
+# Outputs:
+# - True if the shard is now claimed by this process
+def Claim_Shard( study_dir , i_shard , steal = False ):
+
+    lock_name = Shard_File( study_dir , i_shard , "lock" )
+    if lock_name in claim_fds:
+        return True
+    host = socket.gethostname( )
+    while True:
+        fd = os.open( lock_name , os.O_CREAT | os.O_RDWR , 0o644 )
+        try:
+            fcntl.lockf( fd , fcntl.LOCK_EX | fcntl.LOCK_NB )
+        except OSError:
+            # Held by a live worker
+            os.close( fd )
+            return False
+        # A releasing worker removes the file before it drops the lock -> locked a removed file, try the new one
+        try:
+            if os.stat( lock_name ).st_ino == os.fstat( fd ).st_ino:
+                break
+        except FileNotFoundError:
+            pass
+        os.close( fd )
+
+    try:
+        owner = json.loads( os.read( fd , 4096 ) or b"null" )
+    except ValueError:
+        owner = None
+    if isinstance( owner , dict ) and owner.get( "host" , host ) != host and not steal:
+        os.close( fd )
+        return False
+    os.ftruncate( fd , 0 )
+    os.pwrite( fd , json.dumps( { "host" : host , "pid" : os.getpid( ) , "time" : time.time( ) } ).encode( ) , 0 )
+    claim_fds[ lock_name ] = fd
+
+    return True
+
+# Check if a shard is claimed by a live worker (the workers of other hosts are assumed alive)
+# The lock is only queried (F_GETLK), so a status check never makes a concurrent Claim_Shard fail
+def Shard_Locked( study_dir , i_shard ):
+
+    lock_name = Shard_File( study_dir , i_shard , "lock" )
+    if lock_name in claim_fds:
+        return True
+    try:
+        fd = os.open( lock_name , os.O_RDONLY )
+    except FileNotFoundError:
+        return False
+    try:
+        # struct flock of Linux -> l_type, l_whence, l_start, l_len, l_pid ( l_type comes back F_UNLCK if nobody holds the lock )
+        query = fcntl.fcntl( fd , fcntl.F_GETLK , struct.pack( "hhqqi" , fcntl.F_WRLCK , os.SEEK_SET , 0 , 0 , 0 ) )
+        if struct.unpack( "hhqqi" , query )[ 0 ] != fcntl.F_UNLCK:
+            return True
+        try:
+            owner = json.loads( os.read( fd , 4096 ) or b"null" )
+        except ValueError:
+            owner = None
+        return isinstance( owner , dict ) and owner.get( "host" ) != socket.gethostname( )
+    finally:
+        os.close( fd )
+
+# Release the claim of a shard (the file is removed before the lock is dropped, see Claim_Shard)
+def Release_Shard( study_dir , i_shard ):
+
+    lock_name = Shard_File( study_dir , i_shard , "lock" )
+    fd = claim_fds.pop( lock_name , None )
+    if fd is None:
+        return
+    try:
+        os.remove( lock_name )
+    except FileNotFoundError:
+        pass
+    os.close( fd )
+
+# Integrate the tasks of one shard which are not done yet (the caller must hold its claim)
+# The records are appended to the .part file one block at a time, so a killed run continues after the last complete block.
+# The finished shard is renamed to .bin.
+# Inputs:
+# - study_dir, study: the study
+# - i_shard: index of the shard
+# - nthreads: threads of DP45_Param_Sweep (0 for all the cores)
+# - block: tasks integrated between two writes of the .part file
+# Outputs:
+# - the number of tasks integrated by this call
+def Run_Shard( study_dir , study , i_shard , nthreads = 0 , block = 256 ):
+
+    from RK_Driver import DP45_Param_Sweep, Set_RK_Method
+
+    shard = Load_Shard( study_dir , study , i_shard )
+    if Shard_Done( study_dir , study , shard ):
+        return 0
+
+    rec = Record_Dtype( study[ "nstate" ] )
+    part_name = os.path.join( study_dir , shard[ "part" ] )
+    task_lo, task_hi = shard[ "task_lo" ] , shard[ "task_hi" ]
+
+    # Resume point -> drop a partially written record (or anything after a record out of order)
+    n_done = Count_Records( part_name , rec , task_lo )
+    with open( part_name , "ab" ) as f:
+        f.truncate( n_done*rec.itemsize )
+
+    pend_params = np.load( os.path.join( study_dir , "pend_params.npy" ) )
+    states_init = np.load( os.path.join( study_dir , "states_init.npy" ) )
+    Set_RK_Method( study[ "method" ] )
+
+    with open( part_name , "ab" ) as f:
+        for b_lo in range( task_lo + n_done , task_hi , block ):
+            tasks = np.arange( b_lo , min( b_lo + block , task_hi ) )
+            ipar = tasks // study[ "nic" ] if study[ "grid" ] else tasks
+            iic = tasks % study[ "nic" ] if study[ "grid" ] else tasks
+            # Matched pairs of the block -> the same runs as in the full grid sweep
+            state_final, summary = DP45_Param_Sweep( study[ "err_tol" ] , pend_params[ ipar ] , states_init[ iic ] , study[ "range_int" ] ,
+                                                     grid = False , nthreads = nthreads )
+            out = np.zeros( len( tasks ) , dtype = rec )
+            out[ "task" ] = tasks
+            out[ "state_final" ] = state_final
+            out[ "summary" ] = summary
+            f.write( out.tobytes( ) )
+            f.flush( )
+            os.fsync( f.fileno( ) )
+
+    os.replace( part_name , os.path.join( study_dir , shard[ "result" ] ) )
+
+    return task_hi - task_lo - n_done
+
+# Worker process -> claims and runs shards until none are left
+# Inputs:
+# - study_dir: directory of a planned study
+# - nthreads: threads of each shard run (0 for all the cores)
+# - rank: where to start looking for free shards (spreads the workers over the study at the start)
+# - steal: take over the locks of other hosts (after a crashed machine)
+# Outputs:
+# - the number of shards completed by this worker
+def Run_Worker( study_dir , nthreads = 0 , rank = 0 , steal = False ):
+
+    study = Load_Study( study_dir )
+    nshard = study[ "nshard" ]
+    ndone = 0
+    while True:
+        nclaim = 0
+        for n in range( nshard ):
+            i_shard = ( rank + n ) % nshard
+            if Shard_Done( study_dir , study , Load_Shard( study_dir , study , i_shard ) ):
+                continue
+            if not Claim_Shard( study_dir , i_shard , steal ):
+                continue
+            nclaim += 1
+            try:
+                ntask = Run_Shard( study_dir , study , i_shard , nthreads )
+                print( "worker %d: shard %d done ( %d tasks )" % ( os.getpid( ) , i_shard , ntask ) )
+                ndone += 1
+            finally:
+                Release_Shard( study_dir , i_shard )
+        # Pass again until every incomplete shard is held by a live worker -> a shard lost in a race, or whose worker died
+        # after this pass went by it, is picked up
+        if nclaim == 0:
+            if all( Shard_Done( study_dir , study , Load_Shard( study_dir , study , i_shard ) ) or Shard_Locked( study_dir , i_shard )
+                    for i_shard in range( nshard ) ):
+                break
+            time.sleep( 0.1 )
+
+    return ndone
+
+# State of every shard of a study
+# Outputs:
+# - list of [ shard index , "done" / "running" / "partial" / "pending" , finished tasks , tasks ] -> a shard of a dead worker is "partial" or "pending"
+def Study_Status( study_dir ):
+
+    study = Load_Study( study_dir )
+    rec = Record_Dtype( study[ "nstate" ] )
+    status = [ ]
+    for i_shard in range( study[ "nshard" ] ):
+        shard = Load_Shard( study_dir , study , i_shard )
+        ntask = shard[ "task_hi" ] - shard[ "task_lo" ]
+        if Shard_Done( study_dir , study , shard ):
+            status.append( [ i_shard , "done" , ntask , ntask ] )
+            continue
+        n_part = Count_Records( os.path.join( study_dir , shard[ "part" ] ) , rec , shard[ "task_lo" ] )
+        if Shard_Locked( study_dir , i_shard ):
+            status.append( [ i_shard , "running" , n_part , ntask ] )
+        else:
+            status.append( [ i_shard , "partial" if n_part > 0 else "pending" , n_part , ntask ] )
+
+    return status
+
+# Run a study with nproc local worker processes (continues an interrupted run)
+# Inputs:
+# - study_dir: directory of a planned study
+# - nproc: number of worker processes
+# - nthreads: threads of each worker (1 is best when nproc is the number of cores)
+# Outputs:
+# - True if all the shards are done
+def Run_Study( study_dir , nproc , nthreads = 1 ):
+
+    study_dir = os.path.abspath( study_dir )
+    here = os.path.dirname( os.path.abspath( __file__ ) )
+    procs = [ subprocess.Popen( [ sys.executable , os.path.join( here , "Sweep_Runner.py" ) , "worker" , study_dir ,
+                                  "--threads" , str( nthreads ) , "--rank" , str( rank ) ] , cwd = here ) for rank in range( nproc ) ]
+    for p in procs:
+        p.wait( )
+
+    return all( s[ 1 ] == "done" for s in Study_Status( study_dir ) )
+
+# Merge the shards of a complete study into one indexed result set
+# Inputs:
+# - study_dir: directory of a complete study
+# - out_file: name of the result set (in the study directory by default)
+# Outputs:
+# - out_file -> a .npz with task[ Ntask ], ipar[ Ntask ], iic[ Ntask ], state_final[ Ntask ][ dim_state ], summary[ Ntask ][ 4 ]
+#   in task order, the inputs pend_params and states_init and the study settings as JSON (see Load_Results)
+def Merge_Study( study_dir , out_file = None ):
+
+    study = Load_Study( study_dir )
+    rec = Record_Dtype( study[ "nstate" ] )
+    out_file = out_file or os.path.join( study_dir , "results.npz" )
+
+    recs = np.zeros( study[ "ntask" ] , dtype = rec )
+    for i_shard in range( study[ "nshard" ] ):
+        shard = Load_Shard( study_dir , study , i_shard )
+        if not Shard_Done( study_dir , study , shard ):
+            raise IOError( "Shard " + str( i_shard ) + " of study " + study[ "study_id" ] + " is not complete" )
+        recs[ shard[ "task_lo" ] : shard[ "task_hi" ] ] = np.fromfile( os.path.join( study_dir , shard[ "result" ] ) , dtype = rec )
+
+    tasks = recs[ "task" ]
+    np.savez( out_file ,
+              task = tasks ,
+              ipar = tasks // study[ "nic" ] if study[ "grid" ] else tasks ,
+              iic = tasks % study[ "nic" ] if study[ "grid" ] else tasks ,
+              state_final = recs[ "state_final" ] ,
+              summary = recs[ "summary" ] ,
+              pend_params = np.load( os.path.join( study_dir , "pend_params.npy" ) ) ,
+              states_init = np.load( os.path.join( study_dir , "states_init.npy" ) ) ,
+              study = json.dumps( study ) )
+
+    return out_file
+
+# Load a merged result set
+# Outputs:
+# - dict of the arrays of Merge_Study, "study" is the dict of the settings
+def Load_Results( file_name ):
+
+    with np.load( file_name ) as data:
+        res = { key : data[ key ] for key in data.files }
+    res[ "study" ] = json.loads( str( res[ "study" ] ) )
+
+    return res
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser( description = "Sharded sweeps over pendulum coefficients and initial states" )
+    sub = parser.add_subparsers( dest = "cmd" , required = True )
+    p_plan = sub.add_parser( "plan" , help = "split a study into shards" )
+    p_plan.add_argument( "study_dir" )
+    p_plan.add_argument( "pend_params" , help = ".npy file with [ Npar ][ 5 ] coefficients" )
+    p_plan.add_argument( "states_init" , help = ".npy file with [ Nic ][ dim_state ] initial states" )
+    p_plan.add_argument( "--t-max" , type = float , required = True )
+    p_plan.add_argument( "--err-tol" , type = float , default = 1e-10 )
+    p_plan.add_argument( "--matched" , action = "store_true" , help = "matched pairs instead of the full grid" )
+    p_plan.add_argument( "--shard-size" , type = int , default = 4096 )
+    p_plan.add_argument( "--method" , default = "DP45" )
+    p_run = sub.add_parser( "run" , help = "run the study with local worker processes" )
+    p_run.add_argument( "study_dir" )
+    p_run.add_argument( "--procs" , type = int , default = os.cpu_count( ) )
+    p_run.add_argument( "--threads" , type = int , default = 1 )
+    p_work = sub.add_parser( "worker" , help = "run shards until none are left (start one per machine or core)" )
+    p_work.add_argument( "study_dir" )
+    p_work.add_argument( "--threads" , type = int , default = 0 )
+    p_work.add_argument( "--rank" , type = int , default = 0 )
+    p_work.add_argument( "--steal" , action = "store_true" , help = "take over the locks of other hosts" )
+    p_stat = sub.add_parser( "status" , help = "show the state of the shards" )
+    p_stat.add_argument( "study_dir" )
+    p_merge = sub.add_parser( "merge" , help = "merge the shards into results.npz" )
+    p_merge.add_argument( "study_dir" )
+    p_merge.add_argument( "--out" , default = None )
+    args = parser.parse_args( )
+
+    if args.cmd == "plan":
+        study = Plan_Study( args.study_dir , args.err_tol , np.load( args.pend_params ) , np.load( args.states_init ) , [ 0.0 , args.t_max ] ,
+                            grid = not args.matched , shard_size = args.shard_size , method = args.method )
+        print( "study %s: %d tasks in %d shards" % ( study[ "study_id" ] , study[ "ntask" ] , study[ "nshard" ] ) )
+    elif args.cmd == "run":
+        done = Run_Study( args.study_dir , args.procs , args.threads )
+        print( "all shards done" if done else "some shards are not done, run again to continue" )
+        sys.exit( 0 if done else 1 )
+    elif args.cmd == "worker":
+        Run_Worker( args.study_dir , args.threads , args.rank , args.steal )
+    elif args.cmd == "status":
+        status = Study_Status( args.study_dir )
+        for i_shard, state, n_fin, ntask in status:
+            print( "shard %5d: %-8s %d / %d" % ( i_shard , state , n_fin , ntask ) )
+        print( "%d of %d shards done" % ( sum( s[ 1 ] == "done" for s in status ) , len( status ) ) )
+    elif args.cmd == "merge":
+        print( Merge_Study( args.study_dir , args.out ) )
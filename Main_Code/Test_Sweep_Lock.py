@@ -0,0 +1,102 @@
+# Checks of the shard claims of Sweep_Runner.py: several workers race for one shard and exactly one of them may win
+# Usage: python Test_Sweep_Lock.py (run from Main_Code)
+
+import os
+import json
+import socket
+import tempfile
+import subprocess
+import multiprocessing as mp
+from Sweep_Runner import Shard_File , Claim_Shard , Shard_Locked , Release_Shard
+
+# Worker of the race -> claims the shard after the start barrier and keeps its claim until every worker has tried
+def Claim_Worker( study_dir , steal , start , tried , wins ):
+
+    start.wait( )
+    won = Claim_Shard( study_dir , 0 , steal )
+    wins.put( won )
+    tried.wait( )
+    if won:
+        Release_Shard( study_dir , 0 )
+
+# Status checks of the shard (as by Sweep_Runner.py status) until stop is set
+def Probe_Worker( study_dir , stop ):
+
+    while not stop.is_set( ):
+        Shard_Locked( study_dir , 0 )
+
+# Race nproc processes for shard 0 of study_dir
+# Inputs:
+# - probe: True to check the status of the shard from another process all along
+# Outputs:
+# - number of processes which claimed the shard
+def Race( study_dir , nproc , steal = False , probe = False ):
+
+    start = mp.Barrier( nproc )
+    tried = mp.Barrier( nproc )
+    stop = mp.Event( )
+    wins = mp.Queue( )
+    procs = [ mp.Process( target = Claim_Worker , args = ( study_dir , steal , start , tried , wins ) ) for i in range( nproc ) ]
+    prober = mp.Process( target = Probe_Worker , args = ( study_dir , stop ) ) if probe else None
+    if prober is not None:
+        prober.start( )
+    for p in procs:
+        p.start( )
+    nwin = sum( wins.get( ) for p in procs )
+    for p in procs:
+        p.join( )
+        assert p.exitcode == 0
+    if prober is not None:
+        stop.set( )
+        prober.join( )
+
+    return nwin
+
+# Lock file of a process which is gone (as left by a killed worker)
+def Write_Dead_Lock( study_dir , host ):
+
+    proc = subprocess.Popen( [ "true" ] )
+    proc.wait( )
+    with open( Shard_File( study_dir , 0 , "lock" ) , "w" ) as f:
+        json.dump( { "host" : host , "pid" : proc.pid , "time" : 0.0 } , f )
+
+if __name__ == "__main__":
+
+    nproc = 8
+    with tempfile.TemporaryDirectory( ) as study_dir:
+
+        for n in range( 200 ):
+            Write_Dead_Lock( study_dir , socket.gethostname( ) )
+            nwin = Race( study_dir , nproc )
+            assert nwin == 1 , "dead owner lock: %d workers claimed the shard" % nwin
+
+        for n in range( 200 ):
+            Write_Dead_Lock( study_dir , "other-host" )
+            nwin = Race( study_dir , nproc , steal = True )
+            assert nwin == 1 , "stolen lock: %d workers claimed the shard" % nwin
+
+        # A status check must never make a claim fail
+        for n in range( 200 ):
+            Write_Dead_Lock( study_dir , socket.gethostname( ) )
+            nwin = Race( study_dir , nproc , probe = True )
+            assert nwin == 1 , "status check during the race: %d workers claimed the shard" % nwin
+
+        Write_Dead_Lock( study_dir , "other-host" )
+        assert Shard_Locked( study_dir , 0 )
+        assert Race( study_dir , nproc ) == 0 , "lock of another host taken without steal"
+        os.remove( Shard_File( study_dir , 0 , "lock" ) )
+
+        # A worker killed while holding its claim frees the shard
+        proc = mp.Process( target = Claim_Shard , args = ( study_dir , 0 ) )
+        proc.start( )
+        proc.join( )
+        assert not Shard_Locked( study_dir , 0 )
+        assert Race( study_dir , nproc ) == 1
+
+        assert Claim_Shard( study_dir , 0 )
+        assert Shard_Locked( study_dir , 0 )
+        Release_Shard( study_dir , 0 )
+        assert not os.path.exists( Shard_File( study_dir , 0 , "lock" ) )
+        assert not Shard_Locked( study_dir , 0 )
+
+    print( "Test_Sweep_Lock: all checks passed" )
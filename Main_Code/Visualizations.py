@@ -76,6 +76,117 @@ def parse_results_general( filename ):
     
     return time, x_res, v_res
 
+# Header of the binary trajectory files -> mirrors RK_Traj_Header in RK_Library.h
+TRAJ_MAGIC = b"DCTRAJ01"
+TRAJ_HEADER_SIZE = 4096
+TRAJ_HEADER_DTYPE = np.dtype( [ ( "magic" , "S8" ) ,
+                                ( "version" , np.int32 ) ,
+                                ( "ncol" , np.int32 ) ,
+                                ( "chunk_rows" , np.int32 ) ,
+                                ( "codec" , np.int32 ) ,
+                                ( "n_rows" , np.int64 ) ,
+                                ( "n_chunks" , np.int64 ) ,
+                                ( "index_offset" , np.int64 ) ,
+                                ( "err_tol" , np.float64 ) ,
+                                ( "pend_coeff" , np.float64 , ( 5 , ) ) ,
+                                ( "range_int" , np.float64 , ( 2 , ) ) ,
+                                ( "col_names" , "S64" , ( 32 , ) ) ,
+                                ( "dec_tol" , np.float64 ) ,
+                                ( "n_steps" , np.int64 ) ,
+                                ( "mant_bits" , np.int32 ) ,
+                                ( "reserved" , np.int32 ) ] )
+
+# Memory-mapped binary trajectory file written by DP45_Integrator_Bin
+# Opening only reads the header and the sparse time index, the data chunks are read by the OS on access
+# Compressed files (DP45_Integrator_Packed) are decoded at opening, one chunk at a time, by the streaming decoder of the library (Traj_Stream)
+# Inputs:
+# - filename of the binary trajectory file
+class Traj_File:
+
+    def __init__( self , filename ):
+
+        head = np.fromfile( filename , dtype = TRAJ_HEADER_DTYPE , count = 1 )
+        if len( head ) == 0 or head[ 0 ][ "magic" ] != TRAJ_MAGIC:
+            raise IOError( "Not a binary trajectory file: " + str( filename ) )
+        head = head[ 0 ]
+
+        self.ncol = int( head[ "ncol" ] )
+        self.chunk_rows = int( head[ "chunk_rows" ] )
+        self.n_rows = int( head[ "n_rows" ] )
+        self.n_chunks = int( head[ "n_chunks" ] )
+        self.err_tol = float( head[ "err_tol" ] )
+        self.pend_coeff = np.array( head[ "pend_coeff" ] )
+        self.range_int = np.array( head[ "range_int" ] )
+        self.col_names = [ name.decode( ) for name in head[ "col_names" ][ : self.ncol ] ]
+        self.codec = int( head[ "codec" ] )
+        self.dec_tol = float( head[ "dec_tol" ] )
+
+        # chunks[ i ][ j ] is column j of chunk i, index[ i ] is the time of the first row of chunk i
+        if self.codec != 0:
+            from RK_Driver import Traj_Stream
+            self.chunks = np.full( ( self.n_chunks , self.ncol , self.chunk_rows ) , np.nan )
+            for i_chunk , rows in enumerate( Traj_Stream( filename ) ):
+                self.chunks[ i_chunk , : , : len( rows ) ] = rows.T
+            self.index = self.chunks[ : , 0 , 0 ].copy( )
+        else:
+            self.chunks = np.memmap( filename , dtype = np.float64 , mode = "r" , offset = TRAJ_HEADER_SIZE , shape = ( self.n_chunks , self.ncol , self.chunk_rows ) )
+            self.index = np.memmap( filename , dtype = np.float64 , mode = "r" , offset = int( head[ "index_offset" ] ) , shape = ( self.n_chunks , ) )
+
+    # Return column j (0 is time) for all the rows as one array
+    def column( self , j ):
+
+        return self.chunks[ : , j , : ].reshape( -1 )[ : self.n_rows ]
+
+    # Return the row [ time , state ... ] with index i_row
+    def row( self , i_row ):
+
+        return np.array( self.chunks[ i_row // self.chunk_rows , : , i_row % self.chunk_rows ] )
+
+    # Find the index of the last row with time <= t_find (binary search over the sparse index and then inside one chunk)
+    # Returns -1 if t_find is before the first row
+    def find_time( self , t_find ):
+
+        i_chunk = int( np.searchsorted( self.index , t_find , side = "right" ) ) - 1
+        if i_chunk < 0:
+            return -1
+        n_in = min( self.chunk_rows , self.n_rows - i_chunk*self.chunk_rows )
+        i_in = int( np.searchsorted( self.chunks[ i_chunk , 0 , : n_in ] , t_find , side = "right" ) ) - 1
+
+        return i_chunk*self.chunk_rows + i_in
+
+    # Return the row at the last output time <= t_find (None if t_find is before the start)
+    def state_at( self , t_find ):
+
+        i_row = self.find_time( t_find )
+        return None if i_row < 0 else self.row( i_row )
+
+# Parse the results data for the pendulum results from a binary trajectory file (replaces parse_results_doublep)
+# Inputs:
+# - filename of the binary trajectory file
+# Output:
+# It will return arrays of [ time , theta , phi , om_theta , om_phi ] with the same dimensionality (number of points)
+def parse_results_doublep_bin( filename ):
+
+    traj = Traj_File( filename )
+
+    return tuple( traj.column( j ) for j in range( 5 ) )
+
+# Parse the results data from a binary trajectory file without assuming the phase space dimension (replaces parse_results_general)
+# Inputs:
+# - filename of the binary trajectory file
+# Outputs:
+# - time[ N ], x_res[ Nphase/2 ][ N ], v_res[ Nphase/2 ][ N ]
+def parse_results_general_bin( filename ):
+
+    traj = Traj_File( filename )
+    narr = ( traj.ncol - 1 )//2
+
+    time = traj.column( 0 )
+    x_res = np.array( [ traj.column( 1 + j ) for j in range( narr ) ] )
+    v_res = np.array( [ traj.column( 1 + narr + j ) for j in range( narr ) ] )
+
+    return time, x_res, v_res
+
 # Make a 2D plot of the angles and angular rates as functions of time
 # Inputs:
 # - time[ N ]: time array [sec] assumed
@@ -155,6 +266,30 @@ def plot_2D_phase( theta , phi , om_theta , om_phi , file_name ):
     
     plt.show()  
 
+# Make a Poincare section plot -> the states at the crossings of a section (e.g. from DP45_Integrator_Events) as points
+# Inputs:
+# - x_sec[ N ]: horizontal coordinate of the section points (e.g. phi [rad])
+# - y_sec[ N ]: vertical coordinate of the section points (e.g. om_phi [rad/s])
+# - labels: the 2 axis labels
+# - file_name: string which should contain "0" if no plot should be saved and the filename string if you want to save the figure in .pdf
+# Output:
+# - Show the section plot and optionally save it based on the name provided
+def plot_poincare( x_sec , y_sec , labels , file_name ):
+
+    fig, ax = plt.subplots()
+    ax.plot( x_sec , y_sec , color = "blue" , linestyle = "none" , marker = "." , markersize = 2 )
+
+    ax.set_xlabel( labels[ 0 ] )
+    ax.set_ylabel( labels[ 1 ] )
+
+    plt.grid( True )
+
+    if file_name != "0":
+        fname = "Poincare_Section_" + file_name + ".pdf"
+        fig.savefig( fname , format = "pdf" )
+    
+    plt.show()
+
 # Make a 2D plot of the total system energy as a function of time
 # Inputs:
 # - time[ N ]: time array [sec] assumed
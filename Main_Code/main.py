@@ -1,12 +1,12 @@
 # This is the primary Python file which is used to set the parameters, run the scripts and set the visualizations
 
-from RK_Driver import Test_Clib_Interface, Set_Pend_coeff, DP45_Integrator, RK4_Integrator
+from RK_Driver import Test_Clib_Interface, Set_Pend_coeff, RK4_Integrator, DP45_Integrator_Observables, Poincare_Event, DP45_Stream, RK_Integrator
 from numpy import pi
+from collections import deque
 import numpy as np
 from matplotlib import animation
 import matplotlib.pyplot as plt
-from Visualizations import plot_2D_time, parse_results_doublep, plot_2D_phase, plot_energy
-from scipy import interpolate
+from Visualizations import plot_2D_time, plot_2D_phase, plot_energy, plot_poincare
 
 # Get the integrator parameters and constants based on physical pendulum dimensions
 # Inputs:
@@ -57,6 +57,32 @@ def animate_phys( i ):
 
     return lines
 
+# Animate function for the live visualization -> takes the frames the integration thread has published since the last call
+# Inputs:
+# - int i: index of the animation (not used, the frames come from the stream)
+# Outputs:
+# - Outputs the anim lines
+def animate_live( i ):
+
+    # Frames are [ t , theta , phi , om_theta , om_phi , E_kin , E_pot , x_mid , y_mid , x_end , y_end ] -> None once the run has ended
+    frames = stream.poll( )
+    if frames is None or len( frames ) == 0:
+        return lines
+
+    # The trails are bounded deques, so the memory stays bounded for an unbounded run
+    x1.extend( frames[ : , 7 ] )
+    y1.extend( frames[ : , 8 ] + ltot )
+    x2.extend( frames[ : , 9 ] )
+    y2.extend( frames[ : , 10 ] + ltot )
+
+    xlist = [ x1 , x2 , [ 0 , x1[ - 1 ] ] , [ x1[ - 1 ] , x2[ - 1 ] ] ]
+    ylist = [ y1 , y2 , [ ltot , y1[ - 1 ] ] , [ y1[ - 1 ] , y2[ - 1 ] ] ]
+
+    for lnum,line in enumerate( lines ):
+        line.set_data( xlist[ lnum ] , ylist[ lnum ] )
+
+    return lines
+
 # Initialize the physical visualization of the pendulum plot
 def init_phys( ):
     for line in lines:
@@ -77,6 +103,7 @@ if __name__ == "__main__":
     # Simulation Initial and Accuracy Parameters to modify
     #########################################################
     err_tol = 1e-12 # Error Tolerance for the integrator
+    sec_tol = 1e-9 # Error Tolerance of the long Poincare section run
     range_int = [ 0.0 , 6.0*pi ] # Time range of integration in [sec]
     state_init = [ 1.0 , pi , 0.0 , 0.0 ] # Initial state [ theta_0 , phi_0 , om_th_0 , om_phi_0 ]
     #########################################################
@@ -85,6 +112,10 @@ if __name__ == "__main__":
     out_file = b"Test_Results.csv" # Filename for the output - must be binary
     header = b"T [time], Theta [rad], Phi [rad], Om_Theta [rad/s], Om_Phi [rad/s]" # Header for the output file
     #########################################################
+    # Animation details
+    #########################################################
+    live_anim = True # Stream the frames from an integration thread in real time (starts at once) - False to precompute them (needed for anim.save)
+    #########################################################
 
     ltot = l1 + l2
     pend_par = get_int_params( l1 , l2 , m1 , m2 , g_acc )
@@ -94,16 +125,13 @@ if __name__ == "__main__":
 
     Set_Pend_coeff( pend_par )
 
-    DP45_Integrator( err_tol , state_init , range_int , out_file , header )
-
-    time, theta, phi, om_theta, om_phi = parse_results_doublep( out_file )
-
-    # Compute the energy of the Pendulum (Kinetic, Potential and Total)
-    e_kin = [ 0 ]*len( time )
-    e_pot = [ 0 ]*len( time )
-    for j in range( 0 , len( time ) ):
-        e_kin[ j ] = pend_par[ 0 ]*om_theta[ j ]*om_theta[ j ] + pend_par[ 1 ]*om_phi[ j ]*om_phi[ j ] + pend_par[ 2 ]*np.cos( phi[ j ] - theta[ j ] )*om_theta[ j ]*om_phi[ j ]
-        e_pot[ j ] = - pend_par[ 3 ]*np.cos( theta[ j ] ) - pend_par[ 4 ]*np.cos( phi[ j ] )
+    # Integrate straight into memory - use DP45_Integrator( err_tol , state_init , range_int , out_file , header ) to also get the .csv file
+    # For very long horizons GL_Integrator_Array( dt , state_init , range_int ) keeps the energy error bounded
+    # The energy of the Pendulum (Kinetic and Potential) is computed inside the same integration at every accepted step, with the drift and flip counts
+    time, states, obs, obs_red = DP45_Integrator_Observables( err_tol , state_init , range_int , [ l1 , l2 ] , states = True )
+    theta, phi, om_theta, om_phi = states.T
+    e_kin, e_pot = obs[ : , 0 ], obs[ : , 1 ]
+    print( "Max |dE| = %.3e, flips theta / phi = %d / %d" % ( obs_red.e_drift , obs_red.n_flip_th , obs_red.n_flip_phi ) )
     
     #########################################################
     # Static plot of some of the results
@@ -114,35 +142,36 @@ if __name__ == "__main__":
     plot_2D_phase( theta , phi , om_theta , om_phi , "0" )
     # - 2D static plot of the energy as a function of time -> change last param to save as .pdf
     plot_energy( time , e_kin , e_pot , "0" )
+    # - Poincare section theta = 0 with om_theta > 0 -> only the crossings are stored, but every step is still taken, so the 10 times
+    #   longer run uses sec_tol to stay within the iteration cap of the integrator (at err_tol it stops after about a third of it)
+    range_sec = [ range_int[ 0 ] , 10.0*range_int[ 1 ] ]
+    time_sec, states_sec, _, _, summary_sec = RK_Integrator( sec_tol , pend_par ).integrate_events( state_init , range_sec , [ Poincare_Event( 0 ) ] )
+    if summary_sec[ 0 ] < range_sec[ 1 ]:
+        print( "WARNING: The Poincare section only covers t = %.3f out of %.3f, raise sec_tol or shorten the run" % ( summary_sec[ 0 ] , range_sec[ 1 ] ) )
+    plot_poincare( states_sec[ : , 1 ] , states_sec[ : , 3 ] , [ r"$\varphi$ [rad]" , r"$\dot{\varphi}$ [rad/s]" ] , "0" )
     #########################################################
 
     #########################################################
     # Animation of the physical pendulum results
     #########################################################
 
-    # Convert to physical positions of the end points of the first and second pendulum
-    x_mid_0 = l1*np.sin( theta )
-    y_mid_0 = - l1*np.cos( theta )
-    x_end_0 = x_mid_0 + l2*np.sin( phi )
-    y_end_0 = y_mid_0 - l2*np.cos( phi )
-
-    # Create a uniform time array with the range of time and points corresponding to roughly 100 per second of physical time
-    time_int = np.linspace( min( time ) , max( time ) , 100*int( max( time ) ) )
-    # Create the tck handles for the different functions
-    tck_xmid = interpolate.splrep( time , x_mid_0 , s = 0 )
-    tck_ymid = interpolate.splrep( time , y_mid_0 , s = 0 )
-    tck_xend = interpolate.splrep( time , x_end_0 , s = 0 )
-    tck_yend = interpolate.splrep( time , y_end_0 , s = 0 )
-
-    # Interpolate with the points based on time_int 
-    x_mid = interpolate.splev( time_int , tck_xmid , der = 0 )
-    y_mid = interpolate.splev( time_int , tck_ymid , der = 0 )
-    x_end = interpolate.splev( time_int , tck_xend , der = 0 )
-    y_end = interpolate.splev( time_int , tck_yend , der = 0 )
-    
-    fig = plt.figure( )
-    ax1 = plt.axes( xlim = ( min( [ min( x_end ) , min( x_mid ) ] ) - 0.1 , max( [ max( x_end ) , max( x_mid ) ] ) + 0.1 ) , 
-                    ylim = ( - 0.1 , max( [ max( y_end ) , l1 + l2 ] ) + 0.1 ) )
+    if live_anim:
+        # The integration runs on its own thread and publishes a frame every 1/100 s of physical time, paced to the wall clock
+        # -> the first frame is there within milliseconds and only the frames in the ring are kept, so range_int could even be [ 0 , np.inf ]
+        stream = DP45_Stream( err_tol , state_init , range_int , 0.01 , speed = 1.0 , lengths = [ l1 , l2 ] )
+        fig = plt.figure( )
+        ax1 = plt.axes( xlim = ( - ltot - 0.1 , ltot + 0.1 ) , ylim = ( - 0.1 , 2.0*ltot + 0.1 ) )
+    else:
+        # Create a uniform time array with the range of time and points corresponding to roughly 100 per second of physical time
+        time_int = np.linspace( min( time ) , max( time ) , 100*int( max( time ) ) )
+        # Get the physical positions of the end points of the first and second pendulum at these times from the dense output of the integrator
+        # (its own interpolant, no splines needed) -> they are computed in C, only the positions come back
+        _, obs_int, _ = DP45_Integrator_Observables( err_tol , state_init , range_int , [ l1 , l2 ] , time_int )
+        x_mid, y_mid, x_end, y_end = obs_int[ : , 2 ], obs_int[ : , 3 ], obs_int[ : , 4 ], obs_int[ : , 5 ]
+
+        fig = plt.figure( )
+        ax1 = plt.axes( xlim = ( min( [ min( x_end ) , min( x_mid ) ] ) - 0.1 , max( [ max( x_end ) , max( x_mid ) ] ) + 0.1 ) , 
+                        ylim = ( - 0.1 , max( [ max( y_end ) , l1 + l2 ] ) + 0.1 ) )
     line, = ax1.plot( [ ] , [ ] , lw = 1 )
     plt.xlabel( "X [m]" )
     plt.ylabel( "Y [m]" )
@@ -154,16 +183,26 @@ if __name__ == "__main__":
         lobj = ax1.plot( [ ] , [ ] , lw = lwvals[ index ] , color = plotcols[ index ] )[ 0 ]
         lines.append( lobj )
 
-    x1, y1 = [], []
-    x2, y2 = [], []
+    if live_anim:
+        # Keep the last 10 s of the trails
+        x1, y1 = deque( maxlen = 1000 ), deque( maxlen = 1000 )
+        x2, y2 = deque( maxlen = 1000 ), deque( maxlen = 1000 )
+
+        # Poll the stream at every redraw until the window is closed
+        anim = animation.FuncAnimation( fig , animate_live , init_func = init_phys , interval = 10 , blit = True , cache_frame_data = False )
+    else:
+        x1, y1 = [], []
+        x2, y2 = [], []
 
-    frame_num = len( time_int )
+        frame_num = len( time_int )
 
-    # Call the animator, blit=True means only re-draw the parts that have changed
-    anim = animation.FuncAnimation( fig , animate_phys , init_func = init_phys , frames = frame_num , interval = 10 , blit = True )
+        # Call the animator, blit=True means only re-draw the parts that have changed
+        anim = animation.FuncAnimation( fig , animate_phys , init_func = init_phys , frames = frame_num , interval = 10 , blit = True )
 
     # Currently gif comes out huge, should reduce its size
     #anim.save( "Test_Gif.gif" , writer = animation.PillowWriter( fps = 60 ) )
 
     plt.show()
+    if live_anim:
+        stream.close( )
     #########################################################
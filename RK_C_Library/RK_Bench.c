@@ -0,0 +1,643 @@
+/* Benchmark and work-precision suite for the RK library -> build with the Makefile in this folder (make bench) */
+/* It measures for the double Pendulum:
+    - RHS evaluations per second of RHS_Function_Coeff and of the batch kernels (RHS_Function_Batch / RHS_Function_Batch_Fast)
+    - work-precision tables (time, steps, RHS evaluations and error against a high-precision reference) of the adaptive
+      integrators over a range of err_tol and of RK4 (on the harmonic oscillator with its exact solution) over Npoints
+    - output throughput (bytes per second) of the .csv, binary and in-memory outputs and the end-to-end DP45_Integrator time
+    - size and time of the compressed binary output (lossless and decimated)
+    - scaling of the N-link Pendulum with the number of links (RHS time per link and DP45 time per step and link)
+   All the results are also kept as named metrics which can be saved and compared against a saved baseline (regression check) */
+/* Usage:
+    RK_Bench [ --quick ] [ --save <file> ] [ --baseline <file> ] [ --time-tol <frac> ] [ --tmpdir <dir> ]
+    - --quick: fewer tolerances and shorter runs (a few seconds in total)
+    - --save: write all the metrics as "name,kind,value" lines (the baseline format, with the mode of the run in its header)
+    - --baseline: compare against a saved file of the same mode (quick or full, their runs differ) -> the exit code is 2 if
+      anything regressed and 1 if the baseline can not be read or was saved in the other mode
+    - --time-tol: allowed relative slow-down of the timings before it counts as a regression (default 0.25)
+      -> single timings are noisy, so only the geometric mean of all the timing ratios can fail the comparison, the work
+         counts (steps, RHS evaluations) and the errors are compared one by one
+    - --tmpdir: folder for the output files of the throughput runs (default /tmp) */
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <vidanchev@uni-sofia.bg> wrote this file.  As long as you retain this notice you
+ * can do whatever you want with this stuff. If we meet some day, and you think
+ * this stuff is worth it, you can buy me a beer in return. Victor Ivaylov Danchev
+ * ----------------------------------------------------------------------------
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "RK_Library.h"
+
+#define Nrep_min 3 /* Minimum number of repetitions of every timed run -> the best time is kept */
+#define t_rep_min 0.2 /* Minimum total time in seconds spent on the repetitions of a timed run */
+#define Nmetric_max 512 /* Maximum number of metrics of a run (and of a baseline) */
+#define Nrhs_bench 2000000 /* RHS evaluations of the RHS throughput run */
+#define Nrhs_lane 256 /* States per call of the batch RHS throughput runs */
+#define err_floor 1e-13 /* Errors below this are round-off dominated and are not compared against the baseline */
+#define err_fac 2.0 /* Allowed growth of an error against the baseline before it counts as a regression */
+
+/* Kinds of metrics -> decides how they are compared against the baseline */
+#define BENCH_TIME 0 /* Time in seconds (lower is better, noisy) */
+#define BENCH_RATE 1 /* Throughput (higher is better, noisy) */
+#define BENCH_COUNT 2 /* Work count such as steps or RHS evaluations (lower is better, exact) */
+#define BENCH_ERR 3 /* Error against the reference (lower is better) */
+
+typedef struct {
+    char name[ 96 ]; /* Unique name of the metric like dp45.tol1e-08.time */
+    int kind; /* BENCH_* */
+    double value;
+} Bench_Metric;
+
+static Bench_Metric metrics[ Nmetric_max ]; /* Metrics of this run */
+static int Nmetric = 0;
+
+/* The embedded pairs of the library and their cost per step */
+static const struct {
+    const char *name;
+    int method; /* RK_METHOD_* */
+    int Ns; /* Number of stages */
+    int fsal; /* 1 if the last stage is the first one of the next step */
+} bench_methods[ ] = {
+    { "dp45" , RK_METHOD_DP45 , 7 , 1 },
+    { "tsit5" , RK_METHOD_TSIT5 , 7 , 1 },
+    { "verner65" , RK_METHOD_VERNER65 , 8 , 0 },
+    { "dop853" , RK_METHOD_DOP853 , 12 , 0 },
+};
+
+/* Double Pendulum of the benchmark -> regular (not chaotic) motion so that the errors are not amplified over the interval */
+static double pend_coeff[ 5 ] = { 1.0 , 0.7 , 1.2 , 9.0 , 5.0 };
+static double state_init[ 4 ] = { 1.0 , 0.5 , 0.0 , 0.0 };
+
+/* Monotonic wall-clock time in seconds */
+static double Bench_Now( ){
+
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC , &ts );
+    return ( double )ts.tv_sec + 1e-9*( double )ts.tv_nsec;
+}
+
+/* Add a metric to this run */
+static void Bench_Add( int kind , double value , const char* name ){
+
+    if( Nmetric == Nmetric_max ){
+        return;
+    }
+    snprintf( metrics[ Nmetric ].name , sizeof( metrics[ Nmetric ].name ) , "%s" , name );
+    metrics[ Nmetric ].kind = kind;
+    metrics[ Nmetric ].value = value;
+    Nmetric += 1;
+}
+
+/* Name of a metric of a table row as <prefix>.<tag><x>.<what> like dp45.tol1e-08.time */
+static const char* Bench_Name( char* name , const char* prefix , const char* tag , double x , const char* what ){
+
+    snprintf( name , 96 , "%s.%s%.0e.%s" , prefix , tag , x , what );
+    return name;
+}
+
+/* Largest absolute difference of two states */
+static double Bench_Err( int Nstate , double* x , double* y ){
+
+    int j;
+    double err = 0.0;
+
+    for( j = 0; j < Nstate; j++ ){
+        err = ( fabs( x[ j ] - y[ j ] ) > err ) ? fabs( x[ j ] - y[ j ] ) : err;
+    }
+
+    return err;
+}
+
+/* Final state and counts of a single adaptive integration (a one-run parameter sweep on the calling thread) */
+/* Outputs:
+    - state_final[ 4 ]: the state at the end
+    - summary[ 4 ]: [ t_final , accepted steps , rejected steps , max |E - E_0| ] */
+static int Bench_Final( RK_Context* ctx , double* range_int , double* state_final , double* summary ){
+
+    return ( RK_Context_Param_Sweep( ctx , 1 , 1 , 1 , pend_coeff , state_init , range_int , 1 , state_final , summary ) == 1 ) ? 0 : - 1;
+}
+
+/* Best time of repeated in-memory integrations with a context (rows kept in buf between the repetitions) */
+static double Bench_Time_DP45( RK_Context* ctx , double* range_int , RK_Buffer* buf ){
+
+    int n;
+    double t0, t1, t_best = HUGE_VAL, t_tot = 0.0;
+
+    for( n = 0; n < Nrep_min || t_tot < t_rep_min; n++ ){
+        t0 = Bench_Now( );
+        RK_Context_DP45_Buffer( ctx , state_init , range_int , buf );
+        t1 = Bench_Now( ) - t0;
+        t_best = ( t1 < t_best ) ? t1 : t_best;
+        t_tot += t1;
+    }
+
+    return t_best;
+}
+
+/* Throughput of the Right-Hand-Side of the double Pendulum */
+static void Bench_RHS( ){
+
+    int i, j, l, m;
+    double state[ 4 ], deriv[ 4 ], t0, t1, chk = 0.0,
+           lanes[ 4*Nrhs_lane ], derivs[ 4*Nrhs_lane ]; /* Structure-of-arrays states of the batch kernels */
+    const char *rhs_modes[ 3 ] = { "libm" , "fast" , "repro" }; /* Indexed by RK_RHS_* */
+    char name[ 96 ];
+
+    for( j = 0; j < 4; j++ ){
+        state[ j ] = state_init[ j ];
+    }
+
+    t0 = Bench_Now( );
+    for( i = 0; i < Nrhs_bench; i++ ){
+        RHS_Function_Coeff( state , deriv , pend_coeff );
+        /* Move the state a little so that the calls can not be merged */
+        for( j = 0; j < 4; j++ ){
+            state[ j ] += 1e-7*deriv[ j ];
+        }
+    }
+    t1 = Bench_Now( ) - t0;
+    chk = state[ 0 ];
+
+    printf( "RHS_Function_Coeff: %.3e evaluations/s (%.1f ns each, check %.3f)\n" , Nrhs_bench/t1 , 1e9*t1/Nrhs_bench , chk );
+    Bench_Add( BENCH_RATE , Nrhs_bench/t1 , "rhs.evals_per_s" );
+
+    /* The batch kernels on Nrhs_lane states at a time */
+    for( m = 0; m < 3; m++ ){
+        for( l = 0; l < Nrhs_lane; l++ ){
+            for( j = 0; j < 4; j++ ){
+                lanes[ j*Nrhs_lane + l ] = state_init[ j ] + 1e-3*l;
+            }
+        }
+        t0 = Bench_Now( );
+        for( i = 0; i < Nrhs_bench/Nrhs_lane; i++ ){
+            if( m == RK_RHS_LIBM ){
+                RHS_Function_Batch( Nrhs_lane , Nrhs_lane , lanes , derivs , pend_coeff );
+            }
+            else{
+                RHS_Function_Batch_Fast( Nrhs_lane , Nrhs_lane , lanes , derivs , pend_coeff , m == RK_RHS_REPRO );
+            }
+            for( j = 0; j < 4*Nrhs_lane; j++ ){
+                lanes[ j ] += 1e-7*derivs[ j ];
+            }
+        }
+        t1 = Bench_Now( ) - t0;
+        printf( "RHS_Function_Batch (%-5s): %.3e evaluations/s (%.1f ns each, check %.3f)\n" , rhs_modes[ m ] ,
+                Nrhs_bench/t1 , 1e9*t1/Nrhs_bench , lanes[ 0 ] );
+        snprintf( name , sizeof( name ) , "rhs_batch.%s.evals_per_s" , rhs_modes[ m ] );
+        Bench_Add( BENCH_RATE , Nrhs_bench/t1 , name );
+    }
+    printf( "\n" );
+
+}
+
+/* Work-precision tables of the adaptive integrators against a high-precision reference */
+static int Bench_Work_Precision( int quick ){
+
+    RK_Context *ctx;
+    RK_Buffer buf = { NULL , 0 , 0 , NULL , NULL }; /* Output rows of the timed runs -> grown by the library */
+    double range_int[ 2 ] = { 0.0 , quick ? 10.0 : 20.0 },
+           ref[ 4 ], ref_chk[ 4 ], state_final[ 4 ], summary[ 4 ],
+           t_run, err, n_rhs, err_tol;
+    char name[ 96 ];
+    int m, k, Nmethod = ( int )( sizeof( bench_methods )/sizeof( bench_methods[ 0 ] ) ),
+        k_max = quick ? 10 : 12; /* Tightest tolerance is 1e-k_max */
+
+    ctx = RK_Context_Create( 4 , 1e-15 , pend_coeff );
+    if( ctx == NULL ){
+        return -1;
+    }
+
+    /* Reference -> DOP853 at the tightest tolerance, checked against the next looser one */
+    RK_Context_Set_Method( ctx , RK_METHOD_DOP853 );
+    Bench_Final( ctx , range_int , ref , summary );
+    RK_Context_Set_Tolerance( ctx , 1e-14 );
+    Bench_Final( ctx , range_int , ref_chk , summary );
+    printf( "Reference: DOP853 at 1e-15 over [ %.1f , %.1f ], difference to 1e-14 is %.2e\n\n" , range_int[ 0 ] , range_int[ 1 ] ,
+            Bench_Err( 4 , ref , ref_chk ) );
+
+    printf( "%-9s %7s %11s %8s %6s %9s %10s %10s %9s\n" , "method" , "err_tol" , "time [ms]" , "steps" , "rej" , "RHS" , "steps/s" ,
+            "error" , "|dE|" );
+    for( m = 0; m < Nmethod; m++ ){
+        RK_Context_Set_Method( ctx , bench_methods[ m ].method );
+        for( k = 4; k <= k_max; k++ ){
+            err_tol = pow( 10.0 , - ( double )k );
+            RK_Context_Set_Tolerance( ctx , err_tol );
+
+            if( Bench_Final( ctx , range_int , state_final , summary ) != 0 ){
+                RK_Context_Free( ctx );
+                RK_Buffer_Free( &buf );
+                return -1;
+            }
+            /* RHS evaluations -> the initial one plus Ns - 1 per step (Ns for the tableaus without FSAL on accepted steps) */
+            n_rhs = 1.0 + ( bench_methods[ m ].Ns - 1 )*( summary[ 1 ] + summary[ 2 ] ) + ( bench_methods[ m ].fsal ? 0.0 : summary[ 1 ] );
+            err = Bench_Err( 4 , state_final , ref );
+            t_run = Bench_Time_DP45( ctx , range_int , &buf );
+
+            printf( "%-9s %7.0e %11.4f %8.0f %6.0f %9.0f %10.3e %10.3e %9.2e\n" , bench_methods[ m ].name , err_tol , 1e3*t_run ,
+                    summary[ 1 ] , summary[ 2 ] , n_rhs , ( summary[ 1 ] + summary[ 2 ] )/t_run , err , summary[ 3 ] );
+            Bench_Add( BENCH_TIME , t_run , Bench_Name( name , bench_methods[ m ].name , "tol" , err_tol , "time" ) );
+            Bench_Add( BENCH_COUNT , summary[ 1 ] + summary[ 2 ] , Bench_Name( name , bench_methods[ m ].name , "tol" , err_tol , "steps" ) );
+            Bench_Add( BENCH_COUNT , n_rhs , Bench_Name( name , bench_methods[ m ].name , "tol" , err_tol , "rhs" ) );
+            Bench_Add( BENCH_ERR , err , Bench_Name( name , bench_methods[ m ].name , "tol" , err_tol , "error" ) );
+        }
+        printf( "\n" );
+    }
+
+    RK_Context_Free( ctx );
+    RK_Buffer_Free( &buf );
+
+    return 0;
+}
+
+/* Work-precision table of RK4 -> it integrates the harmonic oscillator ( Om = 1 ) so the exact solution is the reference */
+static int Bench_RK4( int quick ){
+
+    RK_Buffer buf = { NULL , 0 , 0 , NULL , NULL };
+    double range_int[ 2 ] = { 0.0 , 20.0 },
+           ho_init[ 2 ] = { 1.0 , 0.0 },
+           ho_exact[ 2 ] = { cos( 20.0 ) , - sin( 20.0 ) },
+           t0, t1, t_best, t_tot, err;
+    char name[ 96 ];
+    int k, n, Npoints,
+        k_max = quick ? 5 : 6;
+
+    printf( "%-9s %7s %11s %10s %10s\n" , "RK4" , "Npoints" , "time [ms]" , "steps/s" , "error" );
+    for( k = 3; k <= k_max; k++ ){
+        Npoints = ( int )pow( 10.0 , ( double )k );
+        t_best = HUGE_VAL;
+        t_tot = 0.0;
+        for( n = 0; n < Nrep_min || t_tot < t_rep_min; n++ ){
+            t0 = Bench_Now( );
+            if( RK4_Integrator_Buffer( 2 , Npoints , ho_init , range_int , &buf ) < 0 ){
+                RK_Buffer_Free( &buf );
+                return -1;
+            }
+            t1 = Bench_Now( ) - t0;
+            t_best = ( t1 < t_best ) ? t1 : t_best;
+            t_tot += t1;
+        }
+        err = Bench_Err( 2 , buf.data + 3*( buf.n - 1 ) + 1 , ho_exact );
+
+        printf( "%-9s %7d %11.4f %10.3e %10.3e\n" , "rk4" , Npoints , 1e3*t_best , ( Npoints - 1 )/t_best , err );
+        Bench_Add( BENCH_TIME , t_best , Bench_Name( name , "rk4" , "n" , ( double )Npoints , "time" ) );
+        Bench_Add( BENCH_ERR , err , Bench_Name( name , "rk4" , "n" , ( double )Npoints , "error" ) );
+    }
+    printf( "\n" );
+
+    RK_Buffer_Free( &buf );
+
+    return 0;
+}
+
+/* Size of a file in bytes */
+static double Bench_File_Size( const char* file_name ){
+
+    struct stat st;
+
+    return ( stat( file_name , &st ) == 0 ) ? ( double )st.st_size : 0.0;
+}
+
+/* Output throughput of the .csv, binary and in-memory outputs, the end-to-end time of DP45_Integrator and the compressed output */
+static int Bench_Output( int quick , const char* tmpdir ){
+
+    RK_Context *ctx;
+    RK_Buffer buf = { NULL , 0 , 0 , NULL , NULL };
+    char csv_name[ 512 ], bin_name[ 512 ], pack_name[ 512 ],
+         header[ ] = "T [time], Theta [rad], Phi [rad], Om_Theta [rad/s], Om_Phi [rad/s]",
+         col_names[ ] = "t,theta,phi,om_theta,om_phi";
+    double range_int[ 2 ] = { 0.0 , quick ? 20.0 : 6.0*3.1415926536 },
+           err_tol = 1e-12, t0, t1, t_tot, t_csv, t_bin, t_buf, nbytes,
+           t_pack[ 2 ], pack_bytes[ 2 ],
+           pack_dec[ 2 ] = { 0.0 , 1e-6 }; /* Decimation tolerance of the compressed runs (the decimated one keeps 36 bits of mantissa) */
+    long rows = 0, pack_rows[ 2 ];
+    int n, i;
+
+    snprintf( csv_name , sizeof( csv_name ) , "%s/RK_Bench_out.csv" , tmpdir );
+    snprintf( bin_name , sizeof( bin_name ) , "%s/RK_Bench_out.bin" , tmpdir );
+    snprintf( pack_name , sizeof( pack_name ) , "%s/RK_Bench_out.pack" , tmpdir );
+
+    ctx = RK_Context_Create( 4 , err_tol , pend_coeff );
+    if( ctx == NULL ){
+        return -1;
+    }
+
+    /* End-to-end .csv run with the global settings as in main.py */
+    Set_Pend_coeff( pend_coeff );
+    Set_RK_Method( RK_METHOD_DP45 );
+    t_csv = HUGE_VAL;
+    t_tot = 0.0;
+    for( n = 0; n < Nrep_min || t_tot < t_rep_min; n++ ){
+        t0 = Bench_Now( );
+        DP45_Integrator( 4 , err_tol , state_init , range_int , csv_name , header );
+        t1 = Bench_Now( ) - t0;
+        t_csv = ( t1 < t_csv ) ? t1 : t_csv;
+        t_tot += t1;
+    }
+    nbytes = Bench_File_Size( csv_name );
+
+    t_bin = HUGE_VAL;
+    t_tot = 0.0;
+    for( n = 0; n < Nrep_min || t_tot < t_rep_min; n++ ){
+        t0 = Bench_Now( );
+        rows = RK_Context_DP45_Bin( ctx , state_init , range_int , bin_name , col_names );
+        t1 = Bench_Now( ) - t0;
+        t_bin = ( t1 < t_bin ) ? t1 : t_bin;
+        t_tot += t1;
+    }
+
+    for( i = 0; i < 2; i++ ){
+        t_pack[ i ] = HUGE_VAL;
+        t_tot = 0.0;
+        for( n = 0; n < Nrep_min || t_tot < t_rep_min; n++ ){
+            t0 = Bench_Now( );
+            pack_rows[ i ] = RK_Context_DP45_Packed( ctx , state_init , range_int , pack_name , col_names , pack_dec[ i ] , ( i == 0 ) ? 52 : 36 );
+            t1 = Bench_Now( ) - t0;
+            t_pack[ i ] = ( t1 < t_pack[ i ] ) ? t1 : t_pack[ i ];
+            t_tot += t1;
+        }
+        pack_bytes[ i ] = Bench_File_Size( pack_name );
+    }
+
+    t_buf = Bench_Time_DP45( ctx , range_int , &buf );
+
+    printf( "Output of DP45 at %.0e over [ 0 , %.2f ] -> %ld rows\n" , err_tol , range_int[ 1 ] , rows );
+    printf( "%-9s %11s %12s %12s\n" , "output" , "time [ms]" , "bytes" , "bytes/s" );
+    printf( "%-9s %11.4f %12.0f %12.3e\n" , "csv" , 1e3*t_csv , nbytes , nbytes/t_csv );
+    printf( "%-9s %11.4f %12.0f %12.3e\n" , "binary" , 1e3*t_bin , Bench_File_Size( bin_name ) , Bench_File_Size( bin_name )/t_bin );
+    printf( "%-9s %11.4f %12.0f %12.3e\n" , "memory" , 1e3*t_buf , 40.0*buf.n , 40.0*buf.n/t_buf );
+    printf( "%-9s %11.4f %12.0f %12.3e -> %.1f times smaller than the .csv\n" , "packed" , 1e3*t_pack[ 0 ] , pack_bytes[ 0 ] , pack_bytes[ 0 ]/t_pack[ 0 ] , nbytes/pack_bytes[ 0 ] );
+    printf( "%-9s %11.4f %12.0f %12.3e -> %.1f times smaller than the .csv (%ld rows, dec_tol %.0e, 36 bits)\n\n" , "decimated" , 1e3*t_pack[ 1 ] , pack_bytes[ 1 ] ,
+            pack_bytes[ 1 ]/t_pack[ 1 ] , nbytes/pack_bytes[ 1 ] , pack_rows[ 1 ] , pack_dec[ 1 ] );
+
+    Bench_Add( BENCH_TIME , t_csv , "dp45_integrator.end_to_end_time" );
+    Bench_Add( BENCH_RATE , nbytes/t_csv , "output.csv_bytes_per_s" );
+    Bench_Add( BENCH_RATE , Bench_File_Size( bin_name )/t_bin , "output.bin_bytes_per_s" );
+    Bench_Add( BENCH_RATE , 40.0*buf.n/t_buf , "output.mem_bytes_per_s" );
+    Bench_Add( BENCH_TIME , t_pack[ 0 ] , "output.packed_time" );
+    Bench_Add( BENCH_COUNT , pack_bytes[ 0 ] , "output.packed_bytes" );
+    Bench_Add( BENCH_TIME , t_pack[ 1 ] , "output.decimated_time" );
+    Bench_Add( BENCH_COUNT , pack_bytes[ 1 ] , "output.decimated_bytes" );
+
+    remove( csv_name );
+    remove( bin_name );
+    remove( pack_name );
+    RK_Context_Free( ctx );
+    RK_Buffer_Free( &buf );
+
+    return 0;
+}
+
+/* Scaling of the N-link Pendulum -> the RHS is O( N ), so the time per link should stay flat as N grows */
+/* Every run starts from the chain held straight at 1 rad and released, the integration covers a short fixed interval */
+static int Bench_Chain( int quick ){
+
+    RK_Chain *chain;
+    double *length, *state, *deriv, summary[ 4 ],
+           range_int[ 2 ] = { 0.0 , 0.5 },
+           t0, t1, t_rhs, t_best, t_tot;
+    char name[ 96 ];
+    int i, n, N, Nrhs,
+        N_max = quick ? 64 : 512;
+
+    length = ( double* )malloc( sizeof( double )*N_max );
+    state = ( double* )malloc( 2*sizeof( double )*N_max );
+    deriv = ( double* )malloc( 2*sizeof( double )*N_max );
+    if( length == NULL || state == NULL || deriv == NULL ){
+        free( length );
+        free( state );
+        free( deriv );
+        return -1;
+    }
+    printf( "%-9s %7s %10s %14s %8s %11s %15s %9s\n" , "chain" , "Nlink" , "RHS [ns]" , "RHS/link [ns]" , "steps" , "time [ms]" ,
+            "step/link [ns]" , "E drift" );
+    for( N = 2; N <= N_max; N *= 2 ){
+        for( i = 0; i < N; i++ ){
+            length[ i ] = 1.0/N; /* Also used as the masses -> a chain of total length and mass 1 for every N */
+        }
+        chain = RK_Chain_Create( N , length , length , NULL , 9.81 );
+        if( chain == NULL ){
+            free( length );
+            free( state );
+            free( deriv );
+            return -1;
+        }
+        for( i = 0; i < N; i++ ){
+            state[ i ] = 1.0;
+            state[ N + i ] = 0.0;
+        }
+
+        /* The RHS alone -> the same number of link updates for every N */
+        Nrhs = ( quick ? 1000000 : 4000000 )/N;
+        t0 = Bench_Now( );
+        for( n = 0; n < Nrhs; n++ ){
+            RK_Chain_RHS( chain , state , deriv );
+            /* Move the state a little so that the calls can not be merged */
+            state[ N ] += 1e-12*deriv[ N ];
+        }
+        t_rhs = ( Bench_Now( ) - t0 )/Nrhs;
+        state[ N ] = 0.0;
+
+        /* The integration (best of the repetitions) */
+        t_best = HUGE_VAL;
+        t_tot = 0.0;
+        for( n = 0; n < Nrep_min || t_tot < t_rep_min; n++ ){
+            t0 = Bench_Now( );
+            if( DP45_Chain_Integrator( chain , 1e-8 , state , range_int , 0 , NULL , NULL , NULL , summary ) < 0 ){
+                RK_Chain_Free( chain );
+                free( length );
+                free( state );
+                free( deriv );
+                return -1;
+            }
+            t1 = Bench_Now( ) - t0;
+            t_best = ( t1 < t_best ) ? t1 : t_best;
+            t_tot += t1;
+        }
+
+        printf( "%-9s %7d %10.1f %14.2f %8.0f %11.4f %15.2f %9.2e\n" , "dp45" , N , 1e9*t_rhs , 1e9*t_rhs/N , summary[ 1 ] + summary[ 2 ] ,
+                1e3*t_best , 1e9*t_best/( summary[ 1 ] + summary[ 2 ] )/N , summary[ 3 ] );
+        snprintf( name , sizeof( name ) , "chain.n%d.rhs_time" , N );
+        Bench_Add( BENCH_TIME , t_rhs , name );
+        snprintf( name , sizeof( name ) , "chain.n%d.time" , N );
+        Bench_Add( BENCH_TIME , t_best , name );
+        snprintf( name , sizeof( name ) , "chain.n%d.steps" , N );
+        Bench_Add( BENCH_COUNT , summary[ 1 ] + summary[ 2 ] , name );
+
+        RK_Chain_Free( chain );
+    }
+    printf( "\n" );
+
+    free( length );
+    free( state );
+    free( deriv );
+
+    return 0;
+}
+
+/* Write all the metrics of this run as "name,kind,value" lines after a header with the mode of the run (quick or full) */
+static int Bench_Save( const char* file_name , int quick ){
+
+    FILE *fp;
+    int i;
+
+    fp = fopen( file_name , "w" );
+    if( fp == NULL ){
+        printf( "ERROR: Could not write the metrics to %s \n" , file_name );
+        return -1;
+    }
+    fprintf( fp , "# RK_Bench metrics: name,kind,value (kind 0 time, 1 rate, 2 count, 3 error)\n" );
+    fprintf( fp , "# mode: %s\n" , quick ? "quick" : "full" );
+    for( i = 0; i < Nmetric; i++ ){
+        fprintf( fp , "%s,%d,%.17g\n" , metrics[ i ].name , metrics[ i ].kind , metrics[ i ].value );
+    }
+    fclose( fp );
+
+    return 0;
+}
+
+/* Compare the metrics of this run against a saved baseline */
+/* The counts and errors regress one by one, the timings (and rates) together through the geometric mean of their ratios */
+/* A quick run integrates over shorter intervals than a full one, so only a baseline of the same mode is compared */
+/* Output:
+    - the number of regressed metrics or -1 if the baseline could not be read or was saved in the other mode */
+static int Bench_Compare( const char* file_name , double time_tol , int quick ){
+
+    FILE *fp;
+    char line[ 256 ], mode[ 16 ] = "unknown", *name, *kind_s, *value_s;
+    double base, ratio,
+           log_sum = 0.0; /* Sum of the logarithms of the slow-down ratios of the timings and rates */
+    int i, kind, n_reg = 0, n_cmp = 0, n_time = 0, reg;
+    const char *status;
+
+    fp = fopen( file_name , "r" );
+    if( fp == NULL ){
+        printf( "ERROR: Could not read the baseline %s \n" , file_name );
+        return -1;
+    }
+    while( fgets( line , sizeof( line ) , fp ) != NULL && line[ 0 ] == '#' ){
+        if( sscanf( line , "# mode: %15s" , mode ) == 1 ){
+            break;
+        }
+    }
+    if( strcmp( mode , quick ? "quick" : "full" ) != 0 ){
+        printf( "ERROR: The baseline %s is from a %s run and this is a %s run, save a baseline in the same mode! \n" , file_name , mode ,
+                quick ? "quick" : "full" );
+        fclose( fp );
+        return -1;
+    }
+    rewind( fp );
+
+    printf( "Comparison against the baseline %s (timings allowed +%.0f%%)\n" , file_name , 100.0*time_tol );
+    printf( "%-36s %12s %12s %8s  %s\n" , "metric" , "baseline" , "current" , "ratio" , "status" );
+    while( fgets( line , sizeof( line ) , fp ) != NULL ){
+        if( line[ 0 ] == '#' || ( name = strtok( line , ",\n" ) ) == NULL || ( kind_s = strtok( NULL , ",\n" ) ) == NULL ||
+            ( value_s = strtok( NULL , ",\n" ) ) == NULL ){
+            continue;
+        }
+        kind = atoi( kind_s );
+        base = atof( value_s );
+        for( i = 0; i < Nmetric && strcmp( metrics[ i ].name , name ) != 0; i++ );
+        if( i == Nmetric ){
+            continue;
+        }
+
+        ratio = ( base != 0.0 ) ? metrics[ i ].value/base : 1.0;
+        reg = 0;
+        status = "ok";
+        switch( kind ){
+            case BENCH_TIME:
+            case BENCH_RATE:
+                if( ratio > 0.0 ){
+                    log_sum += ( kind == BENCH_TIME ) ? log( ratio ) : - log( ratio );
+                    n_time += 1;
+                }
+                if( ( kind == BENCH_TIME ) ? ( ratio > 1.0 + time_tol ) : ( ratio < 1.0/( 1.0 + time_tol ) ) ){
+                    status = "slower";
+                }
+                break;
+            case BENCH_COUNT:
+                reg = ( metrics[ i ].value > base );
+                if( metrics[ i ].value != base ){
+                    status = "changed";
+                }
+                break;
+            default:
+                reg = ( metrics[ i ].value > err_floor && metrics[ i ].value > err_fac*base );
+                break;
+        }
+        if( reg ){
+            status = "REGRESSION";
+        }
+        printf( "%-36s %12.4e %12.4e %8.3f  %s\n" , name , base , metrics[ i ].value , ratio , status );
+        n_reg += reg;
+        n_cmp += 1;
+    }
+    fclose( fp );
+
+    /* All the timings together */
+    ratio = ( n_time > 0 ) ? exp( log_sum/n_time ) : 1.0;
+    reg = ( ratio > 1.0 + time_tol );
+    printf( "%-36s %12s %12s %8.3f  %s\n" , "timings (geometric mean)" , "" , "" , ratio , reg ? "REGRESSION" : "ok" );
+    n_reg += reg;
+
+    printf( "\n%d metrics compared, %d regressions\n" , n_cmp , n_reg );
+
+    return n_reg;
+}
+
+int main( int argc , char** argv ){
+
+    int i, quick = 0, res = 0;
+    const char *save_name = NULL, *base_name = NULL, *tmpdir = "/tmp";
+    double time_tol = 0.25;
+
+    for( i = 1; i < argc; i++ ){
+        if( strcmp( argv[ i ] , "--quick" ) == 0 ){
+            quick = 1;
+        }
+        else if( strcmp( argv[ i ] , "--save" ) == 0 && i + 1 < argc ){
+            save_name = argv[ ++i ];
+        }
+        else if( strcmp( argv[ i ] , "--baseline" ) == 0 && i + 1 < argc ){
+            base_name = argv[ ++i ];
+        }
+        else if( strcmp( argv[ i ] , "--time-tol" ) == 0 && i + 1 < argc ){
+            time_tol = atof( argv[ ++i ] );
+        }
+        else if( strcmp( argv[ i ] , "--tmpdir" ) == 0 && i + 1 < argc ){
+            tmpdir = argv[ ++i ];
+        }
+        else{
+            printf( "Usage: %s [ --quick ] [ --save <file> ] [ --baseline <file> ] [ --time-tol <frac> ] [ --tmpdir <dir> ]\n" , argv[ 0 ] );
+            return 1;
+        }
+    }
+
+    Set_RK_Coeff( );
+
+    Bench_RHS( );
+    if( Bench_Work_Precision( quick ) != 0 || Bench_RK4( quick ) != 0 || Bench_Output( quick , tmpdir ) != 0 || Bench_Chain( quick ) != 0 ){
+        printf( "ERROR: A benchmark run failed! \n" );
+        return 1;
+    }
+
+    if( save_name != NULL && Bench_Save( save_name , quick ) != 0 ){
+        return 1;
+    }
+
+    if( base_name != NULL ){
+        res = Bench_Compare( base_name , time_tol , quick );
+        if( res != 0 ){
+            return ( res < 0 ) ? 1 : 2;
+        }
+    }
+
+    return 0;
+}
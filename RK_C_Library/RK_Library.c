@@ -13,7 +13,16 @@ the actual integrator is independent of them. Change the RHS functions to change
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
+#include <float.h>
+#include <time.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include "RK_Library.h"
 #define PI 3.1415926536 /* I 8 sum ... and it was delicious */
 #define Om 1.0 /* Angular frequency of the oscillator FOR TESTING PURPOSES */
 #define Nloop_max 1e5 /* Maximum number of iterations for the Dormand-Prince loop regardless of step */
@@ -22,110 +31,596 @@ the actual integrator is independent of them. Change the RHS functions to change
 #define p_loss ( - 0.2 ) /* Proportional "loss" for step increase (in power of error ratio) */
 #define i_gain ( - 0.08 ) /* Integral gain for step decrease (in power of error ratio) */
 #define step_mrat 8.0 /* Maximum ratio of the new step with respect to the previous one (increase) */
+#define Nbatch_max 256 /* Maximum number of lanes (trajectories integrated side by side) in the batch Dormand-Prince */
+#define Nthread_max 256 /* Maximum number of worker threads for the parameter sweeps */
+#define GL_NSTAGE_MAX 3 /* Maximum number of stages of the Gauss-Legendre collocation methods (order 2*Nstage) */
+#define GL_iter_max 50 /* Maximum number of fixed-point iterations for the implicit stages of a single Gauss-Legendre step */
+#define GL_iter_tol 1e-15 /* Relative change of the stage increments where the fixed-point iteration is considered converged */
+#define LYAP_NSTATE 20 /* State of the Lyapunov spectrum integration -> the double Pendulum state and its 4 tangent vectors */
+#define Lyap_loop_max 1e9 /* Maximum number of steps of a Lyapunov spectrum integration (these are long by construction) */
+#define Event_iter_max 100 /* Maximum number of root-finding iterations when locating an event inside a step */
+#define RK_NSTAGE_MAX 12 /* Maximum number of stages of the embedded Runge-Kutta pairs (DOP853) */
+#define RK_TAB_CUSTOM 0 /* Id of a tableau without specialized kernels -> always integrated with the generic path (the others are RK_METHOD_*) */
+#define RK_SINCOS_XMAX 1e6 /* Largest |angle| for the vectorized sincos (the reduction by pi/2 is exact below it) -> libm above */
+#define RK_ASYNC_BLOCK_ROWS 4096 /* Rows per block handed to the background output writer */
+#define RK_ASYNC_NBLOCK 4 /* Blocks in the ring between the integration and the writer thread (double buffering and some slack) */
+#define RK_ASYNC_SPIN 256 /* Polls of the ring before a waiting side starts to sleep */
+#define RK_STREAM_CHUNK 32 /* Frames integrated per chunk of a real-time stream -> the latency of the first frame is one chunk */
+#define RK_TRAJ_DEC_WINDOW 64 /* Maximum number of consecutive accepted steps dropped by the decimation of the compressed output */
+#define RK_MC_MAGIC "DCMCST01" /* First 8 bytes of a saved Monte Carlo statistics file */
 
-/* Some global variables which will be used for the integrators */
-double DPc[ 7 ], /* Time-step coefficients {ci} from the Butcher Tableu */
-       DPb[ 2 ][ 7 ], /* 4th and 5th order final weights {bi} and {b*i} from the Butcher Tableu */
-       DPa[ 7 ][ 7 ], /* k computation weights {a_ij} -> Only the non-zero ones from the Butcher Tableu */
-       DPec[ 7 ];  /* bi-b*i -> error coefficient constants (to avoid computation in each step) */
+/* Dormand-Prince 4-5th order Butcher tableau as compile-time constants -> used to fill RK_Tableau and directly in the specialized kernels */
+/* NOTE: Only the non-zero coefficients are listed, the specialized kernels skip the rest altogether */
+#define DP45_C1 ( 1.0/5.0 )
+#define DP45_C2 ( 3.0/10.0 )
+#define DP45_C3 ( 4.0/5.0 )
+#define DP45_C4 ( 8.0/9.0 )
+#define DP45_A10 ( 1.0/5.0 )
+#define DP45_A20 ( 3.0/40.0 )
+#define DP45_A21 ( 9.0/40.0 )
+#define DP45_A30 ( 44.0/45.0 )
+#define DP45_A31 ( - 56.0/15.0 )
+#define DP45_A32 ( 32.0/9.0 )
+#define DP45_A40 ( 19372.0/6561.0 )
+#define DP45_A41 ( - 25360.0/2187.0 )
+#define DP45_A42 ( 64448.0/6561.0 )
+#define DP45_A43 ( - 212.0/729.0 )
+#define DP45_A50 ( 9017.0/3168.0 )
+#define DP45_A51 ( - 355.0/33.0 )
+#define DP45_A52 ( 46732.0/5247.0 )
+#define DP45_A53 ( 49.0/176.0 )
+#define DP45_A54 ( - 5103.0/18656.0 )
+#define DP45_B0 ( 35.0/384.0 ) /* Final weights {bi} -> also the last row of {a_ij} (First Same As Last) */
+#define DP45_B2 ( 500.0/1113.0 )
+#define DP45_B3 ( 125.0/192.0 )
+#define DP45_B4 ( - 2187.0/6784.0 )
+#define DP45_B5 ( 11.0/84.0 )
+#define DP45_E0 ( 5179.0/57600.0 ) /* Embedded weights {b*i} */
+#define DP45_E2 ( 7571.0/16695.0 )
+#define DP45_E3 ( 393.0/640.0 )
+#define DP45_E4 ( - 92097.0/339200.0 )
+#define DP45_E5 ( 187.0/2100.0 )
+#define DP45_E6 ( 1.0/40.0 )
 
-/* Some global variables which will be used for the pendulum characteristics */
-double a_th = 1.0, /* a_{\theta} coefficient in the Lagrangian (term in front of \theta^2) */
-       a_phi = 1.0, /* a_{\varphi} coefficient in the Lagrangian (term in front of \phi^2) */
-       a_mix = 1.0, /* a_{\mix} coefficient in the Lagrangian (term in front of the mixed cosines) */
-       b_th = 1.0, /* b_{\theta} coefficient in the Lagrangian  */
-       b_phi = 1.0; /* b_{\varphi} coefficient in the Lagrangian  */
+/* Constants of the vectorized sincos (fdlibm): pi/2 split into exactly representable parts for the reduction of the
+   argument to [ -pi/4 , pi/4 ] and the minimax polynomials of sin and cos there */
+#define SC_2_PI 6.36619772367581382433e-01 /* 2/pi */
+#define SC_ROUND 6755399441055744.0 /* 1.5*2^52 -> adding and subtracting it rounds to the nearest integer */
+#define SC_PIO2_1 1.57079632673412561417e+00 /* First 33 bits of pi/2 */
+#define SC_PIO2_2 6.07710050630396597660e-11 /* Next 33 bits of pi/2 */
+#define SC_PIO2_2T 2.02226624879595063154e-21 /* pi/2 - SC_PIO2_1 - SC_PIO2_2 */
+#define SC_S1 ( - 1.66666666666666324348e-01 )
+#define SC_S2 8.33333333332248946124e-03
+#define SC_S3 ( - 1.98412698298579493134e-04 )
+#define SC_S4 2.75573137070700676789e-06
+#define SC_S5 ( - 2.50507602534068634195e-08 )
+#define SC_S6 1.58969099521155010221e-10
+#define SC_C1 4.16666666666666019037e-02
+#define SC_C2 ( - 1.38888888888741095749e-03 )
+#define SC_C3 2.48015872894767294178e-05
+#define SC_C4 ( - 2.75573143513906633035e-07 )
+#define SC_C5 2.08757232129817482790e-09
+#define SC_C6 ( - 1.13596475577881948265e-11 )
 
-/* Populate the Runge-Kutta constants for integration
- - currently hardcoded for 4-5th order Dormand Prince adaptive step with embedded error estimation */
-/* NOTE: Must be performed before any integrations with Dormand-Prince are performed!!! */
-void Set_RK_Coeff( ){
+/* Constants of the single precision sincos (cephes sinf/cosf): pi/2 in 3 parts and the minimax polynomials on [ -pi/4 , pi/4 ] */
+#define SCF_2_PI 0.636619772f /* 2/pi */
+#define SCF_ROUND 12582912.0f /* 1.5*2^23 -> adding and subtracting it rounds to the nearest integer */
+#define SCF_PIO2_1 1.5703125f /* First 8 bits of pi/2 */
+#define SCF_PIO2_2 4.837512969970703125e-4f /* Next 11 bits */
+#define SCF_PIO2_3 7.54978995489188216e-8f /* Rest of pi/2 */
+#define SCF_S1 ( - 1.6666654611e-1f )
+#define SCF_S2 8.3321608736e-3f
+#define SCF_S3 ( - 1.9515295891e-4f )
+#define SCF_C1 4.166664568298827e-2f
+#define SCF_C2 ( - 1.388731625493765e-3f )
+#define SCF_C3 2.443315711809948e-5f
+
+/* Force the inlining of the small helpers into the specialized kernels so the stages stay in registers */
+#if defined( __GNUC__ )
+    #define RK_INLINE static inline __attribute__(( always_inline ))
+#else
+    #define RK_INLINE static inline
+#endif
+
+/* Vectorized kernels -> with GCC on x86-64 Linux they are compiled for AVX-512, AVX2 + FMA and the baseline SSE2 and the
+   best one for the CPU is picked when the library is loaded. Other compilers get a single (baseline) version. */
+/* NOTE: RK_SIMD_EXACT kernels are not allowed to fuse a*b + c into FMA, so all the versions give bitwise identical results */
+#if defined( __GNUC__ ) && !defined( __clang__ ) && defined( __x86_64__ ) && defined( __linux__ )
+    #define RK_SIMD_CLONES __attribute__(( target_clones( "arch=x86-64-v4" , "arch=x86-64-v3" , "default" ) , \
+                                           optimize( "tree-vectorize" , "vect-cost-model=dynamic" ) ))
+    #define RK_SIMD_EXACT __attribute__(( target_clones( "arch=x86-64-v4" , "arch=x86-64-v3" , "default" ) , \
+                                          optimize( "tree-vectorize" , "vect-cost-model=dynamic" , "fp-contract=off" ) ))
+#else
+    #define RK_SIMD_CLONES
+    #define RK_SIMD_EXACT
+#endif
+
+/* Butcher tableau of the embedded Runge-Kutta pair together with its dense output coefficients */
+typedef struct {
+    double c[ RK_NSTAGE_MAX ], /* Time-step coefficients {ci} from the Butcher Tableu */
+           b[ 2 ][ RK_NSTAGE_MAX ], /* Final weights {bi} of the propagated solution and {b*i} of the embedded one from the Butcher Tableu */
+           a[ RK_NSTAGE_MAX ][ RK_NSTAGE_MAX ], /* k computation weights {a_ij} -> Only the non-zero ones from the Butcher Tableu */
+           ec[ RK_NSTAGE_MAX ],  /* bi-b*i -> error coefficient constants (to avoid computation in each step) */
+           ec3[ RK_NSTAGE_MAX ],  /* Coefficients of a second (lower order) error estimate, only used if Nerr == 2 (DOP853) */
+           d[ 7 ]; /* Dense output coefficients {di} of the 4th order continuous extension (Hairer & Wanner) */
+    double ctrl_p, /* Proportional gain of the step controller for this order (p_gain for the 5th order pairs) */
+           ctrl_l, /* Proportional "loss" after a rejected step (p_loss for the 5th order pairs) */
+           ctrl_i; /* Integral gain of the step controller (i_gain for the 5th order pairs) */
+    int Ns, /* Number of stages */
+        fsal, /* 1 if the last stage is evaluated at the new state (First Same As Last) -> its RHS is reused by the next step */
+        Nerr, /* Number of error estimates -> 1: |ec.k|, 2: the combined 5th/3rd order estimate of DOP853 */
+        dense, /* 1 if the tableau has the dense output coefficients {di} */
+        id; /* Which tableau this is (RK_METHOD_* or RK_TAB_CUSTOM) -> selects the specialized step kernels */
+} RK_Tableau;
+
+/* Integrator context -> owns everything a single integration configuration needs (opaque in RK_Library.h) */
+/* NOTE: Different contexts never share any state, a single context should be used by one thread at a time */
+struct RK_Context {
+    int Nstate; /* Phase space dimension */
+    double err_tol; /* Error tolerance per step */
+    double pend_coeff[ 5 ]; /* Pendulum coefficients a_th to b_phi in sequence (same order as in Set_Pend_coeff) */
+    RK_Tableau tab; /* Tableau of the Dormand-Prince method */
+    void *batch_work; /* Scratch storage of the batch integrator, kept between the calls (allocated on first use) */
+    size_t batch_work_size; /* Size of batch_work in bytes */
+    RK_Stats *stats; /* Statistics of the last run -> stats_own for the created contexts and the global ones for RK_Default */
+    RK_Stats stats_own; /* Storage of the statistics of a created context */
+    int rhs_mode; /* RK_RHS_* kernel of the batch integrator */
+};
+
+/* Default context behind the original interface (Set_RK_Coeff, Set_Pend_coeff, DP45_Integrator, ...) */
+/* NOTE: The pendulum coefficients are defaulted to 1.0 until Set_Pend_coeff is called and the tableau is empty until Set_RK_Coeff */
+static RK_Stats RK_Default_Stats; /* Statistics of the last run of the original interface */
+static RK_Context RK_Default = { 4 , 1e-12 , { 1.0 , 1.0 , 1.0 , 1.0 , 1.0 } , { { 0.0 } } , NULL , 0 , &RK_Default_Stats };
+
+/* Number of singular LHS (detA) warnings of the RHS on this thread -> read before and after a run for the statistics */
+static _Thread_local long RK_Singular_Count = 0;
+
+/* Populate a tableau with the Runge-Kutta constants for integration
+ - 4-5th order Dormand Prince adaptive step with embedded error estimation */
+/* Inputs:
+    - tab: the tableau to fill (all the coefficients which are not set are zero) */
+static void RK_Tableau_DP45( RK_Tableau* tab ){
 
     int i;
 
+    memset( tab , 0 , sizeof( RK_Tableau ) );
+
     /* Set Coefficients for Dormand-Prince Method (or another 4+5th order method) */
     /* Time-step coefficients {ci} */
-    DPc[ 0 ] = 0.0;
-    DPc[ 1 ] = 1.0/5.0;
-    DPc[ 2 ] = 3.0/10.0;
-    DPc[ 3 ] = 4.0/5.0;
-    DPc[ 4 ] = 8.0/9.0;
-    DPc[ 5 ] = 1.0;
-    DPc[ 6 ] = 1.0;
+    tab->c[ 0 ] = 0.0;
+    tab->c[ 1 ] = DP45_C1;
+    tab->c[ 2 ] = DP45_C2;
+    tab->c[ 3 ] = DP45_C3;
+    tab->c[ 4 ] = DP45_C4;
+    tab->c[ 5 ] = 1.0;
+    tab->c[ 6 ] = 1.0;
 
     /* 4th order final weights {bi} */
-    DPb[ 0 ][ 0 ] = 35.0/384.0;
-    DPb[ 0 ][ 1 ] = 0.0;
-    DPb[ 0 ][ 2 ] = 500.0/1113.0;
-    DPb[ 0 ][ 3 ] = 125.0/192.0;
-    DPb[ 0 ][ 4 ] = - 2187.0/6784.0;
-    DPb[ 0 ][ 5 ] = 11.0/84.0;
-    DPb[ 0 ][ 6 ] = 0.0;
+    tab->b[ 0 ][ 0 ] = DP45_B0;
+    tab->b[ 0 ][ 1 ] = 0.0;
+    tab->b[ 0 ][ 2 ] = DP45_B2;
+    tab->b[ 0 ][ 3 ] = DP45_B3;
+    tab->b[ 0 ][ 4 ] = DP45_B4;
+    tab->b[ 0 ][ 5 ] = DP45_B5;
+    tab->b[ 0 ][ 6 ] = 0.0;
 
     /* 5th order final weights {b*i} */
-    DPb[ 1 ][ 0 ] = 5179.0/57600.0;
-    DPb[ 1 ][ 1 ] = 0.0;
-    DPb[ 1 ][ 2 ] = 7571.0/16695.0;
-    DPb[ 1 ][ 3 ] = 393.0/640.0;
-    DPb[ 1 ][ 4 ] = - 92097.0/339200.0;
-    DPb[ 1 ][ 5 ] = 187.0/2100.0;
-    DPb[ 1 ][ 6 ] = 1.0/40.0;
+    tab->b[ 1 ][ 0 ] = DP45_E0;
+    tab->b[ 1 ][ 1 ] = 0.0;
+    tab->b[ 1 ][ 2 ] = DP45_E2;
+    tab->b[ 1 ][ 3 ] = DP45_E3;
+    tab->b[ 1 ][ 4 ] = DP45_E4;
+    tab->b[ 1 ][ 5 ] = DP45_E5;
+    tab->b[ 1 ][ 6 ] = DP45_E6;
 
     /* Compute Error Coefficients */
     for( i = 0; i < 7; i++ ){
-        DPec[ i ] = DPb[ 0 ][ i ] - DPb[ 1 ][ i ];
+        tab->ec[ i ] = tab->b[ 0 ][ i ] - tab->b[ 1 ][ i ];
     }
 
     /* k computation weights -> Only the non-zero ones  */
-    DPa[ 1 ][ 0 ] = 1.0/5.0;
-    DPa[ 2 ][ 0 ] = 3.0/40.0;
-    DPa[ 2 ][ 1 ] = 9.0/40.0;
-    DPa[ 3 ][ 0 ] = 44.0/45.0;
-    DPa[ 3 ][ 1 ] = - 56.0/15.0;
-    DPa[ 3 ][ 2 ] = 32.0/9.0;
-    DPa[ 4 ][ 0 ] = 19372.0/6561.0;
-    DPa[ 4 ][ 1 ] = - 25360.0/2187.0;
-    DPa[ 4 ][ 2 ] = 64448.0/6561.0;
-    DPa[ 4 ][ 3 ] = - 212.0/729.0;
-    DPa[ 5 ][ 0 ] = 9017.0/3168.0;
-    DPa[ 5 ][ 1 ] = - 355.0/33.0;
-    DPa[ 5 ][ 2 ] = 46732.0/5247.0;
-    DPa[ 5 ][ 3 ] = 49.0/176.0;
-    DPa[ 5 ][ 4 ] = - 5103.0/18656.0;
-    DPa[ 6 ][ 0 ] = 35.0/384.0;
-    DPa[ 6 ][ 1 ] = 0.0;
-    DPa[ 6 ][ 2 ] = 500.0/1113.0;
-    DPa[ 6 ][ 3 ] = 125.0/192.0;
-    DPa[ 6 ][ 4 ] = - 2187.0/6784.0;
-    DPa[ 6 ][ 5 ] = 11.0/84.0;
+    tab->a[ 1 ][ 0 ] = DP45_A10;
+    tab->a[ 2 ][ 0 ] = DP45_A20;
+    tab->a[ 2 ][ 1 ] = DP45_A21;
+    tab->a[ 3 ][ 0 ] = DP45_A30;
+    tab->a[ 3 ][ 1 ] = DP45_A31;
+    tab->a[ 3 ][ 2 ] = DP45_A32;
+    tab->a[ 4 ][ 0 ] = DP45_A40;
+    tab->a[ 4 ][ 1 ] = DP45_A41;
+    tab->a[ 4 ][ 2 ] = DP45_A42;
+    tab->a[ 4 ][ 3 ] = DP45_A43;
+    tab->a[ 5 ][ 0 ] = DP45_A50;
+    tab->a[ 5 ][ 1 ] = DP45_A51;
+    tab->a[ 5 ][ 2 ] = DP45_A52;
+    tab->a[ 5 ][ 3 ] = DP45_A53;
+    tab->a[ 5 ][ 4 ] = DP45_A54;
+    tab->a[ 6 ][ 0 ] = DP45_B0;
+    tab->a[ 6 ][ 1 ] = 0.0;
+    tab->a[ 6 ][ 2 ] = DP45_B2;
+    tab->a[ 6 ][ 3 ] = DP45_B3;
+    tab->a[ 6 ][ 4 ] = DP45_B4;
+    tab->a[ 6 ][ 5 ] = DP45_B5;
+
+    /* Dense output coefficients for the continuous extension between the accepted steps */
+    tab->d[ 0 ] = - 12715105075.0/11282082432.0;
+    tab->d[ 1 ] = 0.0;
+    tab->d[ 2 ] = 87487479700.0/32700410799.0;
+    tab->d[ 3 ] = - 10690763975.0/1880347072.0;
+    tab->d[ 4 ] = 701980252875.0/199316789632.0;
+    tab->d[ 5 ] = - 1453857185.0/822651844.0;
+    tab->d[ 6 ] = 69997945.0/29380423.0;
+
+    tab->ctrl_p = p_gain;
+    tab->ctrl_l = p_loss;
+    tab->ctrl_i = i_gain;
+    tab->Ns = 7;
+    tab->fsal = 1;
+    tab->Nerr = 1;
+    tab->dense = 1;
+    tab->id = RK_METHOD_DP45;
 
 }
 
-/* Prinout the Runge-Kutta constants for integration to check that they are set appropriately */
-void Check_RK_Coeff( ){
+/* Populate a tableau with the Tsitouras 5(4) pair -> same cost as Dormand-Prince (7 stages, FSAL) with smaller error constants */
+/* NOTE: The coefficients are the double precision values published by Tsitouras (2011), there is no dense output for this tableau */
+/* Inputs:
+    - tab: the tableau to fill (all the coefficients which are not set are zero) */
+static void RK_Tableau_Tsit5( RK_Tableau* tab ){
 
     int i;
 
-    printf( "DPc[ 7 ] coefficients are: " );
+    memset( tab , 0 , sizeof( RK_Tableau ) );
+
+    /* Time-step coefficients {ci} */
+    tab->c[ 1 ] = 0.161;
+    tab->c[ 2 ] = 0.327;
+    tab->c[ 3 ] = 0.9;
+    tab->c[ 4 ] = 0.9800255409045097;
+    tab->c[ 5 ] = 1.0;
+    tab->c[ 6 ] = 1.0;
+
+    /* k computation weights -> Only the non-zero ones */
+    tab->a[ 1 ][ 0 ] = 0.161;
+    tab->a[ 2 ][ 0 ] = - 0.008480655492356989;
+    tab->a[ 2 ][ 1 ] = 0.335480655492357;
+    tab->a[ 3 ][ 0 ] = 2.897153057105493;
+    tab->a[ 3 ][ 1 ] = - 6.359448489975075;
+    tab->a[ 3 ][ 2 ] = 4.3622954328695815;
+    tab->a[ 4 ][ 0 ] = 5.325864828439257;
+    tab->a[ 4 ][ 1 ] = - 11.748883564062828;
+    tab->a[ 4 ][ 2 ] = 7.4955393428898365;
+    tab->a[ 4 ][ 3 ] = - 0.09249506636175525;
+    tab->a[ 5 ][ 0 ] = 5.86145544294642;
+    tab->a[ 5 ][ 1 ] = - 12.92096931784711;
+    tab->a[ 5 ][ 2 ] = 8.159367898576159;
+    tab->a[ 5 ][ 3 ] = - 0.071584973281401;
+    tab->a[ 5 ][ 4 ] = - 0.028269050394068383;
+    tab->a[ 6 ][ 0 ] = 0.09646076681806523;
+    tab->a[ 6 ][ 1 ] = 0.01;
+    tab->a[ 6 ][ 2 ] = 0.4798896504144996;
+    tab->a[ 6 ][ 3 ] = 1.379008574103742;
+    tab->a[ 6 ][ 4 ] = - 3.290069515436081;
+    tab->a[ 6 ][ 5 ] = 2.324710524099774;
+
+    /* Error coefficient constants {bi-b*i} */
+    tab->ec[ 0 ] = - 0.00178001105222577714;
+    tab->ec[ 1 ] = - 0.0008164344596567469;
+    tab->ec[ 2 ] = 0.007880878010261995;
+    tab->ec[ 3 ] = - 0.1447110071732629;
+    tab->ec[ 4 ] = 0.5823571654525552;
+    tab->ec[ 5 ] = - 0.45808210592918697;
+    tab->ec[ 6 ] = 1.0/66.0;
+
+    /* 5th order final weights {bi} are the last row of {a_ij} (First Same As Last) and the 4th order ones follow from the error coefficients */
     for( i = 0; i < 7; i++ ){
-        printf( "%.10e \n" , DPc[ i ] );
+        tab->b[ 0 ][ i ] = tab->a[ 6 ][ i ];
+        tab->b[ 1 ][ i ] = tab->b[ 0 ][ i ] - tab->ec[ i ];
     }
 
-    printf( "DPb[ 2 ][ 7 ] coefficients are ( DPb[ 0 ][ i ] , DPb[ 1 ][ i ] ): " );
-    for( i = 0; i < 7; i++ ){
-        printf( "%.10e, %.10e \n" , DPb[ 0 ][ i ] , DPb[ 1 ][ i ] );
+    tab->ctrl_p = p_gain;
+    tab->ctrl_l = p_loss;
+    tab->ctrl_i = i_gain;
+    tab->Ns = 7;
+    tab->fsal = 1;
+    tab->Nerr = 1;
+    tab->id = RK_METHOD_TSIT5;
+
+}
+
+/* Populate a tableau with the Verner 6(5) pair (DVERK) -> 8 stages, 6th order solution with a 5th order error estimate */
+/* Inputs:
+    - tab: the tableau to fill (all the coefficients which are not set are zero) */
+static void RK_Tableau_Verner65( RK_Tableau* tab ){
+
+    int i;
+
+    memset( tab , 0 , sizeof( RK_Tableau ) );
+
+    /* Time-step coefficients {ci} */
+    tab->c[ 1 ] = 1.0/6.0;
+    tab->c[ 2 ] = 4.0/15.0;
+    tab->c[ 3 ] = 2.0/3.0;
+    tab->c[ 4 ] = 5.0/6.0;
+    tab->c[ 5 ] = 1.0;
+    tab->c[ 6 ] = 1.0/15.0;
+    tab->c[ 7 ] = 1.0;
+
+    /* 6th order final weights {bi} */
+    tab->b[ 0 ][ 0 ] = 3.0/40.0;
+    tab->b[ 0 ][ 2 ] = 875.0/2244.0;
+    tab->b[ 0 ][ 3 ] = 23.0/72.0;
+    tab->b[ 0 ][ 4 ] = 264.0/1955.0;
+    tab->b[ 0 ][ 6 ] = 125.0/11592.0;
+    tab->b[ 0 ][ 7 ] = 43.0/616.0;
+
+    /* 5th order final weights {b*i} */
+    tab->b[ 1 ][ 0 ] = 13.0/160.0;
+    tab->b[ 1 ][ 2 ] = 2375.0/5984.0;
+    tab->b[ 1 ][ 3 ] = 5.0/16.0;
+    tab->b[ 1 ][ 4 ] = 12.0/85.0;
+    tab->b[ 1 ][ 5 ] = 3.0/44.0;
+
+    /* Compute Error Coefficients */
+    for( i = 0; i < 8; i++ ){
+        tab->ec[ i ] = tab->b[ 0 ][ i ] - tab->b[ 1 ][ i ];
+    }
+
+    /* k computation weights -> Only the non-zero ones */
+    tab->a[ 1 ][ 0 ] = 1.0/6.0;
+    tab->a[ 2 ][ 0 ] = 4.0/75.0;
+    tab->a[ 2 ][ 1 ] = 16.0/75.0;
+    tab->a[ 3 ][ 0 ] = 5.0/6.0;
+    tab->a[ 3 ][ 1 ] = - 8.0/3.0;
+    tab->a[ 3 ][ 2 ] = 5.0/2.0;
+    tab->a[ 4 ][ 0 ] = - 165.0/64.0;
+    tab->a[ 4 ][ 1 ] = 55.0/6.0;
+    tab->a[ 4 ][ 2 ] = - 425.0/64.0;
+    tab->a[ 4 ][ 3 ] = 85.0/96.0;
+    tab->a[ 5 ][ 0 ] = 12.0/5.0;
+    tab->a[ 5 ][ 1 ] = - 8.0;
+    tab->a[ 5 ][ 2 ] = 4015.0/612.0;
+    tab->a[ 5 ][ 3 ] = - 11.0/36.0;
+    tab->a[ 5 ][ 4 ] = 88.0/255.0;
+    tab->a[ 6 ][ 0 ] = - 8263.0/15000.0;
+    tab->a[ 6 ][ 1 ] = 124.0/75.0;
+    tab->a[ 6 ][ 2 ] = - 643.0/680.0;
+    tab->a[ 6 ][ 3 ] = - 81.0/250.0;
+    tab->a[ 6 ][ 4 ] = 2484.0/10625.0;
+    tab->a[ 7 ][ 0 ] = 3501.0/1720.0;
+    tab->a[ 7 ][ 1 ] = - 300.0/43.0;
+    tab->a[ 7 ][ 2 ] = 297275.0/52632.0;
+    tab->a[ 7 ][ 3 ] = - 319.0/2322.0;
+    tab->a[ 7 ][ 4 ] = 24068.0/84065.0;
+    tab->a[ 7 ][ 6 ] = 3850.0/26703.0;
+
+    /* The step controller exponents scale with the order of the error estimate ( 5/6 of the 5th order ones ) */
+    tab->ctrl_p = p_gain*5.0/6.0;
+    tab->ctrl_l = p_loss*5.0/6.0;
+    tab->ctrl_i = i_gain*5.0/6.0;
+    tab->Ns = 8;
+    tab->fsal = 0;
+    tab->Nerr = 1;
+    tab->id = RK_METHOD_VERNER65;
+
+}
+
+/* Populate a tableau with the Dormand-Prince 8(5,3) pair (DOP853 of Hairer & Wanner) -> 12 stages, 8th order solution */
+/* The error is estimated by combining a 5th and a 3rd order estimate: err = e5^2/sqrt( e5^2 + 0.01*e3^2 ) */
+/* NOTE: The 7th order dense output of DOP853 needs 3 extra stages and is not provided */
+/* Inputs:
+    - tab: the tableau to fill (all the coefficients which are not set are zero) */
+static void RK_Tableau_DOP853( RK_Tableau* tab ){
+
+    int i;
+
+    memset( tab , 0 , sizeof( RK_Tableau ) );
+
+    /* Time-step coefficients {ci} */
+    tab->c[ 1 ] = 0.526001519587677318785587544488e-01;
+    tab->c[ 2 ] = 0.789002279381515978178381316732e-01;
+    tab->c[ 3 ] = 0.118350341907227396726757197510;
+    tab->c[ 4 ] = 0.281649658092772603273242802490;
+    tab->c[ 5 ] = 1.0/3.0;
+    tab->c[ 6 ] = 0.25;
+    tab->c[ 7 ] = 0.307692307692307692307692307692;
+    tab->c[ 8 ] = 0.651282051282051282051282051282;
+    tab->c[ 9 ] = 0.6;
+    tab->c[ 10 ] = 0.857142857142857142857142857142;
+    tab->c[ 11 ] = 1.0;
+
+    /* k computation weights -> Only the non-zero ones */
+    tab->a[ 1 ][ 0 ] = 5.26001519587677318785587544488e-2;
+    tab->a[ 2 ][ 0 ] = 1.97250569845378994544595329183e-2;
+    tab->a[ 2 ][ 1 ] = 5.91751709536136983633785987549e-2;
+    tab->a[ 3 ][ 0 ] = 2.95875854768068491816892993775e-2;
+    tab->a[ 3 ][ 2 ] = 8.87627564304205475450678981324e-2;
+    tab->a[ 4 ][ 0 ] = 2.41365134159266685502369798665e-1;
+    tab->a[ 4 ][ 2 ] = - 8.84549479328286085344864962717e-1;
+    tab->a[ 4 ][ 3 ] = 9.24834003261792003115737966543e-1;
+    tab->a[ 5 ][ 0 ] = 3.7037037037037037037037037037e-2;
+    tab->a[ 5 ][ 3 ] = 1.70828608729473871279604482173e-1;
+    tab->a[ 5 ][ 4 ] = 1.25467687566822425016691814123e-1;
+    tab->a[ 6 ][ 0 ] = 3.7109375e-2;
+    tab->a[ 6 ][ 3 ] = 1.70252211019544039314978060272e-1;
+    tab->a[ 6 ][ 4 ] = 6.02165389804559606850219397283e-2;
+    tab->a[ 6 ][ 5 ] = - 1.7578125e-2;
+    tab->a[ 7 ][ 0 ] = 3.70920001185047927108779319836e-2;
+    tab->a[ 7 ][ 3 ] = 1.70383925712239993810214054705e-1;
+    tab->a[ 7 ][ 4 ] = 1.07262030446373284651809199168e-1;
+    tab->a[ 7 ][ 5 ] = - 1.53194377486244017527936158236e-2;
+    tab->a[ 7 ][ 6 ] = 8.27378916381402288758473766002e-3;
+    tab->a[ 8 ][ 0 ] = 6.24110958716075717114429577812e-1;
+    tab->a[ 8 ][ 3 ] = - 3.36089262944694129406857109825;
+    tab->a[ 8 ][ 4 ] = - 8.68219346841726006818189891453e-1;
+    tab->a[ 8 ][ 5 ] = 2.75920996994467083049415600797e1;
+    tab->a[ 8 ][ 6 ] = 2.01540675504778934086186788979e1;
+    tab->a[ 8 ][ 7 ] = - 4.34898841810699588477366255144e1;
+    tab->a[ 9 ][ 0 ] = 4.77662536438264365890433908527e-1;
+    tab->a[ 9 ][ 3 ] = - 2.48811461997166764192642586468;
+    tab->a[ 9 ][ 4 ] = - 5.90290826836842996371446475743e-1;
+    tab->a[ 9 ][ 5 ] = 2.12300514481811942347288949897e1;
+    tab->a[ 9 ][ 6 ] = 1.52792336328824235832596922938e1;
+    tab->a[ 9 ][ 7 ] = - 3.32882109689848629194453265587e1;
+    tab->a[ 9 ][ 8 ] = - 2.03312017085086261358222928593e-2;
+    tab->a[ 10 ][ 0 ] = - 9.3714243008598732571704021658e-1;
+    tab->a[ 10 ][ 3 ] = 5.18637242884406370830023853209;
+    tab->a[ 10 ][ 4 ] = 1.09143734899672957818500254654;
+    tab->a[ 10 ][ 5 ] = - 8.14978701074692612513997267357;
+    tab->a[ 10 ][ 6 ] = - 1.85200656599969598641566180701e1;
+    tab->a[ 10 ][ 7 ] = 2.27394870993505042818970056734e1;
+    tab->a[ 10 ][ 8 ] = 2.49360555267965238987089396762;
+    tab->a[ 10 ][ 9 ] = - 3.0467644718982195003823669022;
+    tab->a[ 11 ][ 0 ] = 2.27331014751653820792359768449;
+    tab->a[ 11 ][ 3 ] = - 1.05344954667372501984066689879e1;
+    tab->a[ 11 ][ 4 ] = - 2.00087205822486249909675718444;
+    tab->a[ 11 ][ 5 ] = - 1.79589318631187989172765950534e1;
+    tab->a[ 11 ][ 6 ] = 2.79488845294199600508499808837e1;
+    tab->a[ 11 ][ 7 ] = - 2.85899827713502369474065508674;
+    tab->a[ 11 ][ 8 ] = - 8.87285693353062954433549289258;
+    tab->a[ 11 ][ 9 ] = 1.23605671757943030647266201528e1;
+    tab->a[ 11 ][ 10 ] = 6.43392746015763530355970484046e-1;
+
+    /* 8th order final weights {bi} */
+    tab->b[ 0 ][ 0 ] = 5.42937341165687622380535766363e-2;
+    tab->b[ 0 ][ 5 ] = 4.45031289275240888144113950566;
+    tab->b[ 0 ][ 6 ] = 1.89151789931450038304281599044;
+    tab->b[ 0 ][ 7 ] = - 5.8012039600105847814672114227;
+    tab->b[ 0 ][ 8 ] = 3.1116436695781989440891606237e-1;
+    tab->b[ 0 ][ 9 ] = - 1.52160949662516078556178806805e-1;
+    tab->b[ 0 ][ 10 ] = 2.01365400804030348374776537501e-1;
+    tab->b[ 0 ][ 11 ] = 4.47106157277725905176885569043e-2;
+
+    /* 5th order error estimate {bi-b*i} -> the embedded weights {b*i} follow from it */
+    tab->ec[ 0 ] = 0.1312004499419488073250102996e-1;
+    tab->ec[ 5 ] = - 0.1225156446376204440720569753e+1;
+    tab->ec[ 6 ] = - 0.4957589496572501915214079952;
+    tab->ec[ 7 ] = 0.1664377182454986536961530415e+1;
+    tab->ec[ 8 ] = - 0.3503288487499736816886487290;
+    tab->ec[ 9 ] = 0.3341791187130174790297318841;
+    tab->ec[ 10 ] = 0.8192320648511571246570742613e-1;
+    tab->ec[ 11 ] = - 0.2235530786388629525884427845e-1;
+    for( i = 0; i < 12; i++ ){
+        tab->b[ 1 ][ i ] = tab->b[ 0 ][ i ] - tab->ec[ i ];
+    }
+
+    /* 3rd order error estimate -> the 8th order weights minus the 3rd order ones */
+    for( i = 0; i < 12; i++ ){
+        tab->ec3[ i ] = tab->b[ 0 ][ i ];
+    }
+    tab->ec3[ 0 ] -= 0.244094488188976377952755905512;
+    tab->ec3[ 8 ] -= 0.733846688281611857341361741547;
+    tab->ec3[ 11 ] -= 0.220588235294117647058823529412e-1;
+
+    /* The step controller exponents scale with the order of the error estimate ( 5/8 of the 5th order ones ) */
+    tab->ctrl_p = p_gain*5.0/8.0;
+    tab->ctrl_l = p_loss*5.0/8.0;
+    tab->ctrl_i = i_gain*5.0/8.0;
+    tab->Ns = 12;
+    tab->fsal = 0;
+    tab->Nerr = 2;
+    tab->id = RK_METHOD_DOP853;
+
+}
+
+/* Populate a tableau with one of the available embedded pairs */
+/* Inputs:
+    - tab: the tableau to fill
+    - method: RK_METHOD_DP45, RK_METHOD_TSIT5, RK_METHOD_VERNER65 or RK_METHOD_DOP853 */
+/* Output:
+    - 0 on success or -1 if the method is unknown (the tableau is not changed then) */
+static int RK_Tableau_Method( RK_Tableau* tab , int method ){
+
+    switch( method ){
+        case RK_METHOD_DP45:
+            RK_Tableau_DP45( tab );
+            return 0;
+        case RK_METHOD_TSIT5:
+            RK_Tableau_Tsit5( tab );
+            return 0;
+        case RK_METHOD_VERNER65:
+            RK_Tableau_Verner65( tab );
+            return 0;
+        case RK_METHOD_DOP853:
+            RK_Tableau_DOP853( tab );
+            return 0;
+        default:
+            printf( "ERROR: Unknown Runge-Kutta method %d! \n" , method );
+            return -1;
+    }
+
+}
+
+/* Populate the Runge-Kutta constants for integration
+ - currently hardcoded for 4-5th order Dormand Prince adaptive step with embedded error estimation */
+/* NOTE: Must be performed before any integrations with Dormand-Prince are performed!!! */
+/* NOTE: This only sets the default context of the original interface, RK_Context_Create fills its own tableau */
+void Set_RK_Coeff( ){
+
+    RK_Tableau_DP45( &RK_Default.tab );
+
+}
+
+/* Select the embedded Runge-Kutta pair of the original interface (DP45_Integrator, ...) instead of Dormand-Prince */
+/* Inputs:
+    - method: RK_METHOD_DP45, RK_METHOD_TSIT5, RK_METHOD_VERNER65 or RK_METHOD_DOP853 */
+/* Output:
+    - 0 on success or -1 if the method is unknown */
+int Set_RK_Method( int method ){
+
+    return RK_Tableau_Method( &RK_Default.tab , method );
+}
+
+/* Select the Right-Hand-Side kernel of the batch integrator of the original interface (DP45_Integrate_Batch) */
+/* Inputs:
+    - rhs_mode: RK_RHS_LIBM, RK_RHS_FAST or RK_RHS_REPRO */
+/* Output:
+    - 0 on success or -1 if the mode is unknown */
+int Set_RK_RHS_Mode( int rhs_mode ){
+
+    if( rhs_mode != RK_RHS_LIBM && rhs_mode != RK_RHS_FAST && rhs_mode != RK_RHS_REPRO ){
+        return -1;
+    }
+    RK_Default.rhs_mode = rhs_mode;
+
+    return 0;
+}
+
+/* Prinout the Runge-Kutta constants for integration to check that they are set appropriately */
+void Check_RK_Coeff( ){
+
+    int i, j;
+    RK_Tableau *tab = &RK_Default.tab; /* Tableau of the default context */
+    int Ns = tab->Ns; /* Number of stages */
+
+    printf( "DPc[ %d ] coefficients are: " , Ns );
+    for( i = 0; i < Ns; i++ ){
+        printf( "%.10e \n" , tab->c[ i ] );
+    }
+
+    printf( "DPb[ 2 ][ %d ] coefficients are ( DPb[ 0 ][ i ] , DPb[ 1 ][ i ] ): " , Ns );
+    for( i = 0; i < Ns; i++ ){
+        printf( "%.10e, %.10e \n" , tab->b[ 0 ][ i ] , tab->b[ 1 ][ i ] );
     }    
 
-    printf( "DPa[ 7 ][ 7 ] coefficients are ( DPa[ 0 ][ i ] , ... , DPa[ 6 ][ i ] ): " );
-    for( i = 0; i < 7; i++ ){
-        printf( "%.10e, %.10e, %.10e, %.10e, %.10e, %.10e, %.10e \n" , DPa[ 0 ][ i ] , DPa[ 1 ][ i ] , DPa[ 2 ][ i ] , DPa[ 3 ][ i ] , DPa[ 4 ][ i ] , DPa[ 5 ][ i ] , DPa[ 6 ][ i ] );
+    printf( "DPa[ %d ][ %d ] coefficients are ( DPa[ 0 ][ i ] , ... , DPa[ %d ][ i ] ): " , Ns , Ns , Ns - 1 );
+    for( i = 0; i < Ns; i++ ){
+        for( j = 0; j < Ns; j++ ){
+            printf( ( j < Ns - 1 ) ? "%.10e, " : "%.10e \n" , tab->a[ j ][ i ] );
+        }
     } 
 
-    printf( "DPec[ 7 ] coefficients are: " );
-    for( i = 0; i < 7; i++ ){
-        printf( "%.10e \n" , DPec[ i ] );
+    printf( "DPec[ %d ] coefficients are: " , Ns );
+    for( i = 0; i < Ns; i++ ){
+        printf( "%.10e \n" , tab->ec[ i ] );
     }  
 
+    if( tab->dense ){
+        printf( "DPd[ 7 ] coefficients are: " );
+        for( i = 0; i < 7; i++ ){
+            printf( "%.10e \n" , tab->d[ i ] );
+        }  
+    }
+
 }
 
 /* Test interface to the C library from Py */
@@ -143,11 +638,11 @@ void Test_Interface( double x_val ){
 /* NOTE: This function must be called before starting an integration or all the constants will be defaulted to 1.0 */
 void Set_Pend_coeff( double *coeff_vals ){
 
-    a_th = *( coeff_vals );
-    a_phi = *( coeff_vals + 1 );
-    a_mix = *( coeff_vals + 2 );
-    b_th = *( coeff_vals + 3 );
-    b_phi = *( coeff_vals + 4 );
+    int j;
+
+    for( j = 0; j < 5; j++ ){
+        RK_Default.pend_coeff[ j ] = *( coeff_vals + j );
+    }
 
 }
 
@@ -187,388 +682,6405 @@ void RHS_Function_HO( double* state , double* deriv_state ){
 
 }
 
-/* 4th order Runge-Kutta integrator for testing purposes */
+/* Append one row [ t , state[ 0 ] , ... , state[ Nstate - 1 ] ] to an in-memory output buffer */
+/* When the buffer is full it is grown through buf->grow, or with realloc if no grow function is provided */
 /* Inputs:
-    - Nstate: number of quantities in the state (phase space dimension)
-    - Npoints: number of integration points (NOT INTERVALS)
-    - state_init[ Nstate ]: initial state for the integrator
-    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
-    - file_name: a char of the output filename where the results will be written - include .csv in this like "file.csv"
-    - header: a char of the header to start the file with (no need for \n sign) */
-/* Outputs:
-    - The results are written in a file as commas separated values (.csv)
-    -- The format is [ Time , State[ 0 ] , State[ 1 ] , ... State[ Nstate - 1 ] ]
-    -- Reflect this in the header format! */
-void RK4_Integrator( int Nstate , int Npoints , double* state_init , double* range_int , char* file_name , char* header ){
+    - buf: the output buffer (see RK_Buffer in RK_Library.h)
+    - Nstate: number of quantities in the state
+    - t_now, state_now[ Nstate ]: the row to be appended */
+/* Output:
+    - 0 on success, -1 if the buffer could not be grown (the row is not written) */
+static int RK_Buffer_Append( RK_Buffer* buf , int Nstate , double t_now , double* state_now ){
 
-    int i, j; /* Iterators */
-    double k_RK[ Nstate ][ 4 ], /* Runge-Kutta intermediate derivatives */
-           state_now[ Nstate ], /* Variable where we keep the current state */
-           int_state[ Nstate ], /* Variable where we keep intermediate state for RK steps */
-           rhs_state[ Nstate ]; /* Right-Hand-Side of the state (derivatives) */ 
-    double t_now, /* Current time value */
-           dt; /* Time step */
-    FILE *fp; /* File pointer to write the results */
+    int j;
+    long need, cap_new;
+    double *data_new;
 
-    t_now = *( range_int ); /* Initialize time start */
-    dt = ( *( range_int + 1 ) - *( range_int ) )/( ( double )Npoints - 1.0 ); /* Get the interval size from number of points and total interval */
+    need = ( long )( buf->n + 1 )*( Nstate + 1 );
 
-    /* Assign the initial state */
-    for( j = 0; j < Nstate; j++ ){
-        state_now[ j ] = *( state_init + j );
+    if( need > buf->cap ){
+        /* Ask for twice the current size to keep the number of grow calls logarithmic */
+        cap_new = ( 2*buf->cap > need ) ? 2*buf->cap : need;
+        if( buf->grow != NULL ){
+            if( buf->grow( buf , cap_new ) != 0 || buf->cap < need ){
+                return -1;
+            }
+        }
+        else{
+            data_new = ( double* )realloc( buf->data , ( size_t )cap_new*sizeof( double ) );
+            if( data_new == NULL ){
+                return -1;
+            }
+            buf->data = data_new;
+            buf->cap = cap_new;
+        }
     }
 
-    /* Open the file, write header and initial data */
-    fp = fopen( file_name , "w" ); 
-    fprintf( fp , "%s \n" , header );
-    fprintf( fp , "%.10e, " , t_now );
+    *( buf->data + ( long )buf->n*( Nstate + 1 ) ) = t_now;
     for( j = 0; j < Nstate; j++ ){
-        fprintf( fp , "%.10e, " , state_now[ j ] );
+        *( buf->data + ( long )buf->n*( Nstate + 1 ) + 1 + j ) = *( state_now + j );
     }
-    fprintf( fp , "\n" );
+    buf->n += 1;
 
-    /* Start the main integration loop */
-    for( i = 0; i < Npoints - 1; i++ ){
-        
-        /* Call the RHS function in the current point -> x_i */
-        RHS_Function_HO( state_now , rhs_state );
-        /* Assign RK constant for this point and compute intermediate state */
-        for( j = 0; j < Nstate; j++ ){
-            k_RK[ j ][ 0 ] = rhs_state[ j ]*dt;
-            int_state[ j ] = state_now[ j ] + k_RK[ j ][ 0 ]/2.0; /* x_i + k_1/2 */
-        }
+    return 0;
+}
 
-        /* Call the RHS function in the first half-point -> x_i + k_1/2 */
-        RHS_Function_HO( int_state , rhs_state );
-        /* Assign RK constant for this point and compute intermediate state */
-        for( j = 0; j < Nstate; j++ ){
-            k_RK[ j ][ 1 ] = rhs_state[ j ]*dt;
-            int_state[ j ] = state_now[ j ] + k_RK[ j ][ 1 ]/2.0; /* x_i + k_2/2 */
-        }
+/* Writer for the binary trajectory format (see RK_Traj_Header in RK_Library.h) */
+/* Rows are collected in a column-major chunk of RK_TRAJ_CHUNK_ROWS rows which is written out when full,
+   the time of the first row of each chunk is kept for the sparse time index written at the end of the file */
+typedef struct {
+    FILE *fp; /* Binary file pointer */
+    RK_Traj_Header head; /* Header -> rewritten with the final counts when the file is closed */
+    double *chunk; /* [ Ncol ][ RK_TRAJ_CHUNK_ROWS ] current chunk */
+    int n_chunk; /* Rows in the current chunk */
+    double *index; /* [ n_index_cap ] first time of each written chunk */
+    long n_index_cap; /* Capacity of index */
+    /* Compressed files only (codec RK_TRAJ_CODEC_XOR) */
+    unsigned char *zbuf; /* Bit stream of the chunk being written */
+    int64_t *offsets; /* [ n_index_cap + 1 ] byte offsets of the written chunks */
+    int64_t n_bytes; /* Bytes of chunk data written so far */
+    double *win, /* [ RK_TRAJ_DEC_WINDOW ][ Ncol ] rows after the last kept one which are waiting for the decimation */
+           *win_f; /* [ RK_TRAJ_DEC_WINDOW ][ Ncol - 1 ] derivatives of the state at the waiting rows */
+    int n_win; /* Number of waiting rows -> the last one is written only if the next row can not replace it */
+    int n_kept; /* 0 before the first row is written */
+    double kept[ RK_TRAJ_NCOL_MAX ], /* Last written row */
+           f_kept[ RK_TRAJ_NCOL_MAX ]; /* Derivative of the state at the last written row */
+} RK_Traj_Writer;
 
-        /* Call the RHS function in the second half-point -> x_i + k_2/2 */
-        RHS_Function_HO( int_state , rhs_state );
-        /* Assign RK constant for this point and compute intermediate state */
-        for( j = 0; j < Nstate; j++ ){
-            k_RK[ j ][ 2 ] = rhs_state[ j ]*dt;
-            int_state[ j ] = state_now[ j ] + k_RK[ j ][ 2 ]; /* x_i + k_3 */
-        }
+/* Background writer of the .csv and binary outputs -> the integration thread only copies the rows into fixed-size blocks */
+/* The full blocks go to the writer thread through a single-producer single-consumer ring: the integration thread only moves
+   head and the writer only moves tail (atomics, no locks), so the formatting and the disk latency are off the integration loop */
+typedef struct {
+    FILE *fp; /* .csv file written by the thread (NULL for none) */
+    RK_Traj_Writer *bin; /* Binary trajectory file written by the thread (NULL for none) */
+    int Ncol; /* Values per row -> 1 + Nstate */
+    double *blocks; /* [ RK_ASYNC_NBLOCK ][ RK_ASYNC_BLOCK_ROWS ][ Ncol ] ring of row blocks */
+    int n_rows[ RK_ASYNC_NBLOCK ]; /* Rows in each handed over block */
+    int n_fill; /* Rows in the block being filled (integration thread only) */
+    _Atomic long head; /* Blocks handed over by the integration thread */
+    _Atomic long tail; /* Blocks written out by the writer thread */
+    _Atomic int done; /* Set after the last block has been handed over */
+    _Atomic int error; /* Set by the writer thread if the output could not be written */
+    pthread_t thread;
+} RK_Async_Writer;
 
-        /* Call the RHS function in the next point -> x_i + k_3 */
-        RHS_Function_HO( int_state , rhs_state );
-        /* Assign RK constant for this point - no more intermediate steps */
-        for( j = 0; j < Nstate; j++ ){
-            k_RK[ j ][ 3 ] = rhs_state[ j ]*dt;
-        }
+/* Compile-time check that the header has exactly the documented size on disk */
+typedef char RK_Traj_Header_Size_Check[ ( sizeof( RK_Traj_Header ) == RK_TRAJ_HEADER_SIZE ) ? 1 : - 1 ];
+typedef char RK_Checkpoint_Size_Check[ ( sizeof( RK_Checkpoint ) == RK_CKPT_SIZE ) ? 1 : - 1 ];
 
-        /* All RK constants for the step have been populated - we can find the next step */
-        for( j = 0; j < Nstate; j++ ){
-            state_now[ j ] += ( k_RK[ j ][ 0 ] + 2.0*k_RK[ j ][ 1 ] + 2.0*k_RK[ j ][ 2 ] + k_RK[ j ][ 3 ] )/6.0;
-        }
-        t_now += dt; /* Increment time */
+/* Observables stage of the output -> observable rows next to the state rows and running reductions over the accepted steps */
+typedef struct {
+    double *pend_coeff; /* Coefficients a_th to b_phi of the energies */
+    double l1, l2; /* Rod lengths of the positions */
+    RK_Buffer *rows; /* Observable rows [ Time , E_kin , E_pot , x_mid , y_mid , x_end , y_end ] (NULL for the reductions only) */
+    RK_Obs_Summary *red; /* Running reductions (NULL to skip) */
+    long k_th, k_phi; /* Branch of each angle -> floor( ( angle + pi )/( 2*pi ) ), every change of it is a flip over the top */
+} RK_Obs;
 
-        /* Write the new state in the output file */
-        fprintf( fp , "%.10e, " , t_now );
-        //fprintf( fp , "%.10e, %.10e, %.10e, \n" , t_now , state_now[ 0 ] , state_now[ 1 ] );
-        for( j = 0; j < Nstate; j++ ){
-            fprintf( fp , "%.10e, " , state_now[ j ] );
-        }
-        fprintf( fp , "\n" );
+/* All the possible destinations of the integrator output -> any of them can be NULL */
+typedef struct {
+    FILE *fp; /* .csv file */
+    RK_Buffer *buf; /* In-memory buffer */
+    RK_Traj_Writer *bin; /* Binary trajectory file */
+    double *t_out; /* [ Nout ] sorted output times for dense output -> NULL to write every accepted step instead */
+    int Nout, /* Number of dense output times */
+        i_out; /* Next dense output time to be written */
+    RK_Event *events; /* [ Nevent ] events -> if not NULL only the event rows are written (see RK_Event) */
+    int Nevent; /* Number of events */
+    RK_Async_Writer *async; /* Background writer -> if set it writes the rows of fp and bin instead of the integration thread */
+    RK_Obs *obs; /* Observables -> the observable rows are written with every state row (double Pendulum only) */
+} RK_Output;
 
-    }    
+/* Round a value to mant_bits bits of mantissa (to nearest, a carry goes into the exponent) -> 52 or more leaves it unchanged */
+RK_INLINE double RK_Traj_Round( double x , int mant_bits ){
 
-    fclose( fp ); /* Close the file in the end */
+    uint64_t b;
 
-}
+    if( mant_bits >= 52 ){
+        return x;
+    }
+    memcpy( &b , &x , sizeof( b ) );
+    b += ( uint64_t )1 << ( 51 - mant_bits );
+    b &= ~( ( ( uint64_t )1 << ( 52 - mant_bits ) ) - 1 );
+    memcpy( &x , &b , sizeof( b ) );
 
+    return x;
+}
 
-/* Mockup RHS value for two decoupled harmonic oscillators - it was used for the initial testing to validate the DP integrator */
-/* NOTE: The second oscillator (at 2*\omega) has dampening by a coefficient 2.0*\beta defined in the function */
-/* State is assumed to be [ \theta , \phi , \omega_theta , \omega_phi ] in arbitrary units of angle and angular velocity */
-/* Inputs:
-    - state[ 4 ]: the state as [ theta , phi , om_theta , om_phi ] */
-/* Outputs:
-    - deriv_state[ 4 ]: the derivative of the state in the same order */
-/*
-void RHS_Function( double* state , double* deriv_state ){
+/* Prediction of value i of a column from the two previous ones (linear extrapolation, rounded as the stored values) */
+/* NOTE: 2*x is exact, so the prediction is the same whether or not the compiler contracts it into a fused multiply-add */
+RK_INLINE double RK_Traj_Predict( const double* x , int i , int mant_bits ){
 
-    
+    if( i == 0 ){
+        return 0.0;
+    }
+    if( i == 1 ){
+        return x[ 0 ];
+    }
 
-    double bet = 0.2;
+    return RK_Traj_Round( 2.0*x[ i - 1 ] - x[ i - 2 ] , mant_bits );
+}
 
-    *( deriv_state ) = *( state + 2 );
-    *( deriv_state + 1 ) = *( state + 3 ); 
-    *( deriv_state + 2 ) = - Om*Om*( *( state ) );
-    *( deriv_state + 3 ) = - 4.0*Om*Om*( *( state + 1 ) ) - 2.0*bet*( *( state + 3 ) );
+/* Bit stream of a compressed chunk -> the bits are written and read starting from the most significant one of each byte */
+typedef struct {
+    unsigned char *p; /* Bytes of the stream */
+    int64_t n_byte; /* Bytes written (or the size of the stream when reading) */
+    int64_t i_byte; /* Next byte to read */
+    uint64_t acc; /* Bits not yet written to p (or read from p but not yet used) */
+    int n_acc; /* Number of bits in acc */
+} RK_Bits;
 
-}
-*/
+/* Write the n ( <= 64 ) lowest bits of val */
+static void RK_Bits_Put( RK_Bits* bs , uint64_t val , int n ){
 
-/* Right-Hand-Side Function for the double Pendulum with properties defined above */
-/* State is assumed to be [ \theta , \phi , \omega_theta , \omega_phi ] in arbitrary units of angle and angular velocity */
-/* Inputs:
-    - state[ 4 ]: the state as [ theta , phi , om_theta , om_phi ] */
-/* Outputs:
-    - deriv_state[ 4 ]: the derivative of the state in the same order */
-void RHS_Function( double* state , double* deriv_state ){
+    if( n > 32 ){
+        RK_Bits_Put( bs , val >> 32 , n - 32 );
+        n = 32;
+    }
+    val &= ( ( uint64_t )1 << n ) - 1;
 
-    double invA[ 2 ][ 2 ]; /* Inverse of the LHS matrix A */
-    double rhs_vec[ 2 ]; /* RHS vector */
-    double sTh = sin( *( state ) ), /* \sin{ \theta } */
-           cTh = cos( *( state ) ), /* \cos{ \theta } */
-           sDel = sin( *( state + 1 ) - *( state ) ), /* \sin{ \phi - \theta } */
-           cDel = cos( *( state + 1 ) - *( state ) ), /* \cos{ \phi - \theta } */
-           detA = ( 4.0*a_th*a_phi - a_mix*a_mix*cDel*cDel ); /* Determinant of the Left-Hand-Side (LHS) to be inverted */
-    
-    /* Check to see if the system is close to singular and warn in that case */
-    /* NOTE: Analythically this should not be possible but check anyway in case of error in the code! */
-    if( fabs( detA ) < 1e-15 ){
-        printf( "WARNING: The system appears to be going singular at the state: \n" );
-        printf( "theta = %.10e, phi = %.10e, om_theta = %.10e, om_phi = %.10e \n" , *( state ) , *( state + 1 ) , *( state + 2 ) , *( state + 3 ) );
-        printf( "Assuming detA == 1 to continue, results after this point are WRONG!" );
-        detA = 1.0;
+    bs->acc = ( bs->acc << n ) | val;
+    bs->n_acc += n;
+    while( bs->n_acc >= 8 ){
+        bs->n_acc -= 8;
+        bs->p[ bs->n_byte++ ] = ( unsigned char )( bs->acc >> bs->n_acc );
     }
+    bs->acc &= ( ( uint64_t )1 << bs->n_acc ) - 1;
 
-    /* Get the inverse matrix of the LHS */
-    invA[ 0 ][ 0 ] = 2.0*a_phi/detA;
-    invA[ 0 ][ 1 ] = - a_mix*cDel/detA;
-    invA[ 1 ][ 0 ] = - a_mix*cDel/detA;
-    invA[ 1 ][ 1 ] = 2.0*a_th/detA;
+}
 
-    rhs_vec[ 0 ] = - b_th*sTh + a_mix*sDel*( *( state + 3 ) )*( *( state + 3 ) );
-    rhs_vec[ 1 ] = - b_phi*sin( *( state + 1 ) ) - a_mix*sDel*( *( state + 2 ) )*( *( state + 2 ) );
+/* Read n ( <= 64 ) bits -> past the end of the stream zeros are read and i_byte goes beyond n_byte */
+static uint64_t RK_Bits_Get( RK_Bits* bs , int n ){
 
-    /* Write out the derivatives */
-    *( deriv_state ) = *( state + 2 );
-    *( deriv_state + 1 ) = *( state + 3 ); 
-    *( deriv_state + 2 ) = invA[ 0 ][ 0 ]*rhs_vec[ 0 ] + invA[ 0 ][ 1 ]*rhs_vec[ 1 ];
-    *( deriv_state + 3 ) = invA[ 1 ][ 0 ]*rhs_vec[ 0 ] + invA[ 1 ][ 1 ]*rhs_vec[ 1 ];
+    uint64_t val;
 
-}
+    if( n > 32 ){
+        val = RK_Bits_Get( bs , n - 32 ) << 32;
+        return val | RK_Bits_Get( bs , 32 );
+    }
 
-/* 4-5th order adaptive Dormand-Prince integrator */
-/* Inputs:
-    - Nstate: number of quantities in the state (phase space dimension)
-    - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
-    - state_init[ Nstate ]: initial state for the integrator
-    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
-    - file_name: a char of the output filename where the results will be written - include .csv in this like "file.csv"
-    - header: a char of the header to start the file with (no need for \n sign) */
-/* Outputs:
-    - The results are written in a file as commas separated values (.csv)
-    -- The format is [ Time , State[ 0 ] , State[ 1 ] , ... State[ Nstate - 1 ] ]
-    -- Reflect this in the header format! */
-void DP45_Integrator( int Nstate , double err_tol , double* state_init , double* range_int , char* file_name , char* header ){
+    while( bs->n_acc < n ){
+        bs->acc = ( bs->acc << 8 ) | ( ( bs->i_byte < bs->n_byte ) ? bs->p[ bs->i_byte ] : 0 );
+        bs->i_byte += 1;
+        bs->n_acc += 8;
+    }
+    bs->n_acc -= n;
+    val = ( bs->acc >> bs->n_acc ) & ( ( ( uint64_t )1 << n ) - 1 );
 
-    int rej, /* rej is a rejection counter -> ( 0 , 1 ) if the last step was rejected */
-        i, j, k; /* Iterators */
-    double k_DP[ Nstate ][ 7 ], /* Dormand-Prince intermediate derivatives */
-           state_now[ Nstate ], /* Variable where we keep the current state */
-           int_state[ Nstate ], /* Variable where we keep intermediate state for RK steps */
-           rhs_state[ Nstate ], /* Right-Hand-Side of the state (derivatives) */ 
-           err_est[ Nstate ]; /* Estimated error for each of the state quantities */
+    return val;
+}
 
-    double t_now, /* Current time value */
-           t_mid, /* Intermediate time step during the DP integration */
-           dt, /* Current time step */
-           err_ratio, /* Error ratio of actual to desired - current step */
-           err_ratiOld, /* Error ratio of actual to desired - old step */
-           int_frac, /* This is used for interpolation in case we overshoot the end of the interval */
-           tv1; /* Temporary variables which can be reused to hold some intermediate computations */
-    FILE *fp; /* File pointer to write the results */
+/* Compress a column of n values (already rounded to mant_bits) by XOR with their prediction -> the time column is always kept whole */
+/* Codes of the XOR: '0' zero, '10' + the bits inside the window of the last '11' code, '11' + 5 bits of leading zeros
+   + 6 bits of ( length - 1 ) + the length bits between the leading and the trailing zeros (a new window) */
+static void RK_XOR_Encode( RK_Bits* bs , const double* x , int n , int mant_bits ){
 
-    t_now = *( range_int ); /* Initialize time start */
-    dt = ( *( range_int + 1 ) - *( range_int ) )/1e6; /* Initial "guess" for a good time step is 1 millionth of the interval - will be modified from the integrator when it starts */
+    int i, lead, trail,
+        w_lead = 64, w_trail = 64; /* Window of the last '11' code -> none at the start */
+    double pred;
+    uint64_t bx, bp, xr;
 
-    /* Assign the initial state */
-    for( j = 0; j < Nstate; j++ ){
-        state_now[ j ] = *( state_init + j );
-    }
+    for( i = 0; i < n; i++ ){
+        pred = RK_Traj_Predict( x , i , mant_bits );
+        memcpy( &bx , x + i , sizeof( bx ) );
+        memcpy( &bp , &pred , sizeof( bp ) );
+        xr = bx ^ bp;
 
-    /* Open the file, write header and initial data */
-    fp = fopen( file_name , "w" ); 
-    fprintf( fp , "%s \n" , header );
-    fprintf( fp , "%.10e, " , t_now );
-    for( j = 0; j < Nstate; j++ ){
-        fprintf( fp , "%.10e, " , state_now[ j ] );
+        if( xr == 0 ){
+            RK_Bits_Put( bs , 0 , 1 );
+            continue;
+        }
+        lead = __builtin_clzll( xr );
+        trail = __builtin_ctzll( xr );
+        lead = ( lead > 31 ) ? 31 : lead;
+
+        /* Reuse the window only if it wastes fewer bits than the 11 of a new one (a window opened by a change of sign or
+           exponent would otherwise be kept for the rest of the column) */
+        if( lead >= w_lead && trail >= w_trail && w_lead + w_trail < 64 && ( lead - w_lead ) + ( trail - w_trail ) <= 11 ){
+            RK_Bits_Put( bs , 2 , 2 );
+            RK_Bits_Put( bs , xr >> w_trail , 64 - w_lead - w_trail );
+        }
+        else{
+            RK_Bits_Put( bs , 3 , 2 );
+            RK_Bits_Put( bs , ( uint64_t )lead , 5 );
+            RK_Bits_Put( bs , ( uint64_t )( 63 - lead - trail ) , 6 );
+            RK_Bits_Put( bs , xr >> trail , 64 - lead - trail );
+            w_lead = lead;
+            w_trail = trail;
+        }
+    }
+
+}
+
+/* Decompress a column of n values written by RK_XOR_Encode */
+/* Output:
+    - 0 on success or -1 if the stream ended before the n values (corrupted file) */
+static int RK_XOR_Decode( RK_Bits* bs , double* x , int n , int mant_bits ){
+
+    int i, lead,
+        w_lead = 64, w_trail = 64;
+    double pred;
+    uint64_t bp, xr;
+
+    for( i = 0; i < n; i++ ){
+        pred = RK_Traj_Predict( x , i , mant_bits );
+        memcpy( &bp , &pred , sizeof( bp ) );
+
+        xr = 0;
+        if( RK_Bits_Get( bs , 1 ) != 0 ){
+            if( RK_Bits_Get( bs , 1 ) != 0 ){
+                lead = ( int )RK_Bits_Get( bs , 5 );
+                w_lead = lead;
+                w_trail = 64 - lead - ( int )RK_Bits_Get( bs , 6 ) - 1;
+                if( w_trail < 0 ){
+                    return -1;
+                }
+            }
+            else if( w_lead + w_trail >= 64 ){
+                return -1;
+            }
+            xr = RK_Bits_Get( bs , 64 - w_lead - w_trail ) << w_trail;
+        }
+
+        bp ^= xr;
+        memcpy( x + i , &bp , sizeof( bp ) );
+    }
+
+    return ( bs->i_byte > bs->n_byte ) ? -1 : 0;
+}
+
+/* Cubic Hermite interpolant between two rows at the relative position th ( 0 <= th <= 1 ) */
+/* Same form as RK_Step_Interp without the dense output term -> k0 = h*f0 and k1 = h*f1 */
+static void RK_Hermite( int Nstate , double h , double th , const double* y0 , const double* f0 , const double* y1 , const double* f1 , double* y_int ){
+
+    int i;
+    double r1, r2, r3;
+
+    for( i = 0; i < Nstate; i++ ){
+        r1 = y1[ i ] - y0[ i ];
+        r2 = h*f0[ i ] - r1;
+        r3 = r1 - h*f1[ i ] - r2;
+        y_int[ i ] = y0[ i ] + th*( r1 + ( 1.0 - th )*( r2 + th*r3 ) );
+    }
+
+}
+
+/* Open a binary trajectory file and write a provisional header */
+/* Inputs:
+    - tw: the writer to initialize
+    - file_name: name of the binary file
+    - Nstate: number of quantities in the state
+    - err_tol, pend_coeff[ 5 ], range_int[ 2 ]: run parameters stored in the header
+    - col_names: comma separated column names [ Time , State[ 0 ] , ... ] replacing the free-text header of the .csv
+    - codec: RK_TRAJ_CODEC_RAW or RK_TRAJ_CODEC_XOR
+    - dec_tol, mant_bits: decimation tolerance and mantissa bits of the compressed files (see DP45_Integrator_Packed) */
+/* Output:
+    - 0 on success, -1 if the file could not be opened or the storage could not be allocated */
+static int RK_Traj_Writer_Open( RK_Traj_Writer* tw , char* file_name , int Nstate , double err_tol , double* pend_coeff , double* range_int , char* col_names ,
+                                int codec , double dec_tol , int mant_bits ){
+
+    int j, c;
+    char *p;
+
+    memset( tw , 0 , sizeof( RK_Traj_Writer ) );
+
+    if( Nstate + 1 > RK_TRAJ_NCOL_MAX ){
+        printf( "ERROR: The binary trajectory format supports up to %d columns! \n" , RK_TRAJ_NCOL_MAX );
+        return -1;
+    }
+
+    memcpy( tw->head.magic , RK_TRAJ_MAGIC , 8 );
+    tw->head.version = RK_TRAJ_VERSION;
+    tw->head.Ncol = Nstate + 1;
+    tw->head.chunk_rows = RK_TRAJ_CHUNK_ROWS;
+    tw->head.err_tol = err_tol;
+    for( j = 0; j < 5; j++ ){
+        tw->head.pend_coeff[ j ] = ( pend_coeff != NULL ) ? *( pend_coeff + j ) : 0.0;
+    }
+    tw->head.range_int[ 0 ] = *( range_int );
+    tw->head.range_int[ 1 ] = *( range_int + 1 );
+    if( codec == RK_TRAJ_CODEC_XOR ){
+        tw->head.version = RK_TRAJ_VERSION_XOR;
+        tw->head.codec = RK_TRAJ_CODEC_XOR;
+        tw->head.dec_tol = dec_tol;
+        tw->head.mant_bits = mant_bits;
+    }
+
+    /* Split the column names on commas, skipping the leading spaces of each name */
+    p = col_names;
+    for( j = 0; j < tw->head.Ncol && p != NULL && *p != '\0'; j++ ){
+        while( *p == ' ' ){
+            p++;
+        }
+        for( c = 0; *p != ',' && *p != '\0'; p++ ){
+            if( c < RK_TRAJ_NAME_LEN - 1 ){
+                tw->head.col_names[ j ][ c++ ] = *p;
+            }
+        }
+        /* Drop the trailing spaces */
+        while( c > 0 && tw->head.col_names[ j ][ c - 1 ] == ' ' ){
+            tw->head.col_names[ j ][ --c ] = '\0';
+        }
+        if( *p == ',' ){
+            p++;
+        }
+    }
+
+    tw->chunk = ( double* )malloc( ( size_t )tw->head.Ncol*RK_TRAJ_CHUNK_ROWS*sizeof( double ) );
+    tw->n_index_cap = 64;
+    tw->index = ( double* )malloc( ( size_t )tw->n_index_cap*sizeof( double ) );
+    if( codec == RK_TRAJ_CODEC_XOR ){
+        /* Worst case of a value is the 2 + 5 + 6 + 64 bits of a new window -> at most 10 bytes */
+        tw->zbuf = ( unsigned char* )malloc( ( size_t )tw->head.Ncol*RK_TRAJ_CHUNK_ROWS*10 + 8 );
+        tw->offsets = ( int64_t* )malloc( ( size_t )( tw->n_index_cap + 1 )*sizeof( int64_t ) );
+        tw->win = ( double* )malloc( ( size_t )RK_TRAJ_DEC_WINDOW*tw->head.Ncol*sizeof( double ) );
+        tw->win_f = ( double* )malloc( ( size_t )RK_TRAJ_DEC_WINDOW*Nstate*sizeof( double ) );
+    }
+    tw->fp = fopen( file_name , "wb" );
+
+    if( tw->chunk == NULL || tw->index == NULL || tw->fp == NULL ||
+        ( codec == RK_TRAJ_CODEC_XOR && ( tw->zbuf == NULL || tw->offsets == NULL || tw->win == NULL || tw->win_f == NULL ) ) ){
+        printf( "ERROR: Could not open the binary trajectory file %s \n" , file_name );
+        if( tw->fp != NULL ){
+            fclose( tw->fp );
+        }
+        free( tw->chunk );
+        free( tw->index );
+        free( tw->zbuf );
+        free( tw->offsets );
+        free( tw->win );
+        free( tw->win_f );
+        tw->fp = NULL;
+        return -1;
+    }
+
+    /* Provisional header - the counts are filled in when the file is closed */
+    fwrite( &tw->head , sizeof( RK_Traj_Header ) , 1 , tw->fp );
+
+    return 0;
+}
+
+/* Write out the current (possibly partial) chunk of a binary trajectory file */
+/* NOTE: A partial chunk is padded with NaN so that every chunk has the same size on disk (raw files) */
+static int RK_Traj_Writer_Flush( RK_Traj_Writer* tw ){
+
+    int i, j;
+    double *index_new;
+    int64_t *offsets_new;
+    RK_Bits bs = { tw->zbuf , 0 , 0 , 0 , 0 };
+
+    if( tw->n_chunk == 0 ){
+        return 0;
+    }
+
+    if( tw->head.n_chunks == tw->n_index_cap ){
+        index_new = ( double* )realloc( tw->index , ( size_t )2*tw->n_index_cap*sizeof( double ) );
+        if( index_new == NULL ){
+            return -1;
+        }
+        tw->index = index_new;
+        if( tw->offsets != NULL ){
+            offsets_new = ( int64_t* )realloc( tw->offsets , ( size_t )( 2*tw->n_index_cap + 1 )*sizeof( int64_t ) );
+            if( offsets_new == NULL ){
+                return -1;
+            }
+            tw->offsets = offsets_new;
+        }
+        tw->n_index_cap *= 2;
+    }
+    tw->index[ tw->head.n_chunks ] = tw->chunk[ 0 ];
+
+    /* Compressed chunk -> the valid rows of each column one after the other, padded to a whole byte at the end */
+    if( tw->head.codec == RK_TRAJ_CODEC_XOR ){
+        for( j = 0; j < tw->head.Ncol; j++ ){
+            RK_XOR_Encode( &bs , tw->chunk + j*RK_TRAJ_CHUNK_ROWS , tw->n_chunk , ( j == 0 ) ? 52 : tw->head.mant_bits );
+        }
+        if( bs.n_acc > 0 ){
+            RK_Bits_Put( &bs , 0 , 8 - bs.n_acc );
+        }
+        if( fwrite( tw->zbuf , 1 , ( size_t )bs.n_byte , tw->fp ) != ( size_t )bs.n_byte ){
+            return -1;
+        }
+        tw->offsets[ tw->head.n_chunks ] = tw->n_bytes;
+        tw->n_bytes += bs.n_byte;
+        tw->head.n_chunks += 1;
+        tw->n_chunk = 0;
+        return 0;
+    }
+
+    for( j = 0; j < tw->head.Ncol; j++ ){
+        for( i = tw->n_chunk; i < RK_TRAJ_CHUNK_ROWS; i++ ){
+            tw->chunk[ j*RK_TRAJ_CHUNK_ROWS + i ] = NAN;
+        }
+    }
+
+    if( fwrite( tw->chunk , sizeof( double ) , ( size_t )tw->head.Ncol*RK_TRAJ_CHUNK_ROWS , tw->fp ) != ( size_t )tw->head.Ncol*RK_TRAJ_CHUNK_ROWS ){
+        return -1;
+    }
+
+    tw->head.n_chunks += 1;
+    tw->n_chunk = 0;
+
+    return 0;
+}
+
+/* Append one row to a binary trajectory file */
+static int RK_Traj_Writer_Put( RK_Traj_Writer* tw , int Nstate , double t_now , double* state_now ){
+
+    int j;
+
+    tw->chunk[ tw->n_chunk ] = t_now;
+    for( j = 0; j < Nstate; j++ ){
+        tw->chunk[ ( j + 1 )*RK_TRAJ_CHUNK_ROWS + tw->n_chunk ] = *( state_now + j );
+    }
+    tw->n_chunk += 1;
+    tw->head.n_rows += 1;
+
+    if( tw->n_chunk == RK_TRAJ_CHUNK_ROWS ){
+        return RK_Traj_Writer_Flush( tw );
+    }
+
+    return 0;
+}
+
+/* Decimation of a compressed file -> the rows after the last written one wait in tw->win and the newest of them is written
+   only when the next row can not replace it, i.e. when the cubic Hermite interpolant from the last written row to the next
+   one misses one of the waiting rows by more than dec_tol (or the window is full) */
+/* Inputs:
+    - row[ Ncol ]: the next row (with the state already rounded to mant_bits) */
+static int RK_Traj_Writer_Decimate( RK_Traj_Writer* tw , double* row ){
+
+    int i, j, fits,
+        Nstate = tw->head.Ncol - 1;
+    double f_row[ Nstate ], y_int[ Nstate ], h, *w;
+
+    RHS_Function_Coeff( row + 1 , f_row , tw->head.pend_coeff );
+
+    /* The first row is always written */
+    if( tw->n_kept == 0 ){
+        memcpy( tw->kept , row , ( size_t )tw->head.Ncol*sizeof( double ) );
+        memcpy( tw->f_kept , f_row , ( size_t )Nstate*sizeof( double ) );
+        tw->n_kept = 1;
+        return RK_Traj_Writer_Put( tw , Nstate , *( row ) , row + 1 );
+    }
+
+    /* Can the interpolant from the last written row to this one replace all the waiting rows? */
+    fits = ( tw->n_win < RK_TRAJ_DEC_WINDOW );
+    h = *( row ) - tw->kept[ 0 ];
+    for( i = 0; i < tw->n_win && fits; i++ ){
+        w = tw->win + i*tw->head.Ncol;
+        RK_Hermite( Nstate , h , ( *( w ) - tw->kept[ 0 ] )/h , tw->kept + 1 , tw->f_kept , row + 1 , f_row , y_int );
+        for( j = 0; j < Nstate; j++ ){
+            if( !( fabs( y_int[ j ] - *( w + 1 + j ) ) <= tw->head.dec_tol ) ){
+                fits = 0;
+                break;
+            }
+        }
+    }
+
+    /* If not -> the newest waiting row is written and this one starts a new window */
+    if( !fits ){
+        w = tw->win + ( tw->n_win - 1 )*tw->head.Ncol;
+        memcpy( tw->kept , w , ( size_t )tw->head.Ncol*sizeof( double ) );
+        memcpy( tw->f_kept , tw->win_f + ( tw->n_win - 1 )*Nstate , ( size_t )Nstate*sizeof( double ) );
+        tw->n_win = 0;
+        if( RK_Traj_Writer_Put( tw , Nstate , *( w ) , w + 1 ) != 0 ){
+            return -1;
+        }
+    }
+
+    memcpy( tw->win + tw->n_win*tw->head.Ncol , row , ( size_t )tw->head.Ncol*sizeof( double ) );
+    memcpy( tw->win_f + tw->n_win*Nstate , f_row , ( size_t )Nstate*sizeof( double ) );
+    tw->n_win += 1;
+
+    return 0;
+}
+
+/* Append one row to a binary trajectory file -> for the compressed files the state is rounded and the row can be dropped by the decimation */
+static int RK_Traj_Writer_Append( RK_Traj_Writer* tw , int Nstate , double t_now , double* state_now ){
+
+    int j;
+    double row[ RK_TRAJ_NCOL_MAX ];
+
+    if( tw->head.codec == RK_TRAJ_CODEC_RAW ){
+        return RK_Traj_Writer_Put( tw , Nstate , t_now , state_now );
+    }
+
+    row[ 0 ] = t_now;
+    for( j = 0; j < Nstate; j++ ){
+        row[ j + 1 ] = RK_Traj_Round( *( state_now + j ) , tw->head.mant_bits );
+    }
+    tw->head.n_steps += 1;
+
+    if( tw->head.dec_tol > 0.0 ){
+        return RK_Traj_Writer_Decimate( tw , row );
+    }
+
+    return RK_Traj_Writer_Put( tw , Nstate , row[ 0 ] , row + 1 );
+}
+
+/* Flush the last chunk, write the sparse time index and the final header, then close the binary trajectory file */
+static void RK_Traj_Writer_Close( RK_Traj_Writer* tw ){
+
+    if( tw->fp == NULL ){
+        return;
+    }
+
+    /* The last row of a decimated run is always written */
+    if( tw->n_win > 0 ){
+        RK_Traj_Writer_Put( tw , tw->head.Ncol - 1 , *( tw->win + ( tw->n_win - 1 )*tw->head.Ncol ) , tw->win + ( tw->n_win - 1 )*tw->head.Ncol + 1 );
+        tw->n_win = 0;
+    }
+    RK_Traj_Writer_Flush( tw );
+
+    if( tw->head.codec == RK_TRAJ_CODEC_XOR ){
+        tw->head.index_offset = ( int64_t )sizeof( RK_Traj_Header ) + tw->n_bytes;
+        tw->offsets[ tw->head.n_chunks ] = tw->n_bytes;
+        fwrite( tw->index , sizeof( double ) , ( size_t )tw->head.n_chunks , tw->fp );
+        fwrite( tw->offsets , sizeof( int64_t ) , ( size_t )tw->head.n_chunks + 1 , tw->fp );
+    }
+    else{
+        tw->head.index_offset = ( int64_t )sizeof( RK_Traj_Header ) + tw->head.n_chunks*tw->head.Ncol*( int64_t )RK_TRAJ_CHUNK_ROWS*( int64_t )sizeof( double );
+        fwrite( tw->index , sizeof( double ) , ( size_t )tw->head.n_chunks , tw->fp );
+    }
+
+    fseek( tw->fp , 0 , SEEK_SET );
+    fwrite( &tw->head , sizeof( RK_Traj_Header ) , 1 , tw->fp );
+
+    fclose( tw->fp );
+    free( tw->chunk );
+    free( tw->index );
+    free( tw->zbuf );
+    free( tw->offsets );
+    free( tw->win );
+    free( tw->win_f );
+    tw->fp = NULL;
+
+}
+
+/* Wait for the other side of the background writer ring -> poll a little, then sleep so an idle side does not use a core */
+static void RK_Async_Wait( int* n_poll ){
+
+    struct timespec ts = { 0 , 20000 }; /* 20 us */
+
+    if( *n_poll < RK_ASYNC_SPIN ){
+        *n_poll += 1;
+    }
+    else{
+        nanosleep( &ts , NULL );
+    }
+
+}
+
+/* Writer thread -> writes out the blocks in order until the integration thread is done */
+static void* RK_Async_Run( void* arg ){
+
+    RK_Async_Writer *aw = ( RK_Async_Writer* )arg;
+    long tail = atomic_load_explicit( &aw->tail , memory_order_relaxed );
+    int i, j, n_poll = 0;
+    double *row;
+
+    for( ;; ){
+        if( tail == atomic_load_explicit( &aw->head , memory_order_acquire ) ){
+            /* Nothing to write -> finished if the integration thread is done and nothing came in meanwhile */
+            if( atomic_load_explicit( &aw->done , memory_order_acquire ) &&
+                tail == atomic_load_explicit( &aw->head , memory_order_acquire ) ){
+                break;
+            }
+            RK_Async_Wait( &n_poll );
+            continue;
+        }
+        n_poll = 0;
+
+        /* Same formatting as RK_Write_Row -> the .csv file is identical to the one written directly */
+        for( i = 0; i < aw->n_rows[ tail%RK_ASYNC_NBLOCK ] && !atomic_load_explicit( &aw->error , memory_order_relaxed ); i++ ){
+            row = aw->blocks + ( ( size_t )( tail%RK_ASYNC_NBLOCK )*RK_ASYNC_BLOCK_ROWS + i )*aw->Ncol;
+            if( aw->fp != NULL ){
+                for( j = 0; j < aw->Ncol; j++ ){
+                    fprintf( aw->fp , "%.10e, " , *( row + j ) );
+                }
+                if( fprintf( aw->fp , "\n" ) < 0 ){
+                    atomic_store( &aw->error , 1 );
+                }
+            }
+            if( aw->bin != NULL && RK_Traj_Writer_Append( aw->bin , aw->Ncol - 1 , *( row ) , row + 1 ) != 0 ){
+                atomic_store( &aw->error , 1 );
+            }
+        }
+
+        tail += 1;
+        atomic_store_explicit( &aw->tail , tail , memory_order_release );
+    }
+
+    return NULL;
+}
+
+/* Start the background writer for a .csv and/or binary output */
+/* Inputs:
+    - fp: open .csv file (NULL for none)
+    - bin: open binary trajectory writer (NULL for none)
+    - Nstate: number of quantities in the state */
+/* Output:
+    - 0 on success or -1 if the storage or the thread could not be created -> then the rows should be written directly */
+static int RK_Async_Open( RK_Async_Writer* aw , FILE* fp , RK_Traj_Writer* bin , int Nstate ){
+
+    memset( aw , 0 , sizeof( RK_Async_Writer ) );
+    aw->fp = fp;
+    aw->bin = bin;
+    aw->Ncol = Nstate + 1;
+    atomic_init( &aw->head , 0 );
+    atomic_init( &aw->tail , 0 );
+    atomic_init( &aw->done , 0 );
+    atomic_init( &aw->error , 0 );
+
+    aw->blocks = ( double* )malloc( ( size_t )RK_ASYNC_NBLOCK*RK_ASYNC_BLOCK_ROWS*aw->Ncol*sizeof( double ) );
+    if( aw->blocks == NULL ){
+        return -1;
+    }
+    if( pthread_create( &aw->thread , NULL , RK_Async_Run , aw ) != 0 ){
+        free( aw->blocks );
+        aw->blocks = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Hand the block being filled over to the writer thread */
+static void RK_Async_Push( RK_Async_Writer* aw ){
+
+    long head = atomic_load_explicit( &aw->head , memory_order_relaxed );
+
+    aw->n_rows[ head%RK_ASYNC_NBLOCK ] = aw->n_fill;
+    atomic_store_explicit( &aw->head , head + 1 , memory_order_release );
+    aw->n_fill = 0;
+
+}
+
+/* Copy one row into the current block (integration thread) */
+/* Output:
+    - 0 on success or -1 if the writer thread could not write the output */
+static int RK_Async_Append( RK_Async_Writer* aw , double t_now , double* state_now ){
+
+    long head = atomic_load_explicit( &aw->head , memory_order_relaxed );
+    int j, n_poll = 0;
+    double *row;
+
+    /* Starting a new block -> wait until the writer has freed its slot in the ring */
+    if( aw->n_fill == 0 ){
+        while( head - atomic_load_explicit( &aw->tail , memory_order_acquire ) >= RK_ASYNC_NBLOCK ){
+            RK_Async_Wait( &n_poll );
+        }
+        if( atomic_load_explicit( &aw->error , memory_order_relaxed ) ){
+            return -1;
+        }
+    }
+
+    row = aw->blocks + ( ( size_t )( head%RK_ASYNC_NBLOCK )*RK_ASYNC_BLOCK_ROWS + aw->n_fill )*aw->Ncol;
+    *( row ) = t_now;
+    for( j = 1; j < aw->Ncol; j++ ){
+        *( row + j ) = *( state_now + j - 1 );
+    }
+    aw->n_fill += 1;
+
+    if( aw->n_fill == RK_ASYNC_BLOCK_ROWS ){
+        RK_Async_Push( aw );
+    }
+
+    return 0;
+}
+
+/* Hand over the last rows, wait for the writer thread to write everything out and free the ring */
+/* Output:
+    - 0 on success or -1 if the writer thread could not write the output */
+static int RK_Async_Close( RK_Async_Writer* aw ){
+
+    if( aw->n_fill > 0 ){
+        RK_Async_Push( aw );
+    }
+    atomic_store_explicit( &aw->done , 1 , memory_order_release );
+    pthread_join( aw->thread , NULL );
+    free( aw->blocks );
+    aw->blocks = NULL;
+
+    return atomic_load( &aw->error ) ? -1 : 0;
+}
+
+/* Observables of the double Pendulum in a state -> [ E_kin , E_pot , x_mid , y_mid , x_end , y_end ] (same as main.py) */
+/* Inputs:
+    - obs: the observable settings (pendulum coefficients and arm lengths)
+    - state[ 4 ]: the state of the double Pendulum */
+/* Outputs:
+    - row[ RK_OBS_NCOL - 1 ]: the observables of the state (without the time) */
+static void RK_Obs_Row( const RK_Obs* obs , double* state , double* row ){
+
+    double *pc = obs->pend_coeff;
+    double s_th = sin( *( state ) ), c_th = cos( *( state ) ),
+           s_phi = sin( *( state + 1 ) ), c_phi = cos( *( state + 1 ) );
+
+    /* cos( phi - theta ) from the sines and cosines of the angles which are needed anyway */
+    *( row ) = *( pc )*( *( state + 2 ) )*( *( state + 2 ) ) + *( pc + 1 )*( *( state + 3 ) )*( *( state + 3 ) )
+             + *( pc + 2 )*( c_phi*c_th + s_phi*s_th )*( *( state + 2 ) )*( *( state + 3 ) );
+    *( row + 1 ) = - *( pc + 3 )*c_th - *( pc + 4 )*c_phi;
+    *( row + 2 ) = obs->l1*s_th;
+    *( row + 3 ) = - obs->l1*c_th;
+    *( row + 4 ) = *( row + 2 ) + obs->l2*s_phi;
+    *( row + 5 ) = *( row + 3 ) - obs->l2*c_phi;
+
+}
+
+/* Update the running reductions of the observables with an accepted step (first = 1 initializes them with the initial state) */
+/* Inputs:
+    - obs: the observable settings and the angle branches of the previous step
+    - t_now, state[ 4 ]: time and state after the step
+    - first: 1 for the initial state, 0 for an accepted step */
+/* Outputs:
+    - obs->red: the updated reductions (nothing is done if NULL), obs->k_th and obs->k_phi: the angle branches of this step */
+static void RK_Obs_Step( RK_Obs* obs , double t_now , double* state , int first ){
+
+    RK_Obs_Summary *red = obs->red;
+    long k_th = ( long )floor( ( *( state ) + PI )/( 2.0*PI ) ),
+         k_phi = ( long )floor( ( *( state + 1 ) + PI )/( 2.0*PI ) );
+    double tv1;
+
+    if( red == NULL ){
+        return;
+    }
+
+    if( first ){
+        memset( red , 0 , sizeof( *red ) );
+        red->e_init = Pend_Energy( state , obs->pend_coeff );
+        red->th_min = red->th_max = *( state );
+        red->phi_min = red->phi_max = *( state + 1 );
+    }
+    else{
+        tv1 = fabs( Pend_Energy( state , obs->pend_coeff ) - red->e_init );
+        red->e_drift = ( tv1 > red->e_drift ) ? tv1 : red->e_drift;
+        red->th_min = ( *( state ) < red->th_min ) ? *( state ) : red->th_min;
+        red->th_max = ( *( state ) > red->th_max ) ? *( state ) : red->th_max;
+        red->phi_min = ( *( state + 1 ) < red->phi_min ) ? *( state + 1 ) : red->phi_min;
+        red->phi_max = ( *( state + 1 ) > red->phi_max ) ? *( state + 1 ) : red->phi_max;
+        /* NOTE: The flips are counted between the accepted steps, an arm which goes over the top and back within one step is missed */
+        red->n_flip_th += labs( k_th - obs->k_th );
+        red->n_flip_phi += labs( k_phi - obs->k_phi );
+        red->n_acc += 1;
+    }
+    red->t_final = t_now;
+    obs->k_th = k_th;
+    obs->k_phi = k_phi;
+
+}
+
+/* Write one output row [ t , state[ 0 ] , ... , state[ Nstate - 1 ] ] to all the destinations of the output */
+/* Inputs:
+    - out: the output destinations (NULL to skip the output altogether)
+    - Nstate, t_now, state_now[ Nstate ]: the row to be written */
+/* Output:
+    - 0 on success, -1 if the buffer could not be grown or the binary file could not be written */
+static int RK_Write_Row( RK_Output* out , int Nstate , double t_now , double* state_now ){
+
+    int j;
+    double row[ RK_OBS_NCOL - 1 ]; /* Observable row without the time */
+
+    if( out == NULL ){
+        return 0;
+    }
+
+    if( out->obs != NULL && out->obs->rows != NULL ){
+        RK_Obs_Row( out->obs , state_now , row );
+        if( RK_Buffer_Append( out->obs->rows , RK_OBS_NCOL - 1 , t_now , row ) != 0 ){
+            return -1;
+        }
+    }
+
+    if( out->async != NULL ){
+        if( RK_Async_Append( out->async , t_now , state_now ) != 0 ){
+            return -1;
+        }
+    }
+    else if( out->fp != NULL ){
+        fprintf( out->fp , "%.10e, " , t_now );
+        for( j = 0; j < Nstate; j++ ){
+            fprintf( out->fp , "%.10e, " , *( state_now + j ) );
+        }
+        fprintf( out->fp , "\n" );
+    }
+
+    if( out->buf != NULL && RK_Buffer_Append( out->buf , Nstate , t_now , state_now ) != 0 ){
+        return -1;
+    }
+
+    if( out->async == NULL && out->bin != NULL && RK_Traj_Writer_Append( out->bin , Nstate , t_now , state_now ) != 0 ){
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Free the data of an in-memory output buffer which was grown by the library with realloc (buf->grow == NULL) */
+/* Inputs:
+    - buf: the output buffer -> data is freed and the buffer is reset to empty */
+void RK_Buffer_Free( RK_Buffer* buf ){
+
+    free( buf->data );
+    buf->data = NULL;
+    buf->cap = 0;
+    buf->n = 0;
+
+}
+
+/* Core of the 4th order Runge-Kutta integrator -> writes each point to the file and/or the in-memory buffer */
+/* Inputs: as in RK4_Integrator, with out holding the destinations of the output (NULL for no output) */
+/* Output:
+    - 0 on success, -1 if the output could not be written (the integration is stopped at that point) */
+static int RK4_Core( int Nstate , int Npoints , double* state_init , double* range_int , RK_Output* out ){
+
+    int i, j; /* Iterators */
+    double k_RK[ Nstate ][ 4 ], /* Runge-Kutta intermediate derivatives */
+           state_now[ Nstate ], /* Variable where we keep the current state */
+           int_state[ Nstate ], /* Variable where we keep intermediate state for RK steps */
+           rhs_state[ Nstate ]; /* Right-Hand-Side of the state (derivatives) */ 
+    double t_now, /* Current time value */
+           dt; /* Time step */
+
+    t_now = *( range_int ); /* Initialize time start */
+    dt = ( *( range_int + 1 ) - *( range_int ) )/( ( double )Npoints - 1.0 ); /* Get the interval size from number of points and total interval */
+
+    /* Assign the initial state */
+    for( j = 0; j < Nstate; j++ ){
+        state_now[ j ] = *( state_init + j );
+    }
+
+    /* Write the initial data */
+    if( RK_Write_Row( out , Nstate , t_now , state_now ) != 0 ){
+        return -1;
+    }
+
+    /* Start the main integration loop */
+    for( i = 0; i < Npoints - 1; i++ ){
+        
+        /* Call the RHS function in the current point -> x_i */
+        RHS_Function_HO( state_now , rhs_state );
+        /* Assign RK constant for this point and compute intermediate state */
+        for( j = 0; j < Nstate; j++ ){
+            k_RK[ j ][ 0 ] = rhs_state[ j ]*dt;
+            int_state[ j ] = state_now[ j ] + k_RK[ j ][ 0 ]/2.0; /* x_i + k_1/2 */
+        }
+
+        /* Call the RHS function in the first half-point -> x_i + k_1/2 */
+        RHS_Function_HO( int_state , rhs_state );
+        /* Assign RK constant for this point and compute intermediate state */
+        for( j = 0; j < Nstate; j++ ){
+            k_RK[ j ][ 1 ] = rhs_state[ j ]*dt;
+            int_state[ j ] = state_now[ j ] + k_RK[ j ][ 1 ]/2.0; /* x_i + k_2/2 */
+        }
+
+        /* Call the RHS function in the second half-point -> x_i + k_2/2 */
+        RHS_Function_HO( int_state , rhs_state );
+        /* Assign RK constant for this point and compute intermediate state */
+        for( j = 0; j < Nstate; j++ ){
+            k_RK[ j ][ 2 ] = rhs_state[ j ]*dt;
+            int_state[ j ] = state_now[ j ] + k_RK[ j ][ 2 ]; /* x_i + k_3 */
+        }
+
+        /* Call the RHS function in the next point -> x_i + k_3 */
+        RHS_Function_HO( int_state , rhs_state );
+        /* Assign RK constant for this point - no more intermediate steps */
+        for( j = 0; j < Nstate; j++ ){
+            k_RK[ j ][ 3 ] = rhs_state[ j ]*dt;
+        }
+
+        /* All RK constants for the step have been populated - we can find the next step */
+        for( j = 0; j < Nstate; j++ ){
+            state_now[ j ] += ( k_RK[ j ][ 0 ] + 2.0*k_RK[ j ][ 1 ] + 2.0*k_RK[ j ][ 2 ] + k_RK[ j ][ 3 ] )/6.0;
+        }
+        t_now += dt; /* Increment time */
+
+        /* Write the new state in the output */
+        if( RK_Write_Row( out , Nstate , t_now , state_now ) != 0 ){
+            return -1;
+        }
+
+    }    
+
+    return 0;
+}
+
+
+
+/* 4th order Runge-Kutta integrator for testing purposes */
+/* Inputs:
+    - Nstate: number of quantities in the state (phase space dimension)
+    - Npoints: number of integration points (NOT INTERVALS)
+    - state_init[ Nstate ]: initial state for the integrator
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+    - file_name: a char of the output filename where the results will be written - include .csv in this like "file.csv"
+    - header: a char of the header to start the file with (no need for \n sign) */
+/* Outputs:
+    - The results are written in a file as commas separated values (.csv)
+    -- The format is [ Time , State[ 0 ] , State[ 1 ] , ... State[ Nstate - 1 ] ]
+    -- Reflect this in the header format! */
+void RK4_Integrator( int Nstate , int Npoints , double* state_init , double* range_int , char* file_name , char* header ){
+
+    RK_Output out = { NULL , NULL , NULL }; /* Destinations of the output -> only the .csv file */
+
+    /* Open the file and write the header */
+    out.fp = fopen( file_name , "w" ); 
+    fprintf( out.fp , "%s \n" , header );
+
+    RK4_Core( Nstate , Npoints , state_init , range_int , &out );
+
+    fclose( out.fp ); /* Close the file in the end */
+
+}
+
+/* 4th order Runge-Kutta integrator for testing purposes with in-memory output (no file is written) */
+/* Inputs:
+    - Nstate: number of quantities in the state (phase space dimension)
+    - Npoints: number of integration points (NOT INTERVALS)
+    - state_init[ Nstate ]: initial state for the integrator
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+    - buf: output buffer provided by the caller (see RK_Buffer in RK_Library.h) */
+/* Outputs:
+    - buf->data holds buf->n rows as [ Time , State[ 0 ] , State[ 1 ] , ... State[ Nstate - 1 ] ]
+    -- returns the number of rows or -1 if the buffer could not be grown */
+int RK4_Integrator_Buffer( int Nstate , int Npoints , double* state_init , double* range_int , RK_Buffer* buf ){
+
+    RK_Output out = { NULL , buf , NULL }; /* Destinations of the output -> only the in-memory buffer */
+
+    buf->n = 0;
+
+    if( RK4_Core( Nstate , Npoints , state_init , range_int , &out ) != 0 ){
+        return -1;
+    }
+
+    return buf->n;
+}
+
+/* Mockup RHS value for two decoupled harmonic oscillators - it was used for the initial testing to validate the DP integrator */
+/* NOTE: The second oscillator (at 2*\omega) has dampening by a coefficient 2.0*\beta defined in the function */
+/* State is assumed to be [ \theta , \phi , \omega_theta , \omega_phi ] in arbitrary units of angle and angular velocity */
+/* Inputs:
+    - state[ 4 ]: the state as [ theta , phi , om_theta , om_phi ] */
+/* Outputs:
+    - deriv_state[ 4 ]: the derivative of the state in the same order */
+/*
+void RHS_Function( double* state , double* deriv_state ){
+
+    
+
+    double bet = 0.2;
+
+    *( deriv_state ) = *( state + 2 );
+    *( deriv_state + 1 ) = *( state + 3 ); 
+    *( deriv_state + 2 ) = - Om*Om*( *( state ) );
+    *( deriv_state + 3 ) = - 4.0*Om*Om*( *( state + 1 ) ) - 2.0*bet*( *( state + 3 ) );
+
+}
+*/
+
+/* Right-Hand-Side Function for the double Pendulum with explicitly provided coefficients - inlined body of RHS_Function_Coeff */
+/* NOTE: The specialized step kernels call this directly so the compiler can keep the whole step in registers */
+RK_INLINE void RHS_Pend_Inline( const double* state , double* deriv_state , const double* pend_coeff ){
+
+    double a_th = *( pend_coeff ), /* Local copies of the coefficients */
+           a_phi = *( pend_coeff + 1 ),
+           a_mix = *( pend_coeff + 2 ),
+           b_th = *( pend_coeff + 3 ),
+           b_phi = *( pend_coeff + 4 );
+    double invA[ 2 ][ 2 ]; /* Inverse of the LHS matrix A */
+    double rhs_vec[ 2 ]; /* RHS vector */
+    double sTh = sin( *( state ) ), /* \sin{ \theta } */
+           sDel = sin( *( state + 1 ) - *( state ) ), /* \sin{ \phi - \theta } */
+           cDel = cos( *( state + 1 ) - *( state ) ), /* \cos{ \phi - \theta } */
+           detA = ( 4.0*a_th*a_phi - a_mix*a_mix*cDel*cDel ); /* Determinant of the Left-Hand-Side (LHS) to be inverted */
+    
+    /* Check to see if the system is close to singular and warn in that case */
+    /* NOTE: Analythically this should not be possible but check anyway in case of error in the code! */
+    if( fabs( detA ) < 1e-15 ){
+        printf( "WARNING: The system appears to be going singular at the state: \n" );
+        printf( "theta = %.10e, phi = %.10e, om_theta = %.10e, om_phi = %.10e \n" , *( state ) , *( state + 1 ) , *( state + 2 ) , *( state + 3 ) );
+        printf( "Assuming detA == 1 to continue, results after this point are WRONG!" );
+        detA = 1.0;
+        RK_Singular_Count += 1;
+    }
+
+    /* Get the inverse matrix of the LHS */
+    invA[ 0 ][ 0 ] = 2.0*a_phi/detA;
+    invA[ 0 ][ 1 ] = - a_mix*cDel/detA;
+    invA[ 1 ][ 0 ] = - a_mix*cDel/detA;
+    invA[ 1 ][ 1 ] = 2.0*a_th/detA;
+
+    rhs_vec[ 0 ] = - b_th*sTh + a_mix*sDel*( *( state + 3 ) )*( *( state + 3 ) );
+    rhs_vec[ 1 ] = - b_phi*sin( *( state + 1 ) ) - a_mix*sDel*( *( state + 2 ) )*( *( state + 2 ) );
+
+    /* Write out the derivatives */
+    *( deriv_state ) = *( state + 2 );
+    *( deriv_state + 1 ) = *( state + 3 ); 
+    *( deriv_state + 2 ) = invA[ 0 ][ 0 ]*rhs_vec[ 0 ] + invA[ 0 ][ 1 ]*rhs_vec[ 1 ];
+    *( deriv_state + 3 ) = invA[ 1 ][ 0 ]*rhs_vec[ 0 ] + invA[ 1 ][ 1 ]*rhs_vec[ 1 ];
+
+}
+
+/* Right-Hand-Side Function for the double Pendulum with explicitly provided coefficients (instead of the global ones) */
+/* State is assumed to be [ \theta , \phi , \omega_theta , \omega_phi ] in arbitrary units of angle and angular velocity */
+/* Inputs:
+    - state[ 4 ]: the state as [ theta , phi , om_theta , om_phi ]
+    - pend_coeff[ 5 ]: the coefficients a_th to b_phi in sequence (same order as in Set_Pend_coeff) */
+/* Outputs:
+    - deriv_state[ 4 ]: the derivative of the state in the same order */
+void RHS_Function_Coeff( double* state , double* deriv_state , double* pend_coeff ){
+
+    RHS_Pend_Inline( state , deriv_state , pend_coeff );
+
+}
+
+/* Right-Hand-Side Function for the double Pendulum with properties defined above */
+/* State is assumed to be [ \theta , \phi , \omega_theta , \omega_phi ] in arbitrary units of angle and angular velocity */
+/* Inputs:
+    - state[ 4 ]: the state as [ theta , phi , om_theta , om_phi ] */
+/* Outputs:
+    - deriv_state[ 4 ]: the derivative of the state in the same order */
+void RHS_Function( double* state , double* deriv_state ){
+
+    RHS_Function_Coeff( state , deriv_state , RK_Default.pend_coeff );
+
+}
+
+/* Total energy of the double Pendulum (kinetic + potential) for the given state */
+/* The same expression as used in main.py: E = a_th*om_th^2 + a_phi*om_phi^2 + a_mix*cos( phi - theta )*om_th*om_phi - b_th*cos( theta ) - b_phi*cos( phi ) */
+/* Inputs:
+    - state[ 4 ]: the state as [ theta , phi , om_theta , om_phi ]
+    - pend_coeff[ 5 ]: the coefficients a_th to b_phi in sequence (same order as in Set_Pend_coeff) */
+/* Output:
+    - the total energy in the units of the coefficients */
+double Pend_Energy( double* state , double* pend_coeff ){
+
+    return *( pend_coeff )*( *( state + 2 ) )*( *( state + 2 ) )
+         + *( pend_coeff + 1 )*( *( state + 3 ) )*( *( state + 3 ) )
+         + *( pend_coeff + 2 )*cos( *( state + 1 ) - *( state ) )*( *( state + 2 ) )*( *( state + 3 ) )
+         - *( pend_coeff + 3 )*cos( *( state ) )
+         - *( pend_coeff + 4 )*cos( *( state + 1 ) );
+
+}
+
+/* N-link planar Pendulum -> a chain of rigid links, link i hangs from the end of link i - 1 (the first one from the origin) */
+/* The state is [ theta_0 , ... , theta_{N-1} , om_0 , ... , om_{N-1} ] with the absolute angles from the downward vertical
+   (the same convention as [ theta , phi , om_theta , om_phi ] of the double Pendulum). The centre of mass of a link is at the
+   middle of its length. */
+
+/* Workspace of a link in RK_Chain_RHS -> spatial vectors [ angular , x , y ] about the origin */
+typedef struct {
+    double px, py, /* Pivot of the link */
+           c[ 3 ], /* Velocity-product acceleration */
+           IA[ 6 ], /* Articulated inertia (upper triangle of the symmetric 3 x 3 matrix, row by row) */
+           pA[ 3 ], /* Articulated bias force */
+           U[ 3 ], D, u; /* IA*S, S^T*IA*S and the bias of the joint */
+} Chain_Link_Work;
+
+struct RK_Chain {
+    int Nlink; /* Number of links N */
+    double g_acc; /* Gravitational acceleration */
+    double *length, /* [ N ] link lengths */
+           *mass, /* [ N ] link masses */
+           *inertia; /* [ N ] moments of inertia about the centres of mass */
+    Chain_Link_Work *work; /* [ N ] workspace of the Right-Hand-Side -> reused by every call */
+};
+
+/* Allocate an N-link Pendulum */
+RK_Chain* RK_Chain_Create( int Nlink , double* length , double* mass , double* inertia , double g_acc ){
+
+    RK_Chain *chain;
+    int i;
+
+    if( Nlink < 1 || Nlink > RK_CHAIN_NLINK_MAX ){
+        printf( "ERROR: The chain must have between 1 and %d links! \n" , RK_CHAIN_NLINK_MAX );
+        return NULL;
+    }
+    for( i = 0; i < Nlink; i++ ){
+        if( !( *( length + i ) > 0.0 ) || !( *( mass + i ) > 0.0 ) || ( inertia != NULL && !( *( inertia + i ) >= 0.0 ) ) ){
+            printf( "ERROR: Link %d of the chain needs a positive length and mass and a non-negative inertia! \n" , i );
+            return NULL;
+        }
+    }
+
+    chain = ( RK_Chain* )calloc( 1 , sizeof( RK_Chain ) );
+    if( chain == NULL ){
+        return NULL;
+    }
+    chain->Nlink = Nlink;
+    chain->g_acc = g_acc;
+    chain->length = ( double* )malloc( 3*sizeof( double )*( size_t )Nlink );
+    chain->work = ( Chain_Link_Work* )malloc( sizeof( Chain_Link_Work )*( size_t )Nlink );
+    if( chain->length == NULL || chain->work == NULL ){
+        RK_Chain_Free( chain );
+        return NULL;
+    }
+    chain->mass = chain->length + Nlink;
+    chain->inertia = chain->length + 2*Nlink;
+    for( i = 0; i < Nlink; i++ ){
+        chain->length[ i ] = *( length + i );
+        chain->mass[ i ] = *( mass + i );
+        /* Default to a uniform rod */
+        chain->inertia[ i ] = ( inertia != NULL ) ? *( inertia + i ) : *( mass + i )*( *( length + i ) )*( *( length + i ) )/12.0;
+    }
+
+    return chain;
+}
+
+/* Free an N-link Pendulum */
+void RK_Chain_Free( RK_Chain* chain ){
+
+    if( chain == NULL ){
+        return;
+    }
+    free( chain->length );
+    free( chain->work );
+    free( chain );
+
+}
+
+/* Number of links of an N-link Pendulum -> the state has 2*Nlink quantities */
+int RK_Chain_Nlink( RK_Chain* chain ){
+
+    return chain->Nlink;
+}
+
+/* Right-Hand-Side Function for the N-link Pendulum -> articulated-body algorithm in O( N ) */
+/* Instead of building and inverting the N x N mass matrix (O( N^3 ) per call) the accelerations come from three sweeps along
+   the chain (Featherstone's articulated-body algorithm). The planar spatial vectors [ angular , x , y ] are all expressed in
+   the fixed frame about the origin, so no transformations are needed between the links: joint i at the pivot p_i has the
+   motion subspace S_i = [ 1 , p_y , -p_x ] and gravity enters as the acceleration [ 0 , 0 , g_acc ] of the base.
+    1. outwards: joint velocities om_i - om_{i-1}, velocity-product accelerations c_i and bias forces of the single links
+    2. inwards: articulated inertias IA_i and bias forces pA_i, each link is added to its parent once the joint is solved out
+    3. outwards: joint accelerations, summed into the absolute angular accelerations */
+/* Inputs:
+    - chain: the N-link Pendulum (its workspace is overwritten -> do not share a chain between threads)
+    - state[ 2*N ]: the state as [ theta_0 , ... , theta_{N-1} , om_0 , ... , om_{N-1} ] */
+/* Outputs:
+    - deriv_state[ 2*N ]: the derivative of the state in the same order */
+void RK_Chain_RHS( RK_Chain* chain , double* state , double* deriv_state ){
+
+    int N = chain->Nlink, i;
+    Chain_Link_Work *w;
+    double px = 0.0, py = 0.0, /* Pivot of the link */
+           v0 = 0.0, v1 = 0.0, v2 = 0.0, /* Spatial velocity of the link */
+           s_th, c_th, /* Sine and cosine of the link angle */
+           qd, /* Joint velocity (relative to the parent link) */
+           d, m, cx, cy, h1, h2, /* Half length, mass, centre of mass and linear momentum of the link */
+           Ia[ 6 ], /* Articulated inertia passed to the parent */
+           a0, a1, a2, /* Spatial acceleration */
+           qdd, th_dd = 0.0; /* Joint and absolute angular accelerations */
+
+    /* Outwards sweep -> kinematics and the rigid body inertias and bias forces */
+    for( i = 0; i < N; i++ ){
+        w = chain->work + i;
+        s_th = sin( *( state + i ) );
+        c_th = cos( *( state + i ) );
+        qd = *( state + N + i ) - ( ( i > 0 ) ? *( state + N + i - 1 ) : 0.0 );
+
+        w->px = px;
+        w->py = py;
+        /* v = v_parent + S*qd and c = v x S*qd */
+        v0 += qd;
+        v1 += py*qd;
+        v2 -= px*qd;
+        w->c[ 0 ] = 0.0;
+        w->c[ 1 ] = qd*( v2 + v0*px );
+        w->c[ 2 ] = qd*( v0*py - v1 );
+
+        /* Spatial inertia about the origin (symmetric, upper triangle) */
+        d = 0.5*chain->length[ i ];
+        m = chain->mass[ i ];
+        cx = px + d*s_th;
+        cy = py - d*c_th;
+        w->IA[ 0 ] = chain->inertia[ i ] + m*( cx*cx + cy*cy );
+        w->IA[ 1 ] = - m*cy;
+        w->IA[ 2 ] = m*cx;
+        w->IA[ 3 ] = m;
+        w->IA[ 4 ] = 0.0;
+        w->IA[ 5 ] = m;
+
+        /* Bias force v x* ( I*v ) -> the angular momentum drops out in the plane */
+        h1 = w->IA[ 1 ]*v0 + m*v1;
+        h2 = w->IA[ 2 ]*v0 + m*v2;
+        w->pA[ 0 ] = v1*h2 - v2*h1;
+        w->pA[ 1 ] = - v0*h2;
+        w->pA[ 2 ] = v0*h1;
+
+        px += chain->length[ i ]*s_th;
+        py -= chain->length[ i ]*c_th;
+    }
+
+    /* Inwards sweep -> articulated inertias and bias forces */
+    for( i = N - 1; i >= 0; i-- ){
+        w = chain->work + i;
+        /* U = IA*S with S = [ 1 , py , -px ] */
+        w->U[ 0 ] = w->IA[ 0 ] + w->IA[ 1 ]*w->py - w->IA[ 2 ]*w->px;
+        w->U[ 1 ] = w->IA[ 1 ] + w->IA[ 3 ]*w->py - w->IA[ 4 ]*w->px;
+        w->U[ 2 ] = w->IA[ 2 ] + w->IA[ 4 ]*w->py - w->IA[ 5 ]*w->px;
+        w->D = w->U[ 0 ] + w->U[ 1 ]*w->py - w->U[ 2 ]*w->px;
+        w->u = - ( w->pA[ 0 ] + w->pA[ 1 ]*w->py - w->pA[ 2 ]*w->px ); /* No joint torques */
+        if( i == 0 ){
+            break;
+        }
+
+        /* Ia = IA - U*U^T/D and pa = pA + Ia*c + U*u/D go to the parent */
+        Ia[ 0 ] = w->IA[ 0 ] - w->U[ 0 ]*w->U[ 0 ]/w->D;
+        Ia[ 1 ] = w->IA[ 1 ] - w->U[ 0 ]*w->U[ 1 ]/w->D;
+        Ia[ 2 ] = w->IA[ 2 ] - w->U[ 0 ]*w->U[ 2 ]/w->D;
+        Ia[ 3 ] = w->IA[ 3 ] - w->U[ 1 ]*w->U[ 1 ]/w->D;
+        Ia[ 4 ] = w->IA[ 4 ] - w->U[ 1 ]*w->U[ 2 ]/w->D;
+        Ia[ 5 ] = w->IA[ 5 ] - w->U[ 2 ]*w->U[ 2 ]/w->D;
+        ( w - 1 )->pA[ 0 ] += w->pA[ 0 ] + Ia[ 0 ]*w->c[ 0 ] + Ia[ 1 ]*w->c[ 1 ] + Ia[ 2 ]*w->c[ 2 ] + w->U[ 0 ]*w->u/w->D;
+        ( w - 1 )->pA[ 1 ] += w->pA[ 1 ] + Ia[ 1 ]*w->c[ 0 ] + Ia[ 3 ]*w->c[ 1 ] + Ia[ 4 ]*w->c[ 2 ] + w->U[ 1 ]*w->u/w->D;
+        ( w - 1 )->pA[ 2 ] += w->pA[ 2 ] + Ia[ 2 ]*w->c[ 0 ] + Ia[ 4 ]*w->c[ 1 ] + Ia[ 5 ]*w->c[ 2 ] + w->U[ 2 ]*w->u/w->D;
+        ( w - 1 )->IA[ 0 ] += Ia[ 0 ];
+        ( w - 1 )->IA[ 1 ] += Ia[ 1 ];
+        ( w - 1 )->IA[ 2 ] += Ia[ 2 ];
+        ( w - 1 )->IA[ 3 ] += Ia[ 3 ];
+        ( w - 1 )->IA[ 4 ] += Ia[ 4 ];
+        ( w - 1 )->IA[ 5 ] += Ia[ 5 ];
+    }
+
+    /* Outwards sweep -> accelerations starting from the base accelerated upwards by gravity */
+    a0 = 0.0;
+    a1 = 0.0;
+    a2 = chain->g_acc;
+    for( i = 0; i < N; i++ ){
+        w = chain->work + i;
+        a0 += w->c[ 0 ];
+        a1 += w->c[ 1 ];
+        a2 += w->c[ 2 ];
+        qdd = ( w->u - w->U[ 0 ]*a0 - w->U[ 1 ]*a1 - w->U[ 2 ]*a2 )/w->D;
+        a0 += qdd;
+        a1 += w->py*qdd;
+        a2 -= w->px*qdd;
+
+        th_dd += qdd;
+        *( deriv_state + i ) = *( state + N + i );
+        *( deriv_state + N + i ) = th_dd;
+    }
+
+}
+
+/* Total energy of the N-link Pendulum (kinetic + potential, zero potential at the height of the origin) in O( N ) */
+/* Inputs:
+    - chain: the N-link Pendulum
+    - state[ 2*N ]: the state as [ theta_0 , ... , theta_{N-1} , om_0 , ... , om_{N-1} ] */
+/* Output:
+    - the total energy */
+double RK_Chain_Energy( RK_Chain* chain , double* state ){
+
+    int N = chain->Nlink, i;
+    double vx = 0.0, vy = 0.0, py = 0.0, /* Velocity and height of the pivot */
+           s_th, c_th, om, d, vcx, vcy, e_tot = 0.0;
+
+    for( i = 0; i < N; i++ ){
+        s_th = sin( *( state + i ) );
+        c_th = cos( *( state + i ) );
+        om = *( state + N + i );
+        d = 0.5*chain->length[ i ];
+
+        vcx = vx + d*om*c_th;
+        vcy = vy + d*om*s_th;
+        e_tot += 0.5*chain->mass[ i ]*( vcx*vcx + vcy*vcy ) + 0.5*chain->inertia[ i ]*om*om
+               + chain->mass[ i ]*chain->g_acc*( py - d*c_th );
+
+        vx += chain->length[ i ]*om*c_th;
+        vy += chain->length[ i ]*om*s_th;
+        py -= chain->length[ i ]*c_th;
+    }
+
+    return e_tot;
+}
+
+/* Positions of the link ends of the N-link Pendulum (for plotting) */
+/* Inputs:
+    - chain: the N-link Pendulum
+    - state[ 2*N ]: the state (only the angles are used) */
+/* Outputs:
+    - xy[ N ][ 2 ]: the end points [ x , y ] of the links */
+void RK_Chain_Positions( RK_Chain* chain , double* state , double* xy ){
+
+    int i;
+    double px = 0.0, py = 0.0;
+
+    for( i = 0; i < chain->Nlink; i++ ){
+        px += chain->length[ i ]*sin( *( state + i ) );
+        py -= chain->length[ i ]*cos( *( state + i ) );
+        *( xy + 2*i ) = px;
+        *( xy + 2*i + 1 ) = py;
+    }
+
+}
+
+/* Right-Hand-Side of the model of an integration -> the N-link Pendulum if chain is set, the double Pendulum otherwise */
+RK_INLINE void RK_Model_RHS( RK_Chain* chain , double* state , double* deriv_state , double* pend_coeff ){
+
+    if( chain != NULL ){
+        RK_Chain_RHS( chain , state , deriv_state );
+    }
+    else{
+        RHS_Function_Coeff( state , deriv_state , pend_coeff );
+    }
+
+}
+
+/* Energy of the model of an integration (see RK_Model_RHS) */
+RK_INLINE double RK_Model_Energy( RK_Chain* chain , double* state , double* pend_coeff ){
+
+    return ( chain != NULL ) ? RK_Chain_Energy( chain , state ) : Pend_Energy( state , pend_coeff );
+}
+
+/* Right-Hand-Side Function for the double Pendulum evaluated for many states at once (batch mode) */
+/* The states are kept as structure-of-arrays: quantity j of lane l is at state[ j*Nstride + l ]
+   so that the loop over the lanes is contiguous and can be vectorized by the compiler */
+/* Inputs:
+    - Nlane: number of lanes (states) to evaluate
+    - Nstride: distance between two consecutive quantities of the same lane (Nstride >= Nlane)
+    - state[ 4 ][ Nstride ]: the states as [ theta , phi , om_theta , om_phi ] rows
+    - pend_coeff[ 5 ]: the coefficients a_th to b_phi in sequence (same order as in Set_Pend_coeff) */
+/* Outputs:
+    - deriv_state[ 4 ][ Nstride ]: the derivatives of the states in the same layout */
+void RHS_Function_Batch( int Nlane , int Nstride , double* restrict state , double* restrict deriv_state , double* pend_coeff ){
+
+    int l; /* Iterator over the lanes */
+    double a_th = *( pend_coeff ), /* Local copies of the coefficients */
+           a_phi = *( pend_coeff + 1 ),
+           a_mix = *( pend_coeff + 2 ),
+           b_th = *( pend_coeff + 3 ),
+           b_phi = *( pend_coeff + 4 );
+    double sTh, cDel, sDel, detA; /* Same intermediate quantities as in RHS_Function */
+    double rhs_0, rhs_1; /* RHS vector */
+
+    for( l = 0; l < Nlane; l++ ){
+
+        sTh = sin( state[ l ] );
+        sDel = sin( state[ Nstride + l ] - state[ l ] );
+        cDel = cos( state[ Nstride + l ] - state[ l ] );
+        detA = ( 4.0*a_th*a_phi - a_mix*a_mix*cDel*cDel );
+
+        /* NOTE: Analythically this should not be possible, same treatment as in RHS_Function (without the printout for each lane) */
+        if( fabs( detA ) < 1e-15 ){
+            detA = 1.0;
+        }
+
+        rhs_0 = - b_th*sTh + a_mix*sDel*state[ 3*Nstride + l ]*state[ 3*Nstride + l ];
+        rhs_1 = - b_phi*sin( state[ Nstride + l ] ) - a_mix*sDel*state[ 2*Nstride + l ]*state[ 2*Nstride + l ];
+
+        /* Write out the derivatives */
+        deriv_state[ l ] = state[ 2*Nstride + l ];
+        deriv_state[ Nstride + l ] = state[ 3*Nstride + l ];
+        deriv_state[ 2*Nstride + l ] = ( 2.0*a_phi*rhs_0 - a_mix*cDel*rhs_1 )/detA;
+        deriv_state[ 3*Nstride + l ] = ( - a_mix*cDel*rhs_0 + 2.0*a_th*rhs_1 )/detA;
+    }
+
+}
+
+/* Sine and cosine of x without branches (so the loops calling it vectorize) -> fdlibm kernels with a Cody-Waite reduction */
+/* x is reduced to r + y = x - q*pi/2 with |r| <= pi/4 (y is the rounding error of r, kept for the last bit) and the
+   quadrant q mod 4 selects the polynomial and sign. The error is below 1 ULP for |x| < RK_SINCOS_XMAX. */
+/* Inputs:
+    - x: the angle in radians, |x| < RK_SINCOS_XMAX */
+/* Outputs:
+    - s_x, c_x: sin( x ) and cos( x ) */
+RK_INLINE void RK_Sincos( double x , double* s_x , double* c_x ){
+
+    double q = ( x*SC_2_PI + SC_ROUND ) - SC_ROUND; /* Nearest multiple of pi/2 */
+    int n = ( int )q; /* Quadrant */
+    double a = x - q*SC_PIO2_1, /* Exact for |q| < 2^20 */
+           w = q*SC_PIO2_2, /* Exact as well */
+           r0 = a - w,
+           tv1 = q*SC_PIO2_2T - ( ( a - r0 ) - w ), /* Rest of the reduction with the rounding error of r0 */
+           r = r0 - tv1,
+           y = ( r0 - r ) - tv1,
+           z = r*r,
+           v = z*r,
+           p_s, p_c, s_r, c_r, hz;
+
+    p_s = SC_S2 + z*( SC_S3 + z*( SC_S4 + z*( SC_S5 + z*SC_S6 ) ) );
+    s_r = r - ( ( z*( 0.5*y - v*p_s ) - y ) - v*SC_S1 );
+    p_c = z*( SC_C1 + z*( SC_C2 + z*( SC_C3 + z*( SC_C4 + z*( SC_C5 + z*SC_C6 ) ) ) ) );
+    hz = 0.5*z;
+    w = 1.0 - hz;
+    c_r = w + ( ( ( 1.0 - w ) - hz ) + ( z*p_c - r*y ) );
+
+    /* sin and cos swap in the odd quadrants, sin is negative in the quadrants 2 and 3 and cos in 1 and 2 */
+    *s_x = ( n & 1 ) ? c_r : s_r;
+    *c_x = ( n & 1 ) ? s_r : c_r;
+    *s_x = ( n & 2 ) ? - *s_x : *s_x;
+    *c_x = ( ( n + 1 ) & 2 ) ? - *c_x : *c_x;
+
+}
+
+/* Same as RHS_Function_Batch with RK_Sincos -> sin( phi - theta ) and cos( phi - theta ) come from the angle-difference
+   identities, so the 5 libm calls per state are replaced by 2 branch-free sincos and the loop vectorizes */
+/* NOTE: The body is a macro so the fast (FMA) and exact (no FMA) kernels below are the same code */
+#define RHS_PEND_SINCOS_LOOP \
+    for( l = 0; l < Nlane; l++ ){ \
+        RK_Sincos( state[ l ] , &sTh , &cTh ); \
+        RK_Sincos( state[ Nstride + l ] , &sPh , &cPh ); \
+        big |= ( fabs( state[ l ] ) >= RK_SINCOS_XMAX ) | ( fabs( state[ Nstride + l ] ) >= RK_SINCOS_XMAX ); \
+        sDel = sPh*cTh - cPh*sTh; \
+        cDel = cPh*cTh + sPh*sTh; \
+        detA = 4.0*a_th*a_phi - a_mix*a_mix*cDel*cDel; \
+        inv_det = 1.0/( ( fabs( detA ) < 1e-15 ) ? 1.0 : detA ); \
+        rhs_0 = - b_th*sTh + a_mix*sDel*state[ 3*Nstride + l ]*state[ 3*Nstride + l ]; \
+        rhs_1 = - b_phi*sPh - a_mix*sDel*state[ 2*Nstride + l ]*state[ 2*Nstride + l ]; \
+        deriv_state[ l ] = state[ 2*Nstride + l ]; \
+        deriv_state[ Nstride + l ] = state[ 3*Nstride + l ]; \
+        deriv_state[ 2*Nstride + l ] = ( 2.0*a_phi*rhs_0 - a_mix*cDel*rhs_1 )*inv_det; \
+        deriv_state[ 3*Nstride + l ] = ( - a_mix*cDel*rhs_0 + 2.0*a_th*rhs_1 )*inv_det; \
+    }
+
+#define RHS_PEND_SINCOS_KERNEL( NAME , ATTR ) \
+ATTR static int NAME( int Nlane , int Nstride , double* restrict state , double* restrict deriv_state , const double* pend_coeff ){ \
+    int l, big = 0; \
+    double a_th = *( pend_coeff ), a_phi = *( pend_coeff + 1 ), a_mix = *( pend_coeff + 2 ), \
+           b_th = *( pend_coeff + 3 ), b_phi = *( pend_coeff + 4 ); \
+    double sTh, cTh, sPh, cPh, sDel, cDel, detA, inv_det, rhs_0, rhs_1; \
+    RHS_PEND_SINCOS_LOOP \
+    return big; \
+}
+
+RHS_PEND_SINCOS_KERNEL( RHS_Batch_Sincos_Fast , RK_SIMD_CLONES )
+RHS_PEND_SINCOS_KERNEL( RHS_Batch_Sincos_Exact , RK_SIMD_EXACT )
+
+/* Vectorized Right-Hand-Side Function for the double Pendulum evaluated for many states at once (see RK_RHS_FAST) */
+/* Inputs:
+    - Nlane, Nstride, state[ 4 ][ Nstride ], pend_coeff[ 5 ]: same as in RHS_Function_Batch
+    - repro: 0 for the fastest kernel of the CPU (RK_RHS_FAST), 1 for the bitwise reproducible one (RK_RHS_REPRO) */
+/* Outputs:
+    - deriv_state[ 4 ][ Nstride ]: the derivatives of the states in the same layout */
+void RHS_Function_Batch_Fast( int Nlane , int Nstride , double* restrict state , double* restrict deriv_state , double* pend_coeff , int repro ){
+
+    int big; /* 1 if some angle is out of the range of RK_Sincos */
+
+    if( repro ){
+        big = RHS_Batch_Sincos_Exact( Nlane , Nstride , state , deriv_state , pend_coeff );
+    }
+    else{
+        big = RHS_Batch_Sincos_Fast( Nlane , Nstride , state , deriv_state , pend_coeff );
+    }
+
+    /* Very large angles (a pendulum rotating for a long time) -> redo the whole call with libm */
+    if( big ){
+        RHS_Function_Batch( Nlane , Nstride , state , deriv_state , pend_coeff );
+    }
+
+}
+
+/* Batch Right-Hand-Side of the selected RK_RHS_* kernel */
+static void RHS_Function_Batch_Mode( int rhs_mode , int Nlane , int Nstride , double* state , double* deriv_state , double* pend_coeff ){
+
+    if( rhs_mode == RK_RHS_LIBM ){
+        RHS_Function_Batch( Nlane , Nstride , state , deriv_state , pend_coeff );
+    }
+    else{
+        RHS_Function_Batch_Fast( Nlane , Nstride , state , deriv_state , pend_coeff , rhs_mode == RK_RHS_REPRO );
+    }
+
+}
+
+/* Single precision sine and cosine without branches (see RK_Sincos) -> the error is a few ULP of float for |x| < 1e4 */
+/* NOTE: Only used for the angles of the flip screening, which stay within a step of [ -pi , pi ] */
+RK_INLINE void RK_Sincosf( float x , float* s_x , float* c_x ){
+
+    float q = ( x*SCF_2_PI + SCF_ROUND ) - SCF_ROUND; /* Nearest multiple of pi/2 */
+    int n = ( int )q; /* Quadrant */
+    float r = ( ( x - q*SCF_PIO2_1 ) - q*SCF_PIO2_2 ) - q*SCF_PIO2_3,
+          z = r*r,
+          s_r = r + r*z*( SCF_S1 + z*( SCF_S2 + z*SCF_S3 ) ),
+          c_r = 1.0f - 0.5f*z + z*z*( SCF_C1 + z*( SCF_C2 + z*SCF_C3 ) );
+
+    *s_x = ( n & 1 ) ? c_r : s_r;
+    *c_x = ( n & 1 ) ? s_r : c_r;
+    *s_x = ( n & 2 ) ? - *s_x : *s_x;
+    *c_x = ( ( n + 1 ) & 2 ) ? - *c_x : *c_x;
+
+}
+
+/* Single precision Right-Hand-Side of the double Pendulum for many states at once -> same expressions as RHS_Batch_Sincos_Fast
+   with twice the lanes per vector and half the memory traffic */
+/* Inputs:
+    - Nlane, Nstride: same as in RHS_Function_Batch
+    - state[ 4 ][ Nstride ]: the states in single precision
+    - pc[ 5 ]: the pendulum coefficients in single precision */
+/* Outputs:
+    - deriv_state[ 4 ][ Nstride ]: the derivatives of the states in the same layout */
+RK_SIMD_CLONES static void RHS_Batch_F32( int Nlane , int Nstride , float* restrict state , float* restrict deriv_state , const float* pc ){
+
+    int l;
+    float a_th = pc[ 0 ], a_phi = pc[ 1 ], a_mix = pc[ 2 ], b_th = pc[ 3 ], b_phi = pc[ 4 ];
+    float sTh, cTh, sPh, cPh, sDel, cDel, detA, inv_det, rhs_0, rhs_1;
+
+    for( l = 0; l < Nlane; l++ ){
+        RK_Sincosf( state[ l ] , &sTh , &cTh );
+        RK_Sincosf( state[ Nstride + l ] , &sPh , &cPh );
+        sDel = sPh*cTh - cPh*sTh;
+        cDel = cPh*cTh + sPh*sTh;
+        detA = 4.0f*a_th*a_phi - a_mix*a_mix*cDel*cDel;
+        inv_det = 1.0f/( ( fabsf( detA ) < 1e-15f ) ? 1.0f : detA );
+        rhs_0 = - b_th*sTh + a_mix*sDel*state[ 3*Nstride + l ]*state[ 3*Nstride + l ];
+        rhs_1 = - b_phi*sPh - a_mix*sDel*state[ 2*Nstride + l ]*state[ 2*Nstride + l ];
+        deriv_state[ l ] = state[ 2*Nstride + l ];
+        deriv_state[ Nstride + l ] = state[ 3*Nstride + l ];
+        deriv_state[ 2*Nstride + l ] = ( 2.0f*a_phi*rhs_0 - a_mix*cDel*rhs_1 )*inv_det;
+        deriv_state[ 3*Nstride + l ] = ( - a_mix*cDel*rhs_0 + 2.0f*a_th*rhs_1 )*inv_det;
+    }
+
+}
+
+/* Write all the dense output rows which fall inside the accepted Dormand-Prince step [ t_old , t_old + h ] */
+/* The 4th order continuous extension of Dormand-Prince is used:
+   y( t_old + th*h ) = y0 + th*( r1 + ( 1 - th )*( r2 + th*( r3 + ( 1 - th )*r4 ) ) ) with
+   r1 = y1 - y0, r2 = k1 - r1, r3 = r1 - k7 - r2, r4 = sum_i( d[ i ]*k_i ) */
+/* Inputs:
+    - tab: tableau of the method (its dense output coefficients are used)
+    - out: output destinations with the dense output times (out->t_out != NULL)
+    - Nstate: number of quantities in the state
+    - t_old, h: start and size of the accepted step
+    - y_old[ Nstate ], y_new[ Nstate ]: states at the start and at the end of the step
+    - k_DP[ Nstate ][ RK_NSTAGE_MAX ]: Dormand-Prince intermediate derivatives of the step (already multiplied by h) */
+/* Output:
+    - 0 on success, -1 if the output could not be written */
+static int DP45_Dense_Rows( const RK_Tableau* tab , RK_Output* out , int Nstate , double t_old , double h , double* y_old , double* y_new , double k_DP[ Nstate ][ RK_NSTAGE_MAX ] ){
+
+    int i, j;
+    double th, r1, r2, r3, r4, /* Relative position inside the step and the interpolation coefficients */
+           y_int[ Nstate ]; /* Interpolated state */
+
+    while( out->i_out < out->Nout && *( out->t_out + out->i_out ) <= t_old + h ){
+
+        th = ( *( out->t_out + out->i_out ) - t_old )/h;
+
+        for( i = 0; i < Nstate; i++ ){
+            r1 = y_new[ i ] - y_old[ i ];
+            r2 = k_DP[ i ][ 0 ] - r1;
+            r3 = r1 - k_DP[ i ][ 6 ] - r2;
+            r4 = 0.0;
+            for( j = 0; j < 7; j++ ){
+                r4 += tab->d[ j ]*k_DP[ i ][ j ];
+            }
+            y_int[ i ] = y_old[ i ] + th*( r1 + ( 1.0 - th )*( r2 + th*( r3 + ( 1.0 - th )*r4 ) ) );
+        }
+
+        if( RK_Write_Row( out , Nstate , *( out->t_out + out->i_out ) , y_int ) != 0 ){
+            return -1;
+        }
+        out->i_out += 1;
+    }
+
+    return 0;
+}
+
+/* Evaluate an event function -> the user function or the linear event g = sum_i( c[ i ]*state[ i ] ) - c[ Nstate ] */
+static double RK_Event_Eval( const RK_Event* ev , int Nstate , double t , double* state ){
+
+    int i;
+    double g, *c;
+
+    if( ev->fn != NULL ){
+        return ev->fn( Nstate , t , state , ev->data );
+    }
+
+    c = ( double* )ev->data;
+    g = - c[ Nstate ];
+    for( i = 0; i < Nstate; i++ ){
+        g += c[ i ]*state[ i ];
+    }
+
+    return g;
+}
+
+/* State on the continuous extension of an accepted step at the relative position th ( 0 <= th <= 1 ) */
+/* Same form as DP45_Dense_Rows with f_end = h*f( y_new ) as the last derivative, for the tableaus without
+   dense output r4 = 0 and this reduces to the cubic Hermite interpolant */
+static void RK_Step_Interp( const RK_Tableau* tab , int Nstate , double th , double* y_old , double* y_new , double* f_end ,
+                            double k_DP[ Nstate ][ RK_NSTAGE_MAX ] , double* y_int ){
+
+    int i, j;
+    double r1, r2, r3, r4;
+
+    for( i = 0; i < Nstate; i++ ){
+        r1 = y_new[ i ] - y_old[ i ];
+        r2 = k_DP[ i ][ 0 ] - r1;
+        r3 = r1 - f_end[ i ] - r2;
+        r4 = 0.0;
+        if( tab->dense ){
+            for( j = 0; j < 7; j++ ){
+                r4 += tab->d[ j ]*k_DP[ i ][ j ];
+            }
+        }
+        y_int[ i ] = y_old[ i ] + th*( r1 + ( 1.0 - th )*( r2 + th*( r3 + ( 1.0 - th )*r4 ) ) );
+    }
+
+}
+
+/* Locate and write all the events inside the accepted step [ t_old , t_old + h ] in the order they occur */
+/* A crossing is a sign change of g between the ends of the step (allowed by the direction filter), its position is found by
+   the Illinois variant of regula falsi on the continuous extension of the step down to the round-off in time */
+/* Inputs:
+    - tab: tableau of the method
+    - out: output destinations with the events (out->events != NULL)
+    - Nstate: number of quantities in the state
+    - t_old, h: start and size of the accepted step
+    - y_old[ Nstate ], y_new[ Nstate ]: states at the start and at the end of the step
+    - f_new[ Nstate ]: the Right-Hand-Side at y_new
+    - k_DP[ Nstate ][ RK_NSTAGE_MAX ]: intermediate derivatives of the step (already multiplied by h)
+    - g_old[ Nevent ]: the event functions at y_old -> replaced by the ones at y_new */
+/* Outputs:
+    - t_stop, y_stop[ Nstate ]: time and state of a terminal event (only if one occurred)
+    -- returns 0 to continue, 1 if a terminal event occurred and -1 if the output could not be written */
+static int RK_Event_Rows( const RK_Tableau* tab , RK_Output* out , int Nstate , double t_old , double h , double* y_old , double* y_new ,
+                          double* f_new , double k_DP[ Nstate ][ RK_NSTAGE_MAX ] , double* g_old , double* t_stop , double* y_stop ){
+
+    int Nev = out->Nevent;
+    double g_new[ Nev ], /* Event functions at the end of the step */
+           th_ev[ Nev ], /* Relative position of the crossing inside the step ( > 1 if there is none ) */
+           f_end[ Nstate ], /* h*f( y_new ) */
+           y_int[ Nstate + 1 ]; /* Interpolated state and the event index */
+    double th_a, th_b, th_c, g_a, g_b, g_c; /* Bracket of the root-finding */
+    int e, e_min, it, side, i;
+    const RK_Event *ev;
+
+    for( i = 0; i < Nstate; i++ ){
+        f_end[ i ] = h*f_new[ i ];
+    }
+
+    for( e = 0; e < Nev; e++ ){
+        ev = out->events + e;
+        g_new[ e ] = RK_Event_Eval( ev , Nstate , t_old + h , y_new );
+        th_ev[ e ] = 2.0;
+        if( !( ( g_old[ e ] < 0.0 && g_new[ e ] >= 0.0 && ev->direction >= 0 ) ||
+               ( g_old[ e ] > 0.0 && g_new[ e ] <= 0.0 && ev->direction <= 0 ) ) ){
+            continue;
+        }
+
+        /* Illinois iteration -> the retained end point of the bracket has its value halved when it is kept twice in a row */
+        th_a = 0.0;
+        g_a = g_old[ e ];
+        th_b = 1.0;
+        g_b = g_new[ e ];
+        side = 0;
+        for( it = 0; it < Event_iter_max && g_b != 0.0 && ( th_b - th_a ) > 4.0*DBL_EPSILON; it++ ){
+            th_c = ( th_a*g_b - th_b*g_a )/( g_b - g_a );
+            RK_Step_Interp( tab , Nstate , th_c , y_old , y_new , f_end , k_DP , y_int );
+            g_c = RK_Event_Eval( ev , Nstate , t_old + th_c*h , y_int );
+            if( ( g_c < 0.0 ) == ( g_a < 0.0 ) && g_c != 0.0 ){
+                th_a = th_c;
+                g_a = g_c;
+                if( side == - 1 ){
+                    g_b *= 0.5;
+                }
+                side = - 1;
+            }
+            else{
+                th_b = th_c;
+                g_b = g_c;
+                if( side == 1 ){
+                    g_a *= 0.5;
+                }
+                side = 1;
+            }
+        }
+        th_ev[ e ] = th_b;
+    }
+
+    /* Write the events in the order of the crossings -> stop at the first terminal one */
+    for( ; ; ){
+        e_min = - 1;
+        for( e = 0; e < Nev; e++ ){
+            if( th_ev[ e ] <= 1.0 && ( e_min < 0 || th_ev[ e ] < th_ev[ e_min ] ) ){
+                e_min = e;
+            }
+        }
+        if( e_min < 0 ){
+            break;
+        }
+
+        RK_Step_Interp( tab , Nstate , th_ev[ e_min ] , y_old , y_new , f_end , k_DP , y_int );
+        y_int[ Nstate ] = ( double )e_min;
+        if( RK_Write_Row( out , Nstate + 1 , t_old + th_ev[ e_min ]*h , y_int ) != 0 ){
+            return -1;
+        }
+
+        if( out->events[ e_min ].action == RK_EVENT_TERMINATE ){
+            *t_stop = t_old + th_ev[ e_min ]*h;
+            for( i = 0; i < Nstate; i++ ){
+                y_stop[ i ] = y_int[ i ];
+            }
+            return 1;
+        }
+        th_ev[ e_min ] = 2.0;
+    }
+
+    for( e = 0; e < Nev; e++ ){
+        g_old[ e ] = g_new[ e ];
+    }
+
+    return 0;
+}
+
+/* Combined error estimate of a single state quantity from the estimates e (from ec) and e3 (from ec3) */
+/* NOTE: For Nerr == 2 (DOP853) the 5th order estimate is damped by the 3rd order one as in Hairer & Wanner */
+RK_INLINE double RK_Err_Combine( const RK_Tableau* tab , double e , double e3 ){
+
+    double den;
+
+    if( tab->Nerr == 1 ){
+        return fabs( e );
+    }
+    den = e*e + 0.01*e3*e3;
+    return ( den > 0.0 ) ? e*e/sqrt( den ) : 0.0;
+}
+
+/* Single embedded Runge-Kutta step kernel -> computes all the stages for the step dt from state_now */
+/* Inputs:
+    - tab: the Butcher tableau (ignored by the specialized kernels, which have it built in)
+    - Nstate: number of quantities in the state (ignored by the specialized kernels)
+    - pend_coeff[ 5 ]: the coefficients a_th to b_phi in sequence
+    - chain: the N-link Pendulum to integrate instead of the double Pendulum (NULL for the double Pendulum)
+    - dt: the time step
+    - state_now[ Nstate ]: the state at the start of the step
+    - rhs_now[ Nstate ]: the Right-Hand-Side at state_now -> the first stage is never recomputed */
+/* Outputs:
+    - state_new[ Nstate ]: the candidate state at the end of the step (final weights)
+    - rhs_last[ Nstate ]: the Right-Hand-Side of the last stage -> the one at state_new for the FSAL tableaus
+    - k_DP[ Nstate ][ RK_NSTAGE_MAX ]: the intermediate derivatives multiplied by dt (needed by the dense output)
+    -- returns the largest error estimate over the state quantities */
+typedef double ( *DP45_Step_Fn )( const RK_Tableau* tab , int Nstate , double* pend_coeff , RK_Chain* chain , double dt , double* state_now , double* rhs_now ,
+                                  double* state_new , double* rhs_last , double* k_DP );
+
+/* Generic step kernel -> any tableau and dimension, the stages are looped over the runtime coefficients */
+static double DP45_Step_Generic( const RK_Tableau* tab , int Nstate , double* pend_coeff , RK_Chain* chain , double dt , double* state_now , double* rhs_now ,
+                                 double* state_new , double* rhs_last , double* k_DP ){
+
+    int i, j, s; /* Iterators */
+    int Ns = tab->Ns; /* Number of stages */
+    double int_state[ Nstate ], /* Variable where we keep intermediate state for RK steps */
+           err_est[ Nstate ], /* Estimated error for each of the state quantities */
+           e3; /* Second error estimate of a quantity (DOP853) */
+
+    for( i = 0; i < Nstate; i++ ){
+        k_DP[ i*RK_NSTAGE_MAX ] = rhs_now[ i ]*dt;
+    }
+
+    for( s = 1; s < Ns; s++ ){
+
+        /* Intermediate state for this stage: start with the existing state and add all the contributions */
+        for( i = 0; i < Nstate; i++ ){
+            int_state[ i ] = state_now[ i ];
+            for( j = 0; j < s; j++ ){
+                int_state[ i ] += tab->a[ s ][ j ]*k_DP[ i*RK_NSTAGE_MAX + j ];
+            }
+        }
+
+        /* Call the RHS function in the point -> x_i + c_s*dt and assign the RK constant for this stage */
+        RK_Model_RHS( chain , int_state , rhs_last , pend_coeff );
+        for( i = 0; i < Nstate; i++ ){
+            k_DP[ i*RK_NSTAGE_MAX + s ] = rhs_last[ i ]*dt;
+        }
+
+    }
+
+    /* We have all the k_DP at this point -- compute the error estimates and the candidate state */
+    for( i = 0; i < Nstate; i++ ){
+        err_est[ i ] = 0.0;
+        e3 = 0.0;
+        state_new[ i ] = state_now[ i ];
+        for( j = 0; j < Ns; j++ ){
+            err_est[ i ] += tab->ec[ j ]*k_DP[ i*RK_NSTAGE_MAX + j ];
+            state_new[ i ] += tab->b[ 0 ][ j ]*k_DP[ i*RK_NSTAGE_MAX + j ];
+        }
+        if( tab->Nerr == 2 ){
+            for( j = 0; j < Ns; j++ ){
+                e3 += tab->ec3[ j ]*k_DP[ i*RK_NSTAGE_MAX + j ];
+            }
+        }
+        /* Take absolute value for each error (combined with the second estimate if there is one) */
+        err_est[ i ] = RK_Err_Combine( tab , err_est[ i ] , e3 );
+        /* For FSAL the last stage point is the new state -> take it as it is so that rhs_last is exactly the RHS there */
+        if( tab->fsal ){
+            state_new[ i ] = int_state[ i ];
+        }
+    }
+
+    return MaxVal( err_est , Nstate );
+}
+
+/* Specialized step kernel for the Dormand-Prince tableau and a fixed dimension NS -> defines a function NAME */
+/* The stages are written out with the constant coefficients, so the zero ones (a_61, b_1, b_6, ...) are dropped and
+   everything is sized at compile time. The arithmetic order is the same as in DP45_Step_Generic -> identical results. */
+#define DP45_STEP_KERNEL( NAME , NS ) \
+static double NAME( const RK_Tableau* tab , int Nstate , double* pend_coeff , RK_Chain* chain , double dt , double* state_now , double* rhs_now , \
+                    double* state_new , double* rhs_last , double* k_DP ){ \
+    int i; \
+    double y[ NS ], yt[ NS ], f[ NS ], k0[ NS ], k1[ NS ], k2[ NS ], k3[ NS ], k4[ NS ], k5[ NS ], k6[ NS ], err_est[ NS ]; \
+    ( void )tab; \
+    ( void )Nstate; \
+    ( void )chain; \
+    for( i = 0; i < NS; i++ ){ y[ i ] = state_now[ i ]; k0[ i ] = rhs_now[ i ]*dt; yt[ i ] = y[ i ] + DP45_A10*k0[ i ]; } \
+    RHS_Pend_Inline( yt , f , pend_coeff ); \
+    for( i = 0; i < NS; i++ ){ k1[ i ] = f[ i ]*dt; yt[ i ] = y[ i ] + DP45_A20*k0[ i ] + DP45_A21*k1[ i ]; } \
+    RHS_Pend_Inline( yt , f , pend_coeff ); \
+    for( i = 0; i < NS; i++ ){ k2[ i ] = f[ i ]*dt; yt[ i ] = y[ i ] + DP45_A30*k0[ i ] + DP45_A31*k1[ i ] + DP45_A32*k2[ i ]; } \
+    RHS_Pend_Inline( yt , f , pend_coeff ); \
+    for( i = 0; i < NS; i++ ){ k3[ i ] = f[ i ]*dt; yt[ i ] = y[ i ] + DP45_A40*k0[ i ] + DP45_A41*k1[ i ] + DP45_A42*k2[ i ] + DP45_A43*k3[ i ]; } \
+    RHS_Pend_Inline( yt , f , pend_coeff ); \
+    for( i = 0; i < NS; i++ ){ k4[ i ] = f[ i ]*dt; yt[ i ] = y[ i ] + DP45_A50*k0[ i ] + DP45_A51*k1[ i ] + DP45_A52*k2[ i ] + DP45_A53*k3[ i ] + DP45_A54*k4[ i ]; } \
+    RHS_Pend_Inline( yt , f , pend_coeff ); \
+    for( i = 0; i < NS; i++ ){ k5[ i ] = f[ i ]*dt; yt[ i ] = y[ i ] + DP45_B0*k0[ i ] + DP45_B2*k2[ i ] + DP45_B3*k3[ i ] + DP45_B4*k4[ i ] + DP45_B5*k5[ i ]; } \
+    RHS_Pend_Inline( yt , f , pend_coeff ); \
+    for( i = 0; i < NS; i++ ){ \
+        k6[ i ] = f[ i ]*dt; \
+        state_new[ i ] = yt[ i ]; /* The 7th stage point is the 5th order solution (First Same As Last) */ \
+        rhs_last[ i ] = f[ i ]; \
+        err_est[ i ] = fabs( ( DP45_B0 - DP45_E0 )*k0[ i ] + ( DP45_B2 - DP45_E2 )*k2[ i ] + ( DP45_B3 - DP45_E3 )*k3[ i ] \
+                           + ( DP45_B4 - DP45_E4 )*k4[ i ] + ( DP45_B5 - DP45_E5 )*k5[ i ] - DP45_E6*k6[ i ] ); \
+        k_DP[ i*RK_NSTAGE_MAX ] = k0[ i ]; k_DP[ i*RK_NSTAGE_MAX + 1 ] = k1[ i ]; k_DP[ i*RK_NSTAGE_MAX + 2 ] = k2[ i ]; \
+        k_DP[ i*RK_NSTAGE_MAX + 3 ] = k3[ i ]; k_DP[ i*RK_NSTAGE_MAX + 4 ] = k4[ i ]; k_DP[ i*RK_NSTAGE_MAX + 5 ] = k5[ i ]; \
+        k_DP[ i*RK_NSTAGE_MAX + 6 ] = k6[ i ]; \
+    } \
+    return MaxVal( err_est , NS ); \
+}
+
+DP45_STEP_KERNEL( DP45_Step_DP45_N4 , 4 ) /* Double pendulum */
+
+/* Dispatch table of the specialized step kernels -> add a line here (and a DP45_STEP_KERNEL above) for a new specialization */
+static const struct {
+    int tab_id; /* RK_METHOD_* id of the tableau */
+    int Nstate; /* Phase space dimension */
+    DP45_Step_Fn step; /* The kernel */
+} DP45_Step_Table[ ] = {
+    { RK_METHOD_DP45 , 4 , DP45_Step_DP45_N4 },
+};
+
+/* Select the step kernel for a tableau and dimension -> the specialized one if available or the generic one otherwise */
+/* NOTE: The specialized kernels are all for the double Pendulum, the N-link Pendulum ( chain != NULL ) always takes the generic one */
+static DP45_Step_Fn DP45_Select_Step( const RK_Tableau* tab , int Nstate , RK_Chain* chain ){
+
+    size_t n;
+
+    for( n = 0; chain == NULL && n < sizeof( DP45_Step_Table )/sizeof( DP45_Step_Table[ 0 ] ); n++ ){
+        if( DP45_Step_Table[ n ].tab_id == tab->id && DP45_Step_Table[ n ].Nstate == Nstate ){
+            return DP45_Step_Table[ n ].step;
+        }
+    }
+
+    return DP45_Step_Generic;
+}
+
+/* Monotonic wall-clock time in seconds (for the statistics) */
+static double RK_Wall_Time( ){
+
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC , &ts );
+    return ( double )ts.tv_sec + 1e-9*( double )ts.tv_nsec;
+}
+
+/* Reset the statistics at the start of a run -> the trace ring buffer is kept but emptied */
+static void RK_Stats_Reset( RK_Stats* stats ){
+
+    RK_Trace_Entry *trace = stats->trace;
+    int trace_cap = stats->trace_cap;
+
+    memset( stats , 0 , sizeof( RK_Stats ) );
+    stats->dt_min = HUGE_VAL;
+    stats->trace = trace;
+    stats->trace_cap = trace_cap;
+
+}
+
+/* Add one step attempt to the statistics (histogram and trace) */
+static void RK_Stats_Step( RK_Stats* stats , double t , double dt , double err_ratio , int accepted ){
+
+    int bin;
+    RK_Trace_Entry *entry;
+
+    if( accepted ){
+        stats->dt_min = ( dt < stats->dt_min ) ? dt : stats->dt_min;
+        stats->dt_max = ( dt > stats->dt_max ) ? dt : stats->dt_max;
+        bin = ilogb( dt ) - RK_STATS_HIST_EXP_MIN;
+        bin = ( bin < 0 ) ? 0 : ( ( bin >= RK_STATS_NHIST ) ? RK_STATS_NHIST - 1 : bin );
+        stats->dt_hist[ bin ] += 1;
+    }
+
+    if( stats->trace_cap > 0 ){
+        entry = stats->trace + stats->n_trace%stats->trace_cap;
+        entry->t = t;
+        entry->dt = dt;
+        entry->err_ratio = err_ratio;
+        entry->accepted = accepted;
+        stats->n_trace += 1;
+    }
+
+}
+
+/* Resize (or free for cap = 0) the trace ring buffer of the statistics */
+static int RK_Stats_Set_Trace( RK_Stats* stats , int cap ){
+
+    RK_Trace_Entry *trace = NULL;
+
+    if( cap > 0 ){
+        trace = ( RK_Trace_Entry* )malloc( ( size_t )cap*sizeof( RK_Trace_Entry ) );
+        if( trace == NULL ){
+            return -1;
+        }
+    }
+    free( stats->trace );
+    stats->trace = trace;
+    stats->trace_cap = ( cap > 0 ) ? cap : 0;
+    stats->n_trace = 0;
+
+    return 0;
+}
+
+/* Copy the trace of the statistics in chronological order as rows [ t , dt , err_ratio , accepted ] */
+static long RK_Stats_Trace_Rows( RK_Stats* stats , double* rows , long max_rows ){
+
+    long n, n_keep, n_first;
+    RK_Trace_Entry *entry;
+
+    if( stats->trace_cap == 0 ){
+        return 0;
+    }
+    n_keep = ( stats->n_trace < stats->trace_cap ) ? stats->n_trace : stats->trace_cap;
+    n_keep = ( n_keep < max_rows ) ? n_keep : max_rows;
+    n_first = stats->n_trace - n_keep;
+    for( n = 0; n < n_keep; n++ ){
+        entry = stats->trace + ( n_first + n )%stats->trace_cap;
+        *( rows + 4*n ) = entry->t;
+        *( rows + 4*n + 1 ) = entry->dt;
+        *( rows + 4*n + 2 ) = entry->err_ratio;
+        *( rows + 4*n + 3 ) = ( double )entry->accepted;
+    }
+
+    return n_keep;
+}
+
+/* Core of the 4-5th order adaptive Dormand-Prince integrator for the double Pendulum with explicit coefficients */
+/* This is the loop behind DP45_Integrator, it can either write the results to a file or only return a summary of the run */
+/* Inputs:
+    - tab: tableau of the method
+    - Nstate: number of quantities in the state (phase space dimension)
+    - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+    - pend_coeff[ 5 ]: the coefficients a_th to b_phi in sequence (same order as in Set_Pend_coeff)
+    - chain: the N-link Pendulum to integrate instead of the double Pendulum (NULL for the double Pendulum, Nstate = 2*Nlink otherwise)
+    - state_init[ Nstate ]: initial state for the integrator
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+    - out: destinations where each accepted step is written (.csv file, in-memory buffer, binary file), NULL for no output
+           if out->t_out is set, the rows are written only at those times (dense output) instead of at every accepted step */
+/* Outputs:
+    - state_final[ Nstate ]: the state at the end of the integration (NULL to skip)
+    - summary[ 4 ]: [ t_final , accepted steps , rejected steps , max |E - E_0| over the accepted steps ] (NULL to skip)
+    -- The energy drift is only computed for the double pendulum ( Nstate == 4 ) and the N-link Pendulum and is 0.0 otherwise
+    -- returns 0 on success or -1 if the output could not be written (the integration is stopped at that point) */
+/* Checkpoint:
+    - cp: NULL for a run from range_int[ 0 ], otherwise the run continues from the controller state of cp if cp->dt > 0 (state_init
+          is ignored then and nothing is written at the start) and the controller state at the end is saved back to cp */
+static int DP45_Core( const RK_Tableau* tab , int Nstate , double err_tol , double* pend_coeff , RK_Chain* chain , double* state_init , double* range_int , RK_Output* out ,
+                      double* state_final , double* summary , RK_Stats* stats , RK_Checkpoint* cp ){
+
+    int rej, /* rej is a rejection counter -> ( 0 , 1 ) if the last step was rejected */
+        n_acc, n_rej, /* Number of accepted and rejected steps */
+        i, j, k; /* Iterators */
+    double k_DP[ Nstate ][ RK_NSTAGE_MAX ], /* Runge-Kutta intermediate derivatives */
+           state_now[ Nstate ], /* Variable where we keep the current state */
+           state_old[ Nstate ], /* State at the start of the step -> needed for the dense output */
+           state_new[ Nstate ], /* Candidate state at the end of the step -> taken only if the step is accepted */
+           rhs_now[ Nstate ], /* Right-Hand-Side at state_now -> kept between the steps (reused after a rejection and FSAL) */
+           rhs_last[ Nstate ]; /* Right-Hand-Side of the last stage of the step */
+    int dense; /* 1 if the output is written at the requested times (dense output) instead of at every accepted step */
+    int Nev = ( out != NULL && out->events != NULL ) ? out->Nevent : 0; /* Number of events -> only the event rows are written if > 0 */
+    double g_ev[ Nev > 0 ? Nev : 1 ]; /* Event functions at state_now */
+    int ev_res = 0; /* Result of the event location in the last step -> 1 if a terminal event occurred */
+    DP45_Step_Fn step = DP45_Select_Step( tab , Nstate , chain ); /* Step kernel -> specialized for the tableau and dimension if available */
+    RK_Obs *obs = ( out != NULL && Nstate == 4 && chain == NULL ) ? out->obs : NULL; /* Observables -> reduced over the accepted steps */
+
+    double t_now, /* Current time value */
+           dt, /* Current time step */
+           err_ratio, /* Error ratio of actual to desired - current step */
+           err_ratiOld, /* Error ratio of actual to desired - old step */
+           e_init, /* Energy in the initial state */
+           e_drift, /* Largest absolute deviation of the energy from e_init */
+           tv1; /* Temporary variables which can be reused to hold some intermediate computations */
+    double t_wall = 0.0, /* Wall time at the start of the run */
+           t_out_smp = 0.0, /* Wall time of the sampled output calls */
+           t_out_start = 0.0; /* Wall time at the start of a sampled output call */
+    long n_out_smp = 0, /* Number of sampled output calls */
+         n_sing = RK_Singular_Count; /* Singular LHS warnings on this thread before the run */
+    int track_e, /* 1 if the energy drift is tracked */
+        resume = ( cp != NULL && cp->dt > 0.0 ), /* 1 if the run continues from the checkpoint (2 if its RHS had to be recomputed) */
+        clip = 0, /* 1 if dt was cut to end on range_int[ 1 ] -> dt_free is the step the controller had chosen */
+        clip_acc = 0; /* 1 if the last accepted step was such a cut step */
+    double dt_free = 0.0; /* Step of the controller before the cut */
+
+    if( stats != NULL ){
+        RK_Stats_Reset( stats );
+        t_wall = RK_Wall_Time( );
+    }
+
+    t_now = *( range_int ); /* Initialize time start */
+    dt = ( *( range_int + 1 ) - *( range_int ) )/1e6; /* Initial "guess" for a good time step is 1 millionth of the interval - will be modified from the integrator when it starts */
+
+    /* Assign the initial state */
+    for( j = 0; j < Nstate; j++ ){
+        state_now[ j ] = resume ? cp->state[ j ] : *( state_init + j );
+    }
+    if( resume ){
+        t_now = cp->t;
+        dt = cp->dt;
+    }
+
+    /* Write the initial data -> for dense output only the requested times at the start are written (earlier ones are skipped) */
+    dense = ( out != NULL && out->t_out != NULL );
+    if( dense && !tab->dense ){
+        printf( "ERROR: The selected Runge-Kutta method has no dense output, use RK_METHOD_DP45! \n" );
+        return -1;
+    }
+    if( Nev > 0 ){
+        /* Event mode -> nothing is written at the start, only the event functions are initialized */
+        for( j = 0; j < Nev; j++ ){
+            g_ev[ j ] = RK_Event_Eval( out->events + j , Nstate , t_now , state_now );
+        }
+    }
+    else if( dense ){
+        out->i_out = 0;
+        while( out->i_out < out->Nout && *( out->t_out + out->i_out ) <= t_now ){
+            if( !resume && *( out->t_out + out->i_out ) == t_now && RK_Write_Row( out , Nstate , t_now , state_now ) != 0 ){
+                return -1;
+            }
+            out->i_out += 1;
+        }
+    }
+    else if( !resume && RK_Write_Row( out , Nstate , t_now , state_now ) != 0 ){
+        return -1;
+    }
+
+    /* The Right-Hand-Side at the initial state -> the first stage of the first step */
+    /* NOTE: A checkpoint keeps it (the FSAL stage) unless the pendulum coefficients were changed in between */
+    if( resume && memcmp( cp->pend_coeff , pend_coeff , sizeof( cp->pend_coeff ) ) == 0 ){
+        for( j = 0; j < Nstate; j++ ){
+            rhs_now[ j ] = cp->rhs[ j ];
+        }
+    }
+    else{
+        RK_Model_RHS( chain , state_now , rhs_now , pend_coeff );
+        resume = resume ? 2 : 0; /* For the RHS count of the statistics */
+    }
+
+    /* Keep track of the energy only if a summary or a checkpoint is requested for the double or N-link pendulum */
+    track_e = ( ( summary != NULL || cp != NULL ) && ( Nstate == 4 || chain != NULL ) );
+    e_init = track_e ? RK_Model_Energy( chain , state_now , pend_coeff ) : 0.0;
+    e_drift = 0.0;
+    n_acc = 0;
+    n_rej = 0;
+    if( obs != NULL ){
+        RK_Obs_Step( obs , t_now , state_now , 1 );
+    }
+
+    k = 0; /* Zero-out the loop counter */
+    rej = 0; /* No step has been rejected yet */
+    err_ratiOld = 1.0; /* Initialize the "old" error fraction */
+
+    /* Continue with the controller state and the energy reference of the checkpoint */
+    if( resume ){
+        rej = cp->rej;
+        err_ratiOld = cp->err_ratiOld;
+        e_init = cp->e_init;
+        e_drift = cp->e_drift;
+    }
+
+    /* Start the main integration loop */
+    while( ( t_now < *( range_int + 1 ) ) && ( k < Nloop_max ) ){
+
+        /* Compute all the stages, the error estimate and the candidate state with the kernel selected for this tableau and dimension */
+        err_ratio = step( tab , Nstate , pend_coeff , chain , dt , state_now , rhs_now , state_new , rhs_last , &k_DP[ 0 ][ 0 ] )/err_tol;
+
+        /* Choose whether to accept the step or not and how to pick the next step based on the err_ratio */
+        /* NOTE: If the err_ratio is OK but we overshot the endpoint by more than err_tol, reject the step with new dt to end on it exactly! */
+        if( err_ratio < 1.0 && ( t_now + dt - *( range_int + 1 ) < err_tol ) ){
+            /* In this case the step is small enough -> we're within the error range and not yet at the end of the interval */
+
+            /* In this case compute the next values and print them in the file */
+            t_now += dt;
+
+            /* NOTE: No need to check if we overshot since this is included in the outer if statement! */
+
+            /* Update the states with the candidate computed by the step kernel */
+            for( i = 0; i < Nstate; i++ ){
+                state_old[ i ] = state_now[ i ];
+                state_now[ i ] = state_new[ i ];
+            }
+
+            /* The Right-Hand-Side at the new state -> free for FSAL tableaus, otherwise one extra evaluation */
+            if( tab->fsal ){
+                for( i = 0; i < Nstate; i++ ){
+                    rhs_now[ i ] = rhs_last[ i ];
+                }
+            }
+            else{
+                RK_Model_RHS( chain , state_now , rhs_now , pend_coeff );
+            }
+
+            /* Write the new state in the output -> at every accepted step, at the requested times or at the events inside the step */
+            if( stats != NULL ){
+                RK_Stats_Step( stats , t_now - dt , dt , err_ratio , 1 );
+                if( n_acc%RK_STATS_SAMPLE == 0 ){
+                    t_out_start = RK_Wall_Time( );
+                }
+            }
+            ev_res = 0;
+            if( Nev > 0 ){
+                ev_res = RK_Event_Rows( tab , out , Nstate , t_now - dt , dt , state_old , state_now , rhs_now , k_DP , g_ev , &t_now , state_now );
+            }
+            if( ev_res < 0 || ( Nev == 0 && ( dense ? DP45_Dense_Rows( tab , out , Nstate , t_now - dt , dt , state_old , state_now , k_DP )
+                                                    : RK_Write_Row( out , Nstate , t_now , state_now ) ) != 0 ) ){
+                printf( "ERROR: Could not write the output, integration stopped at t = %lf \n" , t_now );
+                return -1;
+            }
+            if( stats != NULL && n_acc%RK_STATS_SAMPLE == 0 ){
+                t_out_smp += RK_Wall_Time( ) - t_out_start;
+                n_out_smp += 1;
+            }
+
+            /* If last step was not rejected - increase the current step with a safety factor based on the integral controller */
+            if( rej == 0 && ( err_ratio > 0.0 ) ){
+                /* Check what the new step candidate is and keep it in tv1 */
+                tv1 = safe_fac*dt*pow( err_ratio , tab->ctrl_p )*pow( err_ratiOld , tab->ctrl_i );
+                /* If step is increased more than step_mrat, increase it by step_mrat */
+                if( tv1/dt < step_mrat ){
+                    dt = tv1;
+                }
+                else{
+                    dt *= step_mrat;
+                }
+            }
+
+            /* If the step was accepted -> set the rejection ratio to 0 */
+            rej = 0;
+            clip_acc = clip;
+            clip = 0;
+
+            n_acc += 1;
+
+            /* Track the largest energy deviation for the summary */
+            if( track_e ){
+                tv1 = fabs( RK_Model_Energy( chain , state_now , pend_coeff ) - e_init );
+                if( tv1 > e_drift ){
+                    e_drift = tv1;
+                }
+            }
+            if( obs != NULL ){
+                RK_Obs_Step( obs , t_now , state_now , 0 );
+            }
+
+            /* Stop at a terminal event -> t_now and state_now are already at the event */
+            if( ev_res == 1 ){
+                break;
+            }
+
+        }
+        else{
+            /* In this case the step is too large or we overshot -> we must reduce it based on the estimate and threshold OR based on interval */
+            if( t_now + dt - *( range_int + 1 ) > err_tol ){
+                /* In this case we overshot the last step - set it to end exactly at the end of the interval */
+                dt_free = dt;
+                clip = 1;
+                dt = ( *( range_int + 1 ) - t_now );
+                rej = 0; /* If we came to this loop because of dt overshooting, we should not reject our new step */
+            }
+            else{
+                /* In this case we're still integrating, reduce the step */
+                if( stats != NULL ){
+                    RK_Stats_Step( stats , t_now , dt , err_ratio , 0 );
+                }
+                dt = safe_fac*dt*pow( err_ratio , tab->ctrl_l );
+                clip = 0;
+                rej = 1; /* Set rej to 1 in case the step was rejected */
+                n_rej += 1;
+            }
+
+        }
+
+        /* After a step has been completed - assign the new error ratio as old for next step */
+        err_ratiOld = err_ratio; /* NOTE: This is used as an integral component in the step control */
+        k += 1;
+
+        /* In case we reached the maximum number of iterations - warn about it (a checkpointed run is simply continued by the caller) */
+        if( k == Nloop_max && cp == NULL ){
+            printf( "----------------------------------------------------------\n" );
+            printf( "----WARNING: The full integration was not carried out!----\n" );
+            printf( "----------------------------------------------------------\n" );
+            printf( "Stopped after %d iterations at t = %lf out of t_max = %lf \n" , k , t_now , *( range_int + 1 ) );
+
+        }
+
+        // This printf was used for debugging the code in the beginning
+        //printf( "At k = %d, Time = %.10e, Error ratio is %.10e, dt = %.10e \n" , k , t_now , err_ratio , dt );
+
+
+    }
+
+    /* Fill the statistics -> RHS evaluations are the initial one, Ns - 1 per attempted step and one more per accepted step without FSAL */
+    if( stats != NULL ){
+        stats->n_acc = n_acc;
+        stats->n_rej = n_rej;
+        stats->n_rhs = ( resume != 1 ) + ( long )( tab->Ns - 1 )*( k + ( ev_res == 1 ) ) + ( tab->fsal ? 0 : n_acc ); /* A terminal event leaves before k += 1 */
+        stats->n_singular = RK_Singular_Count - n_sing;
+        stats->loop_max = ( k >= Nloop_max && t_now < *( range_int + 1 ) );
+        stats->dt_min = ( n_acc > 0 ) ? stats->dt_min : 0.0;
+        stats->t_total = RK_Wall_Time( ) - t_wall;
+        stats->t_output = ( n_out_smp > 0 ) ? t_out_smp*( double )n_acc/( double )n_out_smp : 0.0;
+    }
+
+    /* Save the controller state -> the step cut to end on range_int[ 1 ] is replaced by the one the controller had chosen */
+    if( cp != NULL ){
+        cp->Nstate = Nstate;
+        cp->method = tab->id;
+        cp->t = t_now;
+        cp->dt = ( clip_acc && t_now >= *( range_int + 1 ) && dt_free > dt ) ? dt_free : dt;
+        cp->err_ratiOld = err_ratiOld;
+        cp->rej = rej;
+        cp->n_acc += n_acc;
+        cp->n_rej += n_rej;
+        cp->e_init = e_init;
+        cp->e_drift = e_drift;
+        for( j = 0; j < Nstate; j++ ){
+            cp->state[ j ] = state_now[ j ];
+            cp->rhs[ j ] = rhs_now[ j ];
+        }
+        for( j = 0; j < 5; j++ ){
+            cp->pend_coeff[ j ] = *( pend_coeff + j );
+        }
+    }
+
+    /* Return the final state and the summary of the run */
+    if( state_final != NULL ){
+        for( j = 0; j < Nstate; j++ ){
+            *( state_final + j ) = state_now[ j ];
+        }
+    }
+    if( summary != NULL ){
+        *( summary ) = t_now;
+        *( summary + 1 ) = ( double )n_acc;
+        *( summary + 2 ) = ( double )n_rej;
+        *( summary + 3 ) = e_drift;
+    }
+
+    return 0;
+}
+
+/* Create an integrator context -> it owns its tableau, pendulum coefficients, tolerance and scratch storage */
+/* The integrations with different contexts are independent, so they can run concurrently from different threads */
+/* Inputs:
+    - Nstate: number of quantities in the state (phase space dimension)
+    - err_tol: error tolerance per step
+    - pend_coeff[ 5 ]: the coefficients a_th to b_phi in sequence (NULL to default them to 1.0 like the original interface) */
+/* Output:
+    - the context (free it with RK_Context_Free) or NULL if it could not be allocated */
+RK_Context* RK_Context_Create( int Nstate , double err_tol , double* pend_coeff ){
+
+    RK_Context *ctx;
+    int j;
+
+    ctx = ( RK_Context* )calloc( 1 , sizeof( RK_Context ) );
+    if( ctx == NULL ){
+        return NULL;
+    }
+
+    ctx->Nstate = Nstate;
+    ctx->err_tol = err_tol;
+    for( j = 0; j < 5; j++ ){
+        ctx->pend_coeff[ j ] = ( pend_coeff != NULL ) ? *( pend_coeff + j ) : 1.0;
+    }
+    RK_Tableau_DP45( &ctx->tab );
+    ctx->stats = &ctx->stats_own;
+
+    return ctx;
+}
+
+/* Free an integrator context and its scratch storage */
+void RK_Context_Free( RK_Context* ctx ){
+
+    if( ctx == NULL ){
+        return;
+    }
+    free( ctx->batch_work );
+    free( ctx->stats_own.trace );
+    free( ctx );
+
+}
+
+/* Set the pendulum coefficients of a context */
+/* Inputs:
+    - coeff_vals[ 5 ] double array contains the coefficients a_th to b_phi in sequence */
+void RK_Context_Set_Pend_coeff( RK_Context* ctx , double* coeff_vals ){
+
+    int j;
+
+    for( j = 0; j < 5; j++ ){
+        ctx->pend_coeff[ j ] = *( coeff_vals + j );
+    }
+
+}
+
+/* Set the error tolerance per step of a context */
+void RK_Context_Set_Tolerance( RK_Context* ctx , double err_tol ){
+
+    ctx->err_tol = err_tol;
+
+}
+
+/* Select the embedded Runge-Kutta pair of a context (RK_METHOD_DP45 after RK_Context_Create) */
+/* Inputs:
+    - method: RK_METHOD_DP45, RK_METHOD_TSIT5, RK_METHOD_VERNER65 or RK_METHOD_DOP853 */
+/* Output:
+    - 0 on success or -1 if the method is unknown (the context is not changed then) */
+int RK_Context_Set_Method( RK_Context* ctx , int method ){
+
+    return RK_Tableau_Method( &ctx->tab , method );
+}
+
+/* Select the Right-Hand-Side kernel of the batch integrator of a context (RK_RHS_LIBM after RK_Context_Create) */
+/* Output:
+    - 0 on success or -1 if the mode is unknown (the context is not changed then) */
+int RK_Context_Set_RHS_Mode( RK_Context* ctx , int rhs_mode ){
+
+    if( rhs_mode != RK_RHS_LIBM && rhs_mode != RK_RHS_FAST && rhs_mode != RK_RHS_REPRO ){
+        return -1;
+    }
+    ctx->rhs_mode = rhs_mode;
+
+    return 0;
+}
+
+/* Statistics of the last run of a context (see RK_Stats) */
+void RK_Context_Get_Stats( RK_Context* ctx , RK_Stats* stats ){
+
+    *stats = *ctx->stats;
+
+}
+
+/* Enable the per-step trace of a context -> keeps the last cap step attempts (0 disables the trace and frees it) */
+int RK_Context_Set_Trace( RK_Context* ctx , int cap ){
+
+    return RK_Stats_Set_Trace( ctx->stats , cap );
+}
+
+/* Per-step trace of the last run of a context in chronological order as rows [ t , dt , err_ratio , accepted ] */
+long RK_Context_Get_Trace( RK_Context* ctx , double* rows , long max_rows ){
+
+    return RK_Stats_Trace_Rows( ctx->stats , rows , max_rows );
+}
+
+/* Statistics of the last run of the original interface (see RK_Stats) */
+void Get_RK_Stats( RK_Stats* stats ){
+
+    RK_Context_Get_Stats( &RK_Default , stats );
+
+}
+
+/* Enable the per-step trace of the original interface */
+int Set_RK_Trace( int cap ){
+
+    return RK_Context_Set_Trace( &RK_Default , cap );
+}
+
+/* Per-step trace of the last run of the original interface */
+long Get_RK_Trace( double* rows , long max_rows ){
+
+    return RK_Context_Get_Trace( &RK_Default , rows , max_rows );
+}
+
+/* Temporary context for the original interface -> a copy of the default context with the given dimension and tolerance */
+/* NOTE: The batch scratch storage is not shared with the default context, free it after the call */
+static void RK_Context_From_Default( RK_Context* ctx , int Nstate , double err_tol ){
+
+    *ctx = RK_Default;
+    ctx->Nstate = Nstate;
+    ctx->err_tol = err_tol;
+    ctx->batch_work = NULL;
+    ctx->batch_work_size = 0;
+
+}
+
+/* 4-5th order adaptive Dormand-Prince integrator with a context, writing a .csv file as DP45_Integrator */
+void RK_Context_DP45_File( RK_Context* ctx , double* state_init , double* range_int , char* file_name , char* header ){
+
+    RK_Output out = { NULL , NULL , NULL }; /* Destinations of the output -> only the .csv file */
+    RK_Async_Writer aw; /* Background writer of the .csv rows */
+
+    /* Open the file and write the header */
+    out.fp = fopen( file_name , "w" ); 
+    fprintf( out.fp , "%s \n" , header );
+
+    /* The rows are formatted and written by a background thread (directly if it could not be started) */
+    if( RK_Async_Open( &aw , out.fp , NULL , ctx->Nstate ) == 0 ){
+        out.async = &aw;
+    }
+
+    DP45_Core( &ctx->tab , ctx->Nstate , ctx->err_tol , ctx->pend_coeff , NULL , state_init , range_int , &out , NULL , NULL , ctx->stats , NULL );
+
+    if( out.async != NULL ){
+        RK_Async_Close( &aw );
+    }
+    fclose( out.fp ); /* Close the file in the end */
+
+}
+
+/* 4-5th order adaptive Dormand-Prince integrator with a context and in-memory output as DP45_Integrator_Buffer */
+int RK_Context_DP45_Buffer( RK_Context* ctx , double* state_init , double* range_int , RK_Buffer* buf ){
+
+    RK_Output out = { NULL , buf , NULL }; /* Destinations of the output -> only the in-memory buffer */
+
+    buf->n = 0;
+
+    if( DP45_Core( &ctx->tab , ctx->Nstate , ctx->err_tol , ctx->pend_coeff , NULL , state_init , range_int , &out , NULL , NULL , ctx->stats , NULL ) != 0 ){
+        return -1;
+    }
+
+    return buf->n;
+}
+
+/* 4-5th order adaptive Dormand-Prince integrator with a context and dense output as DP45_Integrator_Dense */
+int RK_Context_DP45_Dense( RK_Context* ctx , double* state_init , double* range_int , int Nout , double* t_out , double* state_out ){
+
+    int Nstate = ctx->Nstate;
+    double *rows; /* Output rows [ time , state ] as written by the integrator */
+    RK_Buffer buf = { NULL , 0 , 0 , NULL , NULL }; /* In-memory buffer for the rows */
+    RK_Output out = { NULL , &buf , NULL , t_out , Nout , 0 }; /* Destinations of the output -> dense rows to the buffer */
+    int i, j;
+
+    rows = ( double* )malloc( ( size_t )( Nout > 0 ? Nout : 1 )*( Nstate + 1 )*sizeof( double ) );
+    if( rows == NULL ){
+        return -1;
+    }
+    buf.data = rows;
+    buf.cap = ( long )Nout*( Nstate + 1 );
+
+    if( DP45_Core( &ctx->tab , Nstate , ctx->err_tol , ctx->pend_coeff , NULL , state_init , range_int , &out , NULL , NULL , ctx->stats , NULL ) != 0 ){
+        free( rows );
+        return -1;
+    }
+
+    /* Drop the time column */
+    for( i = 0; i < buf.n; i++ ){
+        for( j = 0; j < Nstate; j++ ){
+            *( state_out + i*Nstate + j ) = rows[ i*( Nstate + 1 ) + 1 + j ];
+        }
+    }
+
+    free( rows );
+
+    return buf.n;
+}
+
+/* 4-5th order adaptive Dormand-Prince integrator with a context which writes only the events as DP45_Integrator_Events */
+int RK_Context_DP45_Events( RK_Context* ctx , double* state_init , double* range_int , int Nevent , RK_Event* events ,
+                            RK_Buffer* buf , double* state_final , double* summary ){
+
+    RK_Output out = { NULL , buf , NULL , NULL , 0 , 0 , events , Nevent }; /* Destinations of the output -> event rows to the buffer */
+
+    if( Nevent < 1 || events == NULL ){
+        printf( "ERROR: At least one event is needed for the event output! \n" );
+        return -1;
+    }
+
+    if( buf != NULL ){
+        buf->n = 0;
+    }
+
+    if( DP45_Core( &ctx->tab , ctx->Nstate , ctx->err_tol , ctx->pend_coeff , NULL , state_init , range_int , &out , state_final , summary , ctx->stats , NULL ) != 0 ){
+        return -1;
+    }
+
+    return ( buf != NULL ) ? buf->n : 0;
+}
+
+/* 4-5th order adaptive Dormand-Prince integrator with a context which computes only the observables as DP45_Integrator_Observables */
+int RK_Context_DP45_Observables( RK_Context* ctx , double* state_init , double* range_int , int Nout , double* t_out , double* lengths ,
+                                 RK_Buffer* rows , RK_Buffer* states , RK_Obs_Summary* red ){
+
+    RK_Obs obs = { ctx->pend_coeff , 1.0 , 1.0 , rows , red , 0 , 0 }; /* Observables of the run */
+    RK_Output out = { NULL , states , NULL , ( Nout > 0 ) ? t_out : NULL , Nout , 0 }; /* Destinations of the output -> the observables and the states */
+
+    if( ctx->Nstate != 4 ){
+        printf( "ERROR: The observables need the double Pendulum ( Nstate = 4 )! \n" );
+        return -1;
+    }
+    if( lengths != NULL ){
+        obs.l1 = *( lengths );
+        obs.l2 = *( lengths + 1 );
+    }
+    out.obs = &obs;
+
+    if( rows != NULL ){
+        rows->n = 0;
+    }
+    if( states != NULL ){
+        states->n = 0;
+    }
+
+    if( DP45_Core( &ctx->tab , ctx->Nstate , ctx->err_tol , ctx->pend_coeff , NULL , state_init , range_int , &out , NULL , NULL , ctx->stats , NULL ) != 0 ){
+        return -1;
+    }
+
+    return ( rows != NULL ) ? rows->n : 0;
+}
+
+/* 4-5th order adaptive Dormand-Prince integrator with a context and output to a raw or compressed binary trajectory file */
+/* The rows are handed to the background writer, so the compression and the decimation of RK_TRAJ_CODEC_XOR run on its thread */
+static long RK_Context_DP45_Traj( RK_Context* ctx , double* state_init , double* range_int , char* file_name , char* col_names ,
+                                  int codec , double dec_tol , int mant_bits ){
+
+    RK_Traj_Writer tw; /* Binary trajectory writer */
+    RK_Output out = { NULL , NULL , &tw }; /* Destinations of the output -> only the binary file */
+    RK_Async_Writer aw; /* Background writer of the binary chunks */
+    int res;
+
+    if( RK_Traj_Writer_Open( &tw , file_name , ctx->Nstate , ctx->err_tol , ctx->pend_coeff , range_int , col_names , codec , dec_tol , mant_bits ) != 0 ){
+        return -1;
+    }
+    if( RK_Async_Open( &aw , NULL , &tw , ctx->Nstate ) == 0 ){
+        out.async = &aw;
+    }
+
+    res = DP45_Core( &ctx->tab , ctx->Nstate , ctx->err_tol , ctx->pend_coeff , NULL , state_init , range_int , &out , NULL , NULL , ctx->stats , NULL );
+    if( out.async != NULL && RK_Async_Close( &aw ) != 0 ){
+        res = -1;
+    }
+
+    RK_Traj_Writer_Close( &tw );
+
+    return ( res == 0 ) ? ( long )tw.head.n_rows : -1;
+}
+
+/* 4-5th order adaptive Dormand-Prince integrator with a context and binary trajectory output as DP45_Integrator_Bin */
+long RK_Context_DP45_Bin( RK_Context* ctx , double* state_init , double* range_int , char* file_name , char* col_names ){
+
+    return RK_Context_DP45_Traj( ctx , state_init , range_int , file_name , col_names , RK_TRAJ_CODEC_RAW , 0.0 , 52 );
+}
+
+/* 4-5th order adaptive Dormand-Prince integrator with a context and compressed binary trajectory output as DP45_Integrator_Packed */
+long RK_Context_DP45_Packed( RK_Context* ctx , double* state_init , double* range_int , char* file_name , char* col_names ,
+                             double dec_tol , int mant_bits ){
+
+    mant_bits = ( mant_bits == 0 ) ? 52 : mant_bits;
+    if( mant_bits < 1 || mant_bits > 52 ){
+        printf( "ERROR: The mantissa bits of the compressed output must be between 1 and 52! \n" );
+        return -1;
+    }
+    /* The decimation interpolant takes its derivatives from the double Pendulum RHS */
+    if( dec_tol > 0.0 && ctx->Nstate != 4 ){
+        printf( "ERROR: The decimation of the compressed output is only available for the double Pendulum (Nstate = 4)! \n" );
+        return -1;
+    }
+
+    return RK_Context_DP45_Traj( ctx , state_init , range_int , file_name , col_names , RK_TRAJ_CODEC_XOR , ( dec_tol > 0.0 ) ? dec_tol : 0.0 , mant_bits );
+}
+
+/* Start a checkpoint for a chunked integration (see RK_Checkpoint) */
+int RK_Checkpoint_Init( RK_Checkpoint* cp , int Nstate , double t_init , double* state_init ){
+
+    int j;
+
+    if( Nstate < 1 || Nstate > RK_CKPT_NSTATE_MAX ){
+        printf( "ERROR: Checkpoints support up to %d quantities in the state! \n" , RK_CKPT_NSTATE_MAX );
+        return -1;
+    }
+
+    memset( cp , 0 , sizeof( RK_Checkpoint ) );
+    memcpy( cp->magic , RK_CKPT_MAGIC , 8 );
+    cp->version = RK_CKPT_VERSION;
+    cp->Nstate = Nstate;
+    cp->t = t_init;
+    cp->err_ratiOld = 1.0;
+    for( j = 0; j < Nstate; j++ ){
+        cp->state[ j ] = *( state_init + j );
+    }
+
+    return 0;
+}
+
+/* Write a checkpoint to a file */
+int RK_Checkpoint_Save( RK_Checkpoint* cp , char* file_name ){
+
+    FILE *fp;
+    int res;
+
+    fp = fopen( file_name , "wb" );
+    if( fp == NULL ){
+        printf( "ERROR: Could not open the checkpoint file %s \n" , file_name );
+        return -1;
+    }
+    res = ( fwrite( cp , sizeof( RK_Checkpoint ) , 1 , fp ) == 1 );
+    res = ( fclose( fp ) == 0 ) && res;
+
+    return res ? 0 : -1;
+}
+
+/* Read a checkpoint written by RK_Checkpoint_Save */
+int RK_Checkpoint_Load( RK_Checkpoint* cp , char* file_name ){
+
+    FILE *fp;
+    RK_Checkpoint cp_read;
+    int res;
+
+    fp = fopen( file_name , "rb" );
+    if( fp == NULL ){
+        printf( "ERROR: Could not open the checkpoint file %s \n" , file_name );
+        return -1;
+    }
+    res = ( fread( &cp_read , sizeof( RK_Checkpoint ) , 1 , fp ) == 1 );
+    fclose( fp );
+
+    if( !res || memcmp( cp_read.magic , RK_CKPT_MAGIC , 8 ) != 0 || cp_read.version != RK_CKPT_VERSION ||
+        cp_read.Nstate < 1 || cp_read.Nstate > RK_CKPT_NSTATE_MAX ){
+        printf( "ERROR: %s is not a readable checkpoint file \n" , file_name );
+        return -1;
+    }
+    *cp = cp_read;
+
+    return 0;
+}
+
+/* Advance a checkpointed integration of a context to t_target (see DP45_Integrator_Advance) */
+int RK_Context_DP45_Advance( RK_Context* ctx , RK_Checkpoint* cp , double t_target , RK_Buffer* buf ){
+
+    RK_Output out = { NULL , buf , NULL }; /* Destinations of the output -> only the in-memory buffer */
+    double range_int[ 2 ] = { cp->t , t_target }; /* This chunk */
+
+    if( buf != NULL ){
+        buf->n = 0;
+    }
+
+    if( cp->Nstate != ctx->Nstate || memcmp( cp->magic , RK_CKPT_MAGIC , 8 ) != 0 ){
+        printf( "ERROR: The checkpoint does not match the context (initialize it with RK_Checkpoint_Init)! \n" );
+        return -1;
+    }
+    if( t_target < cp->t ){
+        printf( "ERROR: Can not advance the checkpoint at t = %lf back to t = %lf \n" , cp->t , t_target );
+        return -1;
+    }
+    if( t_target == cp->t ){
+        return 0;
+    }
+
+    cp->err_tol = ctx->err_tol;
+    if( DP45_Core( &ctx->tab , ctx->Nstate , ctx->err_tol , ctx->pend_coeff , NULL , cp->state , range_int , &out , NULL , NULL , ctx->stats , cp ) != 0 ){
+        return -1;
+    }
+
+    return ( cp->t < t_target ) ? 1 : 0;
+}
+
+/* Real-time stream -> the integration runs on its own thread and publishes the frames into a single-producer/single-consumer ring */
+/* The settings of the context are copied, so the context can be changed or freed while the stream runs */
+struct RK_Stream {
+    RK_Tableau tab; /* Tableau of the integration */
+    double err_tol, /* Error tolerance per step */
+           pend_coeff[ 5 ], /* Coefficients a_th to b_phi */
+           t_init, t_end, /* Time of the first frame and end of the integration (may be infinity) */
+           dt_frame, /* Time between two frames */
+           speed; /* Simulation time per second of wall time (0 for as fast as the consumer allows) */
+    int Nstate, /* Number of quantities in the state */
+        Ncol, /* Columns of a frame -> 1 + Nstate ( + RK_OBS_NCOL - 1 observables for the double Pendulum ) */
+        Ncap, /* Frames in the ring */
+        mode; /* RK_STREAM_BLOCK or RK_STREAM_DROP */
+    RK_Checkpoint cp; /* State of the integration between the chunks */
+    RK_Obs obs; /* Observables of the frames (double Pendulum only) */
+    double *frames, /* [ Ncap ][ Ncol ] ring of the frames */
+           *rows, /* [ RK_STREAM_CHUNK ][ Nstate + 1 ] dense rows of the chunk being integrated */
+           *obs_rows; /* [ RK_STREAM_CHUNK ][ RK_OBS_NCOL ] observable rows of the chunk */
+    _Atomic long head; /* Frames published by the integration thread */
+    _Atomic long tail; /* Frames taken by the consumer */
+    _Atomic long n_drop; /* Frames dropped because the ring was full (RK_STREAM_DROP) */
+    _Atomic double t_now; /* Time reached by the integration */
+    _Atomic int stop; /* Set by RK_Stream_Close to end the integration early */
+    _Atomic int done; /* 1 after the last frame was published, -1 if the integration failed */
+    pthread_t thread;
+};
+
+/* Integration thread of a stream -> integrates RK_STREAM_CHUNK frames at a time with the dense output and publishes them */
+static void* RK_Stream_Run( void* arg ){
+
+    RK_Stream *st = ( RK_Stream* )arg;
+    RK_Buffer buf = { st->rows , ( long )RK_STREAM_CHUNK*( st->Nstate + 1 ) , 0 , NULL , NULL }, /* Dense rows of a chunk */
+              obs_buf = { st->obs_rows , ( long )RK_STREAM_CHUNK*RK_OBS_NCOL , 0 , NULL , NULL }; /* Observable rows of a chunk */
+    double t_out[ RK_STREAM_CHUNK ], /* Frame times of a chunk */
+           range_int[ 2 ], /* Interval of a chunk */
+           t_wall = RK_Wall_Time( ), /* Wall time of the first frame */
+           t_prev, t_sleep;
+    RK_Output out = { NULL , &buf , NULL , t_out , 0 , 0 }; /* Destinations of the output -> dense rows of the chunk */
+    struct timespec ts;
+    long i_frame = 0, /* Index of the next frame */
+         head;
+    int n, i, j, n_poll, res = 0;
+    double *row, *frame;
+
+    if( st->Nstate == 4 ){
+        st->obs.rows = &obs_buf;
+        out.obs = &st->obs;
+    }
+
+    while( !atomic_load_explicit( &st->stop , memory_order_relaxed ) ){
+
+        /* Frame times of the next chunk -> the chunk ends on its last frame */
+        for( n = 0; n < RK_STREAM_CHUNK; n++ ){
+            t_out[ n ] = st->t_init + ( double )( i_frame + n )*st->dt_frame;
+            if( t_out[ n ] > st->t_end ){
+                break;
+            }
+        }
+        if( n == 0 ){
+            break;
+        }
+
+        out.Nout = n;
+        buf.n = 0;
+        obs_buf.n = 0;
+        t_prev = st->cp.t;
+        range_int[ 0 ] = st->cp.t;
+        range_int[ 1 ] = t_out[ n - 1 ];
+        if( DP45_Core( &st->tab , st->Nstate , st->err_tol , st->pend_coeff , NULL , st->cp.state , range_int , &out , NULL , NULL , NULL , &st->cp ) != 0
+            || ( buf.n == 0 && st->cp.t <= t_prev && i_frame > 0 ) ){
+            res = -1;
+            break;
+        }
+        atomic_store_explicit( &st->t_now , st->cp.t , memory_order_relaxed );
+
+        /* The frames of the chunk which were not reached (Nloop_max or round-off at its end) come with the next chunk */
+        i_frame += buf.n;
+
+        for( i = 0; i < buf.n && !atomic_load_explicit( &st->stop , memory_order_relaxed ); i++ ){
+            row = st->rows + ( size_t )i*( st->Nstate + 1 );
+
+            /* Pace the frames to the wall clock */
+            while( st->speed > 0.0 && !atomic_load_explicit( &st->stop , memory_order_relaxed ) ){
+                t_sleep = t_wall + ( *( row ) - st->t_init )/st->speed - RK_Wall_Time( );
+                if( t_sleep <= 0.0 ){
+                    break;
+                }
+                t_sleep = ( t_sleep < 0.01 ) ? t_sleep : 0.01; /* Wake up now and then to see a stop */
+                ts.tv_sec = 0;
+                ts.tv_nsec = ( long )( 1e9*t_sleep );
+                nanosleep( &ts , NULL );
+            }
+
+            /* Full ring -> wait for the consumer (back-pressure) or drop the frame */
+            head = atomic_load_explicit( &st->head , memory_order_relaxed );
+            n_poll = 0;
+            while( head - atomic_load_explicit( &st->tail , memory_order_acquire ) >= st->Ncap ){
+                if( st->mode == RK_STREAM_DROP || atomic_load_explicit( &st->stop , memory_order_relaxed ) ){
+                    break;
+                }
+                RK_Async_Wait( &n_poll );
+            }
+            if( head - atomic_load_explicit( &st->tail , memory_order_acquire ) >= st->Ncap ){
+                atomic_fetch_add_explicit( &st->n_drop , 1 , memory_order_relaxed );
+                continue;
+            }
+
+            frame = st->frames + ( size_t )( head%st->Ncap )*st->Ncol;
+            for( j = 0; j <= st->Nstate; j++ ){
+                *( frame + j ) = *( row + j );
+            }
+            for( j = 1; j < st->Ncol - st->Nstate; j++ ){
+                *( frame + st->Nstate + j ) = *( st->obs_rows + ( size_t )i*RK_OBS_NCOL + j );
+            }
+            atomic_store_explicit( &st->head , head + 1 , memory_order_release );
+        }
+    }
+
+    atomic_store_explicit( &st->done , ( res == 0 ) ? 1 : - 1 , memory_order_release );
+
+    return NULL;
+}
+
+/* Start a real-time stream of a context (see DP45_Stream_Open) */
+RK_Stream* RK_Context_Stream_Open( RK_Context* ctx , double* state_init , double* range_int , double dt_frame , int Nframe , int mode ,
+                                   double speed , double* lengths ){
+
+    RK_Stream *st;
+
+    if( !ctx->tab.dense || !( dt_frame > 0.0 ) || Nframe < 1 || ( mode != RK_STREAM_BLOCK && mode != RK_STREAM_DROP ) ||
+        !( *( range_int + 1 ) >= *( range_int ) ) ){
+        printf( "ERROR: The stream needs a method with dense output, dt_frame > 0, Nframe >= 1 and a valid mode and range! \n" );
+        return NULL;
+    }
+
+    st = ( RK_Stream* )calloc( 1 , sizeof( RK_Stream ) );
+    if( st == NULL ){
+        return NULL;
+    }
+    if( RK_Checkpoint_Init( &st->cp , ctx->Nstate , *( range_int ) , state_init ) != 0 ){
+        free( st );
+        return NULL;
+    }
+
+    st->tab = ctx->tab;
+    st->err_tol = ctx->err_tol;
+    memcpy( st->pend_coeff , ctx->pend_coeff , sizeof( st->pend_coeff ) );
+    st->t_init = *( range_int );
+    st->t_end = *( range_int + 1 );
+    st->dt_frame = dt_frame;
+    st->speed = ( speed > 0.0 ) ? speed : 0.0;
+    st->Nstate = ctx->Nstate;
+    st->Ncol = 1 + ctx->Nstate + ( ( ctx->Nstate == 4 ) ? RK_OBS_NCOL - 1 : 0 );
+    st->Ncap = Nframe;
+    st->mode = mode;
+    st->cp.err_tol = ctx->err_tol;
+    st->obs.pend_coeff = st->pend_coeff;
+    st->obs.l1 = ( lengths != NULL ) ? *( lengths ) : 1.0;
+    st->obs.l2 = ( lengths != NULL ) ? *( lengths + 1 ) : 1.0;
+    atomic_init( &st->head , 0 );
+    atomic_init( &st->tail , 0 );
+    atomic_init( &st->n_drop , 0 );
+    atomic_init( &st->t_now , *( range_int ) );
+    atomic_init( &st->stop , 0 );
+    atomic_init( &st->done , 0 );
+
+    st->frames = ( double* )malloc( ( size_t )Nframe*st->Ncol*sizeof( double ) );
+    st->rows = ( double* )malloc( ( size_t )RK_STREAM_CHUNK*( st->Nstate + 1 )*sizeof( double ) );
+    st->obs_rows = ( double* )malloc( ( size_t )RK_STREAM_CHUNK*RK_OBS_NCOL*sizeof( double ) );
+    if( st->frames == NULL || st->rows == NULL || st->obs_rows == NULL || pthread_create( &st->thread , NULL , RK_Stream_Run , st ) != 0 ){
+        printf( "ERROR: Could not start the stream! \n" );
+        free( st->frames );
+        free( st->rows );
+        free( st->obs_rows );
+        free( st );
+        return NULL;
+    }
+
+    return st;
+}
+
+/* Take the frames published by a stream so far (consumer side, never blocks) */
+int RK_Stream_Poll( RK_Stream* st , int max_frames , double* frames ){
+
+    long tail = atomic_load_explicit( &st->tail , memory_order_relaxed ), head, n, k;
+    int done = atomic_load_explicit( &st->done , memory_order_acquire ); /* Read before head -> no frame can come after it */
+
+    head = atomic_load_explicit( &st->head , memory_order_acquire );
+    if( head == tail && done != 0 ){
+        return - 1;
+    }
+
+    n = ( head - tail < max_frames ) ? head - tail : max_frames;
+    for( k = 0; k < n; k++ ){
+        memcpy( frames + k*st->Ncol , st->frames + ( size_t )( ( tail + k )%st->Ncap )*st->Ncol , ( size_t )st->Ncol*sizeof( double ) );
+    }
+    atomic_store_explicit( &st->tail , tail + n , memory_order_release );
+
+    return ( int )n;
+}
+
+/* Progress of a stream */
+void RK_Stream_Info( RK_Stream* st , double* info ){
+
+    long head = atomic_load_explicit( &st->head , memory_order_acquire );
+
+    *( info ) = atomic_load_explicit( &st->t_now , memory_order_relaxed );
+    *( info + 1 ) = ( double )head;
+    *( info + 2 ) = ( double )atomic_load_explicit( &st->n_drop , memory_order_relaxed );
+    *( info + 3 ) = ( double )( head - atomic_load_explicit( &st->tail , memory_order_relaxed ) );
+    *( info + 4 ) = ( double )atomic_load_explicit( &st->done , memory_order_acquire );
+    *( info + 5 ) = ( double )st->Ncol;
+
+}
+
+/* Stop a stream (if it is still running), wait for its thread and free it */
+void RK_Stream_Close( RK_Stream* st ){
+
+    if( st == NULL ){
+        return;
+    }
+    atomic_store_explicit( &st->stop , 1 , memory_order_relaxed );
+    pthread_join( st->thread , NULL );
+    free( st->frames );
+    free( st->rows );
+    free( st->obs_rows );
+    free( st );
+
+}
+
+/* Start a real-time stream of the 4-5th order adaptive Dormand-Prince integrator for live visualization */
+/* Inputs:
+    - Nstate: number of quantities in the state (up to RK_CKPT_NSTATE_MAX)
+    - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+    - state_init[ Nstate ]: initial state for the integrator
+    - range_int[ 2 ]: time of the first frame and end of the integration (infinity for an unbounded run which ends at RK_Stream_Close)
+    - dt_frame: time between two frames -> they come from the dense output, so the steps are not affected
+    - Nframe: frames in the ring -> the memory of the stream is bounded by it for any length of the run
+    - mode: RK_STREAM_BLOCK (the integration waits for the consumer) or RK_STREAM_DROP (frames which do not fit are dropped)
+    - speed: simulation time per second of wall time (1.0 for real time, 0 for as fast as possible)
+    - lengths[ 2 ]: the rod lengths l1 and l2 of the positions in the frames (NULL for 1.0 and 1.0) */
+/* Outputs:
+    -- returns the stream (read it with RK_Stream_Poll, end it with RK_Stream_Close) or NULL on error */
+RK_Stream* DP45_Stream_Open( int Nstate , double err_tol , double* state_init , double* range_int , double dt_frame , int Nframe , int mode ,
+                             double speed , double* lengths ){
+
+    RK_Context ctx; /* Temporary context with the global coefficients -> the stream keeps a copy of its settings */
+
+    RK_Context_From_Default( &ctx , Nstate , err_tol );
+    return RK_Context_Stream_Open( &ctx , state_init , range_int , dt_frame , Nframe , mode , speed , lengths );
+}
+
+/* 4-5th order adaptive Dormand-Prince integrator */
+/* Inputs:
+    - Nstate: number of quantities in the state (phase space dimension)
+    - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+    - state_init[ Nstate ]: initial state for the integrator
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+    - file_name: a char of the output filename where the results will be written - include .csv in this like "file.csv"
+    - header: a char of the header to start the file with (no need for \n sign) */
+/* Outputs:
+    - The results are written in a file as commas separated values (.csv)
+    -- The format is [ Time , State[ 0 ] , State[ 1 ] , ... State[ Nstate - 1 ] ]
+    -- Reflect this in the header format! */
+void DP45_Integrator( int Nstate , double err_tol , double* state_init , double* range_int , char* file_name , char* header ){
+
+    RK_Context ctx; /* Temporary context with the global coefficients */
+
+    RK_Context_From_Default( &ctx , Nstate , err_tol );
+    RK_Context_DP45_File( &ctx , state_init , range_int , file_name , header );
+
+}
+
+/* 4-5th order adaptive Dormand-Prince integrator with in-memory output (no file is written) */
+/* Inputs:
+    - Nstate: number of quantities in the state (phase space dimension)
+    - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+    - state_init[ Nstate ]: initial state for the integrator
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+    - buf: output buffer provided by the caller (see RK_Buffer in RK_Library.h) */
+/* Outputs:
+    - buf->data holds buf->n rows as [ Time , State[ 0 ] , State[ 1 ] , ... State[ Nstate - 1 ] ]
+    -- returns the number of rows or -1 if the buffer could not be grown */
+int DP45_Integrator_Buffer( int Nstate , double err_tol , double* state_init , double* range_int , RK_Buffer* buf ){
+
+    RK_Context ctx; /* Temporary context with the global coefficients */
+
+    RK_Context_From_Default( &ctx , Nstate , err_tol );
+    return RK_Context_DP45_Buffer( &ctx , state_init , range_int , buf );
+}
+
+/* 4-5th order adaptive Dormand-Prince integrator with dense output at the requested times */
+/* The integrator steps as DP45_Integrator (whatever step the tolerance allows) and the states at t_out are
+   obtained from the 4th order continuous extension of each step -> the output density is independent of the step density */
+/* Inputs:
+    - Nstate: number of quantities in the state (phase space dimension)
+    - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+    - state_init[ Nstate ]: initial state for the integrator
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+    - Nout: number of output times
+    - t_out[ Nout ]: output times in increasing order (uniform or arbitrary), the ones outside range_int are skipped */
+/* Outputs:
+    - state_out[ Nout ][ Nstate ]: the states at the output times
+    -- returns the number of states written (the first ones inside range_int) or -1 on error */
+int DP45_Integrator_Dense( int Nstate , double err_tol , double* state_init , double* range_int , int Nout , double* t_out , double* state_out ){
+
+    RK_Context ctx; /* Temporary context with the global coefficients */
+
+    RK_Context_From_Default( &ctx , Nstate , err_tol );
+    return RK_Context_DP45_Dense( &ctx , state_init , range_int , Nout , t_out , state_out );
+}
+
+/* 4-5th order adaptive Dormand-Prince integrator with output to a binary trajectory file */
+/* Inputs:
+    - Nstate: number of quantities in the state (phase space dimension)
+    - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+    - state_init[ Nstate ]: initial state for the integrator
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+    - file_name: a char of the output filename where the results will be written (e.g. "file.traj")
+    - col_names: comma separated names of the columns [ Time , State[ 0 ] , ... ] -> same text as the .csv header */
+/* Outputs:
+    - The results are written in the binary format described by RK_Traj_Header in RK_Library.h
+    -- returns the number of rows written or -1 if the file could not be written */
+long DP45_Integrator_Bin( int Nstate , double err_tol , double* state_init , double* range_int , char* file_name , char* col_names ){
+
+    RK_Context ctx; /* Temporary context with the global coefficients */
+
+    RK_Context_From_Default( &ctx , Nstate , err_tol );
+    return RK_Context_DP45_Bin( &ctx , state_init , range_int , file_name , col_names );
+}
+
+/* 4-5th order adaptive Dormand-Prince integrator with output to a compressed binary trajectory file */
+/* Inputs:
+    - Nstate, err_tol, state_init[ Nstate ], range_int[ 2 ], file_name, col_names: as in DP45_Integrator_Bin
+    - dec_tol: drop the accepted steps reproduced within dec_tol (absolute, every state component) by the cubic Hermite
+      interpolant of the kept rows (RK_Traj_Interp) -> 0 keeps every step
+    - mant_bits: bits of mantissa kept in the state values ( 1 to 52 ) -> 52 (or 0) is lossless */
+/* Outputs:
+    - The results are written in the binary format described by RK_Traj_Header in RK_Library.h with the codec RK_TRAJ_CODEC_XOR
+    -- returns the number of rows written or -1 if the file could not be written */
+long DP45_Integrator_Packed( int Nstate , double err_tol , double* state_init , double* range_int , char* file_name , char* col_names ,
+                             double dec_tol , int mant_bits ){
+
+    RK_Context ctx; /* Temporary context with the global coefficients */
+
+    RK_Context_From_Default( &ctx , Nstate , err_tol );
+    return RK_Context_DP45_Packed( &ctx , state_init , range_int , file_name , col_names , dec_tol , mant_bits );
+}
+
+/* Advance a checkpointed 4-5th order adaptive Dormand-Prince integration to t_target -> a long run in bounded-memory chunks */
+/* Inputs:
+    - err_tol: error tolerance per step
+    - cp: the checkpoint from RK_Checkpoint_Init, RK_Checkpoint_Load or an earlier call -> updated to the end of the chunk
+    - t_target: time to advance to ( > cp->t ) */
+/* Outputs:
+    - buf: the rows of the accepted steps of this chunk (NULL for none), the initial state is written only by the first chunk
+    -- returns 0 when t_target is reached, 1 if the chunk stopped at Nloop_max iterations (call again to continue) or -1 on error */
+int DP45_Integrator_Advance( double err_tol , RK_Checkpoint* cp , double t_target , RK_Buffer* buf ){
+
+    RK_Context ctx; /* Temporary context with the global coefficients */
+
+    RK_Context_From_Default( &ctx , cp->Nstate , err_tol );
+    return RK_Context_DP45_Advance( &ctx , cp , t_target , buf );
+}
+
+/* Canonical coordinates of the double Pendulum -> [ theta , phi , p_theta , p_phi ] with the momenta derived from the Lagrangian */
+/* L = a_th*om_th^2 + a_phi*om_phi^2 + a_mix*cos( phi - theta )*om_th*om_phi + b_th*cos( theta ) + b_phi*cos( phi ) gives p = M*om with
+   M = [ [ 2*a_th , a_mix*cos( phi - theta ) ] , [ a_mix*cos( phi - theta ) , 2*a_phi ] ] -> the same matrix as the LHS in RHS_Function */
+/* Inputs:
+    - state[ 4 ]: the state as [ theta , phi , om_theta , om_phi ]
+    - pend_coeff[ 5 ]: the coefficients a_th to b_phi in sequence */
+/* Outputs:
+    - state_can[ 4 ]: the state as [ theta , phi , p_theta , p_phi ] */
+static void Pend_To_Canonical( double* state , double* state_can , double* pend_coeff ){
+
+    double cDel = cos( *( state + 1 ) - *( state ) ); /* \cos{ \phi - \theta } */
+
+    *( state_can ) = *( state );
+    *( state_can + 1 ) = *( state + 1 );
+    *( state_can + 2 ) = 2.0*( *( pend_coeff ) )*( *( state + 2 ) ) + ( *( pend_coeff + 2 ) )*cDel*( *( state + 3 ) );
+    *( state_can + 3 ) = ( *( pend_coeff + 2 ) )*cDel*( *( state + 2 ) ) + 2.0*( *( pend_coeff + 1 ) )*( *( state + 3 ) );
+
+}
+
+/* Angular velocities from the canonical momenta -> om = M^{-1}*p (inverse of Pend_To_Canonical) */
+/* Inputs:
+    - state_can[ 4 ]: the state as [ theta , phi , p_theta , p_phi ]
+    - pend_coeff[ 5 ]: the coefficients a_th to b_phi in sequence */
+/* Outputs:
+    - state[ 4 ]: the state as [ theta , phi , om_theta , om_phi ] */
+static void Pend_From_Canonical( double* state_can , double* state , double* pend_coeff ){
+
+    double a_th = *( pend_coeff ),
+           a_phi = *( pend_coeff + 1 ),
+           a_mix = *( pend_coeff + 2 );
+    double cDel = cos( *( state_can + 1 ) - *( state_can ) ), /* \cos{ \phi - \theta } */
+           detA = ( 4.0*a_th*a_phi - a_mix*a_mix*cDel*cDel ); /* Determinant of M */
+
+    /* NOTE: Analythically this should not be possible, same treatment as in RHS_Function (without the printout) */
+    if( fabs( detA ) < 1e-15 ){
+        detA = 1.0;
+    }
+
+    *( state ) = *( state_can );
+    *( state + 1 ) = *( state_can + 1 );
+    *( state + 2 ) = ( 2.0*a_phi*( *( state_can + 2 ) ) - a_mix*cDel*( *( state_can + 3 ) ) )/detA;
+    *( state + 3 ) = ( - a_mix*cDel*( *( state_can + 2 ) ) + 2.0*a_th*( *( state_can + 3 ) ) )/detA;
+
+}
+
+/* Hamilton's equations of the double Pendulum in the canonical coordinates of Pend_To_Canonical */
+/* d theta/dt = om_theta, d phi/dt = om_phi, d p_theta/dt = a_mix*sin( phi - theta )*om_th*om_phi - b_th*sin( theta ),
+   d p_phi/dt = - a_mix*sin( phi - theta )*om_th*om_phi - b_phi*sin( phi ) with om = M^{-1}*p */
+/* Inputs:
+    - state_can[ 4 ]: the state as [ theta , phi , p_theta , p_phi ]
+    - pend_coeff[ 5 ]: the coefficients a_th to b_phi in sequence */
+/* Outputs:
+    - deriv_can[ 4 ]: the derivative of the canonical state in the same order */
+static void RHS_Function_Hamilton( double* state_can , double* deriv_can , double* pend_coeff ){
+
+    double om[ 4 ]; /* The state with the angular velocities */
+    double tv1; /* a_mix*sin( phi - theta )*om_th*om_phi */
+
+    Pend_From_Canonical( state_can , om , pend_coeff );
+
+    tv1 = ( *( pend_coeff + 2 ) )*sin( *( state_can + 1 ) - *( state_can ) )*om[ 2 ]*om[ 3 ];
+
+    *( deriv_can ) = om[ 2 ];
+    *( deriv_can + 1 ) = om[ 3 ];
+    *( deriv_can + 2 ) = tv1 - ( *( pend_coeff + 3 ) )*sin( *( state_can ) );
+    *( deriv_can + 3 ) = - tv1 - ( *( pend_coeff + 4 ) )*sin( *( state_can + 1 ) );
+
+}
+
+/* Gauss-Legendre collocation coefficients with Nstage = 1, 2 or 3 stages (order 2, 4 and 6) */
+/* Outputs:
+    - a[ GL_NSTAGE_MAX ][ GL_NSTAGE_MAX ]: stage weights {a_ij}
+    - b[ GL_NSTAGE_MAX ]: final weights {bi}
+    -- returns 0 or -1 if Nstage is not supported */
+static int GL_Tableau( int Nstage , double a[ GL_NSTAGE_MAX ][ GL_NSTAGE_MAX ] , double* b ){
+
+    double sq3 = sqrt( 3.0 ), sq15 = sqrt( 15.0 );
+
+    memset( a , 0 , sizeof( double )*GL_NSTAGE_MAX*GL_NSTAGE_MAX );
+
+    switch( Nstage ){
+        case 1: /* Implicit midpoint rule */
+            a[ 0 ][ 0 ] = 0.5;
+            b[ 0 ] = 1.0;
+            return 0;
+        case 2:
+            a[ 0 ][ 0 ] = 0.25;
+            a[ 0 ][ 1 ] = 0.25 - sq3/6.0;
+            a[ 1 ][ 0 ] = 0.25 + sq3/6.0;
+            a[ 1 ][ 1 ] = 0.25;
+            b[ 0 ] = 0.5;
+            b[ 1 ] = 0.5;
+            return 0;
+        case 3:
+            a[ 0 ][ 0 ] = 5.0/36.0;
+            a[ 0 ][ 1 ] = 2.0/9.0 - sq15/15.0;
+            a[ 0 ][ 2 ] = 5.0/36.0 - sq15/30.0;
+            a[ 1 ][ 0 ] = 5.0/36.0 + sq15/24.0;
+            a[ 1 ][ 1 ] = 2.0/9.0;
+            a[ 1 ][ 2 ] = 5.0/36.0 - sq15/24.0;
+            a[ 2 ][ 0 ] = 5.0/36.0 + sq15/30.0;
+            a[ 2 ][ 1 ] = 2.0/9.0 + sq15/15.0;
+            a[ 2 ][ 2 ] = 5.0/36.0;
+            b[ 0 ] = 5.0/18.0;
+            b[ 1 ] = 4.0/9.0;
+            b[ 2 ] = 5.0/18.0;
+            return 0;
+        default:
+            printf( "ERROR: Gauss-Legendre is available with 1 to %d stages, not %d! \n" , GL_NSTAGE_MAX , Nstage );
+            return -1;
+    }
+
+}
+
+/* 4-5th order adaptive Dormand-Prince integrator which writes only the events (e.g. Poincare section points, see RK_Event) */
+/* Inputs:
+    - Nstate: number of quantities in the state (phase space dimension)
+    - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+    - state_init[ Nstate ]: initial state for the integrator
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+    - Nevent: number of events
+    - events[ Nevent ]: the events (the ones already at a zero at the start are not reported) */
+/* Outputs:
+    - buf: the rows [ Time , State[ 0 ] , ... , State[ Nstate - 1 ] , event index ] in the order of the crossings
+    -- returns the number of event rows or -1 on error */
+int DP45_Integrator_Events( int Nstate , double err_tol , double* state_init , double* range_int , int Nevent , RK_Event* events ,
+                            RK_Buffer* buf ){
+
+    RK_Context ctx; /* Temporary context with the global coefficients */
+
+    RK_Context_From_Default( &ctx , Nstate , err_tol );
+    return RK_Context_DP45_Events( &ctx , state_init , range_int , Nevent , events , buf , NULL , NULL );
+}
+
+/* 4-5th order adaptive Dormand-Prince integrator of the double Pendulum which computes the observables inside the integration */
+/* The energies and the positions of the bobs are evaluated at every written state and the reductions are updated at every accepted step,
+   so neither the state history nor a post-processing pass over it is needed */
+/* Inputs:
+    - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+    - state_init[ 4 ]: initial state [ theta , phi , om_theta , om_phi ]
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+    - Nout, t_out[ Nout ]: sorted times of the observable rows (dense output) -> Nout = 0 for a row at every accepted step
+    - lengths[ 2 ]: the rod lengths l1 and l2 of the positions (NULL for 1.0 and 1.0) */
+/* Outputs:
+    - rows: the observable rows [ Time , E_kin , E_pot , x_mid , y_mid , x_end , y_end ] (NULL for the reductions only)
+    - states: the state rows [ Time , State[ 0 ] , ... , State[ 3 ] ] at the same times (NULL to skip)
+    - red: the reductions over the accepted steps -> energy drift, range of the angles and flip counts (NULL to skip)
+    -- returns the number of observable rows or -1 on error */
+int DP45_Integrator_Observables( double err_tol , double* state_init , double* range_int , int Nout , double* t_out , double* lengths ,
+                                 RK_Buffer* rows , RK_Buffer* states , RK_Obs_Summary* red ){
+
+    RK_Context ctx; /* Temporary context with the global coefficients */
+
+    RK_Context_From_Default( &ctx , 4 , err_tol );
+    return RK_Context_DP45_Observables( &ctx , state_init , range_int , Nout , t_out , lengths , rows , states , red );
+}
+
+/* Symplectic Gauss-Legendre integrator of the double Pendulum with a fixed step -> the shared core of the GL_* functions */
+/* The implicit stages are solved in the canonical coordinates by fixed-point iteration (starting from the collocation polynomial
+   of the previous step extrapolated over the new one) down to round-off, and the state is updated with compensated summation. The energy error then stays bounded
+   over arbitrarily long horizons instead of drifting, so large steps can be used when the pointwise accuracy is not needed. */
+/* Inputs:
+    - Nstage: number of Gauss-Legendre stages (1, 2 or 3 -> order 2, 4 and 6)
+    - dt: requested time step -> shortened slightly so that an integer number of steps covers range_int
+    - Nskip: output every Nskip-th step (the first and the last state are always written)
+    - pend_coeff[ 5 ]: the coefficients a_th to b_phi in sequence
+    - state_init[ 4 ]: initial state as [ theta , phi , om_theta , om_phi ]
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+    - out: destinations of the output rows [ Time , theta , phi , om_theta , om_phi ] (NULL to skip the output) */
+/* Outputs:
+    - state_final[ 4 ]: the state at the end of the integration (NULL to skip)
+    - summary[ 4 ]: [ t_final , steps , fixed-point iterations , max |E - E_0| ] (NULL to skip)
+    -- returns 0 on success or -1 if the inputs are invalid or the output could not be written */
+static int GL_Core( int Nstage , double dt , int Nskip , double* pend_coeff , double* state_init , double* range_int , RK_Output* out ,
+                    double* state_final , double* summary ){
+
+    double a[ GL_NSTAGE_MAX ][ GL_NSTAGE_MAX ], /* Stage weights {a_ij} */
+           b[ GL_NSTAGE_MAX ], /* Final weights {bi} */
+           c[ GL_NSTAGE_MAX ], /* Collocation points {ci} */
+           ex[ GL_NSTAGE_MAX ][ GL_NSTAGE_MAX ]; /* Extrapolation of the stage increments to the next step -> Lagrange basis at 1 + c_i */
+    double y[ 4 ], /* Current canonical state */
+           y_comp[ 4 ], /* Compensation of the round-off in y (Kahan summation) */
+           y_stage[ 4 ], /* Canonical state at a stage */
+           dy[ 4 ], /* Increment of the canonical state over the step */
+           F[ GL_NSTAGE_MAX ][ 4 ], /* RHS at the stages */
+           Z[ GL_NSTAGE_MAX ][ 4 ], /* Stage increments Y_i - y */
+           state_out[ 4 ]; /* State with the angular velocities for the output */
+    double t0 = *( range_int ), /* Initial time */
+           h, /* Actual time step */
+           t_now, /* Current time value */
+           e_init, e_drift, /* Energy in the initial state and largest absolute deviation from it */
+           delta, delta_old, /* Largest change of the stage increments in the current and the previous iteration */
+           ymax, /* Largest magnitude of the canonical state -> scale of the convergence criterion */
+           tv1, tv2; /* Temporary variables */
+    long Nsteps, /* Number of steps */
+         n, n_iter, /* Step counter and total number of fixed-point iterations */
+         n_fail; /* Steps where the fixed-point iteration did not converge */
+    int i, j, k, m, it; /* Iterators */
+
+    if( GL_Tableau( Nstage , a , b ) != 0 ){
+        return -1;
+    }
+
+    /* The collocation polynomial of a step interpolates the increments 0 at t and Z_k at t + c_k*h -> evaluate its Lagrange
+       basis at t + ( 1 + c_i )*h for the starting guess of the next step */
+    for( i = 0; i < Nstage; i++ ){
+        c[ i ] = 0.0;
+        for( k = 0; k < Nstage; k++ ){
+            c[ i ] += a[ i ][ k ];
+        }
+    }
+    for( i = 0; i < Nstage; i++ ){
+        for( k = 0; k < Nstage; k++ ){
+            ex[ i ][ k ] = ( 1.0 + c[ i ] )/c[ k ];
+            for( m = 0; m < Nstage; m++ ){
+                if( m != k ){
+                    ex[ i ][ k ] *= ( 1.0 + c[ i ] - c[ m ] )/( c[ k ] - c[ m ] );
+                }
+            }
+        }
+    }
+    if( !( dt > 0.0 ) || *( range_int + 1 ) < t0 ){
+        printf( "ERROR: Gauss-Legendre needs a positive step and an increasing range_int! \n" );
+        return -1;
+    }
+    if( Nskip < 1 ){
+        Nskip = 1;
+    }
+
+    Nsteps = ( long )ceil( ( *( range_int + 1 ) - t0 )/dt );
+    h = ( Nsteps > 0 ) ? ( *( range_int + 1 ) - t0 )/( double )Nsteps : 0.0;
+
+    Pend_To_Canonical( state_init , y , pend_coeff );
+    for( j = 0; j < 4; j++ ){
+        y_comp[ j ] = 0.0;
+    }
+
+    t_now = t0;
+    if( RK_Write_Row( out , 4 , t_now , state_init ) != 0 ){
+        return -1;
+    }
+
+    e_init = Pend_Energy( state_init , pend_coeff );
+    e_drift = 0.0;
+    n_iter = 0;
+    n_fail = 0;
+
+    /* Initial guess for the first step -> the increments of an explicit Euler step to each collocation point */
+    RHS_Function_Hamilton( y , F[ 0 ] , pend_coeff );
+    for( i = Nstage - 1; i >= 0; i-- ){
+        for( j = 0; j < 4; j++ ){
+            Z[ i ][ j ] = c[ i ]*h*F[ 0 ][ j ];
+        }
+    }
+
+    for( n = 1; n <= Nsteps; n++ ){
+
+        ymax = 1.0;
+        for( j = 0; j < 4; j++ ){
+            ymax = ( fabs( y[ j ] ) > ymax ) ? fabs( y[ j ] ) : ymax;
+        }
+
+        /* Fixed-point iteration of the collocation equations Z_i = h*sum_j a_ij*F( y + Z_j ) -> Z holds the starting guess */
+        delta_old = HUGE_VAL;
+        for( it = 0; it < GL_iter_max; it++ ){
+
+            for( i = 0; i < Nstage; i++ ){
+                for( j = 0; j < 4; j++ ){
+                    y_stage[ j ] = y[ j ] + Z[ i ][ j ];
+                }
+                RHS_Function_Hamilton( y_stage , F[ i ] , pend_coeff );
+            }
+            n_iter += 1;
+
+            delta = 0.0;
+            for( i = 0; i < Nstage; i++ ){
+                for( j = 0; j < 4; j++ ){
+                    tv1 = 0.0;
+                    for( k = 0; k < Nstage; k++ ){
+                        tv1 += a[ i ][ k ]*F[ k ][ j ];
+                    }
+                    tv1 *= h;
+                    tv2 = fabs( tv1 - Z[ i ][ j ] );
+                    delta = ( tv2 > delta ) ? tv2 : delta;
+                    Z[ i ][ j ] = tv1;
+                }
+            }
+
+            /* Converged to round-off -> the remaining error is estimated from the contraction rate theta = delta/delta_old as
+               theta/( 1 - theta )*delta, or the change stopped decreasing (round-off floor reached) */
+            if( delta <= GL_iter_tol*ymax || ( it > 1 && delta >= delta_old ) ){
+                break;
+            }
+            tv1 = delta/delta_old;
+            if( it > 0 && tv1*delta <= ( 1.0 - tv1 )*GL_iter_tol*ymax ){
+                break;
+            }
+            delta_old = delta;
+        }
+        if( it == GL_iter_max ){
+            n_fail += 1;
+        }
+
+        /* Update the state with the final weights -> compensated summation keeps the round-off from drifting over long runs */
+        for( j = 0; j < 4; j++ ){
+            tv1 = 0.0;
+            for( i = 0; i < Nstage; i++ ){
+                tv1 += b[ i ]*F[ i ][ j ];
+            }
+            dy[ j ] = h*tv1;
+            tv1 = dy[ j ] + y_comp[ j ];
+            tv2 = y[ j ] + tv1;
+            y_comp[ j ] = tv1 - ( tv2 - y[ j ] );
+            y[ j ] = tv2;
+        }
+
+        /* Starting guess of the next step from the collocation polynomial of this one (relative to the new state) */
+        for( j = 0; j < 4; j++ ){
+            for( i = 0; i < Nstage; i++ ){
+                y_stage[ i ] = - dy[ j ];
+                for( k = 0; k < Nstage; k++ ){
+                    y_stage[ i ] += ex[ i ][ k ]*Z[ k ][ j ];
+                }
+            }
+            for( i = 0; i < Nstage; i++ ){
+                Z[ i ][ j ] = y_stage[ i ];
+            }
+        }
+        t_now = t0 + ( double )n*h;
+
+        /* Write the output and track the energy only at the output steps (and the last one) */
+        if( n%Nskip == 0 || n == Nsteps ){
+            Pend_From_Canonical( y , state_out , pend_coeff );
+            if( RK_Write_Row( out , 4 , t_now , state_out ) != 0 ){
+                printf( "ERROR: Could not write the output, integration stopped at t = %lf \n" , t_now );
+                return -1;
+            }
+            tv1 = fabs( Pend_Energy( state_out , pend_coeff ) - e_init );
+            e_drift = ( tv1 > e_drift ) ? tv1 : e_drift;
+        }
+
+    }
+
+    /* In case some of the steps did not converge - warn about it */
+    if( n_fail > 0 ){
+        printf( "----------------------------------------------------------\n" );
+        printf( "--WARNING: Gauss-Legendre iteration did not converge!-----\n" );
+        printf( "----------------------------------------------------------\n" );
+        printf( "%ld out of %ld steps stopped after %d iterations, reduce the step dt = %lf \n" , n_fail , Nsteps , GL_iter_max , h );
+    }
+
+    /* Return the final state and the summary of the run */
+    if( state_final != NULL ){
+        Pend_From_Canonical( y , state_final , pend_coeff );
+    }
+    if( summary != NULL ){
+        *( summary ) = t_now;
+        *( summary + 1 ) = ( double )Nsteps;
+        *( summary + 2 ) = ( double )n_iter;
+        *( summary + 3 ) = e_drift;
+    }
+
+    return 0;
+}
+
+/* Symplectic Gauss-Legendre integrator of the double Pendulum with a context -> in-memory output and a summary of the run */
+/* Inputs:
+    - ctx: the context -> only the pendulum coefficients are used (Nstate must be 4)
+    - Nstage: number of Gauss-Legendre stages (1, 2 or 3 -> order 2, 4 and 6)
+    - dt: fixed time step (shortened slightly so that an integer number of steps covers range_int)
+    - Nskip: output every Nskip-th step (the first and the last state are always written)
+    - state_init[ 4 ]: initial state as [ theta , phi , om_theta , om_phi ]
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time) */
+/* Outputs:
+    - buf: in-memory output rows [ Time , theta , phi , om_theta , om_phi ] (NULL for no output, see RK_Buffer)
+    - state_final[ 4 ]: the state at the end of the integration (NULL to skip)
+    - summary[ 4 ]: [ t_final , steps , fixed-point iterations , max |E - E_0| at the output steps ] (NULL to skip)
+    -- returns the number of rows written or -1 on error */
+int RK_Context_GL( RK_Context* ctx , int Nstage , double dt , int Nskip , double* state_init , double* range_int ,
+                   RK_Buffer* buf , double* state_final , double* summary ){
+
+    RK_Output out = { NULL , buf , NULL }; /* Destinations of the output -> only the in-memory buffer */
+
+    if( ctx->Nstate != 4 ){
+        printf( "ERROR: Gauss-Legendre integrates the double Pendulum Hamiltonian, Nstate must be 4 and not %d! \n" , ctx->Nstate );
+        return -1;
+    }
+
+    if( buf != NULL ){
+        buf->n = 0;
+    }
+
+    if( GL_Core( Nstage , dt , Nskip , ctx->pend_coeff , state_init , range_int , ( buf != NULL ) ? &out : NULL , state_final , summary ) != 0 ){
+        return -1;
+    }
+
+    return ( buf != NULL ) ? buf->n : 0;
+}
+
+/* Symplectic Gauss-Legendre integrator of the double Pendulum with a fixed step (structure preserving, for long horizons) */
+/* Inputs:
+    - Nstage: number of Gauss-Legendre stages (1, 2 or 3 -> order 2, 4 and 6)
+    - dt: fixed time step (shortened slightly so that an integer number of steps covers range_int)
+    - Nskip: write every Nskip-th step (the first and the last state are always written)
+    - state_init[ 4 ]: initial state as [ theta , phi , om_theta , om_phi ]
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+    - file_name: a char of the output filename where the results will be written - include .csv in this like "file.csv"
+    - header: a char of the header to start the file with (no need for \n sign) */
+/* Outputs:
+    - The results are written in a file as commas separated values (.csv) in the same format as DP45_Integrator */
+void GL_Integrator( int Nstage , double dt , int Nskip , double* state_init , double* range_int , char* file_name , char* header ){
+
+    RK_Output out = { NULL , NULL , NULL }; /* Destinations of the output -> only the .csv file */
+
+    /* Open the file and write the header */
+    out.fp = fopen( file_name , "w" ); 
+    fprintf( out.fp , "%s \n" , header );
+
+    GL_Core( Nstage , dt , Nskip , RK_Default.pend_coeff , state_init , range_int , &out , NULL , NULL );
+
+    fclose( out.fp ); /* Close the file in the end */
+
+}
+
+/* Symplectic Gauss-Legendre integrator of the double Pendulum with in-memory output (see GL_Integrator and RK_Buffer) */
+/* Outputs:
+    - buf: the rows [ Time , theta , phi , om_theta , om_phi ] every Nskip steps
+    - summary[ 4 ]: [ t_final , steps , fixed-point iterations , max |E - E_0| at the output steps ] (NULL to skip)
+    -- returns the number of rows written or -1 on error */
+int GL_Integrator_Buffer( int Nstage , double dt , int Nskip , double* state_init , double* range_int , RK_Buffer* buf , double* summary ){
+
+    RK_Context ctx; /* Temporary context with the global coefficients */
+
+    RK_Context_From_Default( &ctx , 4 , 0.0 );
+    return RK_Context_GL( &ctx , Nstage , dt , Nskip , state_init , range_int , buf , NULL , summary );
+}
+
+/* Right-Hand-Side Function for the double Pendulum and its tangent-linear (variational) system */
+/* The tangent vectors evolve as dv/dt = J( x )*v with the analytic Jacobian J of RHS_Function_Coeff. The angular accelerations
+   are om_dot = N/detA with N = adj( A )*rhs_vec, so each column of J follows from the quotient rule dom_dot = ( dN - om_dot*ddetA )/detA */
+/* Inputs:
+    - state[ LYAP_NSTATE ]: the state [ theta , phi , om_theta , om_phi ] followed by the 4 tangent vectors (4 quantities each)
+    - pend_coeff[ 5 ]: the coefficients a_th to b_phi in sequence (same order as in Set_Pend_coeff) */
+/* Outputs:
+    - deriv_state[ LYAP_NSTATE ]: the derivative of the state in the same order */
+static void RHS_Function_Variational( double* state , double* deriv_state , double* pend_coeff ){
+
+    double a_th = *( pend_coeff ), /* Local copies of the coefficients */
+           a_phi = *( pend_coeff + 1 ),
+           a_mix = *( pend_coeff + 2 ),
+           b_th = *( pend_coeff + 3 ),
+           b_phi = *( pend_coeff + 4 );
+    double sDel = sin( *( state + 1 ) - *( state ) ), /* \sin{ \phi - \theta } */
+           cDel = cos( *( state + 1 ) - *( state ) ), /* \cos{ \phi - \theta } */
+           om_th2 = ( *( state + 2 ) )*( *( state + 2 ) ),
+           om_phi2 = ( *( state + 3 ) )*( *( state + 3 ) ),
+           detA = ( 4.0*a_th*a_phi - a_mix*a_mix*cDel*cDel ); /* Determinant of the LHS of RHS_Function_Coeff */
+    double rhs_0, rhs_1, /* RHS vector of RHS_Function_Coeff */
+           acc[ 2 ], /* Angular accelerations */
+           d_rhs0[ 4 ], d_rhs1[ 4 ], d_cDel[ 4 ], d_det[ 4 ], /* Derivatives of the parts with respect to the 4 state quantities */
+           Jac[ 2 ][ 4 ]; /* Lower half of the Jacobian (the upper half is [ 0 I ]) */
+    int i, j; /* Iterators */
+
+    if( fabs( detA ) < 1e-15 ){
+        printf( "WARNING: The system appears to be going singular, assuming detA == 1 to continue, results after this point are WRONG!\n" );
+        detA = 1.0;
+    }
+
+    rhs_0 = - b_th*sin( *( state ) ) + a_mix*sDel*om_phi2;
+    rhs_1 = - b_phi*sin( *( state + 1 ) ) - a_mix*sDel*om_th2;
+    acc[ 0 ] = ( 2.0*a_phi*rhs_0 - a_mix*cDel*rhs_1 )/detA;
+    acc[ 1 ] = ( - a_mix*cDel*rhs_0 + 2.0*a_th*rhs_1 )/detA;
+
+    /* Derivatives with respect to [ theta , phi , om_theta , om_phi ] -> d( phi - theta ) is ( - 1 , 1 , 0 , 0 ) */
+    d_rhs0[ 0 ] = - b_th*cos( *( state ) ) - a_mix*cDel*om_phi2;
+    d_rhs0[ 1 ] = a_mix*cDel*om_phi2;
+    d_rhs0[ 2 ] = 0.0;
+    d_rhs0[ 3 ] = 2.0*a_mix*sDel*( *( state + 3 ) );
+    d_rhs1[ 0 ] = a_mix*cDel*om_th2;
+    d_rhs1[ 1 ] = - b_phi*cos( *( state + 1 ) ) - a_mix*cDel*om_th2;
+    d_rhs1[ 2 ] = - 2.0*a_mix*sDel*( *( state + 2 ) );
+    d_rhs1[ 3 ] = 0.0;
+    d_cDel[ 0 ] = sDel;
+    d_cDel[ 1 ] = - sDel;
+    d_cDel[ 2 ] = 0.0;
+    d_cDel[ 3 ] = 0.0;
+    for( j = 0; j < 4; j++ ){
+        d_det[ j ] = - 2.0*a_mix*a_mix*cDel*d_cDel[ j ];
+        Jac[ 0 ][ j ] = ( 2.0*a_phi*d_rhs0[ j ] - a_mix*( d_cDel[ j ]*rhs_1 + cDel*d_rhs1[ j ] ) - acc[ 0 ]*d_det[ j ] )/detA;
+        Jac[ 1 ][ j ] = ( 2.0*a_th*d_rhs1[ j ] - a_mix*( d_cDel[ j ]*rhs_0 + cDel*d_rhs0[ j ] ) - acc[ 1 ]*d_det[ j ] )/detA;
+    }
+
+    /* Write out the derivatives of the state */
+    *( deriv_state ) = *( state + 2 );
+    *( deriv_state + 1 ) = *( state + 3 );
+    *( deriv_state + 2 ) = acc[ 0 ];
+    *( deriv_state + 3 ) = acc[ 1 ];
+
+    /* And of the tangent vectors -> dv = J*v */
+    for( i = 4; i < LYAP_NSTATE; i += 4 ){
+        *( deriv_state + i ) = *( state + i + 2 );
+        *( deriv_state + i + 1 ) = *( state + i + 3 );
+        *( deriv_state + i + 2 ) = Jac[ 0 ][ 0 ]*( *( state + i ) ) + Jac[ 0 ][ 1 ]*( *( state + i + 1 ) )
+                                 + Jac[ 0 ][ 2 ]*( *( state + i + 2 ) ) + Jac[ 0 ][ 3 ]*( *( state + i + 3 ) );
+        *( deriv_state + i + 3 ) = Jac[ 1 ][ 0 ]*( *( state + i ) ) + Jac[ 1 ][ 1 ]*( *( state + i + 1 ) )
+                                 + Jac[ 1 ][ 2 ]*( *( state + i + 2 ) ) + Jac[ 1 ][ 3 ]*( *( state + i + 3 ) );
+    }
+
+}
+
+/* Single embedded Runge-Kutta step of the Pendulum with its tangent vectors (see DP45_Step_Generic) */
+/* Output:
+    - the largest error estimate over the state and the tangent vectors */
+static double Lyap_Step( const RK_Tableau* tab , double* pend_coeff , double dt , double* state_now , double* rhs_now ,
+                         double* state_new , double* rhs_last , double k_DP[ LYAP_NSTATE ][ RK_NSTAGE_MAX ] ){
+
+    int i, j, s; /* Iterators */
+    double int_state[ LYAP_NSTATE ], /* Intermediate state for the stages */
+           err_est[ LYAP_NSTATE ], /* Estimated error for each of the state quantities */
+           e3; /* Second error estimate of a quantity (DOP853) */
+
+    for( i = 0; i < LYAP_NSTATE; i++ ){
+        k_DP[ i ][ 0 ] = rhs_now[ i ]*dt;
+    }
+
+    for( s = 1; s < tab->Ns; s++ ){
+        for( i = 0; i < LYAP_NSTATE; i++ ){
+            int_state[ i ] = state_now[ i ];
+            for( j = 0; j < s; j++ ){
+                int_state[ i ] += tab->a[ s ][ j ]*k_DP[ i ][ j ];
+            }
+        }
+        RHS_Function_Variational( int_state , rhs_last , pend_coeff );
+        for( i = 0; i < LYAP_NSTATE; i++ ){
+            k_DP[ i ][ s ] = rhs_last[ i ]*dt;
+        }
+    }
+
+    for( i = 0; i < LYAP_NSTATE; i++ ){
+        err_est[ i ] = 0.0;
+        e3 = 0.0;
+        state_new[ i ] = state_now[ i ];
+        for( j = 0; j < tab->Ns; j++ ){
+            err_est[ i ] += tab->ec[ j ]*k_DP[ i ][ j ];
+            state_new[ i ] += tab->b[ 0 ][ j ]*k_DP[ i ][ j ];
+        }
+        if( tab->Nerr == 2 ){
+            for( j = 0; j < tab->Ns; j++ ){
+                e3 += tab->ec3[ j ]*k_DP[ i ][ j ];
+            }
+        }
+        err_est[ i ] = RK_Err_Combine( tab , err_est[ i ] , e3 );
+        if( tab->fsal ){
+            state_new[ i ] = int_state[ i ];
+        }
+    }
+
+    return MaxVal( err_est , LYAP_NSTATE );
+}
+
+/* Re-orthonormalize the tangent vectors (QR by modified Gram-Schmidt) and accumulate the logarithms of the stretching factors */
+/* Inputs:
+    - vec[ 16 ]: the 4 tangent vectors one after another -> replaced by the orthonormal Q
+    - log_sum[ 4 ]: the accumulated log( R_kk ) -> the diagonal of this R is added */
+static void Lyap_QR( double* vec , double* log_sum ){
+
+    int i, j, k; /* Iterators */
+    double tv1; /* Temporary variable */
+
+    for( k = 0; k < 4; k++ ){
+        for( j = 0; j < k; j++ ){
+            tv1 = 0.0;
+            for( i = 0; i < 4; i++ ){
+                tv1 += vec[ 4*k + i ]*vec[ 4*j + i ];
+            }
+            for( i = 0; i < 4; i++ ){
+                vec[ 4*k + i ] -= tv1*vec[ 4*j + i ];
+            }
+        }
+        tv1 = 0.0;
+        for( i = 0; i < 4; i++ ){
+            tv1 += vec[ 4*k + i ]*vec[ 4*k + i ];
+        }
+        tv1 = sqrt( tv1 );
+        log_sum[ k ] += log( tv1 );
+        for( i = 0; i < 4; i++ ){
+            vec[ 4*k + i ] /= tv1;
+        }
+    }
+
+}
+
+/* Lyapunov spectrum of the double Pendulum from the variational equations -> the shared core of the Lyapunov_* functions */
+/* The state and 4 tangent vectors (starting from the identity) are integrated together with the adaptive embedded pair of the
+   tableau (same step control as DP45_Core with the error taken over all 20 quantities). After the first accepted step past every
+   multiple of t_orth the tangent vectors are re-orthonormalized and lambda_k = sum( log( R_kk ) )/( t - t_0 ). */
+/* Inputs:
+    - tab: tableau of the embedded Runge-Kutta pair
+    - err_tol: error tolerance per step
+    - pend_coeff[ 5 ]: the coefficients a_th to b_phi in sequence
+    - state_init[ 4 ]: initial state as [ theta , phi , om_theta , om_phi ]
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+    - t_orth: time between the re-orthonormalizations (order of the inverse largest exponent or less)
+    - hist: convergence history with the rows [ Time , lambda_1 , ... , lambda_4 ] after every re-orthonormalization (NULL to skip) */
+/* Outputs:
+    - lyap[ 4 ]: the Lyapunov exponents in the order of the tangent vectors (largest first in practice)
+    -- returns 0 on success or -1 if the inputs are invalid or the history could not be written */
+static int Lyap_Core( const RK_Tableau* tab , double err_tol , double* pend_coeff , double* state_init , double* range_int ,
+                      double t_orth , RK_Output* hist , double* lyap ){
+
+    double k_DP[ LYAP_NSTATE ][ RK_NSTAGE_MAX ], /* Runge-Kutta intermediate derivatives */
+           state_now[ LYAP_NSTATE ], /* State and tangent vectors */
+           state_new[ LYAP_NSTATE ], /* Candidate at the end of the step */
+           rhs_now[ LYAP_NSTATE ], /* Right-Hand-Side at state_now -> kept between the steps */
+           rhs_last[ LYAP_NSTATE ], /* Right-Hand-Side of the last stage of the step */
+           log_sum[ 4 ], /* Accumulated logarithms of the stretching factors */
+           t_now, t_qr, /* Current time and time of the next re-orthonormalization */
+           dt, /* Current time step */
+           err_ratio, err_ratiOld, /* Error ratio of actual to desired - current and old step */
+           tv1; /* Temporary variable */
+    int rej, /* 1 if the last step was rejected */
+        i, j; /* Iterators */
+    long k; /* Step counter */
+
+    if( !( t_orth > 0.0 ) || !( *( range_int + 1 ) > *( range_int ) ) ){
+        printf( "ERROR: The Lyapunov spectrum needs t_orth > 0 and range_int[ 1 ] > range_int[ 0 ]! \n" );
+        return -1;
+    }
+
+    /* The state followed by the identity as the initial tangent vectors */
+    for( j = 0; j < LYAP_NSTATE; j++ ){
+        state_now[ j ] = ( j < 4 ) ? *( state_init + j ) : ( ( ( j - 4 ) % 5 == 0 ) ? 1.0 : 0.0 );
+    }
+    for( j = 0; j < 4; j++ ){
+        log_sum[ j ] = 0.0;
+        *( lyap + j ) = 0.0;
+    }
+
+    t_now = *( range_int );
+    t_qr = t_now + t_orth;
+    dt = ( *( range_int + 1 ) - *( range_int ) )/1e6;
+    RHS_Function_Variational( state_now , rhs_now , pend_coeff );
+
+    k = 0;
+    rej = 0;
+    err_ratiOld = 1.0;
+
+    while( ( t_now < *( range_int + 1 ) ) && ( k < Lyap_loop_max ) ){
+
+        err_ratio = Lyap_Step( tab , pend_coeff , dt , state_now , rhs_now , state_new , rhs_last , k_DP )/err_tol;
+
+        if( err_ratio < 1.0 && ( t_now + dt - *( range_int + 1 ) < err_tol ) ){
+
+            t_now += dt;
+            for( i = 0; i < LYAP_NSTATE; i++ ){
+                state_now[ i ] = state_new[ i ];
+            }
+
+            /* Re-orthonormalize once past the next multiple of t_orth (and at the end) -> the RHS changes with the tangent vectors */
+            if( t_now >= t_qr || t_now >= *( range_int + 1 ) - err_tol ){
+                Lyap_QR( state_now + 4 , log_sum );
+                for( j = 0; j < 4; j++ ){
+                    *( lyap + j ) = log_sum[ j ]/( t_now - *( range_int ) );
+                }
+                if( hist != NULL && RK_Write_Row( hist , 4 , t_now , lyap ) != 0 ){
+                    printf( "ERROR: Could not write the Lyapunov history, integration stopped at t = %lf \n" , t_now );
+                    return -1;
+                }
+                while( t_qr <= t_now ){
+                    t_qr += t_orth;
+                }
+                RHS_Function_Variational( state_now , rhs_now , pend_coeff );
+            }
+            else if( tab->fsal ){
+                for( i = 0; i < LYAP_NSTATE; i++ ){
+                    rhs_now[ i ] = rhs_last[ i ];
+                }
+            }
+            else{
+                RHS_Function_Variational( state_now , rhs_now , pend_coeff );
+            }
+
+            /* Integral controller for the step increase (see DP45_Core) */
+            if( rej == 0 && ( err_ratio > 0.0 ) ){
+                tv1 = safe_fac*dt*pow( err_ratio , tab->ctrl_p )*pow( err_ratiOld , tab->ctrl_i );
+                dt = ( tv1/dt < step_mrat ) ? tv1 : dt*step_mrat;
+            }
+            rej = 0;
+
+        }
+        else{
+            if( t_now + dt - *( range_int + 1 ) > err_tol ){
+                dt = ( *( range_int + 1 ) - t_now );
+                rej = 0;
+            }
+            else{
+                dt = safe_fac*dt*pow( err_ratio , tab->ctrl_l );
+                rej = 1;
+            }
+        }
+
+        err_ratiOld = err_ratio;
+        k += 1;
+
+        if( k == Lyap_loop_max ){
+            printf( "----------------------------------------------------------\n" );
+            printf( "----WARNING: The full integration was not carried out!----\n" );
+            printf( "----------------------------------------------------------\n" );
+            printf( "Stopped after %ld iterations at t = %lf out of t_max = %lf \n" , k , t_now , *( range_int + 1 ) );
+        }
+
+    }
+
+    return 0;
+}
+
+/* Lyapunov spectrum of the double Pendulum with a context -> tableau, tolerance and coefficients of the context */
+/* Inputs:
+    - ctx: the context (Nstate must be 4)
+    - state_init[ 4 ]: initial state as [ theta , phi , om_theta , om_phi ]
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+    - t_orth: time between the re-orthonormalizations of the tangent vectors */
+/* Outputs:
+    - lyap[ 4 ]: the Lyapunov exponents (sum close to 0 since the system is Hamiltonian)
+    - hist: convergence history rows [ Time , lambda_1 , ... , lambda_4 ] after every re-orthonormalization (NULL to skip, see RK_Buffer)
+    -- returns the number of history rows or -1 on error */
+int RK_Context_Lyapunov( RK_Context* ctx , double* state_init , double* range_int , double t_orth , double* lyap , RK_Buffer* hist ){
+
+    RK_Output out = { NULL , hist , NULL }; /* Destinations of the history -> only the in-memory buffer */
+
+    if( ctx->Nstate != 4 ){
+        printf( "ERROR: The Lyapunov spectrum is computed for the double Pendulum, Nstate must be 4 and not %d! \n" , ctx->Nstate );
+        return -1;
+    }
+
+    if( hist != NULL ){
+        hist->n = 0;
+    }
+
+    if( Lyap_Core( &ctx->tab , ctx->err_tol , ctx->pend_coeff , state_init , range_int , t_orth , ( hist != NULL ) ? &out : NULL , lyap ) != 0 ){
+        return -1;
+    }
+
+    return ( hist != NULL ) ? hist->n : 0;
+}
+
+/* Lyapunov spectrum of the double Pendulum with the global coefficients and method (see RK_Context_Lyapunov) */
+int Lyapunov_Spectrum( double err_tol , double* state_init , double* range_int , double t_orth , double* lyap , RK_Buffer* hist ){
+
+    RK_Context ctx; /* Temporary context with the global coefficients */
+
+    RK_Context_From_Default( &ctx , 4 , err_tol );
+    return RK_Context_Lyapunov( &ctx , state_init , range_int , t_orth , lyap , hist );
+}
+
+/* Open a binary trajectory file for reading -> only the header and the sparse time index are read */
+/* Inputs:
+    - file_name: name of the binary file written by DP45_Integrator_Bin */
+/* Output:
+    - a reader handle (free with RK_Traj_Close) or NULL if the file is missing or not a trajectory file */
+RK_Traj_Reader* RK_Traj_Open( char* file_name ){
+
+    RK_Traj_Reader *tr;
+
+    tr = ( RK_Traj_Reader* )calloc( 1 , sizeof( RK_Traj_Reader ) );
+    if( tr == NULL ){
+        return NULL;
+    }
+
+    tr->fp = fopen( file_name , "rb" );
+    if( tr->fp == NULL || fread( &tr->head , sizeof( RK_Traj_Header ) , 1 , tr->fp ) != 1 || memcmp( tr->head.magic , RK_TRAJ_MAGIC , 8 ) != 0 ||
+        !( ( tr->head.version == RK_TRAJ_VERSION && tr->head.codec == RK_TRAJ_CODEC_RAW ) ||
+           ( tr->head.version == RK_TRAJ_VERSION_XOR && tr->head.codec == RK_TRAJ_CODEC_XOR ) ) ){
+        printf( "ERROR: %s is not a readable binary trajectory file \n" , file_name );
+        RK_Traj_Close( tr );
+        return NULL;
+    }
+
+    tr->index = ( double* )malloc( ( size_t )( tr->head.n_chunks + 1 )*sizeof( double ) );
+    tr->chunk = ( double* )malloc( ( size_t )tr->head.Ncol*tr->head.chunk_rows*sizeof( double ) );
+    tr->i_chunk = -1;
+    if( tr->index == NULL || tr->chunk == NULL || fseek( tr->fp , ( long )tr->head.index_offset , SEEK_SET ) != 0 ||
+        fread( tr->index , sizeof( double ) , ( size_t )tr->head.n_chunks , tr->fp ) != ( size_t )tr->head.n_chunks ){
+        printf( "ERROR: Could not read the time index of %s \n" , file_name );
+        RK_Traj_Close( tr );
+        return NULL;
+    }
+
+    /* The byte offsets of the compressed chunks follow the time index */
+    if( tr->head.codec == RK_TRAJ_CODEC_XOR ){
+        tr->offsets = ( int64_t* )malloc( ( size_t )( tr->head.n_chunks + 1 )*sizeof( int64_t ) );
+        if( tr->offsets == NULL || fread( tr->offsets , sizeof( int64_t ) , ( size_t )tr->head.n_chunks + 1 , tr->fp ) != ( size_t )tr->head.n_chunks + 1 ){
+            printf( "ERROR: Could not read the chunk offsets of %s \n" , file_name );
+            RK_Traj_Close( tr );
+            return NULL;
+        }
+    }
+
+    return tr;
+}
+
+/* Close a binary trajectory file opened with RK_Traj_Open and free the reader */
+void RK_Traj_Close( RK_Traj_Reader* tr ){
+
+    if( tr == NULL ){
+        return;
+    }
+    if( tr->fp != NULL ){
+        fclose( tr->fp );
+    }
+    free( tr->index );
+    free( tr->chunk );
+    free( tr->offsets );
+    free( tr->zbuf );
+    free( tr );
+
+}
+
+/* Load chunk i_chunk of the trajectory in the reader (nothing is read if it is already loaded) */
+/* A compressed chunk is decoded into the same column-major layout (padded with NaN) as a raw one */
+static int RK_Traj_Load_Chunk( RK_Traj_Reader* tr , long i_chunk ){
+
+    size_t nval = ( size_t )tr->head.Ncol*tr->head.chunk_rows;
+    int64_t n_byte;
+    long n_in;
+    int i, j;
+    unsigned char *zbuf_new;
+    RK_Bits bs = { NULL , 0 , 0 , 0 , 0 };
+
+    if( i_chunk == tr->i_chunk ){
+        return 0;
+    }
+    if( tr->head.codec == RK_TRAJ_CODEC_XOR ){
+        tr->i_chunk = -1;
+        n_byte = tr->offsets[ i_chunk + 1 ] - tr->offsets[ i_chunk ];
+        if( n_byte < 0 ){
+            return -1;
+        }
+        if( n_byte > tr->zbuf_cap ){
+            zbuf_new = ( unsigned char* )realloc( tr->zbuf , ( size_t )n_byte );
+            if( zbuf_new == NULL ){
+                return -1;
+            }
+            tr->zbuf = zbuf_new;
+            tr->zbuf_cap = n_byte;
+        }
+        if( fseek( tr->fp , ( long )( sizeof( RK_Traj_Header ) + tr->offsets[ i_chunk ] ) , SEEK_SET ) != 0 ||
+            fread( tr->zbuf , 1 , ( size_t )n_byte , tr->fp ) != ( size_t )n_byte ){
+            return -1;
+        }
+        bs.p = tr->zbuf;
+        bs.n_byte = n_byte;
+        n_in = tr->head.n_rows - i_chunk*( long )tr->head.chunk_rows;
+        n_in = ( n_in < tr->head.chunk_rows ) ? n_in : tr->head.chunk_rows;
+        for( j = 0; j < tr->head.Ncol; j++ ){
+            if( RK_XOR_Decode( &bs , tr->chunk + j*tr->head.chunk_rows , ( int )n_in , ( j == 0 ) ? 52 : tr->head.mant_bits ) != 0 ){
+                return -1;
+            }
+            for( i = ( int )n_in; i < tr->head.chunk_rows; i++ ){
+                tr->chunk[ j*tr->head.chunk_rows + i ] = NAN;
+            }
+        }
+        tr->i_chunk = i_chunk;
+        return 0;
+    }
+    if( fseek( tr->fp , ( long )( sizeof( RK_Traj_Header ) + i_chunk*nval*sizeof( double ) ) , SEEK_SET ) != 0 ||
+        fread( tr->chunk , sizeof( double ) , nval , tr->fp ) != nval ){
+        tr->i_chunk = -1;
+        return -1;
+    }
+    tr->i_chunk = i_chunk;
+
+    return 0;
+}
+
+/* Read row i_row of the trajectory */
+/* Inputs:
+    - tr: reader handle from RK_Traj_Open
+    - i_row: row index ( 0 <= i_row < n_rows ) */
+/* Outputs:
+    - row[ Ncol ]: [ Time , State[ 0 ] , ... , State[ Ncol - 2 ] ]
+    -- returns 0 on success or -1 if the row does not exist */
+int RK_Traj_Read_Row( RK_Traj_Reader* tr , long i_row , double* row ){
+
+    int j;
+    long i_in;
+
+    if( i_row < 0 || i_row >= tr->head.n_rows || RK_Traj_Load_Chunk( tr , i_row/tr->head.chunk_rows ) != 0 ){
+        return -1;
+    }
+
+    i_in = i_row%tr->head.chunk_rows;
+    for( j = 0; j < tr->head.Ncol; j++ ){
+        *( row + j ) = tr->chunk[ j*tr->head.chunk_rows + i_in ];
+    }
+
+    return 0;
+}
+
+/* Find the last row with time <= t_find -> binary search over the sparse index and then inside a single chunk */
+/* Inputs:
+    - tr: reader handle from RK_Traj_Open
+    - t_find: the time to look for */
+/* Outputs:
+    - row[ Ncol ]: the found row (untouched if nothing was found), can be NULL
+    -- returns the index of the row or -1 if t_find is before the first row */
+long RK_Traj_Find_Time( RK_Traj_Reader* tr , double t_find , double* row ){
+
+    long lo, hi, mid, i_chunk, n_in;
+
+    if( tr->head.n_chunks == 0 || t_find < tr->index[ 0 ] ){
+        return -1;
+    }
+
+    /* Last chunk starting at or before t_find */
+    lo = 0;
+    hi = tr->head.n_chunks - 1;
+    while( lo < hi ){
+        mid = ( lo + hi + 1 )/2;
+        if( tr->index[ mid ] <= t_find ){
+            lo = mid;
+        }
+        else{
+            hi = mid - 1;
+        }
+    }
+    i_chunk = lo;
+
+    if( RK_Traj_Load_Chunk( tr , i_chunk ) != 0 ){
+        return -1;
+    }
+
+    /* Last row of the chunk at or before t_find -> only the valid rows of the last chunk are searched */
+    n_in = tr->head.n_rows - i_chunk*tr->head.chunk_rows;
+    if( n_in > tr->head.chunk_rows ){
+        n_in = tr->head.chunk_rows;
+    }
+    lo = 0;
+    hi = n_in - 1;
+    while( lo < hi ){
+        mid = ( lo + hi + 1 )/2;
+        if( tr->chunk[ mid ] <= t_find ){
+            lo = mid;
+        }
+        else{
+            hi = mid - 1;
+        }
+    }
+
+    if( row != NULL ){
+        RK_Traj_Read_Row( tr , i_chunk*tr->head.chunk_rows + lo , row );
+    }
+
+    return i_chunk*tr->head.chunk_rows + lo;
+}
+
+/* Copy one chunk of the trajectory as rows -> streaming read of a whole (compressed) file one chunk at a time */
+/* Inputs:
+    - tr: reader handle from RK_Traj_Open
+    - i_chunk: chunk index ( 0 <= i_chunk < n_chunks ) */
+/* Outputs:
+    - rows[ chunk_rows ][ Ncol ]: the rows of the chunk (row-major)
+    -- returns the number of rows of the chunk or -1 if it could not be read */
+long RK_Traj_Read_Chunk( RK_Traj_Reader* tr , long i_chunk , double* rows ){
+
+    long i, n_in;
+    int j;
+
+    if( i_chunk < 0 || i_chunk >= tr->head.n_chunks || RK_Traj_Load_Chunk( tr , i_chunk ) != 0 ){
+        return -1;
+    }
+
+    n_in = tr->head.n_rows - i_chunk*tr->head.chunk_rows;
+    n_in = ( n_in < tr->head.chunk_rows ) ? n_in : tr->head.chunk_rows;
+    for( i = 0; i < n_in; i++ ){
+        for( j = 0; j < tr->head.Ncol; j++ ){
+            *( rows + i*tr->head.Ncol + j ) = tr->chunk[ j*tr->head.chunk_rows + i ];
+        }
+    }
+
+    return n_in;
+}
+
+/* State at any time inside the trajectory from the cubic Hermite interpolant between the stored rows around t_find */
+/* The derivatives at the rows come from the double Pendulum RHS with the coefficients of the file -> the same interpolant
+   the decimation of DP45_Integrator_Packed is checked against */
+/* Inputs:
+    - tr: reader handle from RK_Traj_Open
+    - t_find: the time ( first time <= t_find <= last time ) */
+/* Outputs:
+    - row[ Ncol ]: [ t_find , State[ 0 ] , ... ]
+    -- returns 0 on success or -1 if t_find is outside the stored rows or the file is not a double Pendulum trajectory */
+int RK_Traj_Interp( RK_Traj_Reader* tr , double t_find , double* row ){
+
+    long i_row;
+    double row_0[ RK_TRAJ_NCOL_MAX ], row_1[ RK_TRAJ_NCOL_MAX ], f_0[ 4 ], f_1[ 4 ];
+
+    if( tr->head.Ncol != 5 ){
+        return -1;
+    }
+
+    i_row = RK_Traj_Find_Time( tr , t_find , row_0 );
+    if( i_row < 0 ){
+        return -1;
+    }
+    if( row_0[ 0 ] == t_find ){
+        memcpy( row , row_0 , 5*sizeof( double ) );
+        return 0;
+    }
+    if( RK_Traj_Read_Row( tr , i_row + 1 , row_1 ) != 0 ){
+        return -1;
+    }
+
+    RHS_Function_Coeff( row_0 + 1 , f_0 , tr->head.pend_coeff );
+    RHS_Function_Coeff( row_1 + 1 , f_1 , tr->head.pend_coeff );
+    RK_Hermite( 4 , row_1[ 0 ] - row_0[ 0 ] , ( t_find - row_0[ 0 ] )/( row_1[ 0 ] - row_0[ 0 ] ) , row_0 + 1 , f_0 , row_1 + 1 , f_1 , row + 1 );
+    *( row ) = t_find;
+
+    return 0;
+}
+
+/* Load trajectory n of the batch initial states into lane l of the batch Dormand-Prince integrator */
+/* Inputs:
+    - l: lane index to be (re)filled
+    - n: trajectory index in the initial states array
+    - Nstate, Nlane: state dimension and the lane stride of the structure-of-arrays storage
+    - state_init[ Ntraj ][ Nstate ], range_int[ 2 ]: as in DP45_Integrate_Batch */
+/* Outputs:
+    - The per-lane quantities are initialized exactly as DP45_Integrator does for a single trajectory */
+static void DP45_Batch_Load( int l , int n , int Nstate , int Nlane , double* state_init , double* range_int ,
+                             double* state_now , double* t_now , double* dt , double* err_ratiOld , int* rej , int* iter , int* traj_id ){
+
+    int i;
+
+    for( i = 0; i < Nstate; i++ ){
+        state_now[ i*Nlane + l ] = *( state_init + n*Nstate + i );
+    }
+    t_now[ l ] = *( range_int );
+    dt[ l ] = ( *( range_int + 1 ) - *( range_int ) )/1e6;
+    err_ratiOld[ l ] = 1.0;
+    rej[ l ] = 0;
+    iter[ l ] = 0;
+    traj_id[ l ] = n;
+
+}
+
+/* Size in bytes of the scratch storage of the batch Dormand-Prince for Nlane lanes -> the double arrays followed by the int arrays */
+static size_t DP45_Batch_Work_Size( int Ns , int Nstate , int Nlane ){
+
+    return ( ( size_t )( ( Ns + 3 )*Nstate + 6 )*sizeof( double ) + 4*sizeof( int ) )*Nlane;
+}
+
+/* Lanes of the batch Dormand-Prince for an ensemble of initial states (see DP45_Integrate_Batch) */
+/* Inputs:
+    - tab, Nstate, err_tol, pend_coeff[ 5 ], rhs_mode: the integration settings (of a context)
+    - work: scratch storage of at least DP45_Batch_Work_Size bytes for min( Ntraj , Nbatch_max ) lanes
+    - Ntraj, state_init[ Ntraj ][ Nstate ], range_int[ 2 ]: as in DP45_Integrate_Batch
+    - flip: 0.0 to integrate every trajectory up to range_int[ 1 ], otherwise a trajectory stops at the first accepted step
+            where |theta| or |phi| exceeds flip and the crossing is located on the cubic Hermite interpolant of that step */
+/* Outputs:
+    - state_final[ Ntraj ][ Nstate ], t_final[ Ntraj ], n_steps[ Ntraj ]: as in DP45_Integrate_Batch -> at the crossing for the flipped ones
+    -- returns the number of trajectories which stopped at Nloop_max */
+static int DP45_Batch_Core( const RK_Tableau* tab , int Nstate , double err_tol , double* pend_coeff , int rhs_mode , double* work ,
+                            int Ntraj , double* state_init , double* range_int , double flip ,
+                            double* state_final , double* t_final , int* n_steps ){
+
+    int Nlane, /* Number of lanes -> stride of the structure-of-arrays storage */
+        Nact, /* Number of currently active lanes (always the first Nact ones) */
+        n_next, /* Index of the next trajectory waiting to be loaded in a lane */
+        n_cap, /* Number of trajectories which stopped at Nloop_max */
+        it, /* Iterator of the crossing location */
+        l, i, j, s, m; /* Iterators */
+    double *state_now, /* [ Nstate ][ Nlane ] current states */
+           *int_state, /* [ Nstate ][ Nlane ] intermediate states for the RK stages -> the states before the step in the flip mode */
+           *rhs_state, /* [ Nstate ][ Nlane ] Right-Hand-Side of the states */
+           *k_DP, /* [ Ns ][ Nstate ][ Nlane ] Runge-Kutta intermediate derivatives */
+           *t_now, /* [ Nlane ] current time for each lane */
+           *dt, /* [ Nlane ] current time step for each lane */
+           *h_acc, /* [ Nlane ] last accepted step of each lane */
+           *err_ratio, /* [ Nlane ] error ratio of actual to desired - current step */
+           *err_ratiOld, /* [ Nlane ] error ratio of actual to desired - old step */
+           *acc; /* [ Nlane ] accept mask -> 1.0 if the step of the lane is accepted and 0.0 otherwise */
+    int *rej, /* [ Nlane ] rejection flag of the last step for each lane */
+        *iter, /* [ Nlane ] loop counter for each lane (the equivalent of k in DP45_Integrator) */
+        *nacc, /* [ Nlane ] accepted steps for each lane */
+        *traj_id; /* [ Nlane ] which trajectory is integrated in each lane */
+    double tv1, tv2; /* Temporary variables which can be reused to hold some intermediate computations */
+    int Ns = tab->Ns; /* Number of stages */
+    double e3; /* Second error estimate of a quantity (DOP853) */
+    int flipped; /* 1 if the lane crossed the flip angle in its last step */
+    double y0[ RK_CKPT_NSTATE_MAX ], f0[ RK_CKPT_NSTATE_MAX ], /* Ends of the flipping step and the interpolated state */
+           y1[ RK_CKPT_NSTATE_MAX ], f1[ RK_CKPT_NSTATE_MAX ],
+           y_int[ RK_CKPT_NSTATE_MAX ];
+    double th_a, th_b, th_m; /* Bracket of the crossing in units of the step */
+
+    if( Ntraj <= 0 ){
+        return 0;
+    }
+
+    Nlane = ( Ntraj < Nbatch_max ) ? Ntraj : Nbatch_max;
+
+    state_now = work;
+    int_state = state_now + Nstate*Nlane;
+    rhs_state = int_state + Nstate*Nlane;
+    k_DP = rhs_state + Nstate*Nlane;
+    t_now = k_DP + Ns*Nstate*Nlane;
+    dt = t_now + Nlane;
+    h_acc = dt + Nlane;
+    err_ratio = h_acc + Nlane;
+    err_ratiOld = err_ratio + Nlane;
+    acc = err_ratiOld + Nlane;
+    rej = ( int* )( acc + Nlane );
+    iter = rej + Nlane;
+    nacc = iter + Nlane;
+    traj_id = nacc + Nlane;
+
+    /* Fill all the lanes with the first trajectories */
+    for( l = 0; l < Nlane; l++ ){
+        DP45_Batch_Load( l , l , Nstate , Nlane , state_init , range_int , state_now , t_now , dt , err_ratiOld , rej , iter , traj_id );
+        nacc[ l ] = 0;
+    }
+    Nact = Nlane;
+    n_next = Nlane;
+    n_cap = 0;
+
+    /* Start the main integration loop - runs while there are active lanes */
+    while( Nact > 0 ){
+
+        /* Compute all the stages for the active lanes -> stage s uses the k_DP of all previous stages */
+        for( s = 0; s < Ns; s++ ){
+
+            if( s == 0 ){
+                /* Call the RHS function in the current point -> x_i */
+                RHS_Function_Batch_Mode( rhs_mode , Nact , Nlane , state_now , rhs_state , pend_coeff );
+            }
+            else{
+                /* Intermediate state for this stage: start with the existing state and add all the contributions */
+                for( i = 0; i < Nstate; i++ ){
+                    for( l = 0; l < Nact; l++ ){
+                        int_state[ i*Nlane + l ] = state_now[ i*Nlane + l ];
+                    }
+                    for( j = 0; j < s; j++ ){
+                        tv1 = tab->a[ s ][ j ];
+                        for( l = 0; l < Nact; l++ ){
+                            int_state[ i*Nlane + l ] += tv1*k_DP[ ( j*Nstate + i )*Nlane + l ];
+                        }
+                    }
+                }
+                /* Call the RHS function in the point -> x_i + c_s*dt */
+                RHS_Function_Batch_Mode( rhs_mode , Nact , Nlane , int_state , rhs_state , pend_coeff );
+            }
+
+            /* Assign RK constant for this stage */
+            for( i = 0; i < Nstate; i++ ){
+                for( l = 0; l < Nact; l++ ){
+                    k_DP[ ( s*Nstate + i )*Nlane + l ] = rhs_state[ i*Nlane + l ]*dt[ l ];
+                }
+            }
+        }
+
+        /* We have all the k_DP at this point -- compute the largest error estimate of each lane */
+        for( l = 0; l < Nact; l++ ){
+            err_ratio[ l ] = 0.0;
+        }
+        for( i = 0; i < Nstate; i++ ){
+            for( l = 0; l < Nact; l++ ){
+                tv1 = 0.0;
+                e3 = 0.0;
+                for( j = 0; j < Ns; j++ ){
+                    tv1 += tab->ec[ j ]*k_DP[ ( j*Nstate + i )*Nlane + l ];
+                }
+                if( tab->Nerr == 2 ){
+                    for( j = 0; j < Ns; j++ ){
+                        e3 += tab->ec3[ j ]*k_DP[ ( j*Nstate + i )*Nlane + l ];
+                    }
+                }
+                tv1 = RK_Err_Combine( tab , tv1 , e3 );
+                err_ratio[ l ] = ( tv1 >= err_ratio[ l ] ) ? tv1 : err_ratio[ l ];
+            }
+        }
+
+        /* Build the accept mask -> same criterion as in DP45_Integrator */
+        for( l = 0; l < Nact; l++ ){
+            err_ratio[ l ] /= err_tol;
+            acc[ l ] = ( err_ratio[ l ] < 1.0 && ( t_now[ l ] + dt[ l ] - *( range_int + 1 ) < err_tol ) ) ? 1.0 : 0.0;
+        }
+
+        /* Keep the states before the step for locating the flips -> the stages do not need int_state any more */
+        if( flip > 0.0 ){
+            for( i = 0; i < Nstate; i++ ){
+                for( l = 0; l < Nact; l++ ){
+                    int_state[ i*Nlane + l ] = state_now[ i*Nlane + l ];
+                }
+            }
+        }
+
+        /* Update the states of the accepted lanes based on the final weights */
+        /* NOTE: The weights are added one by one to the state (same rounding as the single trajectory kernels) and the
+           result is blended in with the accept mask */
+        for( i = 0; i < Nstate; i++ ){
+            for( l = 0; l < Nact; l++ ){
+                tv1 = state_now[ i*Nlane + l ];
+                for( j = 0; j < Ns; j++ ){
+                    tv1 += tab->b[ 0 ][ j ]*k_DP[ ( j*Nstate + i )*Nlane + l ];
+                }
+                state_now[ i*Nlane + l ] = ( acc[ l ] > 0.0 ) ? tv1 : state_now[ i*Nlane + l ];
+            }
+        }
+
+        /* Step control for each lane -> identical to DP45_Integrator */
+        for( l = 0; l < Nact; l++ ){
+            if( acc[ l ] > 0.0 ){
+                t_now[ l ] += dt[ l ];
+                h_acc[ l ] = dt[ l ];
+                nacc[ l ] += 1;
+                if( rej[ l ] == 0 && ( err_ratio[ l ] > 0.0 ) ){
+                    tv2 = safe_fac*dt[ l ]*pow( err_ratio[ l ] , tab->ctrl_p )*pow( err_ratiOld[ l ] , tab->ctrl_i );
+                    if( tv2/dt[ l ] < step_mrat ){
+                        dt[ l ] = tv2;
+                    }
+                    else{
+                        dt[ l ] *= step_mrat;
+                    }
+                }
+                rej[ l ] = 0;
+            }
+            else{
+                if( t_now[ l ] + dt[ l ] - *( range_int + 1 ) > err_tol ){
+                    dt[ l ] = ( *( range_int + 1 ) - t_now[ l ] );
+                    rej[ l ] = 0;
+                }
+                else{
+                    dt[ l ] = safe_fac*dt[ l ]*pow( err_ratio[ l ] , tab->ctrl_l );
+                    rej[ l ] = 1;
+                }
+            }
+            err_ratiOld[ l ] = err_ratio[ l ];
+            iter[ l ] += 1;
+        }
+
+        /* Retire the finished lanes -> refill them with pending trajectories or compact the active lanes */
+        l = 0;
+        while( l < Nact ){
+
+            /* NOTE: A lane is checked right after every accepted step, so a state beyond the flip angle has just crossed it */
+            flipped = ( flip > 0.0 ) && ( fabs( state_now[ l ] ) > flip || fabs( state_now[ Nlane + l ] ) > flip );
+
+            if( !flipped && ( t_now[ l ] < *( range_int + 1 ) ) && ( iter[ l ] < Nloop_max ) ){
+                l++;
+                continue;
+            }
+
+            if( !flipped && t_now[ l ] < *( range_int + 1 ) ){
+                n_cap += 1;
+            }
+
+            /* Write out the results of the finished trajectory */
+            m = traj_id[ l ];
+            for( i = 0; i < Nstate; i++ ){
+                *( state_final + m*Nstate + i ) = state_now[ i*Nlane + l ];
+            }
+            *( t_final + m ) = t_now[ l ];
+            *( n_steps + m ) = nacc[ l ];
+
+            if( flipped ){
+                /* Bisection for the first crossing on the cubic Hermite interpolant of the step -> f0 is the first stage */
+                for( i = 0; i < Nstate; i++ ){
+                    y0[ i ] = int_state[ i*Nlane + l ];
+                    f0[ i ] = k_DP[ i*Nlane + l ]/h_acc[ l ];
+                    y1[ i ] = state_now[ i*Nlane + l ];
+                }
+                RHS_Function_Coeff( y1 , f1 , pend_coeff );
+                th_a = 0.0;
+                th_b = 1.0;
+                for( it = 0; it < Event_iter_max && ( th_b - th_a ) > 4.0*DBL_EPSILON; it++ ){
+                    th_m = 0.5*( th_a + th_b );
+                    RK_Hermite( Nstate , h_acc[ l ] , th_m , y0 , f0 , y1 , f1 , y_int );
+                    if( fabs( y_int[ 0 ] ) > flip || fabs( y_int[ 1 ] ) > flip ){
+                        th_b = th_m;
+                    }
+                    else{
+                        th_a = th_m;
+                    }
+                }
+                RK_Hermite( Nstate , h_acc[ l ] , th_b , y0 , f0 , y1 , f1 , y_int );
+                for( i = 0; i < Nstate; i++ ){
+                    *( state_final + m*Nstate + i ) = y_int[ i ];
+                }
+                *( t_final + m ) = t_now[ l ] - ( 1.0 - th_b )*h_acc[ l ];
+            }
+
+            if( n_next < Ntraj ){
+                /* Refill the lane with the next pending trajectory */
+                DP45_Batch_Load( l , n_next , Nstate , Nlane , state_init , range_int , state_now , t_now , dt , err_ratiOld , rej , iter , traj_id );
+                nacc[ l ] = 0;
+                n_next += 1;
+                l++;
+            }
+            else{
+                /* No more pending trajectories -> move the last active lane in the place of this one */
+                Nact -= 1;
+                if( l != Nact ){
+                    for( i = 0; i < Nstate; i++ ){
+                        state_now[ i*Nlane + l ] = state_now[ i*Nlane + Nact ];
+                    }
+                    if( flip > 0.0 ){
+                        /* The moved lane may have flipped in this step as well -> bring along what locates the crossing */
+                        for( i = 0; i < Nstate; i++ ){
+                            int_state[ i*Nlane + l ] = int_state[ i*Nlane + Nact ];
+                            k_DP[ i*Nlane + l ] = k_DP[ i*Nlane + Nact ];
+                        }
+                        h_acc[ l ] = h_acc[ Nact ];
+                    }
+                    t_now[ l ] = t_now[ Nact ];
+                    dt[ l ] = dt[ Nact ];
+                    err_ratiOld[ l ] = err_ratiOld[ Nact ];
+                    rej[ l ] = rej[ Nact ];
+                    iter[ l ] = iter[ Nact ];
+                    nacc[ l ] = nacc[ Nact ];
+                    traj_id[ l ] = traj_id[ Nact ];
+                }
+                /* NOTE: Do not increment l - the moved lane must be checked as well */
+            }
+        }
+
+    }
+
+    return n_cap;
+
+}
+
+/* Size in bytes of the scratch storage of the single precision batch Dormand-Prince for Nlane lanes */
+/* -> 4 double, 39 float and 5 int arrays of Nlane (the time and the step stay in double precision) */
+static size_t DP45_Batch_F32_Work_Size( int Nlane ){
+
+    return ( 4*sizeof( double ) + 39*sizeof( float ) + 5*sizeof( int ) )*( size_t )Nlane;
+}
+
+/* Load trajectory n into lane l of the single precision batch Dormand-Prince -> also its first stage (FSAL) */
+static void DP45_Batch_F32_Load( int l , int n , int Nlane , double* state_init , double* range_int , const float* pc ,
+                                 float* y , float* k0 , float* a_max , double* t_now , double* dt , double* err_ratiOld ,
+                                 int* rej , int* iter , int* nacc , int* traj_id , int* acc ){
+
+    int i;
+
+    for( i = 0; i < 4; i++ ){
+        y[ i*Nlane + l ] = ( float )*( state_init + 4*n + i );
+    }
+    RHS_Batch_F32( 1 , Nlane , y + l , k0 + l , pc );
+    a_max[ l ] = fmaxf( fabsf( y[ l ] ) , fabsf( y[ Nlane + l ] ) );
+    t_now[ l ] = *( range_int );
+    dt[ l ] = ( *( range_int + 1 ) - *( range_int ) )/1e6;
+    err_ratiOld[ l ] = 1.0;
+    rej[ l ] = 0;
+    iter[ l ] = 0;
+    nacc[ l ] = 0;
+    traj_id[ l ] = n;
+    acc[ l ] = 0;
+
+}
+
+/* Single precision batch Dormand-Prince 5(4) for the double Pendulum, stopping each trajectory at its first flip (screening) */
+/* The states and the stages are float (twice the SIMD lanes and half the memory traffic of DP45_Batch_Core), the time, the step
+   and the controller stay in double precision. The tableau is always Dormand-Prince with the last stage reused as the first
+   stage of the next step (FSAL), the step control is the same as in DP45_Batch_Core. */
+/* Inputs:
+    - err_tol: error tolerance per step -> meaningful down to about 1e-6 (the rounding of float)
+    - pend_coeff[ 5 ]: the pendulum coefficients
+    - work: scratch storage of at least DP45_Batch_F32_Work_Size bytes for min( Ntraj , Nbatch_max ) lanes
+    - Ntraj, state_init[ Ntraj ][ 4 ], range_int[ 2 ]: as in DP45_Integrate_Batch -> the angles must be within [ -flip , flip ]
+    - flip: a trajectory stops at the first accepted step where |theta| or |phi| exceeds flip */
+/* Outputs:
+    - state_final[ Ntraj ][ 4 ], t_final[ Ntraj ], n_steps[ Ntraj ]: as in DP45_Batch_Core
+    - a_max[ Ntraj ]: the largest |theta| or |phi| of the accepted steps -> how close a trajectory which did not flip came to it
+    -- returns the number of trajectories which stopped at Nloop_max */
+static int DP45_Batch_Core_F32( double err_tol , double* pend_coeff , void* work , int Ntraj , double* state_init , double* range_int ,
+                                double flip , double* state_final , double* t_final , int* n_steps , double* a_max ){
+
+    int Nlane, Nact, n_next, n_cap, it, l, i, m, flipped;
+    double *t_now, /* [ Nlane ] current time for each lane */
+           *dt, /* [ Nlane ] current time step for each lane */
+           *h_acc, /* [ Nlane ] last accepted step of each lane */
+           *err_ratiOld; /* [ Nlane ] error ratio of actual to desired - old step */
+    float *y, /* [ 4 ][ Nlane ] current states */
+          *ys, /* [ 4 ][ Nlane ] stage states -> the new state after the last stage and the old one after an accepted step */
+          *k, /* [ 7 ][ 4 ][ Nlane ] stage derivatives (not multiplied by the step) */
+          *dtf, /* [ Nlane ] the step in single precision */
+          *err, /* [ Nlane ] largest error estimate of each lane */
+          *amax; /* [ Nlane ] largest |angle| of each lane */
+    int *rej, *iter, *nacc, *traj_id, /* Same as in DP45_Batch_Core */
+        *acc; /* [ Nlane ] 1 if the last step of the lane was accepted */
+    float pc[ 5 ], ya, yb, e;
+    double tv2, err_ratio;
+    double y0[ 4 ], f0[ 4 ], y1[ 4 ], f1[ 4 ], y_int[ 4 ]; /* Ends of the flipping step and the interpolated state */
+    double th_a, th_b, th_m; /* Bracket of the crossing in units of the step */
+    const float A[ 7 ][ 6 ] = { { 0 } , /* Dormand-Prince coefficients in single precision -> the last row holds the weights */
+                                { DP45_A10 } ,
+                                { DP45_A20 , DP45_A21 } ,
+                                { DP45_A30 , DP45_A31 , DP45_A32 } ,
+                                { DP45_A40 , DP45_A41 , DP45_A42 , DP45_A43 } ,
+                                { DP45_A50 , DP45_A51 , DP45_A52 , DP45_A53 , DP45_A54 } ,
+                                { DP45_B0 , 0.0f , DP45_B2 , DP45_B3 , DP45_B4 , DP45_B5 } };
+    const float EC[ 7 ] = { DP45_B0 - DP45_E0 , 0.0f , DP45_B2 - DP45_E2 , DP45_B3 - DP45_E3 , DP45_B4 - DP45_E4 , DP45_B5 - DP45_E5 , - DP45_E6 };
+    int s, j;
+
+    if( Ntraj <= 0 ){
+        return 0;
+    }
+
+    Nlane = ( Ntraj < Nbatch_max ) ? Ntraj : Nbatch_max;
+
+    t_now = ( double* )work;
+    dt = t_now + Nlane;
+    h_acc = dt + Nlane;
+    err_ratiOld = h_acc + Nlane;
+    y = ( float* )( err_ratiOld + Nlane );
+    ys = y + 4*Nlane;
+    k = ys + 4*Nlane;
+    dtf = k + 28*Nlane;
+    err = dtf + Nlane;
+    amax = err + Nlane;
+    rej = ( int* )( amax + Nlane );
+    iter = rej + Nlane;
+    nacc = iter + Nlane;
+    traj_id = nacc + Nlane;
+    acc = traj_id + Nlane;
+
+    for( i = 0; i < 5; i++ ){
+        pc[ i ] = ( float )*( pend_coeff + i );
+    }
+
+    for( l = 0; l < Nlane; l++ ){
+        DP45_Batch_F32_Load( l , l , Nlane , state_init , range_int , pc , y , k , amax , t_now , dt , err_ratiOld , rej , iter , nacc , traj_id , acc );
+    }
+    Nact = Nlane;
+    n_next = Nlane;
+    n_cap = 0;
+
+    while( Nact > 0 ){
+
+        for( l = 0; l < Nact; l++ ){
+            dtf[ l ] = ( float )dt[ l ];
+        }
+
+        /* Stages 2 to 7 -> the first one is the last stage of the previous step (or computed when the lane was loaded) */
+        for( s = 1; s < 7; s++ ){
+            for( i = 0; i < 4; i++ ){
+                for( l = 0; l < Nact; l++ ){
+                    e = 0.0f;
+                    for( j = 0; j < s; j++ ){
+                        e += A[ s ][ j ]*k[ ( j*4 + i )*Nlane + l ];
+                    }
+                    ys[ i*Nlane + l ] = y[ i*Nlane + l ] + dtf[ l ]*e;
+                }
+            }
+            RHS_Batch_F32( Nact , Nlane , ys , k + s*4*Nlane , pc );
+        }
+
+        /* Largest error estimate of each lane */
+        for( l = 0; l < Nact; l++ ){
+            err[ l ] = 0.0f;
+        }
+        for( i = 0; i < 4; i++ ){
+            for( l = 0; l < Nact; l++ ){
+                e = 0.0f;
+                for( j = 0; j < 7; j++ ){
+                    e += EC[ j ]*k[ ( j*4 + i )*Nlane + l ];
+                }
+                err[ l ] = fmaxf( err[ l ] , fabsf( dtf[ l ]*e ) );
+            }
+        }
+
+        /* Accept mask -> same criterion as in DP45_Batch_Core */
+        for( l = 0; l < Nact; l++ ){
+            acc[ l ] = ( err[ l ]/err_tol < 1.0 && ( t_now[ l ] + dt[ l ] - *( range_int + 1 ) < err_tol ) );
+        }
+
+        /* The last stage state is the new state -> swap it in for the accepted lanes (ys keeps the old state for the flips) */
+        for( i = 0; i < 4; i++ ){
+            for( l = 0; l < Nact; l++ ){
+                ya = y[ i*Nlane + l ];
+                yb = ys[ i*Nlane + l ];
+                y[ i*Nlane + l ] = acc[ l ] ? yb : ya;
+                ys[ i*Nlane + l ] = acc[ l ] ? ya : yb;
+            }
+        }
+        for( l = 0; l < Nact; l++ ){
+            amax[ l ] = fmaxf( amax[ l ] , fmaxf( fabsf( y[ l ] ) , fabsf( y[ Nlane + l ] ) ) );
+        }
+
+        /* Step control for each lane -> identical to DP45_Batch_Core */
+        for( l = 0; l < Nact; l++ ){
+            err_ratio = err[ l ]/err_tol;
+            if( acc[ l ] ){
+                t_now[ l ] += dt[ l ];
+                h_acc[ l ] = dt[ l ];
+                nacc[ l ] += 1;
+                if( rej[ l ] == 0 && ( err_ratio > 0.0 ) ){
+                    tv2 = safe_fac*dt[ l ]*pow( err_ratio , p_gain )*pow( err_ratiOld[ l ] , i_gain );
+                    if( tv2/dt[ l ] < step_mrat ){
+                        dt[ l ] = tv2;
+                    }
+                    else{
+                        dt[ l ] *= step_mrat;
+                    }
+                }
+                rej[ l ] = 0;
+            }
+            else{
+                if( t_now[ l ] + dt[ l ] - *( range_int + 1 ) > err_tol ){
+                    dt[ l ] = ( *( range_int + 1 ) - t_now[ l ] );
+                    rej[ l ] = 0;
+                }
+                else{
+                    dt[ l ] = safe_fac*dt[ l ]*pow( err_ratio , p_loss );
+                    rej[ l ] = 1;
+                }
+            }
+            err_ratiOld[ l ] = err_ratio;
+            iter[ l ] += 1;
+        }
+
+        /* Retire the finished lanes -> refill them with pending trajectories or compact the active lanes */
+        l = 0;
+        while( l < Nact ){
+
+            flipped = acc[ l ] && ( fabsf( y[ l ] ) > flip || fabsf( y[ Nlane + l ] ) > flip );
+
+            if( !flipped && ( t_now[ l ] < *( range_int + 1 ) ) && ( iter[ l ] < Nloop_max ) ){
+                /* First Same As Last -> the last stage of an accepted step is the first one of the next step */
+                if( acc[ l ] ){
+                    for( i = 0; i < 4; i++ ){
+                        k[ i*Nlane + l ] = k[ ( 24 + i )*Nlane + l ];
+                    }
+                }
+                l++;
+                continue;
+            }
+
+            if( !flipped && t_now[ l ] < *( range_int + 1 ) ){
+                n_cap += 1;
+            }
+
+            m = traj_id[ l ];
+            for( i = 0; i < 4; i++ ){
+                *( state_final + 4*m + i ) = y[ i*Nlane + l ];
+            }
+            *( t_final + m ) = t_now[ l ];
+            *( n_steps + m ) = nacc[ l ];
+            *( a_max + m ) = amax[ l ];
+
+            if( flipped ){
+                /* Bisection for the first crossing on the cubic Hermite interpolant of the step (in double precision) */
+                for( i = 0; i < 4; i++ ){
+                    y0[ i ] = ys[ i*Nlane + l ];
+                    f0[ i ] = k[ i*Nlane + l ];
+                    y1[ i ] = y[ i*Nlane + l ];
+                    f1[ i ] = k[ ( 24 + i )*Nlane + l ];
+                }
+                th_a = 0.0;
+                th_b = 1.0;
+                for( it = 0; it < Event_iter_max && ( th_b - th_a ) > 4.0*FLT_EPSILON; it++ ){
+                    th_m = 0.5*( th_a + th_b );
+                    RK_Hermite( 4 , h_acc[ l ] , th_m , y0 , f0 , y1 , f1 , y_int );
+                    if( fabs( y_int[ 0 ] ) > flip || fabs( y_int[ 1 ] ) > flip ){
+                        th_b = th_m;
+                    }
+                    else{
+                        th_a = th_m;
+                    }
+                }
+                RK_Hermite( 4 , h_acc[ l ] , th_b , y0 , f0 , y1 , f1 , y_int );
+                for( i = 0; i < 4; i++ ){
+                    *( state_final + 4*m + i ) = y_int[ i ];
+                }
+                *( t_final + m ) = t_now[ l ] - ( 1.0 - th_b )*h_acc[ l ];
+            }
+
+            if( n_next < Ntraj ){
+                DP45_Batch_F32_Load( l , n_next , Nlane , state_init , range_int , pc , y , k , amax , t_now , dt , err_ratiOld , rej , iter , nacc , traj_id , acc );
+                n_next += 1;
+                l++;
+            }
+            else{
+                /* No more pending trajectories -> move the last active lane in the place of this one (it is checked next) */
+                Nact -= 1;
+                if( l != Nact ){
+                    for( i = 0; i < 4; i++ ){
+                        y[ i*Nlane + l ] = y[ i*Nlane + Nact ];
+                        ys[ i*Nlane + l ] = ys[ i*Nlane + Nact ];
+                        k[ i*Nlane + l ] = k[ i*Nlane + Nact ];
+                        k[ ( 24 + i )*Nlane + l ] = k[ ( 24 + i )*Nlane + Nact ];
+                    }
+                    amax[ l ] = amax[ Nact ];
+                    t_now[ l ] = t_now[ Nact ];
+                    dt[ l ] = dt[ Nact ];
+                    h_acc[ l ] = h_acc[ Nact ];
+                    err_ratiOld[ l ] = err_ratiOld[ Nact ];
+                    rej[ l ] = rej[ Nact ];
+                    iter[ l ] = iter[ Nact ];
+                    nacc[ l ] = nacc[ Nact ];
+                    traj_id[ l ] = traj_id[ Nact ];
+                    acc[ l ] = acc[ Nact ];
+                }
+            }
+        }
+
+    }
+
+    return n_cap;
+
+}
+
+/* 4-5th order adaptive Dormand-Prince integrator for an ensemble of initial states with a context (see DP45_Integrate_Batch) */
+/* The lane storage is kept in the context between the calls, so repeated batches do not allocate */
+/* Output:
+    - 0 on success, 1 if some trajectories stopped at Nloop_max and -1 if the scratch storage could not be allocated */
+int RK_Context_DP45_Batch( RK_Context* ctx , int Ntraj , double* state_init , double* range_int ,
+                           double* state_final , double* t_final , int* n_steps ){
+
+    int Nlane, /* Number of lanes */
+        n_cap; /* Number of trajectories which stopped at Nloop_max */
+    size_t Nwork; /* Size of the scratch storage in bytes */
+    double *work; /* Scratch storage of the context */
+
+    if( Ntraj <= 0 ){
+        return 0;
+    }
+
+    Nlane = ( Ntraj < Nbatch_max ) ? Ntraj : Nbatch_max;
+
+    /* Reuse the scratch storage of the context - it only grows when a larger batch comes along */
+    Nwork = DP45_Batch_Work_Size( ctx->tab.Ns , ctx->Nstate , Nlane );
+    if( ctx->batch_work_size < Nwork ){
+        work = ( double* )realloc( ctx->batch_work , Nwork );
+        if( work == NULL ){
+            printf( "ERROR: Could not allocate the batch integrator storage for %d lanes! \n" , Nlane );
+            return -1;
+        }
+        ctx->batch_work = work;
+        ctx->batch_work_size = Nwork;
+    }
+
+    n_cap = DP45_Batch_Core( &ctx->tab , ctx->Nstate , ctx->err_tol , ctx->pend_coeff , ctx->rhs_mode , ( double* )ctx->batch_work ,
+                             Ntraj , state_init , range_int , 0.0 , state_final , t_final , n_steps );
+
+    /* In case some of the trajectories reached the maximum number of iterations - warn about it */
+    if( n_cap > 0 ){
+        printf( "----------------------------------------------------------\n" );
+        printf( "----WARNING: The full integration was not carried out!----\n" );
+        printf( "----------------------------------------------------------\n" );
+        printf( "%d out of %d trajectories stopped after %d iterations, check t_final \n" , n_cap , Ntraj , ( int )Nloop_max );
+    }
+
+    return ( n_cap > 0 ) ? 1 : 0;
+
+}
+
+/* 4-5th order adaptive Dormand-Prince integrator for an ensemble of initial states (batch mode) */
+/* Up to Nbatch_max trajectories are integrated side by side as lanes of structure-of-arrays storage.
+   Each lane keeps its own adaptive dt and controller state, the accept/reject decision is applied as a mask
+   and finished lanes are refilled with pending trajectories or compacted away once there are none left.
+   Each trajectory follows the same step control as DP45_Integrator, only the vectorized RHS rounds differently. */
+/* Inputs:
+    - Ntraj: number of trajectories (initial states) to integrate
+    - Nstate: number of quantities in the state (phase space dimension) - must be 4 for the double pendulum RHS
+    - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+    - state_init[ Ntraj ][ Nstate ]: initial states for the integrator (row-major, one trajectory per row)
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time) - common for all trajectories */
+/* Outputs:
+    - state_final[ Ntraj ][ Nstate ]: the state of each trajectory at the end of the integration
+    - t_final[ Ntraj ]: the time reached by each trajectory (less than range_int[ 1 ] only if Nloop_max was hit)
+    - n_steps[ Ntraj ]: the number of accepted steps for each trajectory
+    -- Nothing is written to files in this mode! */
+void DP45_Integrate_Batch( int Ntraj , int Nstate , double err_tol , double* state_init , double* range_int ,
+                           double* state_final , double* t_final , int* n_steps ){
+
+    RK_Context ctx; /* Temporary context with the global coefficients */
+
+    RK_Context_From_Default( &ctx , Nstate , err_tol );
+    RK_Context_DP45_Batch( &ctx , Ntraj , state_init , range_int , state_final , t_final , n_steps );
+    free( ctx.batch_work );
+
+}
+
+/* Task queue of a single sweep worker -> the tasks [ lo , hi ) are still to be integrated */
+/* The owner takes tasks from the front (lo) while idle workers steal half of the remaining ones from the back (hi) */
+typedef struct {
+    pthread_mutex_t lock; /* Protects lo and hi */
+    int lo, hi; /* Range of the remaining task indices */
+} Sweep_Queue;
+
+/* Everything a sweep worker thread needs -> the inputs are shared, only id differs between the workers */
+typedef struct {
+    int id, /* Index of the worker (and of its own queue) */
+        Nthreads, /* Total number of workers */
+        Nstate, /* Phase space dimension */
+        Nic, /* Number of initial states */
+        grid; /* 1 for the full grid of parameters x initial states, 0 for matched pairs */
+    const RK_Tableau *tab; /* Butcher tableau -> shared read-only */
+    double err_tol, /* Error tolerance per step */
+           *pend_params, /* [ Npar ][ 5 ] pendulum coefficients */
+           *states_init, /* [ Nic ][ Nstate ] initial states */
+           *range_int, /* [ 2 ] integration interval */
+           *state_final, /* [ Ntask ][ Nstate ] output final states */
+           *summary; /* [ Ntask ][ 4 ] output summaries */
+    Sweep_Queue *queues; /* [ Nthreads ] the task queues of all the workers */
+} Sweep_Worker;
+
+/* Take the next task for worker id -> first from its own queue and then by stealing from the others */
+/* Inputs:
+    - queues[ Nthreads ]: the task queues of all the workers
+    - id: index of the worker asking for a task */
+/* Output:
+    - index of the task to integrate or -1 if no tasks are left anywhere */
+static int Sweep_Next_Task( Sweep_Queue* queues , int Nthreads , int id ){
+
+    int task = -1, v, n, lo, hi;
+
+    /* Own queue first */
+    pthread_mutex_lock( &queues[ id ].lock );
+    if( queues[ id ].lo < queues[ id ].hi ){
+        task = queues[ id ].lo;
+        queues[ id ].lo += 1;
+    }
+    pthread_mutex_unlock( &queues[ id ].lock );
+
+    /* Steal half of the remaining tasks of the first non-empty victim */
+    for( n = 1; n < Nthreads && task < 0; n++ ){
+        v = ( id + n ) % Nthreads;
+        pthread_mutex_lock( &queues[ v ].lock );
+        lo = queues[ v ].lo;
+        hi = queues[ v ].hi;
+        if( lo < hi ){
+            lo = hi - ( hi - lo + 1 )/2; /* Stolen range is [ lo , hi ) */
+            queues[ v ].hi = lo;
+        }
+        pthread_mutex_unlock( &queues[ v ].lock );
+
+        if( lo < hi ){
+            task = lo;
+            pthread_mutex_lock( &queues[ id ].lock );
+            queues[ id ].lo = lo + 1;
+            queues[ id ].hi = hi;
+            pthread_mutex_unlock( &queues[ id ].lock );
+        }
+    }
+
+    return task;
+}
+
+/* Main function of a sweep worker thread -> integrates tasks until there are none left */
+static void* Sweep_Worker_Run( void* arg ){
+
+    Sweep_Worker *w = ( Sweep_Worker* )arg;
+    int task, ipar, iic;
+
+    while( ( task = Sweep_Next_Task( w->queues , w->Nthreads , w->id ) ) >= 0 ){
+        ipar = w->grid ? task/w->Nic : task;
+        iic = w->grid ? task%w->Nic : task;
+        DP45_Core( w->tab , w->Nstate , w->err_tol , w->pend_params + 5*ipar , NULL , w->states_init + ( size_t )iic*w->Nstate , w->range_int , NULL ,
+                   w->state_final + ( size_t )task*w->Nstate , w->summary + ( size_t )4*task , NULL , NULL );
+    }
+
+    return NULL;
+}
+
+/* Multi-threaded sweep over pendulum parameters and initial states with a context (see DP45_Param_Sweep) */
+/* Only the tableau, dimension and tolerance of the context are used, the coefficients come from pend_params */
+int RK_Context_Param_Sweep( RK_Context* ctx , int Npar , int Nic , int grid , double* pend_params , double* states_init ,
+                            double* range_int , int Nthreads , double* state_final , double* summary ){
+
+    int Ntask, i;
+    int Nstate = ctx->Nstate; /* Phase space dimension */
+    double err_tol = ctx->err_tol; /* Error tolerance per step */
+    pthread_t threads[ Nthread_max ];
+    Sweep_Queue queues[ Nthread_max ];
+    Sweep_Worker workers[ Nthread_max ];
+
+    if( grid ){
+        Ntask = Npar*Nic;
+    }
+    else if( Npar == Nic ){
+        Ntask = Npar;
+    }
+    else{
+        printf( "ERROR: Matched parameter sweep needs as many parameter sets ( %d ) as initial states ( %d )! \n" , Npar , Nic );
+        return -1;
+    }
+
+    if( Ntask <= 0 ){
+        return 0;
+    }
+
+    /* Pick the number of threads - never more than the number of tasks */
+    if( Nthreads <= 0 ){
+        Nthreads = ( int )sysconf( _SC_NPROCESSORS_ONLN );
+    }
+    if( Nthreads < 1 ){
+        Nthreads = 1;
+    }
+    if( Nthreads > Nthread_max ){
+        Nthreads = Nthread_max;
+    }
+    if( Nthreads > Ntask ){
+        Nthreads = Ntask;
+    }
+
+    /* Start with contiguous blocks of tasks for each worker - stealing balances them afterwards */
+    for( i = 0; i < Nthreads; i++ ){
+        pthread_mutex_init( &queues[ i ].lock , NULL );
+        queues[ i ].lo = ( int )( ( long long )Ntask*i/Nthreads );
+        queues[ i ].hi = ( int )( ( long long )Ntask*( i + 1 )/Nthreads );
+
+        workers[ i ].id = i;
+        workers[ i ].Nthreads = Nthreads;
+        workers[ i ].Nstate = Nstate;
+        workers[ i ].Nic = Nic;
+        workers[ i ].grid = grid;
+        workers[ i ].tab = &ctx->tab;
+        workers[ i ].err_tol = err_tol;
+        workers[ i ].pend_params = pend_params;
+        workers[ i ].states_init = states_init;
+        workers[ i ].range_int = range_int;
+        workers[ i ].state_final = state_final;
+        workers[ i ].summary = summary;
+        workers[ i ].queues = queues;
+    }
+
+    /* The calling thread works as worker 0 */
+    for( i = 1; i < Nthreads; i++ ){
+        pthread_create( &threads[ i ] , NULL , Sweep_Worker_Run , &workers[ i ] );
+    }
+    Sweep_Worker_Run( &workers[ 0 ] );
+    for( i = 1; i < Nthreads; i++ ){
+        pthread_join( threads[ i ] , NULL );
+    }
+
+    for( i = 0; i < Nthreads; i++ ){
+        pthread_mutex_destroy( &queues[ i ].lock );
+    }
+
+    return Ntask;
+}
+
+/* Multi-threaded sweep over pendulum parameters and initial states with the 4-5th order Dormand-Prince integrator */
+/* The runs are spread over the threads with a work-stealing scheduler since the number of adaptive steps varies a lot
+   between chaotic and regular regions. Nothing is written to files, only a compact summary of each run is returned. */
+/* Inputs:
+    - Npar: number of parameter sets
+    - Nic: number of initial states
+    - Nstate: number of quantities in the state (phase space dimension) - must be 4 for the double pendulum RHS
+    - grid: 1 to run every parameter set with every initial state ( Ntask = Npar*Nic, task = ipar*Nic + iic )
+            0 to run matched pairs ( Npar == Nic == Ntask, task i uses parameter set i with initial state i )
+    - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+    - pend_params[ Npar ][ 5 ]: the coefficients a_th to b_phi for each parameter set (same order as in Set_Pend_coeff)
+    - states_init[ Nic ][ Nstate ]: initial states for the integrator
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time) - common for all the runs
+    - Nthreads: number of worker threads, 0 to use all the available cores */
+/* Outputs:
+    - state_final[ Ntask ][ Nstate ]: the final state of each run
+    - summary[ Ntask ][ 4 ]: [ t_final , accepted steps , rejected steps , max |E - E_0| ] for each run
+    -- returns the number of runs (Ntask) or -1 if the inputs are inconsistent */
+int DP45_Param_Sweep( int Npar , int Nic , int Nstate , int grid , double err_tol , double* pend_params , double* states_init ,
+                      double* range_int , int Nthreads , double* state_final , double* summary ){
+
+    RK_Context ctx; /* Temporary context with the global coefficients */
+
+    RK_Context_From_Default( &ctx , Nstate , err_tol );
+    return RK_Context_Param_Sweep( &ctx , Npar , Nic , grid , pend_params , states_init , range_int , Nthreads , state_final , summary );
+}
+
+/* Shared description of a flip-time map -> read-only for the tile workers except for the pixels of their own tile */
+typedef struct {
+    const RK_Tableau *tab; /* Butcher tableau */
+    double err_tol, /* Error tolerance per step */
+           *pend_coeff, /* [ 5 ] pendulum coefficients */
+           th_lo, dth, /* theta of the first column and the spacing of the columns */
+           phi_lo, dphi, /* phi of the first row and the spacing of the rows */
+           range_int[ 2 ], /* [ 0 , t_max ] */
+           refine_tol, /* Largest spread of log( t_flip ) over a cell which is filled by interpolation */
+           U_flip, /* Lowest potential energy from which a release at rest can flip an arm (-inf if unknown) */
+           screen_tol, /* Tolerance of the single precision screening pass (0.0 for double precision only) */
+           screen_margin; /* Relative distance to t_max and to pi within which a screened result is verified in double precision */
+    int rhs_mode, /* Right-Hand-Side kernel of the lanes */
+        Nth, Nphi, /* Size of the map in pixels */
+        tile, Ntile_th, /* Size of the square tiles in pixels and the number of tiles along theta */
+        h, /* Pixel spacing of the current refinement level */
+        top; /* 1 on the coarsest level -> every point of the lattice is integrated */
+    float *map; /* [ Nphi ][ Nth ] the flip times */
+    unsigned char *prec; /* [ Nphi ][ Nth ] which precision produced each pixel (RK_FLIP_PREC_*, NULL to skip) */
+} Flip_Job;
+
+/* Everything a flip map worker thread needs -> its own lanes and scratch storage */
+typedef struct {
+    int id, /* Index of the worker (and of its own queue) */
+        Nthreads; /* Total number of workers */
+    Flip_Job *job; /* The map being computed */
+    Sweep_Queue *queues; /* [ Nthreads ] the tile queues of all the workers */
+    double *work, /* Scratch storage of the batch integrator */
+           *a_max, /* [ tile*tile ] closest approach to a flip of the screened points */
+           *states, /* [ tile*tile ][ 4 ] initial states of the points of a tile which are integrated */
+           *state_final, /* [ tile*tile ][ 4 ] their final states */
+           *t_final; /* [ tile*tile ] their flip times */
+    int *n_steps, /* [ tile*tile ] their accepted steps */
+        *pix; /* [ tile*tile ] their pixel indices */
+    void *work_f32; /* Scratch storage of the single precision batch integrator (NULL without screening) */
+    long n_int; /* Number of trajectories integrated by this worker */
+    int n_cap; /* Number of them which stopped at Nloop_max */
+} Flip_Worker;
+
+/* Check if the flip times on the corners of the cell [ i0 , i0 + d ] x [ j0 , j0 + d ] can be interpolated */
+/* Output:
+    - 1 if the cell lies in the map and either no corner flips or all of them flip within exp( refine_tol ) of each other, 0 otherwise */
+static int Flip_Cell_Uniform( const Flip_Job* job , int i0 , int j0 , int d ){
+
+    float v[ 4 ];
+    double lo, hi;
+    int n_inf = 0, n;
+
+    if( i0 < 0 || j0 < 0 || i0 + d > job->Nth - 1 || j0 + d > job->Nphi - 1 ){
+        return 0;
+    }
+
+    v[ 0 ] = job->map[ ( size_t )j0*job->Nth + i0 ];
+    v[ 1 ] = job->map[ ( size_t )j0*job->Nth + i0 + d ];
+    v[ 2 ] = job->map[ ( size_t )( j0 + d )*job->Nth + i0 ];
+    v[ 3 ] = job->map[ ( size_t )( j0 + d )*job->Nth + i0 + d ];
+
+    lo = INFINITY;
+    hi = 0.0;
+    for( n = 0; n < 4; n++ ){
+        if( isnan( v[ n ] ) ){
+            return 0;
+        }
+        if( isinf( v[ n ] ) ){
+            n_inf += 1;
+            continue;
+        }
+        lo = ( v[ n ] < lo ) ? v[ n ] : lo;
+        hi = ( v[ n ] > hi ) ? v[ n ] : hi;
+    }
+
+    if( n_inf == 4 ){
+        return 1;
+    }
+    if( n_inf > 0 || !( lo > 0.0 ) ){
+        return 0;
+    }
+
+    return ( log( hi/lo ) <= job->refine_tol );
+}
+
+/* Try to fill the pixel ( i , j ) of refinement level h from the pixels of level 2*h around it */
+/* The pixel is interpolated only if every cell of level 2*h touching it is uniform (see Flip_Cell_Uniform) */
+/* Output:
+    - 1 if the pixel was filled and 0 if it has to be integrated */
+static int Flip_Interp( Flip_Job* job , int i , int j , int h ){
+
+    int d = 2*h, /* Spacing of the coarser level */
+        ni, nj, /* Number of candidate cells along each direction */
+        ci, cj, n_cell = 0;
+    int i0[ 2 ], j0[ 2 ]; /* Lower corners of the candidate cells */
+    float *map = job->map;
+    size_t Nth = ( size_t )job->Nth;
+    double val;
+
+    /* Cells touching the pixel -> one along a direction where it is between the coarse points, two where it is on them */
+    if( i % d ){
+        i0[ 0 ] = i - h;
+        ni = 1;
+    }
+    else{
+        i0[ 0 ] = i - d;
+        i0[ 1 ] = i;
+        ni = 2;
+    }
+    if( j % d ){
+        j0[ 0 ] = j - h;
+        nj = 1;
+    }
+    else{
+        j0[ 0 ] = j - d;
+        j0[ 1 ] = j;
+        nj = 2;
+    }
+
+    for( cj = 0; cj < nj; cj++ ){
+        for( ci = 0; ci < ni; ci++ ){
+            if( i0[ ci ] < 0 || j0[ cj ] < 0 || i0[ ci ] + d > job->Nth - 1 || j0[ cj ] + d > job->Nphi - 1 ){
+                continue;
+            }
+            if( !Flip_Cell_Uniform( job , i0[ ci ] , j0[ cj ] , d ) ){
+                return 0;
+            }
+            n_cell += 1;
+        }
+    }
+    if( n_cell == 0 ){
+        return 0;
+    }
+
+    /* Bilinear interpolation from the nearest coarse points (infinity stays infinity since the cells are uniform) */
+    if( ( i % d ) && ( j % d ) ){
+        val = 0.25*( ( double )map[ ( j - h )*Nth + i - h ] + map[ ( j - h )*Nth + i + h ] + map[ ( j + h )*Nth + i - h ] + map[ ( j + h )*Nth + i + h ] );
+    }
+    else if( i % d ){
+        val = 0.5*( ( double )map[ j*Nth + i - h ] + map[ j*Nth + i + h ] );
+    }
+    else{
+        val = 0.5*( ( double )map[ ( j - h )*Nth + i ] + map[ ( j + h )*Nth + i ] );
+    }
+    map[ j*Nth + i ] = ( float )val;
+
+    return 1;
+}
+
+/* Pixel value of an integrated point -> the located time if it flipped, infinity if it reached t_max and NaN if it stopped at Nloop_max */
+static float Flip_Result( const Flip_Job* job , const double* state_final , double t_final ){
+
+    if( fabs( *( state_final ) ) > PI || fabs( *( state_final + 1 ) ) > PI ){
+        return ( float )t_final;
+    }
+    if( t_final >= job->range_int[ 1 ] ){
+        return INFINITY;
+    }
+
+    return NAN;
+}
+
+/* Main function of a flip map worker thread -> takes tiles until there are none left at the current level */
+/* Within a tile the points of the level which are neither outside the flip energy nor interpolated are integrated
+   together as lanes of the batch integrator, stopping each one at its first flip */
+static void* Flip_Worker_Run( void* arg ){
+
+    Flip_Worker *w = ( Flip_Worker* )arg;
+    Flip_Job *job = w->job;
+    int task, i, j, i_lo, i_hi, j_lo, j_hi, n, Npts, Nesc;
+    int h = job->h, d = 2*job->h;
+    double th0, phi0;
+    float val;
+    float *map = job->map;
+
+    while( ( task = Sweep_Next_Task( w->queues , w->Nthreads , w->id ) ) >= 0 ){
+
+        i_lo = ( task % job->Ntile_th )*job->tile;
+        j_lo = ( task / job->Ntile_th )*job->tile;
+        i_hi = ( i_lo + job->tile < job->Nth ) ? i_lo + job->tile : job->Nth;
+        j_hi = ( j_lo + job->tile < job->Nphi ) ? j_lo + job->tile : job->Nphi;
+
+        /* Collect the points of this level which have to be integrated */
+        Npts = 0;
+        for( j = j_lo; j < j_hi; j++ ){
+            for( i = i_lo; i < i_hi; i++ ){
+
+                if( ( i % h ) || ( j % h ) || ( !job->top && !( i % d ) && !( j % d ) ) ){
+                    continue;
+                }
+
+                th0 = job->th_lo + i*job->dth;
+                phi0 = job->phi_lo + j*job->dphi;
+
+                if( job->prec != NULL ){
+                    job->prec[ ( size_t )j*job->Nth + i ] = RK_FLIP_PREC_NONE;
+                }
+                if( fabs( th0 ) > PI || fabs( phi0 ) > PI ){
+                    /* Already over the top */
+                    map[ ( size_t )j*job->Nth + i ] = 0.0f;
+                    continue;
+                }
+                if( - *( job->pend_coeff + 3 )*cos( th0 ) - *( job->pend_coeff + 4 )*cos( phi0 ) < job->U_flip ){
+                    /* Not enough energy to ever flip */
+                    map[ ( size_t )j*job->Nth + i ] = INFINITY;
+                    continue;
+                }
+                if( !job->top && Flip_Interp( job , i , j , h ) ){
+                    continue;
+                }
+
+                *( w->states + 4*Npts ) = th0;
+                *( w->states + 4*Npts + 1 ) = phi0;
+                *( w->states + 4*Npts + 2 ) = 0.0;
+                *( w->states + 4*Npts + 3 ) = 0.0;
+                *( w->pix + Npts ) = j*job->Nth + i;
+                Npts += 1;
+            }
+        }
+
+        w->n_int += Npts;
+
+        /* Single precision screening -> only the ambiguous results go on to the double precision pass:
+           no result (NaN), a flip close to t_max or no flip after coming close to pi */
+        if( w->work_f32 != NULL && Npts > 0 ){
+            DP45_Batch_Core_F32( job->screen_tol , job->pend_coeff , w->work_f32 , Npts , w->states , job->range_int , PI ,
+                                 w->state_final , w->t_final , w->n_steps , w->a_max );
+            Nesc = 0;
+            for( n = 0; n < Npts; n++ ){
+                val = Flip_Result( job , w->state_final + 4*n , *( w->t_final + n ) );
+                if( isnan( val ) || ( isfinite( val ) && val > ( 1.0 - job->screen_margin )*job->range_int[ 1 ] )
+                    || ( isinf( val ) && *( w->a_max + n ) > ( 1.0 - job->screen_margin )*PI ) ){
+                    /* Escalate -> compact the point to the front of the list (Nesc <= n) */
+                    for( i = 0; i < 4; i++ ){
+                        *( w->states + 4*Nesc + i ) = *( w->states + 4*n + i );
+                    }
+                    *( w->pix + Nesc ) = *( w->pix + n );
+                    Nesc += 1;
+                    continue;
+                }
+                map[ *( w->pix + n ) ] = val;
+                if( job->prec != NULL ){
+                    job->prec[ *( w->pix + n ) ] = RK_FLIP_PREC_F32;
+                }
+            }
+            Npts = Nesc;
+        }
+
+        w->n_cap += DP45_Batch_Core( job->tab , 4 , job->err_tol , job->pend_coeff , job->rhs_mode , w->work ,
+                                     Npts , w->states , job->range_int , PI , w->state_final , w->t_final , w->n_steps );
+
+        for( n = 0; n < Npts; n++ ){
+            map[ *( w->pix + n ) ] = Flip_Result( job , w->state_final + 4*n , *( w->t_final + n ) );
+            if( job->prec != NULL ){
+                job->prec[ *( w->pix + n ) ] = RK_FLIP_PREC_F64;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/* Write a flip-time map as a binary file (RK_Flip_Header followed by the floats) or as a .ppm image */
+/* Output:
+    - 0 on success and -1 if the file could not be written */
+static int Flip_Map_Write( const Flip_Job* job , long n_int , char* file_name ){
+
+    FILE *fp;
+    RK_Flip_Header head;
+    size_t Npix = ( size_t )job->Nth*job->Nphi, len = strlen( file_name ), k;
+    unsigned char *rgb;
+    double t_lo = INFINITY, u, v;
+    float t;
+    int i, j, ok;
+
+    fp = fopen( file_name , "wb" );
+    if( fp == NULL ){
+        printf( "ERROR: Could not open the flip map file %s! \n" , file_name );
+        return -1;
+    }
+
+    if( len < 4 || strcmp( file_name + len - 4 , ".ppm" ) != 0 ){
+        memset( &head , 0 , sizeof( head ) );
+        memcpy( head.magic , RK_FLIP_MAGIC , 8 );
+        head.Nth = job->Nth;
+        head.Nphi = job->Nphi;
+        head.th_range[ 0 ] = job->th_lo;
+        head.th_range[ 1 ] = job->th_lo + ( job->Nth - 1 )*job->dth;
+        head.phi_range[ 0 ] = job->phi_lo;
+        head.phi_range[ 1 ] = job->phi_lo + ( job->Nphi - 1 )*job->dphi;
+        head.t_max = job->range_int[ 1 ];
+        head.err_tol = job->err_tol;
+        memcpy( head.pend_coeff , job->pend_coeff , sizeof( head.pend_coeff ) );
+        head.n_integrated = n_int;
+        head.has_prec = ( job->prec != NULL );
+        ok = ( fwrite( &head , sizeof( head ) , 1 , fp ) == 1 ) && ( fwrite( job->map , sizeof( float ) , Npix , fp ) == Npix );
+        /* The precision flags follow the map as one byte per pixel */
+        if( ok && job->prec != NULL ){
+            ok = ( fwrite( job->prec , 1 , Npix , fp ) == Npix );
+        }
+    }
+    else{
+        /* Colour by log( t_flip ) from the fastest flip (yellow) over red to t_max (dark blue), black if it never flips */
+        for( k = 0; k < Npix; k++ ){
+            t = job->map[ k ];
+            t_lo = ( t > 0.0f && t < t_lo ) ? t : t_lo;
+        }
+        t_lo = ( t_lo < job->range_int[ 1 ] ) ? t_lo : 1e-3*job->range_int[ 1 ];
+
+        rgb = ( unsigned char* )malloc( 3*( size_t )job->Nth );
+        if( rgb == NULL ){
+            fclose( fp );
+            return -1;
+        }
+        fprintf( fp , "P6\n%d %d\n255\n" , job->Nth , job->Nphi );
+        ok = 1;
+        /* The first image row is the last phi row -> phi grows upwards */
+        for( j = job->Nphi - 1; j >= 0 && ok; j-- ){
+            for( i = 0; i < job->Nth; i++ ){
+                t = job->map[ ( size_t )j*job->Nth + i ];
+                if( isinf( t ) ){
+                    rgb[ 3*i ] = rgb[ 3*i + 1 ] = rgb[ 3*i + 2 ] = 0;
+                    continue;
+                }
+                if( isnan( t ) ){
+                    rgb[ 3*i ] = rgb[ 3*i + 1 ] = rgb[ 3*i + 2 ] = 128;
+                    continue;
+                }
+                u = ( t > t_lo ) ? log( t/t_lo )/log( job->range_int[ 1 ]/t_lo ) : 0.0;
+                u = ( u < 1.0 ) ? u : 1.0;
+                if( u < 0.5 ){
+                    v = 2.0*u;
+                    rgb[ 3*i ] = 255;
+                    rgb[ 3*i + 1 ] = ( unsigned char )( 255.0*( 1.0 - v ) );
+                    rgb[ 3*i + 2 ] = 0;
+                }
+                else{
+                    v = 2.0*u - 1.0;
+                    rgb[ 3*i ] = ( unsigned char )( 255.0*( 1.0 - v ) );
+                    rgb[ 3*i + 1 ] = 0;
+                    rgb[ 3*i + 2 ] = ( unsigned char )( 128.0*v );
+                }
+            }
+            ok = ( fwrite( rgb , 3 , ( size_t )job->Nth , fp ) == ( size_t )job->Nth );
+        }
+        free( rgb );
+    }
+
+    if( fclose( fp ) != 0 || !ok ){
+        printf( "ERROR: Could not write the flip map file %s! \n" , file_name );
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Flip-time map of the double Pendulum with an optional single precision screening pass (see DP45_Flip_Map and DP45_Flip_Map_Mixed) */
+/* Only the tableau, tolerance, coefficients and RHS mode of the context are used (Nstate must be 4) */
+static long Flip_Map_Run( RK_Context* ctx , double* th_range , double* phi_range , int Nth , int Nphi , double t_max ,
+                          int refine_step , double refine_tol , int tile , int Nthreads , double screen_tol , double screen_margin ,
+                          float* flip_time , unsigned char* prec , char* file_name ){
+
+    Flip_Job job; /* The map shared by all the workers */
+    pthread_t threads[ Nthread_max ];
+    Sweep_Queue queues[ Nthread_max ];
+    Flip_Worker workers[ Nthread_max ];
+    int Ntask, Npt, Nlane, S, i, ok;
+    long n_int = 0;
+    int n_cap = 0;
+    double *pc = ctx->pend_coeff;
+
+    if( ctx->Nstate != 4 || Nth < 2 || Nphi < 2 || !( t_max > 0.0 ) || flip_time == NULL ){
+        printf( "ERROR: The flip map needs the double Pendulum ( Nstate = 4 ), at least 2 x 2 pixels and t_max > 0! \n" );
+        return -1;
+    }
+
+    /* Coarsest spacing -> the largest power of 2 not above refine_step */
+    S = 1;
+    while( 2*S <= refine_step && 2*S < Nth && 2*S < Nphi ){
+        S *= 2;
+    }
+    if( tile <= 0 ){
+        tile = 64;
+    }
+
+    job.tab = &ctx->tab;
+    job.err_tol = ctx->err_tol;
+    job.pend_coeff = pc;
+    job.rhs_mode = ctx->rhs_mode;
+    job.th_lo = *( th_range );
+    job.dth = ( *( th_range + 1 ) - *( th_range ) )/( Nth - 1 );
+    job.phi_lo = *( phi_range );
+    job.dphi = ( *( phi_range + 1 ) - *( phi_range ) )/( Nphi - 1 );
+    job.range_int[ 0 ] = 0.0;
+    job.range_int[ 1 ] = t_max;
+    job.refine_tol = refine_tol;
+    job.Nth = Nth;
+    job.Nphi = Nphi;
+    job.tile = tile;
+    job.Ntile_th = ( Nth + tile - 1 )/tile;
+    job.map = flip_time;
+    job.prec = prec;
+    job.screen_tol = ( screen_tol > 0.0 ) ? screen_tol : 0.0;
+    job.screen_margin = screen_margin;
+
+    /* Released at rest the energy is the potential -b_th*cos( theta ) - b_phi*cos( phi ) and the kinetic energy can not be negative
+       (positive definite mass matrix), so theta can only reach pi above b_th - |b_phi| and phi above b_phi - |b_th| */
+    if( *( pc ) > 0.0 && *( pc + 1 ) > 0.0 && 4.0*( *( pc ) )*( *( pc + 1 ) ) > ( *( pc + 2 ) )*( *( pc + 2 ) ) ){
+        job.U_flip = *( pc + 3 ) - fabs( *( pc + 4 ) );
+        job.U_flip = ( *( pc + 4 ) - fabs( *( pc + 3 ) ) < job.U_flip ) ? *( pc + 4 ) - fabs( *( pc + 3 ) ) : job.U_flip;
+    }
+    else{
+        job.U_flip = - INFINITY;
+    }
+
+    Ntask = job.Ntile_th*( ( Nphi + tile - 1 )/tile );
+
+    /* Pick the number of threads - never more than the number of tiles */
+    if( Nthreads <= 0 ){
+        Nthreads = ( int )sysconf( _SC_NPROCESSORS_ONLN );
+    }
+    if( Nthreads < 1 ){
+        Nthreads = 1;
+    }
+    if( Nthreads > Nthread_max ){
+        Nthreads = Nthread_max;
+    }
+    if( Nthreads > Ntask ){
+        Nthreads = Ntask;
+    }
+
+    /* Lanes and scratch storage of each worker - sized for a full tile */
+    Npt = tile*tile;
+    Nlane = ( Npt < Nbatch_max ) ? Npt : Nbatch_max;
+    ok = 1;
+    for( i = 0; i < Nthreads; i++ ){
+        workers[ i ].id = i;
+        workers[ i ].Nthreads = Nthreads;
+        workers[ i ].job = &job;
+        workers[ i ].queues = queues;
+        workers[ i ].work = ( double* )malloc( DP45_Batch_Work_Size( ctx->tab.Ns , 4 , Nlane ) );
+        workers[ i ].states = ( double* )malloc( 4*sizeof( double )*( size_t )Npt );
+        workers[ i ].state_final = ( double* )malloc( 4*sizeof( double )*( size_t )Npt );
+        workers[ i ].t_final = ( double* )malloc( sizeof( double )*( size_t )Npt );
+        workers[ i ].n_steps = ( int* )malloc( sizeof( int )*( size_t )Npt );
+        workers[ i ].pix = ( int* )malloc( sizeof( int )*( size_t )Npt );
+        workers[ i ].n_int = 0;
+        workers[ i ].n_cap = 0;
+        ok = ok && workers[ i ].work && workers[ i ].states && workers[ i ].state_final && workers[ i ].t_final && workers[ i ].n_steps && workers[ i ].pix;
+        if( job.screen_tol > 0.0 ){
+            workers[ i ].work_f32 = malloc( DP45_Batch_F32_Work_Size( Nlane ) );
+            workers[ i ].a_max = ( double* )malloc( sizeof( double )*( size_t )Npt );
+            ok = ok && workers[ i ].work_f32 && workers[ i ].a_max;
+        }
+        else{
+            workers[ i ].work_f32 = NULL;
+            workers[ i ].a_max = NULL;
+        }
+        pthread_mutex_init( &queues[ i ].lock , NULL );
+    }
+
+    /* Coarsest lattice first, then every level only integrates the points next to non-uniform cells of the previous one */
+    /* NOTE: The threads are joined between the levels, so a level only reads the pixels finished by the coarser ones */
+    for( job.h = S, job.top = 1; ok && job.h >= 1; job.h /= 2, job.top = 0 ){
+
+        for( i = 0; i < Nthreads; i++ ){
+            queues[ i ].lo = ( int )( ( long long )Ntask*i/Nthreads );
+            queues[ i ].hi = ( int )( ( long long )Ntask*( i + 1 )/Nthreads );
+        }
+
+        /* The calling thread works as worker 0 */
+        for( i = 1; i < Nthreads; i++ ){
+            pthread_create( &threads[ i ] , NULL , Flip_Worker_Run , &workers[ i ] );
+        }
+        Flip_Worker_Run( &workers[ 0 ] );
+        for( i = 1; i < Nthreads; i++ ){
+            pthread_join( threads[ i ] , NULL );
+        }
+    }
+
+    for( i = 0; i < Nthreads; i++ ){
+        n_int += workers[ i ].n_int;
+        n_cap += workers[ i ].n_cap;
+        free( workers[ i ].work );
+        free( workers[ i ].work_f32 );
+        free( workers[ i ].a_max );
+        free( workers[ i ].states );
+        free( workers[ i ].state_final );
+        free( workers[ i ].t_final );
+        free( workers[ i ].n_steps );
+        free( workers[ i ].pix );
+        pthread_mutex_destroy( &queues[ i ].lock );
+    }
+
+    if( !ok ){
+        printf( "ERROR: Could not allocate the flip map storage for %d threads! \n" , Nthreads );
+        return -1;
+    }
+
+    if( n_cap > 0 ){
+        printf( "----------------------------------------------------------\n" );
+        printf( "----WARNING: The full integration was not carried out!----\n" );
+        printf( "----------------------------------------------------------\n" );
+        printf( "%d trajectories stopped after %d iterations, their pixels are NaN \n" , n_cap , ( int )Nloop_max );
+    }
+
+    if( file_name != NULL && *file_name != '\0' && Flip_Map_Write( &job , n_int , file_name ) != 0 ){
+        return -1;
+    }
+
+    return n_int;
+}
+
+/* Flip-time map of the double Pendulum with a context (see DP45_Flip_Map) */
+/* Only the tableau, tolerance, coefficients and RHS mode of the context are used (Nstate must be 4) */
+long RK_Context_Flip_Map( RK_Context* ctx , double* th_range , double* phi_range , int Nth , int Nphi , double t_max ,
+                          int refine_step , double refine_tol , int tile , int Nthreads , float* flip_time , char* file_name ){
+
+    return Flip_Map_Run( ctx , th_range , phi_range , Nth , Nphi , t_max , refine_step , refine_tol , tile , Nthreads ,
+                         0.0 , 0.0 , flip_time , NULL , file_name );
+}
+
+/* Mixed precision flip-time map of the double Pendulum with a context (see DP45_Flip_Map_Mixed) */
+/* The screening pass always uses the Dormand-Prince tableau, the verification pass the tableau of the context */
+long RK_Context_Flip_Map_Mixed( RK_Context* ctx , double* th_range , double* phi_range , int Nth , int Nphi , double t_max ,
+                                int refine_step , double refine_tol , int tile , int Nthreads , double screen_tol , double screen_margin ,
+                                float* flip_time , unsigned char* prec , char* file_name ){
+
+    if( !( screen_tol > 0.0 ) || !( screen_margin >= 0.0 && screen_margin < 1.0 ) ){
+        printf( "ERROR: The screening needs screen_tol > 0 and 0 <= screen_margin < 1! \n" );
+        return -1;
+    }
+
+    return Flip_Map_Run( ctx , th_range , phi_range , Nth , Nphi , t_max , refine_step , refine_tol , tile , Nthreads ,
+                         screen_tol , screen_margin , flip_time , prec , file_name );
+}
+
+/* Flip-time map of the double Pendulum -> time until either arm flips over for a grid of release angles at rest */
+/* Every pixel is a release from rest at ( theta , phi ) which is integrated with the batch Dormand-Prince until |theta| or |phi|
+   first exceeds pi (located on the interpolant of the step) or until t_max. Releases below the flip energy are never integrated.
+   The map is built on a lattice of spacing refine_step which is halved down to single pixels: a new point is only integrated
+   if a cell of the coarser lattice around it is not uniform (flip and no flip mixed, or flip times more than a factor
+   exp( refine_tol ) apart) and is interpolated otherwise, so the work concentrates on the fractal boundaries.
+   The tiles of the image are spread over the threads with the work-stealing scheduler of the parameter sweeps. */
+/* Inputs:
+    - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+    - th_range[ 2 ], phi_range[ 2 ]: the angles of the first and the last column (theta) and row (phi) of the map
+    - Nth, Nphi: number of columns and rows ( >= 2 )
+    - t_max: the integration stops here for the arms which do not flip
+    - refine_step: spacing of the coarsest lattice in pixels (rounded down to a power of 2) -> 1 integrates every pixel
+    - refine_tol: largest spread of log( t_flip ) in a cell which is still interpolated
+    - tile: size of the square tiles in pixels (0 for 64)
+    - Nthreads: number of worker threads, 0 to use all the available cores
+    - file_name: binary file (RK_Flip_Header + the map) or a .ppm image if it ends with ".ppm", NULL or "" for no file */
+/* Outputs:
+    - flip_time[ Nphi ][ Nth ]: the time of the first flip of each pixel (row j is phi_range[ 0 ] + j*dphi), infinity if it does
+      not flip before t_max and NaN if Nloop_max was hit
+    -- returns the number of integrated trajectories or -1 on an error
+    -- NOTE: Features smaller than the coarsest lattice which do not touch its points can be missed */
+long DP45_Flip_Map( double err_tol , double* th_range , double* phi_range , int Nth , int Nphi , double t_max ,
+                    int refine_step , double refine_tol , int tile , int Nthreads , float* flip_time , char* file_name ){
+
+    RK_Context ctx; /* Temporary context with the global coefficients */
+
+    RK_Context_From_Default( &ctx , 4 , err_tol );
+    return RK_Context_Flip_Map( &ctx , th_range , phi_range , Nth , Nphi , t_max , refine_step , refine_tol , tile , Nthreads , flip_time , file_name );
+}
+
+/* Mixed precision flip-time map of the double Pendulum -> single precision screening with double precision verification */
+/* Every integrated pixel is first run by a single precision Dormand-Prince (float state, stages and RHS with a double time and step)
+   at screen_tol. The results which are ambiguous -> no result, a flip within screen_margin*t_max of t_max, or no flip although an
+   arm came within screen_margin*pi of pi -> are integrated again in double precision at err_tol, all the others are kept.
+   The lattice refinement is the same as DP45_Flip_Map and is driven by the screened times. */
+/* Inputs:
+    - err_tol: error tolerance per step of the double precision verification
+    - th_range[ 2 ], phi_range[ 2 ], Nth, Nphi, t_max, refine_step, refine_tol, tile, Nthreads: see DP45_Flip_Map
+    - screen_tol: error tolerance per step of the single precision screening ( > 0, about 1e-5 or above is meaningful in float)
+    - screen_margin: relative margin to t_max and to pi in which a screened result is verified ( 0 <= screen_margin < 1 )
+    - file_name: see DP45_Flip_Map -> the binary file also stores the precision flags after the map */
+/* Outputs:
+    - flip_time[ Nphi ][ Nth ]: see DP45_Flip_Map
+    - prec[ Nphi ][ Nth ]: which precision produced each pixel -> RK_FLIP_PREC_F32, RK_FLIP_PREC_F64 or RK_FLIP_PREC_NONE for the
+      interpolated pixels and the ones decided without an integration (NULL to skip)
+    -- returns the number of integrated trajectories or -1 on an error */
+long DP45_Flip_Map_Mixed( double err_tol , double* th_range , double* phi_range , int Nth , int Nphi , double t_max ,
+                          int refine_step , double refine_tol , int tile , int Nthreads , double screen_tol , double screen_margin ,
+                          float* flip_time , unsigned char* prec , char* file_name ){
+
+    RK_Context ctx; /* Temporary context with the global coefficients */
+
+    RK_Context_From_Default( &ctx , 4 , err_tol );
+    return RK_Context_Flip_Map_Mixed( &ctx , th_range , phi_range , Nth , Nphi , t_max , refine_step , refine_tol , tile , Nthreads ,
+                                      screen_tol , screen_margin , flip_time , prec , file_name );
+}
+
+/* Online statistics of a Monte Carlo ensemble at the output times -> every array has Nout entries along its first index */
+struct RK_MC_Stats {
+    int Nout, /* Number of output times */
+        Nbins; /* Bins of the angle histograms over [ -pi , pi ) */
+    double *t_out; /* [ Nout ] the output times */
+    int64_t n_sample, /* Samples folded in */
+            n_fail; /* Samples which did not reach the last output time (Nloop_max) -> they only count at the times they reached */
+    int64_t *count; /* [ Nout ] samples at each time */
+    double *mean, /* [ Nout ][ 4 ] running mean (Welford) */
+           *m2; /* [ Nout ][ 4 ][ 4 ] sum of the products of the deviations from the mean -> cov = m2/( count - 1 ) */
+    uint32_t *sketch, /* [ Nout ][ 4 ][ 2*RK_MC_SKETCH_NB + 1 ] quantile sketch buckets (negative, zero, positive) */
+             *hist; /* [ Nout ][ 2 ][ Nbins ] histograms of theta and phi wrapped to [ -pi , pi ) */
+};
+
+/* On-disk header of RK_MC_Stats_Save (native byte order) -> followed by t_out, count, mean, m2, sketch and hist */
+typedef struct {
+    char magic[ 8 ]; /* RK_MC_MAGIC */
+    int32_t Nout, Nbins, Nsketch, reserved; /* Sizes -> Nsketch is RK_MC_SKETCH_NB of the writer */
+    double alpha, x_min; /* Sketch parameters of the writer */
+    int64_t n_sample, n_fail;
+} RK_MC_Header;
+
+/* Number of sketch buckets per component */
+#define RK_MC_NBUCKET ( 2*RK_MC_SKETCH_NB + 1 )
+
+/* Everything a Monte Carlo worker thread needs -> each worker folds a contiguous range of the samples into its own statistics */
+typedef struct {
+    const RK_Tableau *tab; /* Butcher tableau -> shared read-only */
+    double err_tol, /* Error tolerance per step */
+           t_init, /* Start of the integrations */
+           *state_init, *state_sigma, /* [ 4 ] mean and standard deviation of the initial state */
+           *dims, *dims_sigma, /* [ 5 ] mean and standard deviation of l1 , l2 , m1 , m2 , g (NULL for the fixed coefficients) */
+           *pend_coeff, /* [ 5 ] the fixed coefficients if dims is NULL */
+           *rows; /* [ Nout ][ 5 ] dense rows of the sample being integrated */
+    uint64_t seed; /* Seed of the ensemble */
+    int64_t i_lo, i_hi; /* Samples [ i_lo , i_hi ) of this worker */
+    RK_MC_Stats *st; /* Statistics of this worker */
+} MC_Worker;
+
+/* splitmix64 -> small, fast generator with good statistics, also used to decorrelate the sample streams */
+RK_INLINE uint64_t RK_Splitmix64( uint64_t* x ){
+
+    uint64_t z = ( *x += 0x9E3779B97F4A7C15ULL );
+
+    z = ( z ^ ( z >> 30 ) )*0xBF58476D1CE4E5B9ULL;
+    z = ( z ^ ( z >> 27 ) )*0x94D049BB133111EBULL;
+    return z ^ ( z >> 31 );
+}
+
+/* Pair of standard normal numbers (Box-Muller) */
+static void RK_Normal2( uint64_t* x , double* z0 , double* z1 ){
+
+    double u1 = ( ( double )( RK_Splitmix64( x ) >> 11 ) + 1.0 )*0x1.0p-53, /* ( 0 , 1 ] */
+           u2 = ( double )( RK_Splitmix64( x ) >> 11 )*0x1.0p-53,
+           r = sqrt( - 2.0*log( u1 ) );
+
+    *z0 = r*cos( 2.0*PI*u2 );
+    *z1 = r*sin( 2.0*PI*u2 );
+
+}
+
+/* Pendulum coefficients a_th to b_phi from the physical dimensions [ l1 , l2 , m1 , m2 , g ] -> same as get_int_params in main.py */
+static void Pend_Coeff_From_Dims( double* dims , double* pend_coeff ){
+
+    double l1 = *( dims ), l2 = *( dims + 1 ), m1 = *( dims + 2 ), m2 = *( dims + 3 ), g_acc = *( dims + 4 );
+
+    *( pend_coeff ) = m1*l1*l1/6.0 + 0.5*m2*l2*l2;
+    *( pend_coeff + 1 ) = m2*l2*l2/6.0;
+    *( pend_coeff + 2 ) = 0.5*m2*l1*l2;
+    *( pend_coeff + 3 ) = l1*g_acc*( m1/2.0 + m2 );
+    *( pend_coeff + 4 ) = 0.5*l2*g_acc*m2;
+
+}
+
+/* Sketch bucket of a value -> relative accuracy RK_MC_SKETCH_ALPHA for RK_MC_SKETCH_XMIN <= |x| < RK_MC_SKETCH_XMIN*gamma^RK_MC_SKETCH_NB */
+static int RK_MC_Bucket( double x ){
+
+    double a = fabs( x ), lg = log( ( 1.0 + RK_MC_SKETCH_ALPHA )/( 1.0 - RK_MC_SKETCH_ALPHA ) );
+    int i;
+
+    if( !( a >= RK_MC_SKETCH_XMIN ) ){
+        return RK_MC_SKETCH_NB; /* Zero bucket (also NaN) */
+    }
+    i = ( int )ceil( log( a/RK_MC_SKETCH_XMIN )/lg );
+    i = ( i < 1 ) ? 1 : ( ( i > RK_MC_SKETCH_NB ) ? RK_MC_SKETCH_NB : i );
+
+    return ( x < 0.0 ) ? RK_MC_SKETCH_NB - i : RK_MC_SKETCH_NB + i;
+}
+
+/* Representative value of a sketch bucket */
+static double RK_MC_Bucket_Value( int b ){
+
+    double gamma = ( 1.0 + RK_MC_SKETCH_ALPHA )/( 1.0 - RK_MC_SKETCH_ALPHA );
+    int i = b - RK_MC_SKETCH_NB;
+
+    if( i == 0 ){
+        return 0.0;
+    }
+
+    return ( ( i < 0 ) ? - 1.0 : 1.0 )*RK_MC_SKETCH_XMIN*2.0*pow( gamma , abs( i ) )/( gamma + 1.0 );
+}
+
+/* Fold the state of a sample at output time k into the statistics */
+static void RK_MC_Fold( RK_MC_Stats* st , int k , double* state ){
+
+    double *mean = st->mean + 4*k, *m2 = st->m2 + 16*k, d[ 4 ], w;
+    int64_t n = ( st->count[ k ] += 1 );
+    int i, j, b;
+
+    /* Welford update of the mean and the co-moments */
+    for( i = 0; i < 4; i++ ){
+        d[ i ] = *( state + i ) - mean[ i ];
+        mean[ i ] += d[ i ]/( double )n;
+    }
+    for( i = 0; i < 4; i++ ){
+        for( j = 0; j < 4; j++ ){
+            m2[ 4*i + j ] += d[ i ]*( *( state + j ) - mean[ j ] );
+        }
     }
-    fprintf( fp , "\n" );
 
-    k = 0; /* Zero-out the loop counter */
-    err_ratiOld = 1.0; /* Initialize the "old" error fraction */
+    for( i = 0; i < 4; i++ ){
+        st->sketch[ ( ( size_t )k*4 + i )*RK_MC_NBUCKET + RK_MC_Bucket( *( state + i ) ) ] += 1;
+    }
 
-    /* Start the main integration loop */
-    while( ( t_now < *( range_int + 1 ) ) && ( k < Nloop_max ) ){
+    /* Angles wrapped to [ -pi , pi ) */
+    for( i = 0; i < 2; i++ ){
+        w = *( state + i ) - 2.0*PI*floor( ( *( state + i ) + PI )/( 2.0*PI ) );
+        b = ( int )( ( w + PI )/( 2.0*PI )*st->Nbins );
+        b = ( b < 0 ) ? 0 : ( ( b >= st->Nbins ) ? st->Nbins - 1 : b );
+        st->hist[ ( ( size_t )k*2 + i )*st->Nbins + b ] += 1;
+    }
 
-        /* Call the RHS function in the current point -> x_i */
-        RHS_Function( state_now , rhs_state );
-        /* Assign RK constant for this point and compute intermediate state */
-        for( i = 0; i < Nstate; i++ ){
-            k_DP[ i ][ 0 ] = rhs_state[ i ]*dt;
-            /* This intermediate state will be used for k2 computation */
-            int_state[ i ] = state_now[ i ] + DPa[ 1 ][ 0 ]*k_DP[ i ][ 0 ];
+}
+
+/* Main function of a Monte Carlo worker thread -> samples, integrates and folds its range of samples in order */
+static void* MC_Worker_Run( void* arg ){
+
+    MC_Worker *w = ( MC_Worker* )arg;
+    RK_MC_Stats *st = w->st;
+    RK_Buffer buf = { w->rows , ( long )st->Nout*5 , 0 , NULL , NULL }; /* Dense rows of a sample */
+    RK_Output out = { NULL , &buf , NULL , st->t_out , st->Nout , 0 }; /* Destinations of the output -> dense rows at the output times */
+    double range_int[ 2 ] = { w->t_init , st->t_out[ st->Nout - 1 ] },
+           z[ 10 ], state[ 4 ], dims[ 5 ], pend_coeff[ 5 ];
+    uint64_t x;
+    int64_t isample;
+    int j, k;
+
+    for( isample = w->i_lo; isample < w->i_hi; isample++ ){
+
+        /* Every sample has its own stream -> the ensemble does not depend on how the samples are split */
+        x = w->seed;
+        x = RK_Splitmix64( &x ) ^ ( uint64_t )isample;
+        x = RK_Splitmix64( &x );
+        for( j = 0; j < 10; j += 2 ){
+            RK_Normal2( &x , &z[ j ] , &z[ j + 1 ] );
         }
 
-        /* Call the RHS function in the second point -> x_i + c2*dt */
-        RHS_Function( int_state , rhs_state );
-        /* Assign RK constant for this point and compute intermediate state */
-        for( i = 0; i < Nstate; i++ ){
-            k_DP[ i ][ 1 ] = rhs_state[ i ]*dt;
-            /* This intermediate state will be used for k3 computation */
-            int_state[ i ] = state_now[ i ]; 
-            /* start with the existing state and add all the contributions */
-            for( j = 0; j < 2; j++ ){
-                int_state[ i ] += DPa[ 2 ][ j ]*k_DP[ i ][ j ];
+        for( j = 0; j < 4; j++ ){
+            state[ j ] = *( w->state_init + j ) + ( ( w->state_sigma != NULL ) ? *( w->state_sigma + j )*z[ j ] : 0.0 );
+        }
+        if( w->dims != NULL ){
+            for( j = 0; j < 5; j++ ){
+                dims[ j ] = *( w->dims + j ) + ( ( w->dims_sigma != NULL ) ? *( w->dims_sigma + j )*z[ 4 + j ] : 0.0 );
             }
+            Pend_Coeff_From_Dims( dims , pend_coeff );
+        }
+        else{
+            memcpy( pend_coeff , w->pend_coeff , sizeof( pend_coeff ) );
         }
 
-        /* Call the RHS function in the third point -> x_i + c3*dt */
-        RHS_Function( int_state , rhs_state );
-        /* Assign RK constant for this point and compute intermediate state */
-        for( i = 0; i < Nstate; i++ ){
-            k_DP[ i ][ 2 ] = rhs_state[ i ]*dt;
-            /* This intermediate state will be used for k4 computation */
-            int_state[ i ] = state_now[ i ]; 
-            /* start with the existing state and add all the contributions */
-            for( j = 0; j < 3; j++ ){
-                int_state[ i ] += DPa[ 3 ][ j ]*k_DP[ i ][ j ];
-            }
+        buf.n = 0;
+        DP45_Core( w->tab , 4 , w->err_tol , pend_coeff , NULL , state , range_int , &out , NULL , NULL , NULL , NULL );
+
+        for( k = 0; k < buf.n; k++ ){
+            RK_MC_Fold( st , k , w->rows + 5*k + 1 );
         }
+        st->n_sample += 1;
+        st->n_fail += ( buf.n < st->Nout );
+    }
 
-        /* Call the RHS function in the forth point -> x_i + c4*dt */
-        RHS_Function( int_state , rhs_state );
-        /* Assign RK constant for this point and compute intermediate state */
-        for( i = 0; i < Nstate; i++ ){
-            k_DP[ i ][ 3 ] = rhs_state[ i ]*dt;
-            /* This intermediate state will be used for k5 computation */
-            int_state[ i ] = state_now[ i ]; 
-            /* start with the existing state and add all the contributions */
+    return NULL;
+}
+
+/* Create empty Monte Carlo statistics */
+RK_MC_Stats* RK_MC_Stats_Create( int Nout , double* t_out , int Nbins ){
+
+    RK_MC_Stats *st;
+    int k;
+
+    if( Nout < 1 || Nbins < 1 ){
+        printf( "ERROR: The Monte Carlo statistics need at least one output time and one histogram bin! \n" );
+        return NULL;
+    }
+    for( k = 1; k < Nout; k++ ){
+        if( !( *( t_out + k ) > *( t_out + k - 1 ) ) ){
+            printf( "ERROR: The output times of the Monte Carlo statistics must be increasing! \n" );
+            return NULL;
+        }
+    }
+
+    st = ( RK_MC_Stats* )calloc( 1 , sizeof( RK_MC_Stats ) );
+    if( st == NULL ){
+        return NULL;
+    }
+    st->Nout = Nout;
+    st->Nbins = Nbins;
+    st->t_out = ( double* )malloc( sizeof( double )*( size_t )Nout );
+    st->count = ( int64_t* )calloc( ( size_t )Nout , sizeof( int64_t ) );
+    st->mean = ( double* )calloc( ( size_t )Nout*4 , sizeof( double ) );
+    st->m2 = ( double* )calloc( ( size_t )Nout*16 , sizeof( double ) );
+    st->sketch = ( uint32_t* )calloc( ( size_t )Nout*4*RK_MC_NBUCKET , sizeof( uint32_t ) );
+    st->hist = ( uint32_t* )calloc( ( size_t )Nout*2*Nbins , sizeof( uint32_t ) );
+    if( st->t_out == NULL || st->count == NULL || st->mean == NULL || st->m2 == NULL || st->sketch == NULL || st->hist == NULL ){
+        RK_MC_Stats_Free( st );
+        return NULL;
+    }
+    memcpy( st->t_out , t_out , sizeof( double )*( size_t )Nout );
+
+    return st;
+}
+
+/* Free Monte Carlo statistics */
+void RK_MC_Stats_Free( RK_MC_Stats* st ){
+
+    if( st == NULL ){
+        return;
+    }
+    free( st->t_out );
+    free( st->count );
+    free( st->mean );
+    free( st->m2 );
+    free( st->sketch );
+    free( st->hist );
+    free( st );
+
+}
+
+/* Merge the statistics src into dst (same output times and bins) -> pairwise update of the moments (Chan et al.) and sums of the counts */
+int RK_MC_Stats_Merge( RK_MC_Stats* dst , RK_MC_Stats* src ){
+
+    int k, i, j;
+    size_t n;
+    double na, nb, nt, d[ 4 ];
+
+    if( dst->Nout != src->Nout || dst->Nbins != src->Nbins || memcmp( dst->t_out , src->t_out , sizeof( double )*( size_t )dst->Nout ) != 0 ){
+        printf( "ERROR: Only Monte Carlo statistics with the same output times and bins can be merged! \n" );
+        return -1;
+    }
+
+    for( k = 0; k < dst->Nout; k++ ){
+        if( src->count[ k ] == 0 ){
+            continue;
+        }
+        na = ( double )dst->count[ k ];
+        nb = ( double )src->count[ k ];
+        nt = na + nb;
+        for( i = 0; i < 4; i++ ){
+            d[ i ] = src->mean[ 4*k + i ] - dst->mean[ 4*k + i ];
+        }
+        for( i = 0; i < 4; i++ ){
             for( j = 0; j < 4; j++ ){
-                int_state[ i ] += DPa[ 4 ][ j ]*k_DP[ i ][ j ];
+                dst->m2[ 16*k + 4*i + j ] += src->m2[ 16*k + 4*i + j ] + d[ i ]*d[ j ]*na*nb/nt;
             }
+            dst->mean[ 4*k + i ] += d[ i ]*nb/nt;
         }
+        dst->count[ k ] += src->count[ k ];
+    }
+    for( n = 0; n < ( size_t )dst->Nout*4*RK_MC_NBUCKET; n++ ){
+        dst->sketch[ n ] += src->sketch[ n ];
+    }
+    for( n = 0; n < ( size_t )dst->Nout*2*dst->Nbins; n++ ){
+        dst->hist[ n ] += src->hist[ n ];
+    }
+    dst->n_sample += src->n_sample;
+    dst->n_fail += src->n_fail;
 
-        /* Call the RHS function in the fifth point -> x_i + c5*dt */
-        RHS_Function( int_state , rhs_state );
-        /* Assign RK constant for this point and compute intermediate state */
-        for( i = 0; i < Nstate; i++ ){
-            k_DP[ i ][ 4 ] = rhs_state[ i ]*dt;
-            /* This intermediate state will be used for k6 computation */
-            int_state[ i ] = state_now[ i ]; 
-            /* start with the existing state and add all the contributions */
-            for( j = 0; j < 5; j++ ){
-                int_state[ i ] += DPa[ 5 ][ j ]*k_DP[ i ][ j ];
+    return 0;
+}
+
+/* Sizes and counters of Monte Carlo statistics */
+void RK_MC_Stats_Info( RK_MC_Stats* st , int* sizes , double* t_out , int64_t* n_run ){
+
+    if( sizes != NULL ){
+        *( sizes ) = st->Nout;
+        *( sizes + 1 ) = st->Nbins;
+    }
+    if( t_out != NULL ){
+        memcpy( t_out , st->t_out , sizeof( double )*( size_t )st->Nout );
+    }
+    if( n_run != NULL ){
+        *( n_run ) = st->n_sample;
+        *( n_run + 1 ) = st->n_fail;
+    }
+
+}
+
+/* Mean and covariance of the state at the output times */
+void RK_MC_Stats_Moments( RK_MC_Stats* st , double* count , double* mean , double* cov ){
+
+    int k, i;
+
+    for( k = 0; k < st->Nout; k++ ){
+        if( count != NULL ){
+            *( count + k ) = ( double )st->count[ k ];
+        }
+        if( mean != NULL ){
+            for( i = 0; i < 4; i++ ){
+                *( mean + 4*k + i ) = ( st->count[ k ] > 0 ) ? st->mean[ 4*k + i ] : NAN;
+            }
+        }
+        if( cov != NULL ){
+            for( i = 0; i < 16; i++ ){
+                *( cov + 16*k + i ) = ( st->count[ k ] > 1 ) ? st->m2[ 16*k + i ]/( double )( st->count[ k ] - 1 ) : NAN;
             }
         }
+    }
 
-        /* Call the RHS function in the sixth point -> x_i + c6*dt */
-        RHS_Function( int_state , rhs_state );
-        /* Assign RK constant for this point and compute intermediate state */
-        for( i = 0; i < Nstate; i++ ){
-            k_DP[ i ][ 5 ] = rhs_state[ i ]*dt;
-            /* This intermediate state will be used for k7 computation */
-            int_state[ i ] = state_now[ i ]; 
-            /* start with the existing state and add all the contributions */
-            for( j = 0; j < 6; j++ ){
-                int_state[ i ] += DPa[ 6 ][ j ]*k_DP[ i ][ j ];
+}
+
+/* Quantiles of the state components at the output times from the sketch */
+void RK_MC_Stats_Quantiles( RK_MC_Stats* st , int Nq , double* q , double* quant ){
+
+    int k, i, iq, b;
+    double rank;
+    uint64_t cum;
+    uint32_t *sk;
+
+    for( k = 0; k < st->Nout; k++ ){
+        for( i = 0; i < 4; i++ ){
+            sk = st->sketch + ( ( size_t )k*4 + i )*RK_MC_NBUCKET;
+            for( iq = 0; iq < Nq; iq++ ){
+                if( st->count[ k ] == 0 ){
+                    *( quant + ( ( size_t )k*Nq + iq )*4 + i ) = NAN;
+                    continue;
+                }
+                /* Lower quantile -> the bucket holding the sample of rank floor( q*( count - 1 ) ) in increasing order */
+                rank = floor( *( q + iq )*( double )( st->count[ k ] - 1 ) );
+                cum = 0;
+                for( b = 0; b < RK_MC_NBUCKET - 1; b++ ){
+                    cum += sk[ b ];
+                    if( ( double )cum > rank ){
+                        break;
+                    }
+                }
+                *( quant + ( ( size_t )k*Nq + iq )*4 + i ) = RK_MC_Bucket_Value( b );
             }
         }
+    }
 
-        /* Call the RHS function in the seventh point -> x_i + c7*dt -> last one (t + dt) */
-        RHS_Function( int_state , rhs_state );
-        /* Assign RK constant for this point */
-        for( i = 0; i < Nstate; i++ ){
-            k_DP[ i ][ 6 ] = rhs_state[ i ]*dt;
+}
+
+/* Angle histograms at the output times */
+void RK_MC_Stats_Histograms( RK_MC_Stats* st , double* hist ){
+
+    size_t n;
+
+    for( n = 0; n < ( size_t )st->Nout*2*st->Nbins; n++ ){
+        *( hist + n ) = ( double )st->hist[ n ];
+    }
+
+}
+
+/* Write Monte Carlo statistics to a file -> they can be merged with the ones of other processes after RK_MC_Stats_Load */
+int RK_MC_Stats_Save( RK_MC_Stats* st , char* file_name ){
+
+    FILE *fp;
+    RK_MC_Header head;
+    size_t Nout = ( size_t )st->Nout;
+    int ok;
+
+    fp = fopen( file_name , "wb" );
+    if( fp == NULL ){
+        printf( "ERROR: Could not open the Monte Carlo statistics file %s \n" , file_name );
+        return -1;
+    }
+
+    memset( &head , 0 , sizeof( head ) );
+    memcpy( head.magic , RK_MC_MAGIC , 8 );
+    head.Nout = st->Nout;
+    head.Nbins = st->Nbins;
+    head.Nsketch = RK_MC_SKETCH_NB;
+    head.alpha = RK_MC_SKETCH_ALPHA;
+    head.x_min = RK_MC_SKETCH_XMIN;
+    head.n_sample = st->n_sample;
+    head.n_fail = st->n_fail;
+
+    ok = ( fwrite( &head , sizeof( head ) , 1 , fp ) == 1 )
+      && ( fwrite( st->t_out , sizeof( double ) , Nout , fp ) == Nout )
+      && ( fwrite( st->count , sizeof( int64_t ) , Nout , fp ) == Nout )
+      && ( fwrite( st->mean , sizeof( double ) , 4*Nout , fp ) == 4*Nout )
+      && ( fwrite( st->m2 , sizeof( double ) , 16*Nout , fp ) == 16*Nout )
+      && ( fwrite( st->sketch , sizeof( uint32_t ) , 4*Nout*RK_MC_NBUCKET , fp ) == 4*Nout*RK_MC_NBUCKET )
+      && ( fwrite( st->hist , sizeof( uint32_t ) , 2*Nout*st->Nbins , fp ) == 2*Nout*st->Nbins );
+    ok = ( fclose( fp ) == 0 ) && ok;
+
+    if( !ok ){
+        printf( "ERROR: Could not write the Monte Carlo statistics file %s \n" , file_name );
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Read Monte Carlo statistics written by RK_MC_Stats_Save */
+RK_MC_Stats* RK_MC_Stats_Load( char* file_name ){
+
+    FILE *fp;
+    RK_MC_Header head;
+    RK_MC_Stats *st = NULL;
+    double *t_out = NULL;
+    size_t Nout;
+    int ok;
+
+    fp = fopen( file_name , "rb" );
+    if( fp == NULL ){
+        printf( "ERROR: Could not open the Monte Carlo statistics file %s \n" , file_name );
+        return NULL;
+    }
+
+    ok = ( fread( &head , sizeof( head ) , 1 , fp ) == 1 ) && memcmp( head.magic , RK_MC_MAGIC , 8 ) == 0 && head.Nout > 0 && head.Nbins > 0
+      && head.Nsketch == RK_MC_SKETCH_NB && head.alpha == RK_MC_SKETCH_ALPHA && head.x_min == RK_MC_SKETCH_XMIN;
+    if( ok ){
+        Nout = ( size_t )head.Nout;
+        t_out = ( double* )malloc( sizeof( double )*Nout );
+        ok = ( t_out != NULL ) && ( fread( t_out , sizeof( double ) , Nout , fp ) == Nout );
+        st = ok ? RK_MC_Stats_Create( head.Nout , t_out , head.Nbins ) : NULL;
+        ok = ( st != NULL )
+          && ( fread( st->count , sizeof( int64_t ) , Nout , fp ) == Nout )
+          && ( fread( st->mean , sizeof( double ) , 4*Nout , fp ) == 4*Nout )
+          && ( fread( st->m2 , sizeof( double ) , 16*Nout , fp ) == 16*Nout )
+          && ( fread( st->sketch , sizeof( uint32_t ) , 4*Nout*RK_MC_NBUCKET , fp ) == 4*Nout*RK_MC_NBUCKET )
+          && ( fread( st->hist , sizeof( uint32_t ) , 2*Nout*head.Nbins , fp ) == 2*Nout*head.Nbins );
+    }
+    fclose( fp );
+    free( t_out );
+
+    if( !ok ){
+        printf( "ERROR: %s is not a readable Monte Carlo statistics file (or has a different sketch) \n" , file_name );
+        RK_MC_Stats_Free( st );
+        return NULL;
+    }
+    st->n_sample = head.n_sample;
+    st->n_fail = head.n_fail;
+
+    return st;
+}
+
+/* Monte Carlo uncertainty propagation with a context (see DP45_MC_Run) */
+/* Only the tableau and tolerance of the context are used, and its coefficients if dims is NULL */
+long RK_Context_MC_Run( RK_Context* ctx , RK_MC_Stats* st , double t_init , double* state_init , double* state_sigma ,
+                        double* dims , double* dims_sigma , int64_t i_first , int64_t Nsample , uint64_t seed , int Nthreads ){
+
+    pthread_t threads[ Nthread_max ];
+    MC_Worker workers[ Nthread_max ];
+    int i, ok;
+
+    if( ctx->Nstate != 4 || !ctx->tab.dense || !( *( st->t_out ) >= t_init ) || Nsample < 0 ){
+        printf( "ERROR: The Monte Carlo run needs the double Pendulum ( Nstate = 4 ), a method with dense output and t_out[ 0 ] >= t_init! \n" );
+        return -1;
+    }
+    if( Nsample == 0 ){
+        return 0;
+    }
+
+    /* Pick the number of threads - never more than the number of samples */
+    if( Nthreads <= 0 ){
+        Nthreads = ( int )sysconf( _SC_NPROCESSORS_ONLN );
+    }
+    if( Nthreads < 1 ){
+        Nthreads = 1;
+    }
+    if( Nthreads > Nthread_max ){
+        Nthreads = Nthread_max;
+    }
+    if( Nthreads > Nsample ){
+        Nthreads = ( int )Nsample;
+    }
+
+    /* Contiguous blocks of samples -> the partial statistics are merged in the order of the samples, so a run is reproducible
+       (only the round-off of the moments depends on the number of threads, the counts never do) */
+    ok = 1;
+    for( i = 0; i < Nthreads; i++ ){
+        workers[ i ].tab = &ctx->tab;
+        workers[ i ].err_tol = ctx->err_tol;
+        workers[ i ].t_init = t_init;
+        workers[ i ].state_init = state_init;
+        workers[ i ].state_sigma = state_sigma;
+        workers[ i ].dims = dims;
+        workers[ i ].dims_sigma = dims_sigma;
+        workers[ i ].pend_coeff = ctx->pend_coeff;
+        workers[ i ].seed = seed;
+        workers[ i ].i_lo = i_first + Nsample*i/Nthreads;
+        workers[ i ].i_hi = i_first + Nsample*( i + 1 )/Nthreads;
+        workers[ i ].rows = ( double* )malloc( sizeof( double )*5*( size_t )st->Nout );
+        workers[ i ].st = RK_MC_Stats_Create( st->Nout , st->t_out , st->Nbins );
+        ok = ok && workers[ i ].rows != NULL && workers[ i ].st != NULL;
+    }
+
+    if( ok ){
+        /* The calling thread works as worker 0 */
+        for( i = 1; i < Nthreads; i++ ){
+            pthread_create( &threads[ i ] , NULL , MC_Worker_Run , &workers[ i ] );
+        }
+        MC_Worker_Run( &workers[ 0 ] );
+        for( i = 1; i < Nthreads; i++ ){
+            pthread_join( threads[ i ] , NULL );
         }
+        for( i = 0; i < Nthreads; i++ ){
+            RK_MC_Stats_Merge( st , workers[ i ].st );
+        }
+    }
 
-        /* We have all the k_DP at this point -- compute the error estimates for each state quantity */
-        for( i = 0; i < Nstate; i++ ){
-            err_est[ i ] = 0.0;
-            for( j = 0; j < 7; j++ ){
-                err_est[ i ] += DPec[ j ]*k_DP[ i ][ j ];
+    for( i = 0; i < Nthreads; i++ ){
+        free( workers[ i ].rows );
+        RK_MC_Stats_Free( workers[ i ].st );
+    }
+
+    if( !ok ){
+        printf( "ERROR: Could not allocate the Monte Carlo storage for %d threads! \n" , Nthreads );
+        return -1;
+    }
+
+    return ( long )Nsample;
+}
+
+/* Monte Carlo uncertainty propagation for the double Pendulum with online statistics at the output times */
+/* Each sample perturbs the initial state and the physical dimensions with independent normal deviates, is integrated with the
+   dense output at the output times of st and is folded into the running statistics -> mean and covariance (Welford), a quantile
+   sketch of every component and histograms of the wrapped angles. The memory is O( Nout ) whatever the number of samples.
+   Sample i always gets the same deviates for a seed, so a run can be split into ranges of i_first (over processes or calls)
+   and the statistics merged with RK_MC_Stats_Merge. */
+/* Inputs:
+    - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+    - st: the statistics to fold the samples into (RK_MC_Stats_Create or RK_MC_Stats_Load)
+    - t_init: start of the integrations ( <= the first output time )
+    - state_init[ 4 ], state_sigma[ 4 ]: mean and standard deviation of the initial state (state_sigma NULL for no perturbation)
+    - dims[ 5 ], dims_sigma[ 5 ]: mean and standard deviation of [ l1 , l2 , m1 , m2 , g ] (dims NULL to use the coefficients
+      of Set_Pend_coeff for all the samples, dims_sigma NULL for no perturbation) -> the deviates are not truncated, keep the
+      standard deviations well below the values
+    - i_first, Nsample: the samples i_first to i_first + Nsample - 1 are run
+    - seed: seed of the ensemble
+    - Nthreads: number of worker threads, 0 to use all the available cores */
+/* Outputs:
+    - st: updated with the samples
+    -- returns Nsample or -1 on an error */
+long DP45_MC_Run( double err_tol , RK_MC_Stats* st , double t_init , double* state_init , double* state_sigma ,
+                  double* dims , double* dims_sigma , int64_t i_first , int64_t Nsample , uint64_t seed , int Nthreads ){
+
+    RK_Context ctx; /* Temporary context with the global coefficients */
+
+    RK_Context_From_Default( &ctx , 4 , err_tol );
+    return RK_Context_MC_Run( &ctx , st , t_init , state_init , state_sigma , dims , dims_sigma , i_first , Nsample , seed , Nthreads );
+}
+
+/* N-link Pendulum integration with a context (see DP45_Chain_Integrator) */
+/* Only the tableau, tolerance and statistics of the context are used -> its Nstate and coefficients are ignored */
+int RK_Context_Chain_Integrate( RK_Context* ctx , RK_Chain* chain , double* state_init , double* range_int , int Nout , double* t_out ,
+                                RK_Buffer* buf , double* state_final , double* summary ){
+
+    RK_Output out = { NULL , buf , NULL , t_out , Nout , 0 }; /* Destinations of the output -> rows at every accepted step or at t_out */
+
+    if( t_out != NULL && Nout < 1 ){
+        printf( "ERROR: The dense output of the chain needs at least one output time! \n" );
+        return -1;
+    }
+    if( buf != NULL ){
+        buf->n = 0;
+    }
+
+    if( DP45_Core( &ctx->tab , 2*chain->Nlink , ctx->err_tol , ctx->pend_coeff , chain , state_init , range_int , ( buf != NULL ) ? &out : NULL ,
+                   state_final , summary , ctx->stats , NULL ) != 0 ){
+        return -1;
+    }
+
+    return ( buf != NULL ) ? buf->n : 0;
+}
+
+/* Adaptive integrator (method of Set_RK_Method) for the N-link Pendulum */
+/* Inputs:
+    - chain: the N-link Pendulum from RK_Chain_Create
+    - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+    - state_init[ 2*N ]: initial state as [ theta_0 , ... , theta_{N-1} , om_0 , ... , om_{N-1} ]
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+    - Nout, t_out[ Nout ]: increasing output times for the dense output (t_out NULL for a row at every accepted step) */
+/* Outputs:
+    - buf: rows [ Time , State[ 0 ] , ... , State[ 2*N - 1 ] ] (NULL for no output)
+    - state_final[ 2*N ]: the state at the end of the integration (NULL to skip)
+    - summary[ 4 ]: [ t_final , accepted steps , rejected steps , max |E - E_0| over the accepted steps ] (NULL to skip)
+    -- returns the number of rows in buf or -1 on an error */
+int DP45_Chain_Integrator( RK_Chain* chain , double err_tol , double* state_init , double* range_int , int Nout , double* t_out ,
+                           RK_Buffer* buf , double* state_final , double* summary ){
+
+    RK_Context ctx; /* Temporary context with the global method */
+
+    RK_Context_From_Default( &ctx , 2*chain->Nlink , err_tol );
+    return RK_Context_Chain_Integrate( &ctx , chain , state_init , range_int , Nout , t_out , buf , state_final , summary );
+}
+
+/* One fine pass of Parareal -> the slices n_first to Nslice - 1 are integrated from their current start states by the worker threads */
+typedef struct {
+    RK_Context *ctx; /* Tableau, tolerance and coefficients of the fine propagator -> shared read-only */
+    int Nstate, Nslice,
+        n_first; /* First slice of this pass (the earlier ones are converged) */
+    atomic_int next, /* Next slice to take */
+               fail; /* Set if a slice could not write its output */
+    double *t_bound, /* [ Nslice + 1 ] slice boundaries */
+           *U, /* [ Nslice + 1 ][ Nstate ] start states of the slices (and the end state) */
+           *F; /* [ Nslice ][ Nstate ] fine end states of the slices */
+    RK_Buffer *rows; /* [ Nslice ] output rows of the slices (NULL for no output) */
+    double *t_out; /* Output times of the dense output (NULL for every accepted step) */
+    int *i_out; /* [ Nslice + 1 ] the output times of slice n are t_out[ i_out[ n ] ] to t_out[ i_out[ n + 1 ] - 1 ] */
+} Parareal_Pass;
+
+/* Main function of a Parareal worker thread -> takes slices until none are left in the pass */
+static void* Parareal_Worker( void* arg ){
+
+    Parareal_Pass *pass = ( Parareal_Pass* )arg;
+    RK_Output out = { NULL , NULL , NULL , NULL , 0 , 0 }; /* Destinations of the output -> rows of the slice */
+    double range_int[ 2 ];
+    int n;
+
+    while( ( n = atomic_fetch_add( &pass->next , 1 ) ) < pass->Nslice ){
+        range_int[ 0 ] = pass->t_bound[ n ];
+        range_int[ 1 ] = pass->t_bound[ n + 1 ];
+        if( pass->rows != NULL ){
+            out.buf = pass->rows + n;
+            out.buf->n = 0;
+            if( pass->t_out != NULL ){
+                out.t_out = pass->t_out + pass->i_out[ n ];
+                out.Nout = pass->i_out[ n + 1 ] - pass->i_out[ n ];
             }
-            /* Take absolute value for each error */
-            err_est[ i ] = fabs( err_est[ i ] );
         }
+        if( DP45_Core( &pass->ctx->tab , pass->Nstate , pass->ctx->err_tol , pass->ctx->pend_coeff , NULL , pass->U + ( size_t )n*pass->Nstate ,
+                       range_int , ( pass->rows != NULL ) ? &out : NULL , pass->F + ( size_t )n*pass->Nstate , NULL , NULL , NULL ) != 0 ){
+            atomic_store( &pass->fail , 1 );
+        }
+    }
 
-        /* Get the largest estimated error and find its ratio to the tolerance */
-        err_ratio = MaxVal( err_est , Nstate )/err_tol;
+    return NULL;
+}
 
-        /* Choose whether to accept the step or not and how to pick the next step based on the err_ratio */
-        /* NOTE: If the err_ratio is OK but we overshot the endpoint by more than err_tol, reject the step with new dt to end on it exactly! */
-        if( err_ratio < 1.0 && ( t_now + dt - *( range_int + 1 ) < err_tol ) ){
-            /* In this case the step is small enough -> we're within the error range and not yet at the end of the interval */
+/* Coarse propagator of Parareal -> Nstep fixed RK4 steps, or the adaptive method of the context at coarse_tol if Nstep <= 0 */
+static void Parareal_Coarse( RK_Context* ctx , int Nstate , int Nstep , double coarse_tol , double t_start , double t_end ,
+                             double* state , double* state_out ){
 
-            /* In this case compute the next values and print them in the file */
-            t_now += dt;
+    double range_int[ 2 ] = { t_start , t_end },
+           k1[ Nstate ], k2[ Nstate ], k3[ Nstate ], k4[ Nstate ], y[ Nstate ],
+           dt = ( t_end - t_start )/( ( Nstep > 0 ) ? Nstep : 1 );
+    int i, j;
 
-            /* NOTE: No need to check if we overshot since this is included in the outer if statement! */
+    if( Nstep <= 0 ){
+        DP45_Core( &ctx->tab , Nstate , coarse_tol , ctx->pend_coeff , NULL , state , range_int , NULL , state_out , NULL , NULL , NULL );
+        return;
+    }
 
-            /* Update the states based on the DP coefficients of 4th order (final weights) */
-            for( i = 0; i < Nstate; i++ ){
-                for( j = 0; j < 7; j++ ){
-                    state_now[ i ] += DPb[ 0 ][ j ]*k_DP[ i ][ j ];
-                }
-            }
+    for( j = 0; j < Nstate; j++ ){
+        *( state_out + j ) = *( state + j );
+    }
+    for( i = 0; i < Nstep; i++ ){
+        RHS_Function_Coeff( state_out , k1 , ctx->pend_coeff );
+        for( j = 0; j < Nstate; j++ ){
+            y[ j ] = *( state_out + j ) + 0.5*dt*k1[ j ];
+        }
+        RHS_Function_Coeff( y , k2 , ctx->pend_coeff );
+        for( j = 0; j < Nstate; j++ ){
+            y[ j ] = *( state_out + j ) + 0.5*dt*k2[ j ];
+        }
+        RHS_Function_Coeff( y , k3 , ctx->pend_coeff );
+        for( j = 0; j < Nstate; j++ ){
+            y[ j ] = *( state_out + j ) + dt*k3[ j ];
+        }
+        RHS_Function_Coeff( y , k4 , ctx->pend_coeff );
+        for( j = 0; j < Nstate; j++ ){
+            *( state_out + j ) += dt*( k1[ j ] + 2.0*k2[ j ] + 2.0*k3[ j ] + k4[ j ] )/6.0;
+        }
+    }
 
-            /* If last step was not rejected - increase the current step with a safety factor based on the integral controller */
-            if( rej == 0 && ( err_ratio > 0.0 ) ){
-                /* Check what the new step candidate is and keep it in tv1 */
-                tv1 = safe_fac*dt*pow( err_ratio , p_gain )*pow( err_ratiOld , i_gain );
-                /* If step is increased more than step_mrat, increase it by step_mrat */
-                if( tv1/dt < step_mrat ){
-                    dt = tv1;
-                }
-                else{
-                    dt *= step_mrat;
-                }
-            }
+}
 
-            /* If the step was accepted -> set the rejection ratio to 0 */
-            rej = 0;
+/* Parareal integration with a context (see DP45_Parareal) */
+/* The fine propagator is the method and tolerance of the context, the coarse one RK4 or the same method at coarse_tol */
+int RK_Context_Parareal( RK_Context* ctx , double* state_init , double* range_int , int Nslice , int coarse_steps , double coarse_tol ,
+                         int Kmax , double conv_tol , int Nthreads , int Nout , double* t_out , RK_Buffer* buf , double* state_final , double* diag ){
 
-            /* Write the new state in the output file */
-            fprintf( fp , "%.10e, " , t_now );
-            for( i = 0; i < Nstate; i++ ){
-                fprintf( fp , "%.10e, " , state_now[ i ] );
+    int Nstate = ctx->Nstate;
+    pthread_t threads[ Nthread_max ];
+    Parareal_Pass pass;
+    double *G = NULL, /* [ Nslice ][ Nstate ] coarse end states of the slices from the last iteration */
+           g[ Nstate ], u_new[ Nstate ], /* Coarse end state and corrected start of the next slice */
+           upd, t0, t_fine, t_coarse;
+    int i, j, n, k, res = 0;
+
+    if( ctx->Nstate != 4 ){
+        printf( "ERROR: Parareal integrates the double Pendulum, Nstate must be 4 and not %d! \n" , ctx->Nstate );
+        return -1;
+    }
+    if( Nslice < 1 || Kmax < 1 || ( coarse_steps <= 0 && !( coarse_tol > 0.0 ) ) || !( *( range_int + 1 ) > *( range_int ) ) ){
+        printf( "ERROR: Parareal needs Nslice >= 1, Kmax >= 1, a coarse propagator ( coarse_steps > 0 or coarse_tol > 0 ) and range_int[ 1 ] > range_int[ 0 ]! \n" );
+        return -1;
+    }
+    if( t_out != NULL && !ctx->tab.dense ){
+        printf( "ERROR: The selected Runge-Kutta method has no dense output, use RK_METHOD_DP45! \n" );
+        return -1;
+    }
+    Kmax = ( Kmax < Nslice ) ? Kmax : Nslice; /* After Nslice iterations Parareal is the sequential fine solution */
+
+    /* Pick the number of threads - never more than the number of slices */
+    if( Nthreads <= 0 ){
+        Nthreads = ( int )sysconf( _SC_NPROCESSORS_ONLN );
+    }
+    Nthreads = ( Nthreads < 1 ) ? 1 : ( ( Nthreads > Nthread_max ) ? Nthread_max : Nthreads );
+    Nthreads = ( Nthreads > Nslice ) ? Nslice : Nthreads;
+
+    memset( &pass , 0 , sizeof( pass ) );
+    pass.ctx = ctx;
+    pass.Nstate = Nstate;
+    pass.Nslice = Nslice;
+    pass.t_out = t_out;
+    pass.t_bound = ( double* )malloc( sizeof( double )*( size_t )( Nslice + 1 ) );
+    pass.U = ( double* )malloc( sizeof( double )*( size_t )( Nslice + 1 )*Nstate );
+    pass.F = ( double* )malloc( sizeof( double )*( size_t )Nslice*Nstate );
+    pass.i_out = ( int* )calloc( ( size_t )( Nslice + 1 ) , sizeof( int ) );
+    pass.rows = ( buf != NULL ) ? ( RK_Buffer* )calloc( ( size_t )Nslice , sizeof( RK_Buffer ) ) : NULL;
+    G = ( double* )malloc( sizeof( double )*( size_t )Nslice*Nstate );
+    if( pass.t_bound == NULL || pass.U == NULL || pass.F == NULL || pass.i_out == NULL || G == NULL || ( buf != NULL && pass.rows == NULL ) ){
+        printf( "ERROR: Could not allocate the Parareal storage for %d slices! \n" , Nslice );
+        res = -1;
+    }
+
+    /* Equal slices -> the output times of slice n are the ones in [ t_n , t_{n+1} ) (the last slice also takes its end) */
+    for( n = 0; res == 0 && n <= Nslice; n++ ){
+        pass.t_bound[ n ] = *( range_int ) + ( *( range_int + 1 ) - *( range_int ) )*( double )n/( double )Nslice;
+        if( t_out != NULL ){
+            i = ( n > 0 ) ? pass.i_out[ n - 1 ] : 0;
+            while( i < Nout && ( ( n == Nslice ) || *( t_out + i ) < pass.t_bound[ n ] ) ){
+                i++;
             }
-            fprintf( fp , "\n" );
+            pass.i_out[ n ] = i;
+        }
+    }
+    if( res == 0 ){
+        pass.t_bound[ Nslice ] = *( range_int + 1 );
+    }
+
+    /* Iteration 0 -> the coarse propagator alone gives the start states of the slices */
+    t0 = RK_Wall_Time( );
+    for( j = 0; res == 0 && j < Nstate; j++ ){
+        pass.U[ j ] = *( state_init + j );
+    }
+    for( n = 0; res == 0 && n < Nslice; n++ ){
+        Parareal_Coarse( ctx , Nstate , coarse_steps , coarse_tol , pass.t_bound[ n ] , pass.t_bound[ n + 1 ] , pass.U + ( size_t )n*Nstate , G + ( size_t )n*Nstate );
+        memcpy( pass.U + ( size_t )( n + 1 )*Nstate , G + ( size_t )n*Nstate , sizeof( double )*Nstate );
+    }
+    t_coarse = RK_Wall_Time( ) - t0;
+
+    for( k = 1; res == 0 && k <= Kmax; k++ ){
 
+        /* Fine pass in parallel over the slices which are not converged yet -> slice k - 1 starts from an exact state */
+        t0 = RK_Wall_Time( );
+        pass.n_first = k - 1;
+        atomic_store( &pass.next , k - 1 );
+        atomic_store( &pass.fail , 0 );
+        /* The calling thread works as worker 0 */
+        for( i = 1; i < Nthreads; i++ ){
+            pthread_create( &threads[ i ] , NULL , Parareal_Worker , &pass );
         }
-        else{
-            /* In this case the step is too large or we overshot -> we must reduce it based on the estimate and threshold OR based on interval */
-            if( t_now + dt - *( range_int + 1 ) > err_tol ){
-                /* In this case we overshot the last step - set it to end exactly at the end of the interval */
-                dt = ( *( range_int + 1 ) - t_now );
-                rej = 0; /* If we came to this loop because of dt overshooting, we should not reject our new step */
+        Parareal_Worker( &pass );
+        for( i = 1; i < Nthreads; i++ ){
+            pthread_join( threads[ i ] , NULL );
+        }
+        t_fine = RK_Wall_Time( ) - t0;
+        if( atomic_load( &pass.fail ) ){
+            printf( "ERROR: Could not write the Parareal output! \n" );
+            res = -1;
+            break;
+        }
+
+        /* Sequential correction U_{n+1} = G( U_n new ) + F( U_n old ) - G( U_n old ) -> the start of slice k is now exact */
+        t0 = RK_Wall_Time( );
+        upd = 0.0;
+        for( n = k - 1; n < Nslice; n++ ){
+            if( n == k - 1 ){
+                memcpy( g , G + ( size_t )n*Nstate , sizeof( g ) ); /* Its start did not change */
             }
             else{
-                /* In this case we're still integrating, reduce the step */
-                dt = safe_fac*dt*pow( err_ratio , p_loss );
-                rej = 1; /* Set rej to 1 in case the step was rejected */
+                Parareal_Coarse( ctx , Nstate , coarse_steps , coarse_tol , pass.t_bound[ n ] , pass.t_bound[ n + 1 ] , pass.U + ( size_t )n*Nstate , g );
             }
-
+            for( j = 0; j < Nstate; j++ ){
+                u_new[ j ] = g[ j ] + pass.F[ ( size_t )n*Nstate + j ] - G[ ( size_t )n*Nstate + j ];
+                upd = ( fabs( u_new[ j ] - pass.U[ ( size_t )( n + 1 )*Nstate + j ] ) > upd ) ? fabs( u_new[ j ] - pass.U[ ( size_t )( n + 1 )*Nstate + j ] ) : upd;
+            }
+            memcpy( G + ( size_t )n*Nstate , g , sizeof( g ) );
+            memcpy( pass.U + ( size_t )( n + 1 )*Nstate , u_new , sizeof( u_new ) );
         }
+        t_coarse += RK_Wall_Time( ) - t0;
 
-        /* After a step has been completed - assign the new error ratio as old for next step */
-        err_ratiOld = err_ratio; /* NOTE: This is used as an integral component in the step control */
-        k += 1;
+        /* Diagnostics of the iteration */
+        if( diag != NULL ){
+            *( diag + 4*( k - 1 ) ) = upd;
+            *( diag + 4*( k - 1 ) + 1 ) = ( double )( Nslice - k + 1 );
+            *( diag + 4*( k - 1 ) + 2 ) = t_fine;
+            *( diag + 4*( k - 1 ) + 3 ) = t_coarse;
+        }
+        t_coarse = 0.0;
 
-        /* In case we reached the maximum number of iterations - warn about it */
-        if( k == Nloop_max ){
-            printf( "----------------------------------------------------------\n" );
-            printf( "----WARNING: The full integration was not carried out!----\n" );
-            printf( "----------------------------------------------------------\n" );
-            printf( "Stopped after %d iterations at t = %lf out of t_max = %lf \n" , k , t_now , *( range_int + 1 ) );
+        /* Converged when no slice start moved by more than conv_tol (the fine solutions of this pass are then the trajectory) */
+        if( upd <= conv_tol || k == Kmax ){
+            break;
+        }
+    }
+    k = ( k > Kmax ) ? Kmax : k;
 
+    /* The trajectory are the fine solutions of the slices -> concatenated without the repeated boundary rows */
+    if( res == 0 ){
+        if( state_final != NULL ){
+            memcpy( state_final , pass.F + ( size_t )( Nslice - 1 )*Nstate , sizeof( double )*Nstate );
+        }
+        if( buf != NULL ){
+            buf->n = 0;
+            for( n = 0; n < Nslice && res == 0; n++ ){
+                for( i = ( t_out == NULL && n > 0 ) ? 1 : 0; i < pass.rows[ n ].n && res == 0; i++ ){
+                    res = RK_Buffer_Append( buf , Nstate , pass.rows[ n ].data[ ( size_t )i*( Nstate + 1 ) ] , pass.rows[ n ].data + ( size_t )i*( Nstate + 1 ) + 1 );
+                }
+            }
+            if( res != 0 ){
+                printf( "ERROR: Could not write the Parareal output! \n" );
+            }
         }
+    }
 
-        // This printf was used for debugging the code in the beginning
-        //printf( "At k = %d, Time = %.10e, Error ratio is %.10e, dt = %.10e \n" , k , t_now , err_ratio , dt );
+    for( n = 0; pass.rows != NULL && n < Nslice; n++ ){
+        RK_Buffer_Free( pass.rows + n );
+    }
+    free( pass.rows );
+    free( pass.t_bound );
+    free( pass.U );
+    free( pass.F );
+    free( pass.i_out );
+    free( G );
 
+    return ( res == 0 ) ? k : -1;
+}
 
-    }
+/* Parareal parallel-in-time integration of a single trajectory */
+/* range_int is cut into Nslice equal slices. A cheap coarse propagator G runs sequentially over the slices and the accurate
+   fine propagator F (the adaptive method of Set_RK_Method at err_tol) runs on all the slices at once. Each iteration corrects
+   the slice starts as U_{n+1} = G( U_n new ) + F( U_n old ) - G( U_n old ) until they stop moving. With K iterations the wall
+   time is about K fine slices (plus the coarse sweeps) instead of Nslice -> worthwhile while K << Nslice. For the chaotic
+   double Pendulum the number of iterations grows with the horizon (the slice starts must be accurate to err_tol), so keep
+   range_int within a few Lyapunov times or expect K close to Nslice. Beyond that horizon a converged result is still a solution
+   within the tolerance, but it separates from the sequential run like two sequential runs at slightly different tolerances. */
+/* Inputs:
+    - Nstate: number of quantities in the state (phase space dimension) - must be 4 for the double pendulum RHS
+    - err_tol: error tolerance per step of the fine propagator
+    - state_init[ Nstate ]: initial state for the integrator
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+    - Nslice: number of time slices (at least the number of threads)
+    - coarse_steps: number of fixed RK4 steps per slice of the coarse propagator (0 to use the adaptive method at coarse_tol)
+    - coarse_tol: error tolerance per step of the adaptive coarse propagator (ignored if coarse_steps > 0)
+    - Kmax: maximum number of iterations (at most Nslice are ever needed)
+    - conv_tol: the iteration stops once no slice start moves by more than conv_tol (in any state quantity)
+    - Nthreads: number of worker threads, 0 to use all the available cores
+    - Nout, t_out[ Nout ]: increasing output times for the dense output (t_out NULL for a row at every accepted fine step) */
+/* Outputs:
+    - buf: rows [ Time , State[ 0 ] , ... , State[ Nstate - 1 ] ] of the trajectory (NULL for no output)
+    - state_final[ Nstate ]: the state at the end (NULL to skip)
+    - diag[ Kmax ][ 4 ]: per iteration [ largest update of a slice start , slices integrated by F , fine wall time [s] ,
+      coarse wall time [s] ] (NULL to skip) -> converged if the update of the last iteration is <= conv_tol
+    -- returns the number of iterations or -1 on an error */
+int DP45_Parareal( int Nstate , double err_tol , double* state_init , double* range_int , int Nslice , int coarse_steps , double coarse_tol ,
+                   int Kmax , double conv_tol , int Nthreads , int Nout , double* t_out , RK_Buffer* buf , double* state_final , double* diag ){
 
-    fclose( fp ); /* Close the file in the end */
+    RK_Context ctx; /* Temporary context with the global coefficients */
 
-}
\ No newline at end of file
+    RK_Context_From_Default( &ctx , Nstate , err_tol );
+    return RK_Context_Parareal( &ctx , state_init , range_int , Nslice , coarse_steps , coarse_tol , Kmax , conv_tol , Nthreads , Nout , t_out ,
+                                buf , state_final , diag );
+}
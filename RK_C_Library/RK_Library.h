@@ -13,6 +13,9 @@ Modify accordingly if you are modifying the RK_Library.c RHS functions to change
 #ifndef RK_LIBRARY_H
 #define RK_LIBRARY_H
 
+#include <stdio.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" { // only need to export C interface if used by C++ code
 #endif
@@ -23,6 +26,176 @@ extern "C" { // only need to export C interface if used by C++ code
     #define EXPORT __attribute__((visibility("default")))
 #endif
 
+/* In-memory output buffer for the integrators -> rows of [ Time , State[ 0 ] , ... , State[ Nstate - 1 ] ] are appended to data */
+/* Growth protocol: when a new row does not fit, the library calls grow( buf , cap_needed ) which must provide a (copied) data
+   array of at least cap_needed doubles, update data and cap and return 0 (anything else stops the integration).
+   If grow is NULL the library grows data itself with realloc -> data must then be NULL or malloc-ed and released with RK_Buffer_Free */
+typedef struct RK_Buffer RK_Buffer;
+struct RK_Buffer {
+    double *data; /* Row-major output [ n ][ Nstate + 1 ] */
+    long cap; /* Capacity of data in number of doubles */
+    int n; /* Number of rows written so far (reset to 0 at the start of each integration) */
+    int ( *grow )( RK_Buffer* buf , long cap_needed ); /* Grow callback of the caller, NULL to use realloc */
+    void *user; /* Free pointer for the caller (e.g. to find its own storage in the grow callback) */
+};
+
+/* Statistics of the last adaptive (DP45_*) integration -> filled on every run, see Get_RK_Stats and RK_Context_Get_Stats */
+#define RK_STATS_NHIST 64 /* Bins of the histogram of the accepted steps -> bin i holds 2^( i + RK_STATS_HIST_EXP_MIN ) <= dt < 2^( i + 1 + ... ) */
+#define RK_STATS_HIST_EXP_MIN ( - 48 ) /* Base 2 exponent of the first bin (the steps outside the range go to the first or the last bin) */
+#define RK_STATS_SAMPLE 8 /* The output time is measured on every RK_STATS_SAMPLE-th accepted step and scaled (keeps the clock off the hot path) */
+
+/* One entry of the per-step trace -> a ring buffer of the last trace_cap step attempts (enable with Set_RK_Trace) */
+typedef struct {
+    double t; /* Time at the start of the step */
+    double dt; /* Attempted step */
+    double err_ratio; /* Error estimate over err_tol ( < 1 for the accepted steps) */
+    int accepted; /* 1 if the step was accepted and 0 if it was rejected */
+} RK_Trace_Entry;
+
+typedef struct {
+    long n_acc; /* Accepted steps */
+    long n_rej; /* Rejected steps */
+    long n_rhs; /* Right-Hand-Side evaluations */
+    long n_singular; /* Singular LHS (detA) warnings of the RHS */
+    int loop_max; /* 1 if the run stopped at Nloop_max before the end of the interval */
+    double dt_min, dt_max; /* Smallest and largest accepted step */
+    long dt_hist[ RK_STATS_NHIST ]; /* Histogram of the accepted steps in powers of 2 (see RK_STATS_NHIST) */
+    double t_total; /* Wall time of the whole run in seconds */
+    double t_output; /* Part of t_total spent writing the output (estimated from every RK_STATS_SAMPLE-th step) */
+    long n_trace; /* Step attempts written to the trace -> the last min( n_trace , trace_cap ) of them are kept */
+    int trace_cap; /* Capacity of the trace ring buffer (0 if disabled) */
+    RK_Trace_Entry *trace; /* Trace ring buffer -> entry n is at trace[ n % trace_cap ] */
+} RK_Stats;
+
+/* Event (e.g. Poincare section) for the adaptive integrators -> located at the zeros of g( t , state ) inside the accepted steps */
+/* The crossings are found by root-finding on the continuous extension of the step (4th order for Dormand-Prince and cubic Hermite
+   for the other methods) and every located event is written as a row [ Time , State[ 0 ] , ... , State[ Nstate - 1 ] , event ] */
+#define RK_EVENT_RECORD 0 /* Write the event row and continue */
+#define RK_EVENT_TERMINATE 1 /* Write the event row and stop the integration at the event */
+typedef double ( *RK_Event_Fn )( int Nstate , double t , double* state , void* data );
+typedef struct {
+    RK_Event_Fn fn; /* Event function g -> NULL for the linear g = sum_i( data[ i ]*state[ i ] ) - data[ Nstate ] */
+    void *data; /* Free pointer passed to fn -> for fn == NULL the Nstate + 1 coefficients of the linear event (double*) */
+    int direction; /* +1 only g rising through 0, -1 only falling and 0 both */
+    int action; /* RK_EVENT_RECORD or RK_EVENT_TERMINATE */
+} RK_Event;
+
+/* Observables of the double Pendulum computed inside the integrator (see DP45_Integrator_Observables) */
+/* The observable rows are [ Time , E_kin , E_pot , x_mid , y_mid , x_end , y_end ] -> the energies use the coefficients a_th to b_phi
+   and the positions of the ends of the two rods have the pivot at the origin ( x_mid = l1*sin( theta ) , y_mid = - l1*cos( theta ) ) */
+#define RK_OBS_NCOL 7 /* Columns of an observable row (including the time) */
+typedef struct {
+    double e_init; /* Energy at the start */
+    double e_drift; /* Largest |E - e_init| over the accepted steps */
+    double th_min, th_max; /* Range of theta over the accepted steps */
+    double phi_min, phi_max; /* Range of phi over the accepted steps */
+    double t_final; /* Time at the end of the run */
+    int64_t n_flip_th, n_flip_phi; /* Number of times each arm went over the top (the angle crossed an odd multiple of pi) */
+    int64_t n_acc; /* Number of accepted steps */
+} RK_Obs_Summary;
+
+/* Binary trajectory format -> alternative to the .csv output which can be memory-mapped and searched by time */
+/* Layout of the file:
+    - RK_Traj_Header (RK_TRAJ_HEADER_SIZE bytes)
+    - n_chunks chunks of [ Ncol ][ chunk_rows ] doubles (column-major inside each chunk, the last one padded with NaN)
+    - sparse time index: n_chunks doubles holding the time of the first row of each chunk (at index_offset)
+   All the values are in the native byte order of the machine which wrote the file */
+/* Compressed files (codec RK_TRAJ_CODEC_XOR, written by DP45_Integrator_Packed) have the same header and index but:
+    - every chunk is a bit stream of variable size holding its columns one after the other, each value is stored as the XOR
+      with its prediction 2*x[ i - 1 ] - x[ i - 2 ] (Gorilla style: a 0 bit for an exact prediction, otherwise only the bits
+      between the leading and the trailing zeros of the XOR, reusing the previous window when they fit in it)
+    - the index is followed by n_chunks + 1 int64 byte offsets of the chunks (the last one is the end of the chunk data)
+    - with mant_bits < 52 the state values are rounded to mant_bits bits of mantissa (36 bits are about the 11 digits of the .csv),
+      the time is always stored exactly
+    - with dec_tol > 0 the accepted steps reproduced within dec_tol (absolute, in every state component) by the cubic Hermite
+      interpolant of their neighbours are dropped (see RK_Traj_Interp, the derivatives come from the RHS at the stored rows)
+   The chunks are independent, so a compressed file is still read one chunk at a time and searched by time */
+#define RK_TRAJ_MAGIC "DCTRAJ01" /* First 8 bytes of every binary trajectory file */
+#define RK_TRAJ_VERSION 1 /* Version of the binary format of the raw files */
+#define RK_TRAJ_VERSION_XOR 2 /* Version of the compressed files -> older readers reject them instead of reading them as raw */
+#define RK_TRAJ_CODEC_RAW 0 /* Chunks of plain doubles */
+#define RK_TRAJ_CODEC_XOR 1 /* Chunks compressed by XOR with the prediction */
+#define RK_TRAJ_CHUNK_ROWS 4096 /* Rows per chunk */
+#define RK_TRAJ_NCOL_MAX 32 /* Maximum number of columns ( 1 + Nstate ) */
+#define RK_TRAJ_NAME_LEN 64 /* Maximum length of a column name (including the terminating zero) */
+#define RK_TRAJ_HEADER_SIZE 4096 /* Size of the header on disk in bytes */
+
+typedef struct {
+    char magic[ 8 ]; /* RK_TRAJ_MAGIC */
+    int32_t version; /* RK_TRAJ_VERSION or RK_TRAJ_VERSION_XOR */
+    int32_t Ncol; /* Number of columns -> 1 + Nstate */
+    int32_t chunk_rows; /* Rows per chunk */
+    int32_t codec; /* RK_TRAJ_CODEC_RAW or RK_TRAJ_CODEC_XOR (always 0 in version 1 files) */
+    int64_t n_rows; /* Number of valid rows */
+    int64_t n_chunks; /* Number of chunks */
+    int64_t index_offset; /* Position of the sparse time index in bytes from the start of the file */
+    double err_tol; /* Error tolerance of the run */
+    double pend_coeff[ 5 ]; /* Pendulum coefficients a_th to b_phi of the run */
+    double range_int[ 2 ]; /* Requested integration interval */
+    char col_names[ RK_TRAJ_NCOL_MAX ][ RK_TRAJ_NAME_LEN ]; /* Names of the columns */
+    double dec_tol; /* Decimation tolerance (0 if every accepted step is kept) */
+    int64_t n_steps; /* Rows before the decimation -> n_rows + the dropped ones (0 in raw files) */
+    int32_t mant_bits; /* Bits of mantissa kept in the state values (52 for the full doubles, 0 in raw files) */
+    int32_t reserved; /* Always 0 */
+    char padding[ RK_TRAJ_HEADER_SIZE - 136 - RK_TRAJ_NCOL_MAX*RK_TRAJ_NAME_LEN ]; /* Zeros up to RK_TRAJ_HEADER_SIZE */
+} RK_Traj_Header;
+
+/* Reader handle for a binary trajectory file -> one chunk is kept in memory at a time */
+typedef struct {
+    FILE *fp; /* Binary file pointer */
+    RK_Traj_Header head; /* Header of the file */
+    double *index; /* [ n_chunks ] first time of each chunk */
+    double *chunk; /* [ Ncol ][ chunk_rows ] currently loaded chunk */
+    long i_chunk; /* Index of the loaded chunk, -1 if none */
+    int64_t *offsets; /* [ n_chunks + 1 ] byte offsets of the compressed chunks (NULL for raw files) */
+    unsigned char *zbuf; /* Compressed bytes of the chunk being decoded */
+    int64_t zbuf_cap; /* Capacity of zbuf in bytes */
+} RK_Traj_Reader;
+
+/* Checkpoint of an adaptive integration -> everything needed to continue it exactly where it stopped (see DP45_Integrator_Advance) */
+/* It is also the on-disk format of RK_Checkpoint_Save / RK_Checkpoint_Load (native byte order, RK_CKPT_SIZE bytes) */
+#define RK_CKPT_MAGIC "DCCKPT01" /* First 8 bytes of every checkpoint file */
+#define RK_CKPT_VERSION 1 /* Version of the checkpoint format */
+#define RK_CKPT_NSTATE_MAX 8 /* Maximum number of quantities in the state */
+#define RK_CKPT_SIZE 256 /* Size of RK_Checkpoint in bytes */
+
+typedef struct {
+    char magic[ 8 ]; /* RK_CKPT_MAGIC */
+    int32_t version; /* RK_CKPT_VERSION */
+    int32_t Nstate; /* Number of quantities in the state */
+    int32_t method; /* RK_METHOD_* of the last chunk (for information, any method can continue a checkpoint) */
+    int32_t rej; /* 1 if the last step attempt was rejected */
+    int64_t n_acc, n_rej; /* Accepted and rejected steps of all the chunks so far */
+    double t; /* Time reached */
+    double dt; /* Next step of the controller -> 0.0 for a checkpoint which has not been integrated yet */
+    double err_ratiOld; /* Error ratio of the last step (integral part of the step controller) */
+    double err_tol; /* Error tolerance of the last chunk (for information) */
+    double pend_coeff[ 5 ]; /* Pendulum coefficients at which rhs was evaluated */
+    double e_init, e_drift; /* Energy at the start of the first chunk and the largest |E - e_init| so far (double pendulum only) */
+    double state[ RK_CKPT_NSTATE_MAX ]; /* State at t */
+    double rhs[ RK_CKPT_NSTATE_MAX ]; /* Right-Hand-Side at state -> the first stage of the next step (FSAL) */
+} RK_Checkpoint;
+
+/* Header of the binary flip-time maps written by DP45_Flip_Map (native byte order) */
+/* The header is followed by the map as float[ Nphi ][ Nth ] -> row j is phi_range[ 0 ] + j*dphi, column i is theta_range[ 0 ] + i*dth,
+   and by the precision flags as unsigned char[ Nphi ][ Nth ] if has_prec is set (DP45_Flip_Map_Mixed) */
+#define RK_FLIP_MAGIC "DCFLIP01" /* First 8 bytes of every binary flip map */
+#define RK_FLIP_PREC_NONE 0 /* Pixel interpolated or decided without an integration */
+#define RK_FLIP_PREC_F32 1 /* Pixel from the single precision screening */
+#define RK_FLIP_PREC_F64 2 /* Pixel from the double precision integration */
+
+typedef struct {
+    char magic[ 8 ]; /* RK_FLIP_MAGIC */
+    int32_t Nth, Nphi; /* Columns (theta) and rows (phi) of the map */
+    double th_range[ 2 ], phi_range[ 2 ]; /* Angles of the first and the last column and row */
+    double t_max; /* End of the integration -> the pixels which do not flip before it are infinity */
+    double err_tol; /* Error tolerance of the run */
+    double pend_coeff[ 5 ]; /* Pendulum coefficients a_th to b_phi of the run */
+    int64_t n_integrated; /* Number of pixels which were integrated (the rest were interpolated or below the flip energy) */
+    int32_t has_prec; /* 1 if the precision flags follow the map */
+    int32_t reserved; /* Padding -> 0 */
+} RK_Flip_Header;
+
 /* Test interface to the C library from Py */
 /* Enter x value to be allocated and check that it is true */
 EXPORT void Test_Interface( double x_val );
@@ -32,6 +205,36 @@ EXPORT void Test_Interface( double x_val );
 /* NOTE: Must be performed before any integrations with Dormand-Prince are performed!!! */
 EXPORT void Set_RK_Coeff( );
 
+/* Embedded Runge-Kutta pairs available for the adaptive integrators */
+/* NOTE: Only RK_METHOD_DP45 has dense output (DP45_Integrator_Dense / RK_Context_DP45_Dense) */
+#define RK_METHOD_DP45 1 /* Dormand-Prince 5(4), 7 stages with FSAL -> the default */
+#define RK_METHOD_TSIT5 2 /* Tsitouras 5(4), 7 stages with FSAL */
+#define RK_METHOD_VERNER65 3 /* Verner 6(5) (DVERK), 8 stages */
+#define RK_METHOD_DOP853 4 /* Dormand-Prince 8(5,3) of Hairer & Wanner, 12 stages -> for tight tolerances */
+
+/* Select the embedded Runge-Kutta pair of the original interface (DP45_Integrator, ...) - call after Set_RK_Coeff */
+/* Inputs:
+    - method: one of the RK_METHOD_* values */
+/* Output:
+    - 0 on success or -1 if the method is unknown */
+EXPORT int Set_RK_Method( int method );
+
+/* Right-Hand-Side kernels of the batch integrator (DP45_Integrate_Batch / RK_Context_DP45_Batch) */
+/* The vectorized kernels use 2 branch-free sincos per state (sin and cos of phi - theta from the angle-difference identities)
+   instead of 5 libm calls and run on AVX-512 / AVX2 when the CPU has them. Accuracy contract for |theta|, |phi| < 1e6:
+   sin and cos are within 1 ULP and the angular accelerations within 5 ULP of the sum of the magnitudes of their terms.
+   RK_RHS_LIBM has the same bound only for |theta|, |phi| < pi (its phi - theta is rounded before sin and cos). */
+#define RK_RHS_LIBM 0 /* libm sin and cos -> the default, the same results as before */
+#define RK_RHS_FAST 1 /* Vectorized with FMA where available -> the last bits can differ between CPUs */
+#define RK_RHS_REPRO 2 /* Vectorized without FMA -> bitwise identical on all CPUs and for any number and order of the lanes */
+
+/* Select the Right-Hand-Side kernel of the batch integrator of the original interface */
+/* Inputs:
+    - rhs_mode: one of the RK_RHS_* values */
+/* Output:
+    - 0 on success or -1 if the mode is unknown */
+EXPORT int Set_RK_RHS_Mode( int rhs_mode );
+
 /* Prinout the Runge-Kutta constants for integration to check that they are set appropriately */
 EXPORT void Check_RK_Coeff( );
 
@@ -71,6 +274,18 @@ void RHS_Function_HO( double* state , double* deriv_state );
     -- Reflect this in the header format! */
 EXPORT void RK4_Integrator( int Nstate , int Npoints , double* state_init , double* range_int , char* file_name , char* header );
 
+/* 4th order Runge-Kutta integrator for testing purposes with in-memory output (no file is written) */
+/* Inputs:
+    - Nstate, Npoints, state_init[ Nstate ], range_int[ 2 ]: as in RK4_Integrator
+    - buf: output buffer provided by the caller (see RK_Buffer above) */
+/* Outputs:
+    - buf->data holds buf->n rows as [ Time , State[ 0 ] , State[ 1 ] , ... State[ Nstate - 1 ] ]
+    -- returns the number of rows or -1 if the buffer could not be grown */
+EXPORT int RK4_Integrator_Buffer( int Nstate , int Npoints , double* state_init , double* range_int , RK_Buffer* buf );
+
+/* Free the data of an in-memory output buffer which was grown by the library with realloc (buf->grow == NULL) */
+EXPORT void RK_Buffer_Free( RK_Buffer* buf );
+
 /* Mockup RHS value for two decoupled harmonic oscillators - it was used for the initial testing to validate the DP integrator */
 /* NOTE: The second oscillator (at 2*\omega) has dampening by a coefficient 2.0*\beta defined in the function */
 /* State is assumed to be [ \theta , \phi , \omega_theta , \omega_phi ] in arbitrary units of angle and angular velocity */
@@ -90,6 +305,76 @@ void RHS_Function( double* state , double* deriv_state );
     - deriv_state[ 4 ]: the derivative of the state in the same order */
 void RHS_Function( double* state , double* deriv_state );
 
+/* Right-Hand-Side Function for the double Pendulum with explicitly provided coefficients (instead of the global ones) */
+/* Inputs:
+    - state[ 4 ]: the state as [ theta , phi , om_theta , om_phi ]
+    - pend_coeff[ 5 ]: the coefficients a_th to b_phi in sequence (same order as in Set_Pend_coeff) */
+/* Outputs:
+    - deriv_state[ 4 ]: the derivative of the state in the same order */
+void RHS_Function_Coeff( double* state , double* deriv_state , double* pend_coeff );
+
+/* Total energy of the double Pendulum (kinetic + potential) for the given state */
+/* Inputs:
+    - state[ 4 ]: the state as [ theta , phi , om_theta , om_phi ]
+    - pend_coeff[ 5 ]: the coefficients a_th to b_phi in sequence (same order as in Set_Pend_coeff) */
+/* Output:
+    - the total energy in the units of the coefficients */
+EXPORT double Pend_Energy( double* state , double* pend_coeff );
+
+/* N-link planar Pendulum -> a chain of rigid links with the centre of mass in the middle, each hanging from the end of the previous one */
+/* The state is [ theta_0 , ... , theta_{N-1} , om_0 , ... , om_{N-1} ] with the absolute angles from the downward vertical (for
+   N = 2 this is the state of the double Pendulum). The Right-Hand-Side is the articulated-body algorithm -> O( N ) per call. */
+#define RK_CHAIN_NLINK_MAX 1024 /* Maximum number of links -> the integrator keeps its stages on the stack */
+typedef struct RK_Chain RK_Chain;
+
+/* Allocate an N-link Pendulum */
+/* Inputs:
+    - Nlink: number of links N
+    - length[ N ], mass[ N ]: the link lengths and masses ( > 0 )
+    - inertia[ N ]: the moments of inertia about the centres of mass (NULL for uniform rods -> mass*length^2/12)
+    - g_acc: gravitational acceleration */
+/* Outputs:
+    -- returns the chain (free with RK_Chain_Free) or NULL on an error */
+EXPORT RK_Chain* RK_Chain_Create( int Nlink , double* length , double* mass , double* inertia , double g_acc );
+
+/* Free an N-link Pendulum */
+EXPORT void RK_Chain_Free( RK_Chain* chain );
+
+/* Number of links of an N-link Pendulum -> the state has 2*Nlink quantities */
+EXPORT int RK_Chain_Nlink( RK_Chain* chain );
+
+/* Right-Hand-Side Function for the N-link Pendulum -> O( N ) with the workspace of the chain (do not share a chain between threads) */
+/* Inputs:
+    - state[ 2*N ]: the state as [ theta_0 , ... , theta_{N-1} , om_0 , ... , om_{N-1} ] */
+/* Outputs:
+    - deriv_state[ 2*N ]: the derivative of the state in the same order */
+EXPORT void RK_Chain_RHS( RK_Chain* chain , double* state , double* deriv_state );
+
+/* Total energy (kinetic + potential, zero at the height of the origin) of the N-link Pendulum */
+EXPORT double RK_Chain_Energy( RK_Chain* chain , double* state );
+
+/* End points of the links of the N-link Pendulum -> xy[ N ][ 2 ] as [ x , y ] */
+EXPORT void RK_Chain_Positions( RK_Chain* chain , double* state , double* xy );
+
+/* Right-Hand-Side Function for the double Pendulum evaluated for many states at once (batch mode) */
+/* The states are kept as structure-of-arrays: quantity j of lane l is at state[ j*Nstride + l ] */
+/* Inputs:
+    - Nlane: number of lanes (states) to evaluate
+    - Nstride: distance between two consecutive quantities of the same lane (Nstride >= Nlane)
+    - state[ 4 ][ Nstride ]: the states as [ theta , phi , om_theta , om_phi ] rows
+    - pend_coeff[ 5 ]: the coefficients a_th to b_phi in sequence (same order as in Set_Pend_coeff) */
+/* Outputs:
+    - deriv_state[ 4 ][ Nstride ]: the derivatives of the states in the same layout */
+void RHS_Function_Batch( int Nlane , int Nstride , double* state , double* deriv_state , double* pend_coeff );
+
+/* Vectorized Right-Hand-Side Function for the double Pendulum evaluated for many states at once (see RK_RHS_FAST) */
+/* Inputs:
+    - Nlane, Nstride, state[ 4 ][ Nstride ], pend_coeff[ 5 ]: same as in RHS_Function_Batch
+    - repro: 0 for the fastest kernel of the CPU (RK_RHS_FAST), 1 for the bitwise reproducible one (RK_RHS_REPRO) */
+/* Outputs:
+    - deriv_state[ 4 ][ Nstride ]: the derivatives of the states in the same layout */
+void RHS_Function_Batch_Fast( int Nlane , int Nstride , double* state , double* deriv_state , double* pend_coeff , int repro );
+
 /* 4-5th order adaptive Dormand-Prince integrator */
 /* Inputs:
     - Nstate: number of quantities in the state (phase space dimension)
@@ -104,6 +389,531 @@ void RHS_Function( double* state , double* deriv_state );
     -- Reflect this in the header format! */
 EXPORT void DP45_Integrator( int Nstate , double err_tol , double* state_init , double* range_int , char* file_name , char* header );
 
+/* 4-5th order adaptive Dormand-Prince integrator with in-memory output (no file is written) */
+/* Inputs:
+    - Nstate, err_tol, state_init[ Nstate ], range_int[ 2 ]: as in DP45_Integrator
+    - buf: output buffer provided by the caller (see RK_Buffer above) */
+/* Outputs:
+    - buf->data holds buf->n rows as [ Time , State[ 0 ] , State[ 1 ] , ... State[ Nstate - 1 ] ]
+    -- returns the number of rows or -1 if the buffer could not be grown */
+EXPORT int DP45_Integrator_Buffer( int Nstate , double err_tol , double* state_init , double* range_int , RK_Buffer* buf );
+
+/* 4-5th order adaptive Dormand-Prince integrator with dense output at the requested times */
+/* The integrator takes whatever steps the tolerance allows and the states at t_out come from the 4th order continuous extension */
+/* Inputs:
+    - Nstate, err_tol, state_init[ Nstate ], range_int[ 2 ]: as in DP45_Integrator
+    - Nout: number of output times
+    - t_out[ Nout ]: output times in increasing order (uniform or arbitrary), the ones outside range_int are skipped */
+/* Outputs:
+    - state_out[ Nout ][ Nstate ]: the states at the output times
+    -- returns the number of states written (the first ones inside range_int) or -1 on error */
+EXPORT int DP45_Integrator_Dense( int Nstate , double err_tol , double* state_init , double* range_int , int Nout , double* t_out , double* state_out );
+
+/* 4-5th order adaptive Dormand-Prince integrator with output to a binary trajectory file (see RK_Traj_Header above) */
+/* Inputs:
+    - Nstate, err_tol, state_init[ Nstate ], range_int[ 2 ]: as in DP45_Integrator
+    - file_name: a char of the output filename where the results will be written (e.g. "file.traj")
+    - col_names: comma separated names of the columns [ Time , State[ 0 ] , ... ] -> same text as the .csv header */
+/* Outputs:
+    -- returns the number of rows written or -1 if the file could not be written */
+EXPORT long DP45_Integrator_Bin( int Nstate , double err_tol , double* state_init , double* range_int , char* file_name , char* col_names );
+
+/* 4-5th order adaptive Dormand-Prince integrator with output to a compressed binary trajectory file (see RK_TRAJ_CODEC_XOR) */
+/* Inputs:
+    - Nstate, err_tol, state_init[ Nstate ], range_int[ 2 ], file_name, col_names: as in DP45_Integrator_Bin
+    - dec_tol: drop the accepted steps which the cubic Hermite interpolant of the kept ones reproduces within dec_tol
+      (absolute error in every state component, double Pendulum only) -> 0 keeps every step
+    - mant_bits: bits of mantissa kept in the state values ( 1 to 52 ) -> 52 (or 0) is lossless, 36 has about the precision of the .csv */
+/* Outputs:
+    -- returns the number of rows written or -1 if the file could not be written */
+EXPORT long DP45_Integrator_Packed( int Nstate , double err_tol , double* state_init , double* range_int , char* file_name , char* col_names ,
+                                    double dec_tol , int mant_bits );
+
+/* 4-5th order adaptive Dormand-Prince integrator which writes only the events (e.g. Poincare section points, see RK_Event) */
+/* Inputs:
+    - Nstate: number of quantities in the state (phase space dimension)
+    - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+    - state_init[ Nstate ]: initial state for the integrator
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+    - Nevent: number of events
+    - events[ Nevent ]: the events (the ones already at a zero at the start are not reported) */
+/* Outputs:
+    - buf: the rows [ Time , State[ 0 ] , ... , State[ Nstate - 1 ] , event index ] in the order of the crossings
+    -- returns the number of event rows or -1 on error */
+EXPORT int DP45_Integrator_Events( int Nstate , double err_tol , double* state_init , double* range_int , int Nevent , RK_Event* events ,
+                                   RK_Buffer* buf );
+
+/* 4-5th order adaptive Dormand-Prince integrator of the double Pendulum which computes the observables inside the integration */
+/* The energies and the positions of the bobs are evaluated at every written state and the reductions at every accepted step */
+/* Inputs:
+    - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+    - state_init[ 4 ]: initial state [ theta , phi , om_theta , om_phi ]
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+    - Nout, t_out[ Nout ]: sorted times of the observable rows (dense output) -> Nout = 0 for a row at every accepted step
+    - lengths[ 2 ]: the rod lengths l1 and l2 of the positions (NULL for 1.0 and 1.0) */
+/* Outputs:
+    - rows: the observable rows [ Time , E_kin , E_pot , x_mid , y_mid , x_end , y_end ] (NULL for the reductions only)
+    - states: the state rows [ Time , State[ 0 ] , ... , State[ 3 ] ] at the same times (NULL to skip) -> trajectory and observables from one run
+    - red: the reductions over the accepted steps (NULL to skip, see RK_Obs_Summary)
+    -- returns the number of observable rows or -1 on error */
+EXPORT int DP45_Integrator_Observables( double err_tol , double* state_init , double* range_int , int Nout , double* t_out , double* lengths ,
+                                        RK_Buffer* rows , RK_Buffer* states , RK_Obs_Summary* red );
+
+/* Start a checkpoint for a chunked (resumable) integration with DP45_Integrator_Advance */
+/* Inputs:
+    - Nstate: number of quantities in the state (up to RK_CKPT_NSTATE_MAX)
+    - t_init: initial time
+    - state_init[ Nstate ]: initial state */
+/* Outputs:
+    - cp: the checkpoint (the first chunk guesses the step like DP45_Integrator)
+    -- returns 0 on success or -1 if Nstate is too large */
+EXPORT int RK_Checkpoint_Init( RK_Checkpoint* cp , int Nstate , double t_init , double* state_init );
+
+/* Write a checkpoint to a file / read it back -> returns 0 on success or -1 if the file could not be written or is not a checkpoint */
+EXPORT int RK_Checkpoint_Save( RK_Checkpoint* cp , char* file_name );
+EXPORT int RK_Checkpoint_Load( RK_Checkpoint* cp , char* file_name );
+
+/* Advance a checkpointed 4-5th order adaptive integration to t_target -> a long run in bounded-memory chunks */
+/* Each call continues with the state, step, step controller and FSAL stage of the checkpoint and ends exactly on t_target.
+   The step cut to end on t_target is not kept, so the next chunk continues with the step the controller had chosen. */
+/* Inputs:
+    - err_tol: error tolerance per step
+    - cp: the checkpoint from RK_Checkpoint_Init, RK_Checkpoint_Load or an earlier call -> updated to the end of the chunk
+    - t_target: time to advance to ( > cp->t ) */
+/* Outputs:
+    - buf: the rows [ Time , State[ 0 ] , ... ] of the accepted steps of this chunk (NULL for none) -> buf->n is reset first,
+           the initial state is written only by the first chunk
+    -- returns 0 when t_target is reached, 1 if the chunk stopped at Nloop_max iterations (call again to continue) or -1 on error */
+EXPORT int DP45_Integrator_Advance( double err_tol , RK_Checkpoint* cp , double t_target , RK_Buffer* buf );
+
+/* Real-time stream for live visualization -> the integration runs on its own thread and publishes frames at a fixed rate of the
+   simulation time (from the dense output) into a lock-free single-producer/single-consumer ring of bounded size */
+/* A frame is [ Time , State[ 0 ] , ... , State[ Nstate - 1 ] ] followed for the double Pendulum by the observables
+   [ E_kin , E_pot , x_mid , y_mid , x_end , y_end ] (see RK_OBS_NCOL) */
+#define RK_STREAM_BLOCK 0 /* Back-pressure -> the integration waits while the ring is full */
+#define RK_STREAM_DROP 1 /* The integration never waits -> the frames which do not fit in the ring are dropped and counted */
+typedef struct RK_Stream RK_Stream;
+
+/* Start a real-time stream of the 4-5th order adaptive Dormand-Prince integrator */
+/* Inputs:
+    - Nstate: number of quantities in the state (up to RK_CKPT_NSTATE_MAX)
+    - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+    - state_init[ Nstate ]: initial state for the integrator
+    - range_int[ 2 ]: time of the first frame and end of the integration (infinity for an unbounded run which ends at RK_Stream_Close)
+    - dt_frame: time between two frames
+    - Nframe: frames in the ring -> bounds the memory of the stream for any length of the run
+    - mode: RK_STREAM_BLOCK or RK_STREAM_DROP
+    - speed: simulation time per second of wall time (1.0 for real time, 0 for as fast as possible)
+    - lengths[ 2 ]: the rod lengths l1 and l2 of the positions in the frames (NULL for 1.0 and 1.0) */
+/* Outputs:
+    -- returns the stream or NULL on error */
+EXPORT RK_Stream* DP45_Stream_Open( int Nstate , double err_tol , double* state_init , double* range_int , double dt_frame , int Nframe , int mode ,
+                                    double speed , double* lengths );
+
+/* Take the frames published by a stream so far -> never blocks */
+/* Outputs:
+    - frames[ max_frames ][ Ncol ]: the frames in order (Ncol from RK_Stream_Info)
+    -- returns the number of frames taken (0 if none is ready yet) or -1 when the stream has ended and every frame was taken */
+EXPORT int RK_Stream_Poll( RK_Stream* st , int max_frames , double* frames );
+
+/* Progress of a stream */
+/* Outputs:
+    - info[ 6 ]: [ time reached by the integration , frames published , frames dropped , frames waiting in the ring ,
+                   1 if the integration ended ( -1 if it failed, 0 while running ) , Ncol ] */
+EXPORT void RK_Stream_Info( RK_Stream* st , double* info );
+
+/* Stop a stream (if it is still running), wait for its thread and free it */
+EXPORT void RK_Stream_Close( RK_Stream* st );
+
+/* Statistics of the last run of the DP45_* functions of the original interface (see RK_Stats) */
+/* Output:
+    - stats: copy of the statistics (stats->trace points to the library's ring buffer -> read it with Get_RK_Trace) */
+EXPORT void Get_RK_Stats( RK_Stats* stats );
+
+/* Enable the per-step trace of the DP45_* functions of the original interface */
+/* Inputs:
+    - cap: number of the last step attempts to keep (0 disables the trace and frees it) */
+/* Output:
+    - 0 on success or -1 if the ring buffer could not be allocated */
+EXPORT int Set_RK_Trace( int cap );
+
+/* Per-step trace of the last run of the DP45_* functions of the original interface in chronological order */
+/* Inputs:
+    - max_rows: room in rows */
+/* Outputs:
+    - rows[ max_rows ][ 4 ]: the last attempts as [ t , dt , err_ratio , accepted ]
+    -- returns the number of rows written */
+EXPORT long Get_RK_Trace( double* rows , long max_rows );
+
+/* Symplectic Gauss-Legendre integrator of the double Pendulum with a fixed step (structure preserving, for long horizons) */
+/* The implicit stages are solved by fixed-point iteration in the canonical coordinates [ theta , phi , p_theta , p_phi ],
+   the energy error stays bounded instead of drifting so large steps can be taken when only the statistics matter */
+/* Inputs:
+    - Nstage: number of Gauss-Legendre stages (1, 2 or 3 -> order 2, 4 and 6)
+    - dt: fixed time step (shortened slightly so that an integer number of steps covers range_int)
+    - Nskip: write every Nskip-th step (the first and the last state are always written)
+    - state_init[ 4 ]: initial state as [ theta , phi , om_theta , om_phi ]
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+    - file_name: a char of the output filename where the results will be written - include .csv in this like "file.csv"
+    - header: a char of the header to start the file with (no need for \n sign) */
+/* Outputs:
+    - The results are written in a file as commas separated values (.csv) in the same format as DP45_Integrator */
+EXPORT void GL_Integrator( int Nstage , double dt , int Nskip , double* state_init , double* range_int , char* file_name , char* header );
+
+/* Symplectic Gauss-Legendre integrator of the double Pendulum with in-memory output (see GL_Integrator and RK_Buffer) */
+/* Outputs:
+    - buf: the rows [ Time , theta , phi , om_theta , om_phi ] every Nskip steps
+    - summary[ 4 ]: [ t_final , steps , fixed-point iterations , max |E - E_0| at the output steps ] (NULL to skip)
+    -- returns the number of rows written or -1 on error */
+EXPORT int GL_Integrator_Buffer( int Nstage , double dt , int Nskip , double* state_init , double* range_int , RK_Buffer* buf , double* summary );
+
+/* Lyapunov spectrum of the double Pendulum from the variational equations (global coefficients and method) */
+/* The 4 tangent vectors are integrated with the state using the analytic Jacobian and re-orthonormalized by QR every t_orth,
+   so a single integration gives all the exponents (no twin trajectories needed) */
+/* Inputs:
+    - err_tol: error tolerance per step (over the state and the tangent vectors)
+    - state_init[ 4 ]: initial state as [ theta , phi , om_theta , om_phi ]
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+    - t_orth: time between the re-orthonormalizations of the tangent vectors */
+/* Outputs:
+    - lyap[ 4 ]: the Lyapunov exponents (largest first in practice, their sum is close to 0 since the system is Hamiltonian)
+    - hist: convergence history rows [ Time , lambda_1 , ... , lambda_4 ] after every re-orthonormalization (NULL to skip)
+    -- returns the number of history rows or -1 on error */
+EXPORT int Lyapunov_Spectrum( double err_tol , double* state_init , double* range_int , double t_orth , double* lyap , RK_Buffer* hist );
+
+/* Open a binary trajectory file for reading -> only the header and the sparse time index are read */
+/* Output:
+    - a reader handle (free with RK_Traj_Close) or NULL if the file is missing or not a trajectory file */
+EXPORT RK_Traj_Reader* RK_Traj_Open( char* file_name );
+
+/* Close a binary trajectory file opened with RK_Traj_Open and free the reader */
+EXPORT void RK_Traj_Close( RK_Traj_Reader* tr );
+
+/* Read row i_row ( 0 <= i_row < n_rows ) of the trajectory into row[ Ncol ] */
+/* Output:
+    - 0 on success or -1 if the row does not exist */
+EXPORT int RK_Traj_Read_Row( RK_Traj_Reader* tr , long i_row , double* row );
+
+/* Find the last row with time <= t_find by binary search (sparse index first, then inside one chunk) */
+/* Outputs:
+    - row[ Ncol ]: the found row (can be NULL)
+    -- returns the index of the row or -1 if t_find is before the first row */
+EXPORT long RK_Traj_Find_Time( RK_Traj_Reader* tr , double t_find , double* row );
+
+/* Copy chunk i_chunk ( 0 <= i_chunk < n_chunks ) of the trajectory as rows -> streaming read of a whole (compressed) file */
+/* Outputs:
+    - rows[ chunk_rows ][ Ncol ]: the rows of the chunk (row-major)
+    -- returns the number of rows of the chunk or -1 if it could not be read */
+EXPORT long RK_Traj_Read_Chunk( RK_Traj_Reader* tr , long i_chunk , double* rows );
+
+/* State at any time inside the trajectory from the cubic Hermite interpolant between the two stored rows around t_find */
+/* This is the interpolant the decimation of DP45_Integrator_Packed is checked against (the derivatives at the rows are
+   computed from the double Pendulum RHS with the coefficients of the file), so the dropped steps are within dec_tol of it */
+/* Outputs:
+    - row[ Ncol ]: [ t_find , State[ 0 ] , ... ]
+    -- returns 0 on success or -1 if t_find is outside the stored rows or the file is not a double Pendulum trajectory */
+EXPORT int RK_Traj_Interp( RK_Traj_Reader* tr , double t_find , double* row );
+
+/* 4-5th order adaptive Dormand-Prince integrator for an ensemble of initial states (batch mode) */
+/* Trajectories are integrated side by side in structure-of-arrays lanes with per-lane adaptive steps,
+   each one follows the same step control as DP45_Integrator (up to the rounding of the vectorized RHS) */
+/* Inputs:
+    - Ntraj: number of trajectories (initial states) to integrate
+    - Nstate: number of quantities in the state (phase space dimension) - must be 4 for the double pendulum RHS
+    - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+    - state_init[ Ntraj ][ Nstate ]: initial states for the integrator (row-major, one trajectory per row)
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time) - common for all trajectories */
+/* Outputs:
+    - state_final[ Ntraj ][ Nstate ]: the state of each trajectory at the end of the integration
+    - t_final[ Ntraj ]: the time reached by each trajectory (less than range_int[ 1 ] only if Nloop_max was hit)
+    - n_steps[ Ntraj ]: the number of accepted steps for each trajectory
+    -- Nothing is written to files in this mode! */
+EXPORT void DP45_Integrate_Batch( int Ntraj , int Nstate , double err_tol , double* state_init , double* range_int ,
+                                  double* state_final , double* t_final , int* n_steps );
+
+/* Multi-threaded sweep over pendulum parameters and initial states with the 4-5th order Dormand-Prince integrator */
+/* The runs are spread over the threads with a work-stealing scheduler, only a compact summary of each run is returned */
+/* Inputs:
+    - Npar: number of parameter sets
+    - Nic: number of initial states
+    - Nstate: number of quantities in the state (phase space dimension) - must be 4 for the double pendulum RHS
+    - grid: 1 to run every parameter set with every initial state ( Ntask = Npar*Nic, task = ipar*Nic + iic )
+            0 to run matched pairs ( Npar == Nic == Ntask, task i uses parameter set i with initial state i )
+    - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+    - pend_params[ Npar ][ 5 ]: the coefficients a_th to b_phi for each parameter set (same order as in Set_Pend_coeff)
+    - states_init[ Nic ][ Nstate ]: initial states for the integrator
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time) - common for all the runs
+    - Nthreads: number of worker threads, 0 to use all the available cores */
+/* Outputs:
+    - state_final[ Ntask ][ Nstate ]: the final state of each run
+    - summary[ Ntask ][ 4 ]: [ t_final , accepted steps , rejected steps , max |E - E_0| ] for each run
+    -- returns the number of runs (Ntask) or -1 if the inputs are inconsistent */
+EXPORT int DP45_Param_Sweep( int Npar , int Nic , int Nstate , int grid , double err_tol , double* pend_params , double* states_init ,
+                             double* range_int , int Nthreads , double* state_final , double* summary );
+
+/* Flip-time map of the double Pendulum -> time until either arm flips over for a grid of release angles at rest */
+/* Every pixel is integrated with the batch Dormand-Prince until |theta| or |phi| first exceeds pi or until t_max, the releases
+   below the flip energy are skipped. The map starts from a lattice of spacing refine_step which is halved down to single pixels,
+   integrating only the new points next to non-uniform cells of the coarser lattice (flip and no flip mixed, or flip times
+   more than a factor exp( refine_tol ) apart) and interpolating the rest. The image tiles are spread over the threads. */
+/* Inputs:
+    - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+    - th_range[ 2 ], phi_range[ 2 ]: the angles of the first and the last column (theta) and row (phi) of the map
+    - Nth, Nphi: number of columns and rows ( >= 2 )
+    - t_max: the integration stops here for the arms which do not flip
+    - refine_step: spacing of the coarsest lattice in pixels (rounded down to a power of 2) -> 1 integrates every pixel
+    - refine_tol: largest spread of log( t_flip ) in a cell which is still interpolated
+    - tile: size of the square tiles in pixels (0 for 64)
+    - Nthreads: number of worker threads, 0 to use all the available cores
+    - file_name: binary file (RK_Flip_Header + the map) or a .ppm image if it ends with ".ppm", NULL or "" for no file */
+/* Outputs:
+    - flip_time[ Nphi ][ Nth ]: the time of the first flip of each pixel, infinity if it does not flip before t_max
+      and NaN if Nloop_max was hit
+    -- returns the number of integrated trajectories or -1 on an error */
+EXPORT long DP45_Flip_Map( double err_tol , double* th_range , double* phi_range , int Nth , int Nphi , double t_max ,
+                           int refine_step , double refine_tol , int tile , int Nthreads , float* flip_time , char* file_name );
+
+/* Mixed precision flip-time map of the double Pendulum -> single precision screening with double precision verification */
+/* Every integrated pixel is first run by a single precision Dormand-Prince at screen_tol. The ambiguous results -> no result,
+   a flip within screen_margin*t_max of t_max, or no flip although an arm came within screen_margin*pi of pi -> are integrated
+   again in double precision at err_tol. The lattice refinement is the same as DP45_Flip_Map. */
+/* Inputs:
+    - err_tol: error tolerance per step of the double precision verification
+    - th_range[ 2 ], phi_range[ 2 ], Nth, Nphi, t_max, refine_step, refine_tol, tile, Nthreads: see DP45_Flip_Map
+    - screen_tol: error tolerance per step of the single precision screening ( > 0 )
+    - screen_margin: relative margin to t_max and to pi in which a screened result is verified ( 0 <= screen_margin < 1 )
+    - file_name: see DP45_Flip_Map -> the binary file also stores the precision flags */
+/* Outputs:
+    - flip_time[ Nphi ][ Nth ]: see DP45_Flip_Map
+    - prec[ Nphi ][ Nth ]: RK_FLIP_PREC_F32, RK_FLIP_PREC_F64 or RK_FLIP_PREC_NONE for each pixel (NULL to skip)
+    -- returns the number of integrated trajectories or -1 on an error */
+EXPORT long DP45_Flip_Map_Mixed( double err_tol , double* th_range , double* phi_range , int Nth , int Nphi , double t_max ,
+                                 int refine_step , double refine_tol , int tile , int Nthreads , double screen_tol , double screen_margin ,
+                                 float* flip_time , unsigned char* prec , char* file_name );
+
+/* Monte Carlo uncertainty propagation with online statistics at a set of output times (see DP45_MC_Run) */
+/* The statistics hold, for every output time, the mean and covariance of the state (Welford), a quantile sketch of every
+   component and histograms of theta and phi wrapped to [ -pi , pi ). They only grow with the number of output times and
+   statistics of different runs (threads, calls or processes) with the same output times and bins can be merged. */
+/* The quantile sketch has buckets of relative width RK_MC_SKETCH_ALPHA (the quantiles are within this relative error) for
+   RK_MC_SKETCH_XMIN <= |x| < RK_MC_SKETCH_XMIN*( ( 1 + alpha )/( 1 - alpha ) )^RK_MC_SKETCH_NB, smaller values count as 0
+   and larger ones as the largest bucket */
+#define RK_MC_SKETCH_ALPHA 0.01 /* Relative accuracy of the quantiles */
+#define RK_MC_SKETCH_XMIN 1e-6 /* Smallest magnitude told apart from 0 */
+#define RK_MC_SKETCH_NB 1024 /* Buckets per sign -> magnitudes up to about 8e8*RK_MC_SKETCH_XMIN */
+typedef struct RK_MC_Stats RK_MC_Stats;
+
+/* Create empty statistics for the output times t_out[ Nout ] (increasing) with Nbins bins per angle histogram -> NULL on error */
+EXPORT RK_MC_Stats* RK_MC_Stats_Create( int Nout , double* t_out , int Nbins );
+
+/* Free the statistics */
+EXPORT void RK_MC_Stats_Free( RK_MC_Stats* st );
+
+/* Merge the statistics src into dst -> returns 0 or -1 if they have different output times or bins */
+EXPORT int RK_MC_Stats_Merge( RK_MC_Stats* dst , RK_MC_Stats* src );
+
+/* Sizes and counters of the statistics */
+/* Outputs (NULL to skip):
+    - sizes[ 2 ]: [ Nout , Nbins ]
+    - t_out[ Nout ]: the output times
+    - n_run[ 2 ]: [ samples folded in , samples which did not reach the last output time ] */
+EXPORT void RK_MC_Stats_Info( RK_MC_Stats* st , int* sizes , double* t_out , int64_t* n_run );
+
+/* Moments of the state at the output times */
+/* Outputs (NULL to skip):
+    - count[ Nout ]: the number of samples at each time
+    - mean[ Nout ][ 4 ]: the mean state (NaN without samples)
+    - cov[ Nout ][ 4 ][ 4 ]: the sample covariance (NaN with less than 2 samples) */
+EXPORT void RK_MC_Stats_Moments( RK_MC_Stats* st , double* count , double* mean , double* cov );
+
+/* Quantiles of the state components at the output times from the sketch */
+/* Inputs:
+    - Nq, q[ Nq ]: the probabilities ( 0 to 1 ) */
+/* Outputs:
+    - quant[ Nout ][ Nq ][ 4 ]: the quantiles (NaN without samples) */
+EXPORT void RK_MC_Stats_Quantiles( RK_MC_Stats* st , int Nq , double* q , double* quant );
+
+/* Histograms of the wrapped angles at the output times */
+/* Outputs:
+    - hist[ Nout ][ 2 ][ Nbins ]: the counts of theta and phi in Nbins equal bins over [ -pi , pi ) */
+EXPORT void RK_MC_Stats_Histograms( RK_MC_Stats* st , double* hist );
+
+/* Write the statistics to a file / read them back -> 0 or -1 / the statistics or NULL if the file is not readable */
+EXPORT int RK_MC_Stats_Save( RK_MC_Stats* st , char* file_name );
+EXPORT RK_MC_Stats* RK_MC_Stats_Load( char* file_name );
+
+/* Monte Carlo uncertainty propagation for the double Pendulum with online statistics at the output times */
+/* Each sample perturbs the initial state and the physical dimensions with independent normal deviates, is integrated with the
+   dense output at the output times of st and is folded into the statistics. Sample i always gets the same deviates for a seed,
+   so a run can be split into ranges of i_first over calls or processes and merged afterwards. The samples of a call are split
+   into contiguous blocks over the threads and merged in order. */
+/* Inputs:
+    - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+    - st: the statistics to fold the samples into
+    - t_init: start of the integrations ( <= the first output time )
+    - state_init[ 4 ], state_sigma[ 4 ]: mean and standard deviation of the initial state (state_sigma NULL for no perturbation)
+    - dims[ 5 ], dims_sigma[ 5 ]: mean and standard deviation of [ l1 , l2 , m1 , m2 , g ] (dims NULL to use the coefficients
+      of Set_Pend_coeff, dims_sigma NULL for no perturbation)
+    - i_first, Nsample: the samples i_first to i_first + Nsample - 1 are run
+    - seed: seed of the ensemble
+    - Nthreads: number of worker threads, 0 to use all the available cores */
+/* Outputs:
+    -- returns Nsample or -1 on an error */
+EXPORT long DP45_MC_Run( double err_tol , RK_MC_Stats* st , double t_init , double* state_init , double* state_sigma ,
+                         double* dims , double* dims_sigma , int64_t i_first , int64_t Nsample , uint64_t seed , int Nthreads );
+
+/* Adaptive integrator (method of Set_RK_Method) for the N-link Pendulum */
+/* Inputs:
+    - chain: the N-link Pendulum from RK_Chain_Create
+    - err_tol: error tolerance per step -> the adaptive step is modified to maintain this
+    - state_init[ 2*N ]: initial state as [ theta_0 , ... , theta_{N-1} , om_0 , ... , om_{N-1} ]
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+    - Nout, t_out[ Nout ]: increasing output times for the dense output (t_out NULL for a row at every accepted step) */
+/* Outputs:
+    - buf: rows [ Time , State[ 0 ] , ... , State[ 2*N - 1 ] ] (NULL for no output)
+    - state_final[ 2*N ]: the state at the end of the integration (NULL to skip)
+    - summary[ 4 ]: [ t_final , accepted steps , rejected steps , max |E - E_0| over the accepted steps ] (NULL to skip)
+    -- returns the number of rows in buf or -1 on an error */
+EXPORT int DP45_Chain_Integrator( RK_Chain* chain , double err_tol , double* state_init , double* range_int , int Nout , double* t_out ,
+                                  RK_Buffer* buf , double* state_final , double* summary );
+
+/* Parareal parallel-in-time integration of a single trajectory */
+/* range_int is cut into Nslice equal slices. A cheap coarse propagator runs sequentially over the slices and the fine one (the
+   adaptive method of Set_RK_Method at err_tol) on all the slices at once, and the slice starts are corrected until they stop
+   moving. K iterations cost about K fine slices of wall time instead of Nslice. For the chaotic double Pendulum K grows with
+   the horizon, so this pays off within a few Lyapunov times. */
+/* Inputs:
+    - Nstate: number of quantities in the state (phase space dimension) - must be 4 for the double pendulum RHS
+    - err_tol: error tolerance per step of the fine propagator
+    - state_init[ Nstate ]: initial state for the integrator
+    - range_int[ 2 ]: initial and final values evolution parameter (initial and final time)
+    - Nslice: number of time slices (at least the number of threads)
+    - coarse_steps: number of fixed RK4 steps per slice of the coarse propagator (0 to use the adaptive method at coarse_tol)
+    - coarse_tol: error tolerance per step of the adaptive coarse propagator (ignored if coarse_steps > 0)
+    - Kmax: maximum number of iterations (at most Nslice are ever needed)
+    - conv_tol: the iteration stops once no slice start moves by more than conv_tol (in any state quantity)
+    - Nthreads: number of worker threads, 0 to use all the available cores
+    - Nout, t_out[ Nout ]: increasing output times for the dense output (t_out NULL for a row at every accepted fine step) */
+/* Outputs:
+    - buf: rows [ Time , State[ 0 ] , ... , State[ Nstate - 1 ] ] of the trajectory (NULL for no output)
+    - state_final[ Nstate ]: the state at the end (NULL to skip)
+    - diag[ Kmax ][ 4 ]: per iteration [ largest update of a slice start , slices integrated by the fine propagator ,
+      fine wall time [s] , coarse wall time [s] ] (NULL to skip) -> converged if the last update is <= conv_tol
+    -- returns the number of iterations or -1 on an error */
+EXPORT int DP45_Parareal( int Nstate , double err_tol , double* state_init , double* range_int , int Nslice , int coarse_steps , double coarse_tol ,
+                          int Kmax , double conv_tol , int Nthreads , int Nout , double* t_out , RK_Buffer* buf , double* state_final , double* diag );
+
+/* Integrator context -> owns the tableau, pendulum coefficients, tolerance and scratch storage of the integrations */
+/* The functions above use a shared default context filled by Set_RK_Coeff and Set_Pend_coeff. The RK_Context_* functions
+   below only touch the context they are given, so different contexts can be integrated concurrently from different threads.
+   A single context must not be used by two threads at the same time. */
+typedef struct RK_Context RK_Context;
+
+/* Create an integrator context with the Dormand-Prince tableau (change it with RK_Context_Set_Method) */
+/* Inputs:
+    - Nstate: number of quantities in the state (phase space dimension)
+    - err_tol: error tolerance per step
+    - pend_coeff[ 5 ]: the coefficients a_th to b_phi in sequence (NULL to default them to 1.0) */
+/* Output:
+    - the context (free it with RK_Context_Free) or NULL if it could not be allocated */
+EXPORT RK_Context* RK_Context_Create( int Nstate , double err_tol , double* pend_coeff );
+
+/* Free an integrator context and its scratch storage */
+EXPORT void RK_Context_Free( RK_Context* ctx );
+
+/* Set the pendulum coefficients (a_th to b_phi in sequence) of a context */
+EXPORT void RK_Context_Set_Pend_coeff( RK_Context* ctx , double* coeff_vals );
+
+/* Set the error tolerance per step of a context */
+EXPORT void RK_Context_Set_Tolerance( RK_Context* ctx , double err_tol );
+
+/* Select the embedded Runge-Kutta pair (one of the RK_METHOD_* values) of a context -> returns 0 or -1 if the method is unknown */
+EXPORT int RK_Context_Set_Method( RK_Context* ctx , int method );
+
+/* Select the Right-Hand-Side kernel (one of the RK_RHS_* values) of the batch integrator of a context -> returns 0 or -1 if the mode is unknown */
+EXPORT int RK_Context_Set_RHS_Mode( RK_Context* ctx , int rhs_mode );
+
+/* Same as DP45_Integrator with the dimension, tolerance and coefficients of the context */
+EXPORT void RK_Context_DP45_File( RK_Context* ctx , double* state_init , double* range_int , char* file_name , char* header );
+
+/* Same as DP45_Integrator_Buffer with the dimension, tolerance and coefficients of the context */
+EXPORT int RK_Context_DP45_Buffer( RK_Context* ctx , double* state_init , double* range_int , RK_Buffer* buf );
+
+/* Same as DP45_Integrator_Dense with the dimension, tolerance and coefficients of the context */
+EXPORT int RK_Context_DP45_Dense( RK_Context* ctx , double* state_init , double* range_int , int Nout , double* t_out , double* state_out );
+
+/* Same as DP45_Integrator_Events with the dimension, tolerance and coefficients of the context */
+/* Outputs:
+    - state_final[ Nstate ]: the state at the end -> at the event for RK_EVENT_TERMINATE (NULL to skip)
+    - summary[ 4 ]: [ t_final , accepted steps , rejected steps , max |E - E_0| ] (NULL to skip) */
+EXPORT int RK_Context_DP45_Events( RK_Context* ctx , double* state_init , double* range_int , int Nevent , RK_Event* events ,
+                                   RK_Buffer* buf , double* state_final , double* summary );
+
+/* Same as DP45_Integrator_Observables with the tolerance, method and coefficients of the context (Nstate must be 4) */
+EXPORT int RK_Context_DP45_Observables( RK_Context* ctx , double* state_init , double* range_int , int Nout , double* t_out , double* lengths ,
+                                        RK_Buffer* rows , RK_Buffer* states , RK_Obs_Summary* red );
+
+/* Same as DP45_Integrator_Bin with the dimension, tolerance and coefficients of the context */
+EXPORT long RK_Context_DP45_Bin( RK_Context* ctx , double* state_init , double* range_int , char* file_name , char* col_names );
+
+/* Same as DP45_Integrator_Packed with the dimension, tolerance and coefficients of the context */
+EXPORT long RK_Context_DP45_Packed( RK_Context* ctx , double* state_init , double* range_int , char* file_name , char* col_names ,
+                                    double dec_tol , int mant_bits );
+
+/* Same as DP45_Integrator_Advance with the tolerance, method and coefficients of the context (cp->Nstate must be its dimension) */
+EXPORT int RK_Context_DP45_Advance( RK_Context* ctx , RK_Checkpoint* cp , double t_target , RK_Buffer* buf );
+
+/* Same as DP45_Stream_Open with the dimension, tolerance, method and coefficients of the context (copied -> the context stays free) */
+EXPORT RK_Stream* RK_Context_Stream_Open( RK_Context* ctx , double* state_init , double* range_int , double dt_frame , int Nframe , int mode ,
+                                          double speed , double* lengths );
+
+/* Same as DP45_Integrate_Batch with the dimension, tolerance and coefficients of the context */
+/* The lane storage is kept in the context, so repeated batches do not allocate */
+/* Output:
+    - 0 on success, 1 if some trajectories stopped at Nloop_max and -1 if the scratch storage could not be allocated */
+EXPORT int RK_Context_DP45_Batch( RK_Context* ctx , int Ntraj , double* state_init , double* range_int ,
+                                  double* state_final , double* t_final , int* n_steps );
+
+/* Same as Get_RK_Stats, Set_RK_Trace and Get_RK_Trace for the runs of the RK_Context_DP45_* functions of a context */
+/* NOTE: The parameter sweeps and the batch integrator do not fill the statistics (they return their own per-run summary) */
+EXPORT void RK_Context_Get_Stats( RK_Context* ctx , RK_Stats* stats );
+EXPORT int RK_Context_Set_Trace( RK_Context* ctx , int cap );
+EXPORT long RK_Context_Get_Trace( RK_Context* ctx , double* rows , long max_rows );
+
+/* Same as GL_Integrator_Buffer with the coefficients of the context (Nstate must be 4), buf can be NULL for no output */
+/* Outputs:
+    - state_final[ 4 ]: the state at the end of the integration (NULL to skip) */
+EXPORT int RK_Context_GL( RK_Context* ctx , int Nstage , double dt , int Nskip , double* state_init , double* range_int ,
+                          RK_Buffer* buf , double* state_final , double* summary );
+
+/* Same as Lyapunov_Spectrum with the tableau, tolerance and coefficients of the context (Nstate must be 4) */
+EXPORT int RK_Context_Lyapunov( RK_Context* ctx , double* state_init , double* range_int , double t_orth , double* lyap , RK_Buffer* hist );
+
+/* Same as DP45_Param_Sweep with the dimension and tolerance of the context (the coefficients come from pend_params) */
+EXPORT int RK_Context_Param_Sweep( RK_Context* ctx , int Npar , int Nic , int grid , double* pend_params , double* states_init ,
+                                   double* range_int , int Nthreads , double* state_final , double* summary );
+
+/* Same as DP45_Flip_Map with the tableau, tolerance, coefficients and RHS mode of the context (Nstate must be 4) */
+EXPORT long RK_Context_Flip_Map( RK_Context* ctx , double* th_range , double* phi_range , int Nth , int Nphi , double t_max ,
+                                 int refine_step , double refine_tol , int tile , int Nthreads , float* flip_time , char* file_name );
+
+/* Same as DP45_Chain_Integrator with the tableau, tolerance and statistics of the context (its Nstate and coefficients are not used) */
+EXPORT int RK_Context_Chain_Integrate( RK_Context* ctx , RK_Chain* chain , double* state_init , double* range_int , int Nout , double* t_out ,
+                                       RK_Buffer* buf , double* state_final , double* summary );
+
+/* Same as DP45_Parareal with the tableau, tolerance and coefficients of the context for the fine propagator */
+EXPORT int RK_Context_Parareal( RK_Context* ctx , double* state_init , double* range_int , int Nslice , int coarse_steps , double coarse_tol ,
+                                int Kmax , double conv_tol , int Nthreads , int Nout , double* t_out , RK_Buffer* buf , double* state_final , double* diag );
+
+/* Same as DP45_MC_Run with the tableau and tolerance of the context (and its coefficients if dims is NULL) */
+EXPORT long RK_Context_MC_Run( RK_Context* ctx , RK_MC_Stats* st , double t_init , double* state_init , double* state_sigma ,
+                               double* dims , double* dims_sigma , int64_t i_first , int64_t Nsample , uint64_t seed , int Nthreads );
+
+/* Same as DP45_Flip_Map_Mixed with the tableau (double precision pass), tolerance, coefficients and RHS mode of the context */
+EXPORT long RK_Context_Flip_Map_Mixed( RK_Context* ctx , double* th_range , double* phi_range , int Nth , int Nphi , double t_max ,
+                                       int refine_step , double refine_tol , int tile , int Nthreads , double screen_tol , double screen_margin ,
+                                       float* flip_time , unsigned char* prec , char* file_name );
+
 #ifdef __cplusplus
 }
 #endif